@@ -0,0 +1,2249 @@
+// A SMING-compatible C interpreter
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyInterpreter.h"
+
+static bool isAlpha(char c)
+{
+  return (c>='a' && c<='z') || (c>='A' && c<='Z') || c == '_';
+}
+
+static bool isDigit(char c)
+{
+  return c>='0' && c<='9';
+}
+
+MyCompiler::MyCompiler()
+{
+  nodes = NULL;
+  nodeCount = nodeCap = 0;
+  code = NULL;
+  codeLen = codeCap = 0;
+  imports = NULL;
+  importLen = importCap = importCount = 0;
+  strings = NULL;
+  stringLen = stringCap = stringCount = 0;
+  image = NULL;
+  imageLen = 0;
+  trace = NULL;
+  calls = NULL;
+  probes = NULL;
+  profile = NULL;
+  profileCount = 0;
+  caching = true;
+  err = errPos = 0;
+}
+
+MyCompiler::~MyCompiler()
+{
+  free(nodes);
+  free(code);
+  free(imports);
+  free(strings);
+  free(image);
+}
+
+void MyCompiler::addPure(const char *name, int arity)
+{
+  pureNames.add(name);
+  pureArities.add(arity);
+}
+
+void MyCompiler::addProbes(Vector<ProbeSite> *sites)
+{
+  probes = sites;
+}
+
+void MyCompiler::useProfile(const struct ProbeSite *sites, int count)
+{
+  profile = sites;
+  profileCount = count;
+}
+
+int MyCompiler::compile(const char *prg, int len, Vector<TracePoint> *trace,
+			Vector<CallSite> *calls)
+{
+  struct ProgramHeader *hdr;
+  struct ColdBranch c;
+  uint32_t defined = 0, worstCalls = 0, worstOps;
+  int root, i;
+
+  this->trace = trace;
+  this->calls = calls;
+  src = cur = prg;
+  end = prg + len;
+  nodeCount = 0;
+  loopDepth = switchDepth = 0;
+  nesting = 0;
+  codeLen = 0;
+  importLen = importCount = 0;
+  stringLen = stringCount = 0;
+  depth = maxDepth = 0;
+  tempCount = 0;
+  memset(tempKills, 0, sizeof(tempKills));
+  breakChain = continueChain = -1;
+  cold.clear();
+  err = errPos = 0;
+  free(image);
+  image = NULL;
+  imageLen = 0;
+
+  if (len > 0xffff)
+    return ERROR_TOO_BIG;
+
+  next();
+  root = parseBlock(T_END);
+  if (root < 0)
+    return err;
+  // Keep the code in source order when tracing
+  inferTypes();
+  worstOps = worstOf(root, &worstCalls);
+  if (!trace) {
+    if (profile)
+      reorder(root);
+    if (caching)
+      optimize(root);
+  }
+  genStatement(root);
+  emit(OP_HALT);
+  // Else branches moved out of the way, each jumping back after its if
+  for (i=0; i<(int)cold.count(); i++) {
+    c = cold[i];
+    patch(c.jump, codeLen);
+    depth = c.depth;
+    genStatement(c.node);
+    emitJump(OP_LOOP, c.end);
+  }
+  if (cold.count())
+    emit(OP_HALT);
+  if (err)
+    return err;
+  if (maxDepth > PROGRAM_STACK)
+    return ERROR_DEPTH;
+  if (codeLen > 0xffff)
+    return ERROR_TOO_BIG;
+  if (!compact())
+    return err;
+  if (codeLen > PROGRAM_DIST)
+    return ERROR_TOO_BIG;
+
+  imageLen = sizeof(struct ProgramHeader) + codeLen + importLen + stringLen;
+  image = (uint8_t *)malloc(imageLen);
+  if (!image)
+    return ERROR_MEMORY;
+
+  hdr = (struct ProgramHeader *)image;
+  hdr->magic = PROGRAM_MAGIC;
+  hdr->version = PROGRAM_VERSION;
+  hdr->importCount = importCount;
+  hdr->maxStack = maxDepth;
+  hdr->temps = tempCount;
+  hdr->inputs = inputsOf(root, &defined);
+  hdr->reals = reals;
+  hdr->worstOps = worstOps;
+  hdr->worstCalls = worstCalls;
+  hdr->sourceHash = hash32((const uint8_t *)prg, len);
+  hdr->codeLen = codeLen;
+  hdr->importLen = importLen;
+  hdr->stringLen = stringLen;
+  hdr->stringCount = stringCount;
+  hdr->realFormat = PROGRAM_REAL;
+  memcpy(image + sizeof(*hdr), code, codeLen);
+  // Scripts without calls or strings have no table allocated
+  if (importLen)
+    memcpy(image + sizeof(*hdr) + codeLen, imports, importLen);
+  if (stringLen)
+    memcpy(image + sizeof(*hdr) + codeLen + importLen, strings, stringLen);
+  hdr->checksum = hash32(image + sizeof(*hdr), codeLen + importLen + stringLen);
+
+  return 0;
+}
+
+uint8_t *MyCompiler::release(int *len)
+{
+  uint8_t *p = image;
+
+  *len = imageLen;
+  image = NULL;
+  imageLen = 0;
+  return p;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Lexer
+//////////////////////////////////////////////////////////////////////////////
+
+void MyCompiler::next()
+{
+  const char *s = cur;
+  uint32_t v = 0;		// Wraps around like the arithmetic
+  double r, frac, scale;
+  bool real = false;
+  int i;
+
+  lastEnd = cur - src;
+  for (;;) {
+    while (s<end && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n'))
+      s ++;
+    if (s+1<end && s[0] == '/' && s[1] == '/') {
+      while (s<end && *s != '\n')
+	s ++;
+    } else if (s+1<end && s[0] == '/' && s[1] == '*') {
+      for (s += 2; s<end && !(s[0] == '*' && s+1<end && s[1] == '/'); s ++)
+	;
+      s = s<end ? s + 2 : end;
+    } else {
+      break;
+    }
+  }
+  tokPos = s - src;
+
+  if (s>=end || *s == 0) {
+    tok = T_END;
+  } else if (isDigit(*s)) {
+    if (*s == '0' && s+1<end && (*(s+1) == 'x' || *(s+1) == 'X')) {
+      s += 2;
+      for (;; s ++) {
+	if (s<end && *s>='0' && *s<='9')
+	  v = (v<<4) + (*s - '0');
+	else if (s<end && *s>='a' && *s<='f')
+	  v = (v<<4) + (*s - 'a' + 0xa);
+	else if (s<end && *s>='A' && *s<='F')
+	  v = (v<<4) + (*s - 'A' + 0xa);
+	else
+	  break;
+      }
+    } else if (*s == '0' && s+1<end && (*(s+1) == 'b' || *(s+1) == 'B')) {
+      s += 2;
+      while (s<end && (*s == '0' || *s == '1'))
+	v = (v<<1) + (*s++ - '0');
+    } else {
+      while (s<end && isDigit(*s))
+	v = v*10 + (*s++ - '0');
+      // A fraction makes it a real
+      if (s+1<end && *s == '.' && isDigit(s[1])) {
+	for (r = 0, i = tokPos; src + i < s; i ++)
+	  r = r*10 + (src[i] - '0');
+	for (s ++, frac = 0, scale = 1; s<end && isDigit(*s); s ++) {
+	  frac = frac*10 + (*s - '0');
+	  scale *= 10;
+	}
+	real = true;
+      }
+    }
+    tok = real ? T_REAL : T_NUM;
+    tokVal = real ? realFrom(r + frac / scale) : (int32_t)v;
+  } else if (*s == '"') {
+    // Escapes are decoded by addString()
+    for (s ++; s<end && *s != '"' && *s != '\n'; s ++)
+      if (*s == '\\' && s+1<end)
+	s ++;
+    if (s<end && *s == '"') {
+      s ++;
+      tok = T_STR;
+    } else {
+      tok = '"';
+    }
+  } else if (isAlpha(*s)) {
+    const char *p = s;
+
+    while (s<end && (isAlpha(*s) || isDigit(*s)))
+      s ++;
+    tok = T_IDENT;
+    for (i=0; i<(int)KEYWORD_NUM; i++) {
+      const struct Keyword *k = keywords+i;
+      if (s-p == k->len && strncmp(k->name, p, k->len) == 0) {
+	tok = k->tok;
+	tokVal = k->val;
+	break;
+      }
+    }
+  } else {
+    char c = *s++, c2 = s<end ? *s : 0;
+
+    tok = c;
+    if (c == '|' && c2 == '|')
+      tok = T_OROR;
+    else if (c == '&' && c2 == '&')
+      tok = T_ANDAND;
+    else if (c == '=' && c2 == '=')
+      tok = T_EQ;
+    else if (c == '!' && c2 == '=')
+      tok = T_NE;
+    else if (c == '<' && c2 == '=')
+      tok = T_LE;
+    else if (c == '>' && c2 == '=')
+      tok = T_GE;
+    else if (c == '<' && c2 == '<')
+      tok = T_SHL;
+    else if (c == '>' && c2 == '>')
+      tok = T_SHR;
+    if (tok >= 256)
+      s ++;
+  }
+
+  tokLen = s - (src + tokPos);
+  cur = s;
+}
+
+bool MyCompiler::accept(int t)
+{
+  if (tok != t)
+    return false;
+  next();
+  return true;
+}
+
+bool MyCompiler::expect(int t)
+{
+  if (accept(t))
+    return true;
+  fail(tokPos);
+  return false;
+}
+
+int MyCompiler::fail(int pos)
+{
+  if (!err) {
+    err = ERROR_SYNTAX;
+    errPos = pos;
+  }
+  return -1;
+}
+
+int MyCompiler::tooDeep(int pos)
+{
+  if (!err) {
+    err = ERROR_DEPTH;
+    errPos = pos;
+  }
+  return -1;
+}
+
+// Counts the recursion of the parser while in scope
+class Nesting
+{
+  public:
+    Nesting(int *depth) : depth(depth) { (*depth) ++; }
+    ~Nesting() { (*depth) --; }
+
+  private:
+    int *depth;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Parser
+//////////////////////////////////////////////////////////////////////////////
+
+int MyCompiler::newNode(int kind, int pos)
+{
+  Node *n;
+
+  if (nodeCount >= nodeCap) {
+    int cap = nodeCap ? nodeCap * 2 : 32;
+
+    if (cap > 0x7fff) {
+      if (!err)
+	err = ERROR_TOO_BIG;
+      return -1;
+    }
+    n = (Node *)realloc(nodes, cap * sizeof(Node));
+    if (!n) {
+      if (!err)
+	err = ERROR_MEMORY;
+      return -1;
+    }
+    nodes = n;
+    nodeCap = cap;
+  }
+
+  n = nodes + nodeCount;
+  n->kind = kind;
+  n->op = 0;
+  n->flags = 0;
+  n->temp = -1;
+  n->height = 1;
+  n->type = TYPE_INT;
+  n->a = n->b = n->c = n->d = n->next = -1;
+  n->pos = pos;
+  n->len = lastEnd - pos;
+  n->val = 0;
+  return nodeCount++;
+}
+
+// Records the height of a node once its children are set
+int MyCompiler::measure(int n)
+{
+  Node *p = nodes + n;
+  int h = 0, c;
+
+  if (p->kind == N_BLOCK || p->kind == N_CALL) {
+    for (c = p->a; c >= 0; c = nodes[c].next)
+      if (nodes[c].height > h)
+	h = nodes[c].height;
+  } else {
+    if (p->a >= 0 && nodes[p->a].height > h)
+      h = nodes[p->a].height;
+    if (p->b >= 0 && nodes[p->b].height > h)
+      h = nodes[p->b].height;
+    if (p->c >= 0 && nodes[p->c].height > h)
+      h = nodes[p->c].height;
+    if (p->d >= 0 && nodes[p->d].height > h)
+      h = nodes[p->d].height;
+  }
+  if (h >= SCRIPT_HEIGHT)
+    return tooDeep(p->pos);
+  p->height = h + 1;
+  return n;
+}
+
+int MyCompiler::parseBlock(int close)
+{
+  int n, s, last = -1;
+
+  if ((n = newNode(N_BLOCK, tokPos)) < 0)
+    return -1;
+  while (tok != close) {
+    if (tok == T_END)
+      return fail(tokPos);
+    if ((s = parseStatement()) < 0)
+      return -1;
+    if (last < 0)
+      nodes[n].a = s;
+    else
+      nodes[last].next = s;
+    last = s;
+  }
+  nodes[n].len = tokPos - nodes[n].pos;
+  return measure(n);
+}
+
+// The body of a switch, a block whose statements may follow labels.  The
+// value of a case must be constant, and given once.
+int MyCompiler::parseCases()
+{
+  int n, s, e = -1, c, kind, last = -1, pos;
+
+  if (!expect('{') || (n = newNode(N_BLOCK, tokPos)) < 0)
+    return -1;
+  while (tok != '}') {
+    pos = tokPos;
+    if (tok == T_END)
+      return fail(tokPos);
+    if (tok == T_CASE || tok == T_DEFAULT) {
+      kind = tok == T_CASE ? N_CASE : N_DEFAULT;
+      next();
+      if (kind == N_CASE) {
+	if ((e = parseExpr()) < 0)
+	  return -1;
+	if (nodes[e].kind != N_NUM)
+	  return fail(nodes[e].pos);
+      }
+      if (!expect(':'))
+	return -1;
+      for (c = nodes[n].a; c >= 0; c = nodes[c].next)
+	if (nodes[c].kind == kind && (kind == N_DEFAULT || nodes[c].val == nodes[e].val))
+	  return fail(pos);
+      if ((s = newNode(kind, pos)) < 0)
+	return -1;
+      if (kind == N_CASE)
+	nodes[s].val = nodes[e].val;
+    } else if ((s = parseStatement()) < 0) {
+      return -1;
+    }
+    if (last < 0)
+      nodes[n].a = s;
+    else
+      nodes[last].next = s;
+    last = s;
+  }
+  nodes[n].len = tokPos - nodes[n].pos;
+  return measure(n);
+}
+
+int MyCompiler::parseStatement()
+{
+  int n, a = -1, b = -1, c = -1, d = -1, kind, pos = tokPos;
+  Nesting guard(&nesting);
+
+  if (nesting > SCRIPT_NESTING)
+    return tooDeep(pos);
+
+  switch (tok) {
+  case '{':
+    next();
+    if ((n = parseBlock('}')) < 0 || !expect('}'))
+      return -1;
+    return n;
+
+  case ';':
+    next();
+    return newNode(N_BLOCK, pos);
+
+  case T_IF:
+    return parseIf();
+
+  case T_WHILE:
+    kind = N_WHILE;
+    next();
+    if (!expect('(') || (a = parseExpr()) < 0 || !expect(')'))
+      return -1;
+    loopDepth ++;
+    b = parseStatement();
+    loopDepth --;
+    if (b < 0)
+      return -1;
+    break;
+
+  case T_FOR:
+    kind = N_FOR;
+    next();
+    if (!expect('('))
+      return -1;
+    if (tok != ';' && (a = parseExpr()) < 0)
+      return -1;
+    if (!expect(';'))
+      return -1;
+    if (tok != ';' && (b = parseExpr()) < 0)
+      return -1;
+    if (!expect(';'))
+      return -1;
+    if (tok != ')' && (c = parseExpr()) < 0)
+      return -1;
+    if (!expect(')'))
+      return -1;
+    loopDepth ++;
+    d = parseStatement();
+    loopDepth --;
+    if (d < 0)
+      return -1;
+    break;
+
+  case T_SWITCH:
+    kind = N_SWITCH;
+    next();
+    if (!expect('(') || (a = parseExpr()) < 0 || !expect(')'))
+      return -1;
+    switchDepth ++;
+    b = parseCases();
+    switchDepth --;
+    if (b < 0 || !expect('}'))
+      return -1;
+    break;
+
+  case T_BREAK:
+  case T_CONTINUE:
+    kind = tok == T_BREAK ? N_BREAK : N_CONTINUE;
+    // A break also leaves a switch
+    if (!loopDepth && !(kind == N_BREAK && switchDepth))
+      return fail(pos);
+    next();
+    if (!expect(';'))
+      return -1;
+    break;
+
+  default: // 式文
+    kind = N_EXPR;
+    if ((a = parseExpr()) < 0)
+      return -1;
+    // The last statement of a script may omit the ';'
+    if (tok != T_END && !expect(';'))
+      return -1;
+    break;
+  }
+
+  if ((n = newNode(kind, pos)) < 0)
+    return -1;
+  nodes[n].a = a;
+  nodes[n].b = b;
+  nodes[n].c = c;
+  nodes[n].d = d;
+  return measure(n);
+}
+
+// An if and the ifs of its else-if chain, in a loop: a long chain takes
+// one level of nesting.  The ifs are linked through their else branch and
+// each spans to the end of the chain, their heights are recorded from the
+// last one up.
+int MyCompiler::parseIf()
+{
+  int n, a, b, first = -1, last = -1, pos;
+
+  for (;;) {
+    pos = tokPos;
+    next();
+    if (!expect('(') || (a = parseExpr()) < 0 || !expect(')')
+	|| (b = parseStatement()) < 0 || (n = newNode(N_IF, pos)) < 0)
+      return -1;
+    nodes[n].a = a;
+    nodes[n].b = b;
+    // Back to the previous if until measured
+    nodes[n].d = last;
+    if (last < 0)
+      first = n;
+    else
+      nodes[last].c = n;
+    last = n;
+    if (!accept(T_ELSE))
+      break;
+    if (tok != T_IF) {
+      if ((nodes[last].c = parseStatement()) < 0)
+	return -1;
+      break;
+    }
+  }
+
+  for (n = last; n >= 0; n = a) {
+    a = nodes[n].d;
+    nodes[n].d = -1;
+    nodes[n].len = lastEnd - nodes[n].pos;
+    if (measure(n) < 0)
+      return -1;
+  }
+  return first;
+}
+
+int MyCompiler::parseExpr()
+{
+  int n, l, r, pos = tokPos;
+  Nesting guard(&nesting);
+
+  if (nesting > SCRIPT_NESTING)
+    return tooDeep(pos);
+  if ((l = parseBinary(1)) < 0 || tok != '=')
+    return l;
+  if (nodes[l].kind != N_VAR)
+    return fail(tokPos);
+  next();
+  if ((r = parseExpr()) < 0 || (n = newNode(N_ASSIGN, pos)) < 0)
+    return -1;
+  nodes[n].val = nodes[l].val;
+  nodes[n].a = r;
+  return measure(n);
+}
+
+int MyCompiler::parseBinary(int minPrec)
+{
+  int n, l, r, t, prec, pos = tokPos;
+  int32_t v;
+  uint8_t op;
+
+  if ((l = parseUnary()) < 0)
+    return -1;
+  while ((prec = binaryPrec(tok, &op)) >= minPrec) {
+    t = tok;
+    next();
+    if (t == T_IN) {
+      if ((l = parseSet(l, pos)) < 0)
+	return -1;
+      continue;
+    }
+    if ((r = parseBinary(prec + 1)) < 0)
+      return -1;
+
+    if (nodes[l].kind == N_NUM && nodes[r].kind == N_NUM) {
+      if (t == T_OROR || t == T_ANDAND) {
+	v = t == T_OROR ? (nodes[l].val || nodes[r].val)
+	  : (nodes[l].val && nodes[r].val);
+	nodes[l].val = v;
+	nodes[l].len = lastEnd - pos;
+	continue;
+      } else if (foldBinary(op, nodes[l].val, nodes[r].val, &v)) {
+	nodes[l].val = v;
+	nodes[l].len = lastEnd - pos;
+	continue;
+      }
+    }
+
+    if (t == T_OROR || t == T_ANDAND)
+      n = newNode(t == T_OROR ? N_OR : N_AND, pos);
+    else
+      n = newNode(N_BINARY, pos);
+    if (n < 0)
+      return -1;
+    nodes[n].op = op;
+    nodes[n].a = l;
+    nodes[n].b = r;
+    if ((l = measure(n)) < 0)
+      return -1;
+  }
+  return l;
+}
+
+// The constant set l is tested against, {} or {c, ...}.  Testing a
+// constant is folded.
+int MyCompiler::parseSet(int l, int pos)
+{
+  int n, e, first = -1, last = -1, count = 0;
+  bool found = false;
+
+  if (!expect('{'))
+    return -1;
+  while (tok != '}') {
+    if (count && !expect(','))
+      return -1;
+    if ((e = parseExpr()) < 0)
+      return -1;
+    if (nodes[e].kind != N_NUM)
+      return fail(nodes[e].pos);
+    found = found || (nodes[l].kind == N_NUM && nodes[l].val == nodes[e].val);
+    if (last < 0)
+      first = e;
+    else
+      nodes[last].next = e;
+    last = e;
+    count ++;
+  }
+  next();
+
+  if (nodes[l].kind == N_NUM) {
+    nodes[l].val = found;
+    nodes[l].pos = pos;
+    nodes[l].len = lastEnd - pos;
+    return l;
+  }
+  if ((n = newNode(N_IN, pos)) < 0)
+    return -1;
+  nodes[n].a = l;
+  nodes[n].b = first;
+  nodes[n].val = count;
+  return measure(n);
+}
+
+int MyCompiler::parseUnary()
+{
+  int n, a, t, pos = tokPos;
+  uint8_t op;
+
+  if (tok != '-' && tok != '+' && tok != '!' && tok != '~')
+    return parsePrimary();
+
+  Nesting guard(&nesting);
+  if (nesting > SCRIPT_NESTING)
+    return tooDeep(pos);
+
+  t = tok;
+  next();
+  if ((a = parseUnary()) < 0)
+    return -1;
+  if (t == '+')
+    return a;
+
+  op = t == '-' ? OP_NEG : (t == '!' ? OP_NOT : OP_BNOT);
+  if (nodes[a].kind == N_REAL && op == OP_NEG) {
+    nodes[a].val = realNeg(nodes[a].val);
+    nodes[a].pos = pos;
+    nodes[a].len = lastEnd - pos;
+    return a;
+  }
+  if (nodes[a].kind == N_NUM) {
+    if (op == OP_NEG)
+      nodes[a].val = intNeg(nodes[a].val);
+    else if (op == OP_NOT)
+      nodes[a].val = !nodes[a].val;
+    else
+      nodes[a].val = ~nodes[a].val;
+    nodes[a].pos = pos;
+    nodes[a].len = lastEnd - pos;
+    return a;
+  }
+
+  if ((n = newNode(N_UNARY, pos)) < 0)
+    return -1;
+  nodes[n].op = op;
+  nodes[n].a = a;
+  return measure(n);
+}
+
+int MyCompiler::parsePrimary()
+{
+  int n, kind, pos = tokPos;
+  int32_t v;
+  const char *s;
+  char c;
+
+  switch (tok) {
+  case T_NUM:
+  case T_REAL:
+    v = tokVal;
+    kind = tok == T_REAL ? N_REAL : N_NUM;
+    next();
+    if ((n = newNode(kind, pos)) < 0)
+      return -1;
+    nodes[n].val = v;
+    return n;
+
+  case '(':
+    next();
+    if ((n = parseExpr()) < 0 || !expect(')'))
+      return -1;
+    return n;
+
+  case T_IDENT:
+    // A name followed by '(' calls a handler
+    for (s = cur; s<end && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n'); s ++)
+      ;
+    if (s<end && *s == '(')
+      return parseCall();
+
+    // Otherwise it must be one of the variables a-z (or A-Z)
+    c = src[tokPos];
+    if (tokLen != 1 || c == '_')
+      return fail(pos);
+    next();
+    if ((n = newNode(N_VAR, pos)) < 0)
+      return -1;
+    nodes[n].val = c>='a' ? c - 'a' : c - 'A';
+    return n;
+
+  default:
+    return fail(pos);
+  }
+}
+
+int MyCompiler::parseCall()
+{
+  const char *name = src + tokPos;
+  int n = -1, a, imp, nameLen = tokLen, pos = tokPos, argc = 0, last = -1;
+  bool pure;
+
+  next();
+  next(); // '('
+  // A string literal can only come first
+  if (tok == T_STR) {
+    if ((a = newNode(N_STR, tokPos)) < 0
+	|| (nodes[a].val = addString(src + tokPos + 1, tokLen - 2)) < 0)
+      return -1;
+    next();
+    n = last = a;
+    argc = 1;
+    if (tok != ')' && !expect(','))
+      return -1;
+  }
+  if (tok != ')') {
+    for (;;) {
+      if ((a = parseExpr()) < 0)
+	return -1;
+      if (last >= 0)
+	nodes[last].next = a;
+      if (argc++ == 0)
+	n = a;
+      last = a;
+      if (!accept(','))
+	break;
+    }
+  }
+  if (!expect(')'))
+    return -1;
+  // Handlers take one to three arguments, a string and one more at most
+  if (argc < 1 || argc > (nodes[n].kind == N_STR ? 2 : 3))
+    return fail(pos);
+  if ((imp = import(name, nameLen, argc | (nodes[n].kind == N_STR ? IMPORT_STRING : 0), &pure)) < 0)
+    return -1;
+
+  a = n;
+  if ((n = newNode(N_CALL, pos)) < 0)
+    return -1;
+  nodes[n].op = argc;
+  nodes[n].flags = pure ? NODE_PURE : 0;
+  nodes[n].val = imp;
+  nodes[n].a = a;
+  return measure(n);
+}
+
+int MyCompiler::import(const char *name, int len, int arity, bool *pure)
+{
+  uint8_t *p = imports;
+  int i;
+
+  // Only an optimized program relies on purity
+  *pure = false;
+  for (i=0; !trace && i<(int)pureNames.count(); i++)
+    if (pureArities[i] == arity && strlen(pureNames[i]) == (size_t)len
+	&& memcmp(pureNames[i], name, len) == 0)
+      *pure = true;
+
+  for (i=0; i<importCount; i++) {
+    if ((p[0] & ~IMPORT_PURE) == arity && p[1] == len && memcmp(p+2, name, len) == 0)
+      return i;
+    p += 2 + p[1];
+  }
+
+  if (importCount >= PROGRAM_UNBOUND || len > 255) {
+    if (!err)
+      err = ERROR_TOO_BIG;
+    return -1;
+  }
+  if (!grow(&imports, &importCap, importLen + 2 + len))
+    return -1;
+  p = imports + importLen;
+  p[0] = arity | (*pure ? IMPORT_PURE : 0);
+  p[1] = len;
+  memcpy(p+2, name, len);
+  importLen += 2 + len;
+  return importCount++;
+}
+
+// Adds a string literal to the string table, once, and returns its number
+int MyCompiler::addString(const char *s, int len)
+{
+  uint8_t text[STRING_MAX];
+  uint8_t *p = strings;
+  int i, n = 0;
+
+  for (i=0; i<len; i++) {
+    if (n >= STRING_MAX) {
+      if (!err)
+	err = ERROR_TOO_BIG;
+      return -1;
+    }
+    if (s[i] != '\\' || i+1 == len) {
+      text[n++] = s[i];
+      continue;
+    }
+    switch (s[++i]) {
+    case 'n':	text[n++] = '\n';	break;
+    case 'r':	text[n++] = '\r';	break;
+    case 't':	text[n++] = '\t';	break;
+    case '0':	text[n++] = 0;		break;
+    default:	text[n++] = s[i];	break;
+    }
+  }
+
+  for (i=0; i<stringCount; i++) {
+    if (p[0] == n && memcmp(p+1, text, n) == 0)
+      return i;
+    p += 2 + p[0];
+  }
+  if (stringCount >= 255) {
+    if (!err)
+      err = ERROR_TOO_BIG;
+    return -1;
+  }
+  if (!grow(&strings, &stringCap, stringLen + 2 + n))
+    return -1;
+  p = strings + stringLen;
+  p[0] = n;
+  memcpy(p+1, text, n);
+  p[1+n] = 0;
+  stringLen += 2 + n;
+  return stringCount++;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Optimizer
+//////////////////////////////////////////////////////////////////////////////
+
+#define CALL_COST	5		// A handler call weighs a few operations
+#define NOT_IN_LOOP	EXPR_IMPURE
+#define CHAIN_TERMS	32		// Operands of a chain sorted at once
+
+// Variables an expression reads, with EXPR_IMPURE
+uint32_t MyCompiler::varsOf(int n)
+{
+  Node *p = nodes + n;
+  uint32_t v = 0;
+  int a;
+
+  switch (p->kind) {
+  case N_VAR:
+    return 1u << p->val;
+  case N_UNARY:
+  case N_IN:
+    return varsOf(p->a);
+  case N_BINARY:
+  case N_AND:
+  case N_OR:
+    return varsOf(p->a) | varsOf(p->b);
+  case N_ASSIGN:
+    return EXPR_IMPURE | varsOf(p->a);
+  case N_CALL:
+    for (a = p->a; a >= 0; a = nodes[a].next)
+      v |= varsOf(a);
+    return v | (p->flags & NODE_PURE ? 0 : EXPR_IMPURE);
+  default:
+    return 0;
+  }
+}
+
+// Variables a statement or expression may read before assigning them.
+// *defined holds the variables certainly assigned so far and is updated;
+// what a branch or a loop body assigns is not certain.
+uint32_t MyCompiler::inputsOf(int n, uint32_t *defined)
+{
+  Node *p = nodes + n;
+  uint32_t v = 0, d, e;
+  int c;
+
+  switch (p->kind) {
+  case N_VAR:
+    return (1u << p->val) & ~*defined;
+  case N_UNARY:
+  case N_EXPR:
+  case N_IN:
+    return inputsOf(p->a, defined);
+  case N_BINARY:
+    v = inputsOf(p->a, defined);
+    return v | inputsOf(p->b, defined);
+  case N_AND:
+  case N_OR:
+  case N_WHILE:
+    v = inputsOf(p->a, defined);
+    d = *defined;
+    return v | inputsOf(p->b, &d);
+  case N_ASSIGN:
+    v = inputsOf(p->a, defined);
+    *defined |= 1u << p->val;
+    return v;
+  case N_CALL:
+  case N_BLOCK:
+    for (c = p->a; c >= 0; c = nodes[c].next)
+      v |= inputsOf(c, defined);
+    return v;
+  case N_IF:
+    v = inputsOf(p->a, defined);
+    d = e = *defined;
+    v |= inputsOf(p->b, &d);
+    if (p->c >= 0) {
+      v |= inputsOf(p->c, &e);
+      *defined = d & e;
+    }
+    return v;
+  case N_SWITCH:
+    // Each label may be reached without what comes before it
+    v = inputsOf(p->a, defined);
+    for (c = nodes[p->b].a, d = *defined; c >= 0; c = nodes[c].next) {
+      if (nodes[c].kind == N_CASE || nodes[c].kind == N_DEFAULT)
+	d = *defined;
+      v |= inputsOf(c, &d);
+    }
+    return v;
+  case N_FOR:
+    if (p->a >= 0)
+      v |= inputsOf(p->a, defined);
+    if (p->b >= 0)
+      v |= inputsOf(p->b, defined);
+    // A continue may skip to the increment
+    d = e = *defined;
+    v |= inputsOf(p->d, &d);
+    if (p->c >= 0)
+      v |= inputsOf(p->c, &e);
+    return v;
+  default:
+    return 0;
+  }
+}
+
+// Variables a statement or expression assigns
+uint32_t MyCompiler::killsOf(int n)
+{
+  Node *p = nodes + n;
+  uint32_t v = p->kind == N_ASSIGN ? 1u << p->val : 0;
+  int c;
+
+  if (p->kind == N_BLOCK || p->kind == N_CALL) {
+    for (c = p->a; c >= 0; c = nodes[c].next)
+      v |= killsOf(c);
+    return v;
+  }
+  if (p->a >= 0)
+    v |= killsOf(p->a);
+  if (p->b >= 0)
+    v |= killsOf(p->b);
+  if (p->c >= 0)
+    v |= killsOf(p->c);
+  if (p->d >= 0)
+    v |= killsOf(p->d);
+  return v;
+}
+
+// Number of instructions evaluating an expression takes
+int MyCompiler::costOf(int n)
+{
+  Node *p = nodes + n;
+  int a, c = CALL_COST;
+
+  switch (p->kind) {
+  case N_UNARY:
+  case N_IN:
+    return 1 + costOf(p->a);
+  case N_BINARY:
+    return 1 + costOf(p->a) + costOf(p->b);
+  case N_AND:
+  case N_OR:
+    return 2 + costOf(p->a) + costOf(p->b);
+  case N_ASSIGN:
+    return 2 + costOf(p->a);
+  case N_CALL:
+    for (a = p->a; a >= 0; a = nodes[a].next)
+      c += costOf(a);
+    return c;
+  default:
+    return 1;
+  }
+}
+
+bool MyCompiler::sameExpr(int x, int y)
+{
+  Node *p = nodes + x, *q = nodes + y;
+
+  if (x == y)
+    return true;
+  if (p->kind != q->kind || p->op != q->op || p->val != q->val)
+    return false;
+  switch (p->kind) {
+  case N_NUM:
+  case N_REAL:
+  case N_VAR:
+  case N_STR:
+    return true;
+  case N_UNARY:
+    return sameExpr(p->a, q->a);
+  case N_BINARY:
+  case N_AND:
+  case N_OR:
+    return sameExpr(p->a, q->a) && sameExpr(p->b, q->b);
+  case N_CALL:
+    for (x = p->a, y = q->a; x >= 0 && y >= 0; x = nodes[x].next, y = nodes[y].next)
+      if (!sameExpr(x, y))
+	return false;
+    return x < 0 && y < 0;
+  case N_IN:
+    if (!sameExpr(p->a, q->a))
+      return false;
+    for (x = p->b, y = q->b; x >= 0 && y >= 0; x = nodes[x].next, y = nodes[y].next)
+      if (nodes[x].val != nodes[y].val)
+	return false;
+    return x < 0 && y < 0;
+  default:
+    return false;
+  }
+}
+
+// Lists the pure expressions worth caching.  Those which do not change in
+// the loop they are in are flagged, kills holds what that loop assigns.
+void MyCompiler::collect(int n, uint32_t kills, int16_t *list, int *count)
+{
+  Node *p = nodes + n;
+  uint32_t k;
+  int c;
+
+  switch (p->kind) {
+  case N_BLOCK:
+  case N_CALL:
+    for (c = p->a; c >= 0; c = nodes[c].next)
+      collect(c, kills, list, count);
+    break;
+  case N_WHILE:
+    k = killsOf(p->a) | killsOf(p->b);
+    collect(p->a, k, list, count);
+    collect(p->b, k, list, count);
+    break;
+  case N_FOR:
+    k = killsOf(p->d);
+    if (p->b >= 0)
+      k |= killsOf(p->b);
+    if (p->c >= 0)
+      k |= killsOf(p->c);
+    if (p->a >= 0)
+      collect(p->a, kills, list, count);
+    if (p->b >= 0)
+      collect(p->b, k, list, count);
+    if (p->c >= 0)
+      collect(p->c, k, list, count);
+    collect(p->d, k, list, count);
+    break;
+  default:
+    if (p->a >= 0)
+      collect(p->a, kills, list, count);
+    if (p->b >= 0)
+      collect(p->b, kills, list, count);
+    if (p->c >= 0)
+      collect(p->c, kills, list, count);
+    break;
+  }
+
+  if ((p->kind == N_UNARY || p->kind == N_BINARY || p->kind == N_AND
+       || p->kind == N_OR || p->kind == N_CALL || p->kind == N_IN)
+      && !(varsOf(n) & EXPR_IMPURE) && costOf(n) >= 3) {
+    if (kills != NOT_IN_LOOP && !(varsOf(n) & kills))
+      p->flags |= NODE_LOOP;
+    list[(*count)++] = n;
+  }
+}
+
+void MyCompiler::cover(int n)
+{
+  Node *p = nodes + n;
+  int c;
+
+  if (p->kind == N_CALL) {
+    for (c = p->a; c >= 0; c = nodes[c].next) {
+      nodes[c].flags |= NODE_COVERED;
+      cover(c);
+    }
+    return;
+  }
+  if (p->a >= 0) {
+    nodes[p->a].flags |= NODE_COVERED;
+    cover(p->a);
+  }
+  if (p->b >= 0) {
+    nodes[p->b].flags |= NODE_COVERED;
+    cover(p->b);
+  }
+}
+
+// Tells if a variable is assigned between two points of the source
+bool MyCompiler::assignedBetween(uint32_t vars, int from, int to)
+{
+  int i;
+
+  for (i=0; i<nodeCount; i++)
+    if (nodes[i].kind == N_ASSIGN && (vars & (1u << nodes[i].val))
+	&& nodes[i].pos + nodes[i].len > from && nodes[i].pos + nodes[i].len <= to)
+      return true;
+  return false;
+}
+
+// Tells if node x holds node y
+bool MyCompiler::holds(int x, int y)
+{
+  return nodes[x].pos <= nodes[y].pos
+    && nodes[y].pos + nodes[y].len <= nodes[x].pos + nodes[x].len;
+}
+
+// Tells if x, which comes first, is evaluated on every way to y: each
+// branch, loop body, right operand of && or || and run of switch cases
+// holding x also holds y
+bool MyCompiler::dominates(int root, int x, int y)
+{
+  Node *p;
+  int n = root, c, s;
+  bool cases = false, branch;
+
+  while (n != x) {
+    p = nodes + n;
+    if (p->kind == N_BLOCK || p->kind == N_CALL) {
+      for (c = p->a; c >= 0 && !holds(c, x); c = nodes[c].next)
+	;
+      if (c < 0)
+	return false;
+      // A label may be reached without what comes before it
+      if (cases) {
+	for (s = c; s >= 0 && !holds(s, y); s = nodes[s].next)
+	  if (nodes[s].kind == N_CASE || nodes[s].kind == N_DEFAULT)
+	    return false;
+	if (s < 0)
+	  return false;
+      }
+      cases = false;
+    } else {
+      if (p->a >= 0 && holds(p->a, x))
+	c = p->a;
+      else if (p->b >= 0 && holds(p->b, x))
+	c = p->b;
+      else if (p->c >= 0 && holds(p->c, x))
+	c = p->c;
+      else if (p->d >= 0 && holds(p->d, x))
+	c = p->d;
+      else
+	return false;
+      switch (p->kind) {
+      case N_IF:
+      case N_WHILE:
+      case N_SWITCH:
+      case N_AND:
+      case N_OR:
+	branch = c != p->a;
+	break;
+      case N_FOR:
+	branch = c == p->c || c == p->d;
+	break;
+      default:
+	branch = false;
+	break;
+      }
+      if (branch && !holds(c, y))
+	return false;
+      cases = p->kind == N_SWITCH && c == p->b;
+    }
+    n = c;
+  }
+  return true;
+}
+
+// Gives a temporary to the costliest expressions written again before their
+// variables change, where the first one is evaluated on every way to the
+// next, or computed again and again in a loop.  Parts of a cached
+// expression are only considered where they also appear on their own.
+void MyCompiler::optimize(int root)
+{
+  int16_t *list;
+  int i, j, k, l, n, count = 0, reuses;
+  bool loop;
+  uint32_t vars;
+
+  list = (int16_t *)malloc(nodeCount * sizeof(int16_t));
+  if (!list)
+    return;
+  collect(root, NOT_IN_LOOP, list, &count);
+
+  // Costliest first, in source order
+  for (i=1; i<count; i++) {
+    n = list[i];
+    for (j=i; j>0 && (costOf(list[j-1]) < costOf(n)
+		      || (costOf(list[j-1]) == costOf(n) && nodes[list[j-1]].pos > nodes[n].pos)); j--)
+      list[j] = list[j-1];
+    list[j] = n;
+  }
+
+  for (i=0; i<count && tempCount<PROGRAM_TEMPS; i++) {
+    n = list[i];
+    if (nodes[n].temp >= 0 || (nodes[n].flags & NODE_COVERED))
+      continue;
+    vars = varsOf(n);
+    reuses = 0;
+    loop = false;
+    for (j=i; j<count; j++) {
+      k = list[j];
+      if ((nodes[k].flags & NODE_COVERED) || nodes[k].temp >= 0 || !sameExpr(n, k))
+	continue;
+      for (l=i; l<j; l++)
+	if (!(nodes[list[l]].flags & NODE_COVERED) && nodes[list[l]].temp < 0
+	    && sameExpr(n, list[l])
+	    && dominates(root, list[l], k)
+	    && !assignedBetween(vars, nodes[list[l]].pos, nodes[k].pos)) {
+	  reuses ++;
+	  break;
+	}
+      loop = loop || (nodes[k].flags & NODE_LOOP);
+    }
+    if (!reuses && !loop)
+      continue;
+
+    for (j=i; j<count; j++) {
+      k = list[j];
+      if (!(nodes[k].flags & NODE_COVERED) && nodes[k].temp < 0 && sameExpr(n, k)) {
+	nodes[k].temp = tempCount;
+	cover(k);
+      }
+    }
+    for (j=0; j<26; j++)
+      if (vars & (1u << j))
+	tempKills[j] |= 1 << tempCount;
+    tempCount ++;
+  }
+  free(list);
+}
+
+// Counts of the probed run for a node, NULL if it was never reached.  The
+// node is known by its span, which a recompile of the same source keeps.
+const struct ProbeSite *MyCompiler::siteOf(int n, uint8_t kind)
+{
+  int i;
+
+  if (trace)
+    return NULL;
+  for (i=0; i<profileCount; i++)
+    if (profile[i].pos == nodes[n].pos && profile[i].len == nodes[n].len
+	&& profile[i].kind == kind)
+      return profile[i].count ? profile + i : NULL;
+  return NULL;
+}
+
+// Tells if evaluating an expression may stop the run, dividing by zero
+bool MyCompiler::mayFail(int n)
+{
+  Node *p = nodes + n;
+  int a;
+
+  switch (p->kind) {
+  case N_UNARY:
+  case N_IN:
+  case N_ASSIGN:
+    return mayFail(p->a);
+  case N_BINARY:
+    if ((p->op == OP_DIV || p->op == OP_MOD)
+	&& (nodes[p->b].kind != N_NUM || nodes[p->b].val == 0))
+      return true;
+    return mayFail(p->a) || mayFail(p->b);
+  case N_AND:
+  case N_OR:
+    return mayFail(p->a) || mayFail(p->b);
+  case N_CALL:
+    for (a = p->a; a >= 0; a = nodes[a].next)
+      if (mayFail(a))
+	return true;
+    return false;
+  default:
+    return false;
+  }
+}
+
+// Tells if a statement holds a break or a continue
+bool MyCompiler::jumpsOut(int n)
+{
+  Node *p = nodes + n;
+  int c;
+
+  if (p->kind == N_BREAK || p->kind == N_CONTINUE)
+    return true;
+  if (p->kind == N_BLOCK) {
+    for (c = p->a; c >= 0; c = nodes[c].next)
+      if (jumpsOut(c))
+	return true;
+    return false;
+  }
+  return (p->b >= 0 && jumpsOut(p->b)) || (p->c >= 0 && jumpsOut(p->c))
+    || (p->d >= 0 && jumpsOut(p->d));
+}
+
+// A chain a && b && c leans left: its nodes of one kind each add an
+// operand.  The operands are sorted by their cost over the rate at which
+// they settle the result, as seen in the probed run, so the test is
+// likely to end early and cheaply.  Only done when all of them were
+// reached, none may fail or has an effect, and the tree gets no higher.
+// Past CHAIN_TERMS operands, the rest of the chain is sorted on its own.
+void MyCompiler::reorderChain(int n)
+{
+  int16_t spine[CHAIN_TERMS], leaves[CHAIN_TERMS + 1];
+  uint32_t cost[CHAIN_TERMS + 1], rate[CHAIN_TERMS + 1], settled;
+  const struct ProbeSite *site;
+  Node *p;
+  uint8_t kind = nodes[n].kind;
+  int i, j, k = 0, l, h, c, r;
+  bool movable = true;
+
+  for (i = n; nodes[i].kind == kind && k < CHAIN_TERMS; i = nodes[i].a)
+    spine[k++] = i;
+  leaves[0] = nodes[spine[k-1]].a;
+  for (i=1; i<=k; i++)
+    leaves[i] = nodes[spine[k-i]].b;
+
+  for (i=0; i<=k; i++) {
+    reorder(leaves[i]);
+    site = siteOf(leaves[i], PROBE_COND);
+    if (!site || (varsOf(leaves[i]) & EXPR_IMPURE) || mayFail(leaves[i])) {
+      movable = false;
+      continue;
+    }
+    settled = kind == N_AND ? site->count - site->taken : site->taken;
+    rate[i] = (uint32_t)(((uint64_t)settled << 16) / site->count);
+    cost[i] = costOf(leaves[i]);
+  }
+  if (!movable)
+    return;
+
+  for (i=1; i<=k; i++) {
+    l = leaves[i];
+    c = cost[i];
+    r = rate[i];
+    for (j=i; j>0 && (uint64_t)c * rate[j-1] < (uint64_t)cost[j-1] * r; j--) {
+      leaves[j] = leaves[j-1];
+      cost[j] = cost[j-1];
+      rate[j] = rate[j-1];
+    }
+    leaves[j] = l;
+    cost[j] = c;
+    rate[j] = r;
+  }
+
+  h = nodes[leaves[0]].height;
+  for (i=1; i<=k; i++)
+    h = (h > nodes[leaves[i]].height ? h : nodes[leaves[i]].height) + 1;
+  if (h > nodes[n].height)
+    return;
+
+  nodes[spine[k-1]].a = leaves[0];
+  for (i=1; i<=k; i++) {
+    p = nodes + spine[k-i];
+    p->b = leaves[i];
+    h = nodes[p->a].height > nodes[p->b].height ? nodes[p->a].height : nodes[p->b].height;
+    p->height = h + 1;
+  }
+}
+
+// Puts the operands of && and || in the order best suited to the profile
+void MyCompiler::reorder(int n)
+{
+  Node *p = nodes + n;
+  int c;
+
+  if (p->kind == N_AND || p->kind == N_OR) {
+    reorderChain(n);
+  } else if (p->kind == N_BLOCK || p->kind == N_CALL) {
+    for (c = p->a; c >= 0; c = nodes[c].next)
+      reorder(c);
+  } else {
+    if (p->a >= 0)
+      reorder(p->a);
+    if (p->b >= 0)
+      reorder(p->b);
+    if (p->c >= 0)
+      reorder(p->c);
+    if (p->d >= 0)
+      reorder(p->d);
+  }
+}
+
+// Gives each expression the type of its value.  Children come before their
+// parent in the node pool, so one pass types the tree for the variables
+// known to be real; assigning a real makes a variable real, then the tree
+// is typed again.
+void MyCompiler::inferTypes()
+{
+  Node *p;
+  uint32_t known;
+  int i;
+
+  reals = 0;
+  do {
+    known = reals;
+    for (i=0; i<nodeCount; i++) {
+      p = nodes + i;
+      switch (p->kind) {
+      case N_REAL:
+	p->type = TYPE_REAL;
+	break;
+      case N_VAR:
+	p->type = reals & (1u << p->val) ? TYPE_REAL : TYPE_INT;
+	break;
+      case N_UNARY:
+	p->type = p->op == OP_NEG ? nodes[p->a].type : (uint8_t)TYPE_INT;
+	break;
+      case N_BINARY:
+	// Comparisons give an int
+	p->type = (p->op == OP_MUL || p->op == OP_DIV || p->op == OP_ADD || p->op == OP_SUB)
+	  && (nodes[p->a].type == TYPE_REAL || nodes[p->b].type == TYPE_REAL)
+	  ? TYPE_REAL : TYPE_INT;
+	break;
+      case N_ASSIGN:
+	if (nodes[p->a].type == TYPE_REAL)
+	  reals |= 1u << p->val;
+	p->type = reals & (1u << p->val) ? TYPE_REAL : TYPE_INT;
+	break;
+      }
+    }
+  } while (reals != known);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Cost analysis
+//////////////////////////////////////////////////////////////////////////////
+
+// Instructions an expression takes at most, counting the conversions and
+// caching it may get.  Adds its handler calls to *calls.
+uint32_t MyCompiler::exprCost(int n, uint32_t *calls)
+{
+  Node *p = nodes + n;
+  uint32_t c = 3;	// The instruction, caching
+  int a;
+
+  switch (p->kind) {
+  case N_NUM:
+  case N_REAL:
+  case N_VAR:
+  case N_STR:
+    return 1;
+  case N_UNARY:
+    return c + 1 + exprCost(p->a, calls);
+  case N_IN:
+    return c + 2 + exprCost(p->a, calls);
+  case N_BINARY:
+  case N_AND:
+  case N_OR:
+    c += 3 + exprCost(p->a, calls);
+    return addCost(c, exprCost(p->b, calls));
+  case N_ASSIGN:
+    return c + 3 + exprCost(p->a, calls);
+  case N_CALL:
+    *calls = addCost(*calls, 1);
+    for (a = p->a; a >= 0; a = nodes[a].next)
+      c = addCost(c, 1 + exprCost(a, calls));
+    return c;
+  default:
+    return c;
+  }
+}
+
+// Instructions and handler calls a statement takes at most
+uint32_t MyCompiler::worstOf(int n, uint32_t *calls)
+{
+  Node *p = nodes + n, *init;
+  uint32_t c = 0, t, e, tc = 0, ec = 0, bodyCalls = 0;
+  int s;
+  int32_t from, to;
+
+  switch (p->kind) {
+  case N_BLOCK:
+    for (s = p->a; s >= 0; s = nodes[s].next)
+      c = addCost(c, worstOf(s, calls));
+    return c;
+
+  case N_EXPR:
+    return 1 + exprCost(p->a, calls);
+
+  case N_IF:
+    c = 2 + exprCost(p->a, calls);
+    t = worstOf(p->b, &tc);
+    e = p->c >= 0 ? worstOf(p->c, &ec) : 0;
+    *calls = addCost(*calls, tc > ec ? tc : ec);
+    return addCost(c + 1, t > e ? t : e);
+
+  case N_SWITCH:
+    // Falling through from the first label runs the whole body once
+    c = 2 + exprCost(p->a, calls);
+    return addCost(c, worstOf(p->b, calls));
+
+  case N_WHILE:
+  case N_FOR:
+    if (p->kind == N_FOR && p->a >= 0)
+      c = 1 + exprCost(p->a, calls);
+    // Never entered
+    s = p->kind == N_WHILE ? p->a : p->b;
+    if (s >= 0 && nodes[s].kind == N_NUM && !nodes[s].val)
+      return c + 1;
+
+    // Counting from a constant to a constant
+    init = p->kind == N_FOR && p->a >= 0 ? nodes + p->a : NULL;
+    if (!init || !isCounted(n) || init->kind != N_ASSIGN
+	|| init->val != nodes[nodes[p->b].a].val || nodes[init->a].kind != N_NUM
+	|| nodes[nodes[p->b].b].kind != N_NUM) {
+      *calls = COST_UNBOUNDED;
+      return COST_UNBOUNDED;
+    }
+    from = nodes[init->a].val;
+    to = nodes[nodes[p->b].b].val;
+
+    // Each iteration tests and steps the counter in full when tracing
+    t = worstOf(p->d, &bodyCalls);
+    t = addCost(t, 4 + exprCost(p->b, &bodyCalls) + exprCost(p->c, &bodyCalls));
+    e = from < to ? (uint32_t)to - (uint32_t)from : 0;
+    *calls = addCost(*calls, mulCost(bodyCalls, e));
+    return addCost(c + 4 + exprCost(p->b, calls), mulCost(t, e));
+
+  default:
+    return 1;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Code generator
+//////////////////////////////////////////////////////////////////////////////
+
+bool MyCompiler::grow(uint8_t **buf, int *cap, int need)
+{
+  uint8_t *p;
+  int n;
+
+  if (need <= *cap)
+    return true;
+  for (n = *cap ? *cap * 2 : 64; n < need; n *= 2)
+    ;
+  p = (uint8_t *)realloc(*buf, n);
+  if (!p) {
+    if (!err)
+      err = ERROR_MEMORY;
+    return false;
+  }
+  *buf = p;
+  *cap = n;
+  return true;
+}
+
+void MyCompiler::emit(uint8_t op)
+{
+  if (grow(&code, &codeCap, codeLen + 1))
+    code[codeLen++] = op;
+}
+
+void MyCompiler::emit8(uint8_t op, uint8_t v)
+{
+  if (grow(&code, &codeCap, codeLen + 2)) {
+    code[codeLen++] = op;
+    code[codeLen++] = v;
+  }
+}
+
+// Jumps to unknown targets are chained through their operands until patched
+int MyCompiler::emitJump(uint8_t op, int target)
+{
+  int at = codeLen;
+
+  if (!grow(&code, &codeCap, codeLen + 3))
+    return -1;
+  code[codeLen] = op;
+  write16(code + codeLen + 1, target < 0 ? 0xffff : target);
+  codeLen += 3;
+  return at;
+}
+
+void MyCompiler::patch(int chain, int target)
+{
+  int prev;
+
+  while (chain >= 0) {
+    prev = read16(code + chain + 1);
+    write16(code + chain + 1, target);
+    chain = prev == 0xffff ? -1 : prev;
+  }
+}
+
+// Rewrites the jumps with the shortest distance reaching their target.
+// Widening a jump only moves others further apart, so the sizes are grown
+// until none changes.
+bool MyCompiler::compact()
+{
+  uint16_t *at;		// Compacted pc of each instruction
+  uint8_t *wide, *out;
+  int pc, n, t, d, i;
+  bool changed;
+
+  at = (uint16_t *)malloc((codeLen + 1) * sizeof(uint16_t));
+  wide = (uint8_t *)calloc(codeLen + 1, 1);
+  if (!at || !wide) {
+    free(at);
+    free(wide);
+    err = ERROR_MEMORY;
+    return false;
+  }
+
+  do {
+    for (pc = n = 0; pc < codeLen; pc += wideSize(code + pc)) {
+      at[pc] = n;
+      if (isJump(code[pc]))
+	n += (hasOperand(code[pc]) ? 3 : 2) + wide[pc];
+      else
+	n += wideSize(code + pc);
+    }
+    at[codeLen] = n;
+
+    changed = false;
+    for (pc = 0; pc < codeLen; pc += wideSize(code + pc)) {
+      if (!isJump(code[pc]) || wide[pc])
+	continue;
+      t = read16(code + pc + 1);
+      n = at[pc] + (hasOperand(code[pc]) ? 3 : 2);
+      d = isBackward(code[pc]) ? n - at[t] : at[t] - n;
+      if (d >= 0x80) {
+	wide[pc] = 1;
+	changed = true;
+      }
+    }
+  } while (changed);
+
+  out = (uint8_t *)malloc(at[codeLen] ? at[codeLen] : 1);
+  if (!out) {
+    free(at);
+    free(wide);
+    err = ERROR_MEMORY;
+    return false;
+  }
+  for (pc = n = 0; pc < codeLen; pc += wideSize(code + pc)) {
+    if (!isJump(code[pc])) {
+      memcpy(out + n, code + pc, wideSize(code + pc));
+      n += wideSize(code + pc);
+      // A table keeps its size, its targets become distances
+      if (code[pc] == OP_JTAB || code[pc] == OP_JFIND)
+	for (i = -1; i < tableCount(code + pc); i ++)
+	  write16(out + at[pc] + tableEntry(code + pc, i),
+		  at[read16(code + pc + tableEntry(code + pc, i))] - n);
+      continue;
+    }
+    t = at[read16(code + pc + 1)];
+    out[n++] = code[pc];
+    if (hasOperand(code[pc]))
+      out[n++] = code[pc + 3];
+    d = isBackward(code[pc]) ? n + 1 + wide[pc] - t : t - (n + 1 + wide[pc]);
+    n += writeDist(out + n, d);
+  }
+
+  if (trace)
+    for (i=0; i<(int)trace->count(); i++)
+      (*trace)[i].pc = at[(*trace)[i].pc];
+  if (calls)
+    for (i=0; i<(int)calls->count(); i++)
+      (*calls)[i].pc = at[(*calls)[i].pc];
+  free(code);
+  code = out;
+  codeLen = codeCap = n;
+  free(at);
+  free(wide);
+  return true;
+}
+
+void MyCompiler::addTrace(int n, uint8_t kind)
+{
+  struct TracePoint t;
+
+  if (!trace)
+    return;
+  t.pc = codeLen;
+  t.pos = nodes[n].pos;
+  t.len = nodes[n].len;
+  t.kind = kind;
+  trace->add(t);
+}
+
+// Counts how often a condition is reached and holds, or a call is made,
+// up to PROBE_MAX probes
+void MyCompiler::addProbe(int n, uint8_t kind)
+{
+  struct ProbeSite s;
+
+  if (!probes || probes->count() >= PROBE_MAX)
+    return;
+  s.pos = nodes[n].pos;
+  s.len = nodes[n].len;
+  s.kind = kind;
+  s.count = s.taken = 0;
+  emit8(OP_PROBE, probes->count());
+  probes->add(s);
+}
+
+void MyCompiler::push(int n)
+{
+  depth += n;
+  if (depth > maxDepth)
+    maxDepth = depth;
+}
+
+// Tests the value against a bitset when that takes no more room than the
+// sorted values, searches these otherwise.  A real is truncated.
+void MyCompiler::genSet(int n)
+{
+  Node *p = nodes + n;
+  int e, f, i, j, at, size, count = 0;
+  int32_t low = 0, high = 0;
+  uint32_t span;
+  bool bits;
+
+  for (e = p->b; e >= 0; e = nodes[e].next) {
+    for (f = p->b; f != e && nodes[f].val != nodes[e].val; f = nodes[f].next)
+      ;
+    if (f != e)
+      continue;
+    if (!count || nodes[e].val < low)
+      low = nodes[e].val;
+    if (!count || nodes[e].val > high)
+      high = nodes[e].val;
+    count ++;
+  }
+  span = (uint32_t)high - (uint32_t)low;
+  bits = count && span < 8 * 255 && 7 + (int)span / 8 <= 3 + 4 * count;
+  size = bits ? 7 + span / 8 : 3 + 4 * count;
+
+  genAs(p->a, TYPE_INT);
+  at = codeLen;
+  if (!grow(&code, &codeCap, codeLen + size))
+    return;
+  memset(code + at, 0, size);
+  if (bits) {
+    code[at] = OP_INBITS;
+    write32(code + at + 1, low);
+    code[at + 5] = span / 8 + 1;
+    for (e = p->b; e >= 0; e = nodes[e].next) {
+      i = (uint32_t)nodes[e].val - (uint32_t)low;
+      code[at + 6 + i / 8] |= 1 << (i % 8);
+    }
+  } else {
+    code[at] = OP_INLIST;
+    write16(code + at + 1, count);
+    for (e = p->b, i = 0; e >= 0; e = nodes[e].next) {
+      for (j = 0; j < i && read32(code + at + 3 + 4 * j) < nodes[e].val; j ++)
+	;
+      if (j < i && read32(code + at + 3 + 4 * j) == nodes[e].val)
+	continue;
+      memmove(code + at + 7 + 4 * j, code + at + 3 + 4 * j, 4 * (i - j));
+      write32(code + at + 3 + 4 * j, nodes[e].val);
+      i ++;
+    }
+  }
+  codeLen += size;
+}
+
+void MyCompiler::genValue(int n)
+{
+  Node *p = nodes + n;
+  int a, j, t;
+
+  switch (p->kind) {
+  case N_NUM:
+  case N_REAL:
+    if (p->val >= -128 && p->val <= 127) {
+      emit8(OP_PUSHB, p->val);
+    } else if (p->val >= -32768 && p->val <= 32767) {
+      if (grow(&code, &codeCap, codeLen + 3)) {
+	code[codeLen] = OP_PUSHW;
+	write16(code + codeLen + 1, p->val);
+	codeLen += 3;
+      }
+    } else if (grow(&code, &codeCap, codeLen + 5)) {
+      code[codeLen] = OP_PUSH;
+      write32(code + codeLen + 1, p->val);
+      codeLen += 5;
+    }
+    push(1);
+    break;
+  case N_VAR:
+    emit8(OP_LOAD, p->val);
+    push(1);
+    break;
+  case N_UNARY:
+    if (p->op == OP_NOT)
+      genTest(p->a);
+    else
+      genAs(p->a, p->type);
+    emit(p->type == TYPE_REAL ? realOp(p->op) : p->op);
+    break;
+  case N_BINARY:
+    t = realOp(p->op) && (nodes[p->a].type == TYPE_REAL || nodes[p->b].type == TYPE_REAL)
+      ? TYPE_REAL : TYPE_INT;
+    genAs(p->a, t);
+    genAs(p->b, t);
+    emit(t == TYPE_REAL ? realOp(p->op) : p->op);
+    push(-1);
+    break;
+  case N_AND:
+  case N_OR:
+    genTest(p->a);
+    if (nodes[p->a].kind != p->kind)
+      addProbe(p->a, PROBE_COND);
+    j = emitJump(p->kind == N_AND ? OP_ANDJ : OP_ORJ, -1);
+    push(-1);
+    genTest(p->b);
+    if (nodes[p->b].kind != p->kind)
+      addProbe(p->b, PROBE_COND);
+    emit(OP_BOOL);
+    patch(j, codeLen);
+    break;
+  case N_ASSIGN:
+    genAs(p->a, p->type);
+    emit(OP_DUP);
+    push(1);
+    genStore(p->val);
+    push(-1);
+    break;
+  case N_CALL:
+    a = p->a;
+    if (nodes[a].kind == N_STR)
+      a = nodes[a].next;
+    for (; a >= 0; a = nodes[a].next)
+      genAs(a, TYPE_INT);
+    if (calls) {
+      struct CallSite c;
+      c.pc = codeLen;
+      c.pos = p->pos;
+      calls->add(c);
+    }
+    if (nodes[p->a].kind == N_STR) {
+      emit8(OP_CALLS, p->val);
+      emit(nodes[p->a].val);
+      push(2 - p->op);
+    } else {
+      emit8(OP_CALL, p->val);
+      push(1 - p->op);
+    }
+    addProbe(n, PROBE_CALL);
+    break;
+  case N_IN:
+    genSet(n);
+    break;
+  }
+}
+
+// A cached expression is skipped while its temporary is set
+void MyCompiler::genExpr(int n)
+{
+  int j;
+
+  if (nodes[n].temp < 0) {
+    genValue(n);
+    return;
+  }
+  j = emitJump(OP_TGET, -1);
+  emit(nodes[n].temp);
+  genValue(n);
+  emit8(OP_TSET, nodes[n].temp);
+  patch(j, codeLen);
+}
+
+// Evaluates an expression as an int or a real, converting it if needed
+void MyCompiler::genAs(int n, int type)
+{
+  genExpr(n);
+  if (nodes[n].type != type)
+    emit(type == TYPE_REAL ? OP_ITOR : OP_RTOI);
+}
+
+// Evaluates an expression for its truth, zero or not
+void MyCompiler::genTest(int n)
+{
+  genExpr(n);
+  if (nodes[n].type == TYPE_REAL)
+    emit(OP_RNZ);
+}
+
+// Assigns a variable, forgetting the cached values computed from it
+void MyCompiler::genStore(int var)
+{
+  emit8(OP_STORE, var);
+  if (tempKills[var])
+    emitJump(OP_TCLEAR, tempKills[var]);
+}
+
+// Evaluates an expression for its side effects only
+void MyCompiler::genEffect(int n)
+{
+  if (nodes[n].kind == N_ASSIGN) {
+    genAs(nodes[n].a, nodes[n].type);
+    genStore(nodes[n].val);
+  } else {
+    genExpr(n);
+    emit(OP_POP);
+  }
+  push(-1);
+}
+
+// Emits a test and returns the jump taken when it is false, -1 if never
+int MyCompiler::genCond(int n)
+{
+  int j;
+
+  if (!trace && nodes[n].kind == N_NUM)
+    return nodes[n].val ? -1 : emitJump(OP_JMP, -1);
+  genTest(n);
+  addTrace(n, TRACE_COND);
+  addProbe(n, PROBE_COND);
+  j = emitJump(OP_JZ, -1);
+  push(-1);
+  return j;
+}
+
+// Tells if a for loop counts an int up to a bound which does not change in
+// the loop, the body leaving the counter alone
+bool MyCompiler::isCounted(int n)
+{
+  Node *p = nodes + n, *cond, *inc, *sum;
+  uint32_t kills;
+  int var;
+
+  if (p->b < 0 || p->c < 0)
+    return false;
+  cond = nodes + p->b;
+  if (cond->kind != N_BINARY || cond->op != OP_LT || nodes[cond->a].kind != N_VAR
+      || nodes[cond->a].type != TYPE_INT || nodes[cond->b].type != TYPE_INT)
+    return false;
+  var = nodes[cond->a].val;
+
+  inc = nodes + p->c;
+  if (inc->kind != N_ASSIGN || inc->val != var)
+    return false;
+  sum = nodes + inc->a;
+  if (sum->kind != N_BINARY || sum->op != OP_ADD
+      || !((nodes[sum->a].kind == N_VAR && nodes[sum->a].val == var
+	    && nodes[sum->b].kind == N_NUM && nodes[sum->b].val == 1)
+	   || (nodes[sum->b].kind == N_VAR && nodes[sum->b].val == var
+	       && nodes[sum->a].kind == N_NUM && nodes[sum->a].val == 1)))
+    return false;
+
+  kills = killsOf(p->d);
+  return !(kills & (1u << var)) && !(varsOf(cond->b) & (kills | EXPR_IMPURE | (1u << var)));
+}
+
+// Jumps to the case with a single instruction: a table indexed by the
+// value when it takes no more room than the sorted values, a binary search
+// of these otherwise.  Values without a case go to the default, or past
+// the switch.
+void MyCompiler::genSwitch(int n)
+{
+  Node *p = nodes + n;
+  int s, i, j, at, size, brk, count = 0;
+  int32_t low = 0, high = 0;
+  uint32_t span;
+  bool dense;
+
+  for (s = nodes[p->b].a; s >= 0; s = nodes[s].next)
+    if (nodes[s].kind == N_CASE) {
+      if (!count || nodes[s].val < low)
+	low = nodes[s].val;
+      if (!count || nodes[s].val > high)
+	high = nodes[s].val;
+      count ++;
+    }
+  span = (uint32_t)high - (uint32_t)low;
+  dense = count && span < 0x7fff
+    && JTAB_HEAD + 2 * ((int)span + 1) <= JFIND_HEAD + JFIND_ENTRY * count;
+  size = dense ? JTAB_HEAD + 2 * ((int)span + 1) : JFIND_HEAD + JFIND_ENTRY * count;
+
+  genAs(p->a, TYPE_INT);
+  addTrace(p->a, TRACE_VALUE);
+  at = codeLen;
+  if (!grow(&code, &codeCap, codeLen + size))
+    return;
+  memset(code + at, 0xff, size);
+  code[at] = dense ? OP_JTAB : OP_JFIND;
+  if (dense) {
+    write32(code + at + 1, low);
+    write16(code + at + 5, span + 1);
+  } else {
+    write16(code + at + 1, count);
+    for (s = nodes[p->b].a, i = 0; s >= 0; s = nodes[s].next) {
+      if (nodes[s].kind != N_CASE)
+	continue;
+      for (j = i++; j > 0 && read32(code + at + JFIND_HEAD + JFIND_ENTRY * (j-1)) > nodes[s].val; j --)
+	memcpy(code + at + JFIND_HEAD + JFIND_ENTRY * j,
+	       code + at + JFIND_HEAD + JFIND_ENTRY * (j-1), JFIND_ENTRY);
+      write32(code + at + JFIND_HEAD + JFIND_ENTRY * j, nodes[s].val);
+    }
+  }
+  codeLen += size;
+  push(-1);
+
+  brk = breakChain;
+  breakChain = -1;
+  for (s = nodes[p->b].a; s >= 0; s = nodes[s].next) {
+    if (nodes[s].kind == N_CASE) {
+      for (i = 0; !dense && read32(code + at + JFIND_HEAD + JFIND_ENTRY * i) != nodes[s].val; i ++)
+	;
+      write16(code + at + tableEntry(code + at, dense ? nodes[s].val - low : i), codeLen);
+    } else if (nodes[s].kind == N_DEFAULT) {
+      write16(code + at + tableEntry(code + at, -1), codeLen);
+    } else {
+      genStatement(s);
+    }
+  }
+  if (read16(code + at + tableEntry(code + at, -1)) == 0xffff)
+    write16(code + at + tableEntry(code + at, -1), codeLen);
+  for (i = 0; i < tableCount(code + at); i ++)
+    if (read16(code + at + tableEntry(code + at, i)) == 0xffff)
+      write16(code + at + tableEntry(code + at, i), read16(code + at + tableEntry(code + at, -1)));
+  patch(breakChain, codeLen);
+  breakChain = brk;
+}
+
+// The bound is computed once and stays on the stack while the loop runs.
+// Stepping the counter does not clear what was cached from it, so this is
+// done at the top of the body and on the way out.
+void MyCompiler::genCounted(int n)
+{
+  Node *p = nodes + n;
+  int var = nodes[nodes[p->b].a].val, top, j, brk, cont;
+
+  brk = breakChain;
+  cont = continueChain;
+  breakChain = continueChain = -1;
+
+  if (p->a >= 0)
+    genEffect(p->a);
+  genExpr(nodes[p->b].b);
+  j = emitJump(OP_FORT, -1);
+  emit(var);
+  top = codeLen;
+  if (tempKills[var])
+    emitJump(OP_TCLEAR, tempKills[var]);
+  genStatement(p->d);
+  patch(continueChain, codeLen);
+  emitJump(OP_FORI, top);
+  emit(var);
+  patch(j, codeLen);
+  patch(breakChain, codeLen);
+  if (tempKills[var])
+    emitJump(OP_TCLEAR, tempKills[var]);
+  emit(OP_POP);
+  push(-1);
+
+  breakChain = brk;
+  continueChain = cont;
+}
+
+void MyCompiler::genStatement(int n)
+{
+  Node *p = nodes + n;
+  const struct ProbeSite *site;
+  struct ColdBranch c;
+  int s, j, e, top, brk, cont;
+
+  switch (p->kind) {
+  case N_BLOCK:
+    for (s = p->a; s >= 0; s = nodes[s].next)
+      genStatement(s);
+    break;
+
+  case N_EXPR:
+    addTrace(n, TRACE_STMT);
+    genEffect(p->a);
+    break;
+
+  case N_IF:
+    j = genCond(p->a);
+    genStatement(p->b);
+    // When the condition mostly holds, the else branch is moved past the
+    // end so the common path does not jump over it
+    if (p->c >= 0 && j >= 0 && (site = siteOf(p->a, PROBE_COND)) != NULL
+	&& site->taken > site->count - site->taken && !jumpsOut(p->c)) {
+      c.node = p->c;
+      c.jump = j;
+      c.end = codeLen;
+      c.depth = depth;
+      cold.add(c);
+    } else if (p->c >= 0) {
+      e = emitJump(OP_JMP, -1);
+      patch(j, codeLen);
+      genStatement(p->c);
+      patch(e, codeLen);
+    } else {
+      patch(j, codeLen);
+    }
+    break;
+
+  case N_WHILE:
+  case N_FOR:
+    // Tracing reports the condition of each iteration
+    if (p->kind == N_FOR && !trace && isCounted(n)) {
+      genCounted(n);
+      break;
+    }
+    brk = breakChain;
+    cont = continueChain;
+    breakChain = continueChain = -1;
+
+    if (p->kind == N_FOR && p->a >= 0)
+      genEffect(p->a);
+    top = codeLen;
+    if (p->kind == N_WHILE)
+      j = genCond(p->a);
+    else
+      j = p->b >= 0 ? genCond(p->b) : -1;
+    genStatement(p->kind == N_WHILE ? p->b : p->d);
+    patch(continueChain, codeLen);
+    if (p->kind == N_FOR && p->c >= 0)
+      genEffect(p->c);
+    emitJump(OP_LOOP, top);
+    patch(j, codeLen);
+    patch(breakChain, codeLen);
+
+    breakChain = brk;
+    continueChain = cont;
+    break;
+
+  case N_SWITCH:
+    genSwitch(n);
+    break;
+
+  case N_BREAK:
+    breakChain = emitJump(OP_JMP, breakChain);
+    break;
+
+  case N_CONTINUE:
+    continueChain = emitJump(OP_JMP, continueChain);
+    break;
+  }
+}
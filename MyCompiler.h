@@ -0,0 +1,499 @@
+// A SMING-compatible C interpreter
+//
+// Compiler from script source to the program image described in
+// MyProgram.h.  The script is parsed into a small tree which is then
+// turned into bytecode for the stack machine in MyInterpreter.
+//
+// Unless tracing, the tree is optimized first.  Expressions written more
+// than once, or inside a loop, are cached in a temporary the first time they
+// are computed and read back as long as none of their variables is assigned,
+// so a loop invariant is computed once and a repeated test once per run.
+// This covers operators and the handlers declared pure with addPure();
+// handlers are assumed never to change the script variables.  Counted
+// loops, for (i = ...; i < n; i = i + 1) with neither i changed by the body
+// nor n by the loop, test and step i with a single instruction.  A switch
+// jumps to its case with a single instruction too: a table indexed by the
+// value when the cases are dense, a binary search of the values otherwise.
+// Membership of a constant set, v in {1, 2, 3}, is one instruction as
+// well, testing a bitset or searching the sorted values.
+//
+// A script can be compiled with probes counting how often its conditions
+// hold and its handlers are called, then compiled again for these counts:
+// the operands of && and || that cannot fail or change anything are tested
+// in the order most likely to settle the result cheaply, and the else
+// branch of an if which mostly holds is moved past the end of the code so
+// the common path runs without a jump.
+//
+// A number with a fraction is a real (see MyProgram.h).  Types are found
+// before generating: a variable is real if anything real is assigned to it,
+// an operation is real if one of its operands is.  Real operations and
+// conversions are only emitted there, a script without reals compiles to
+// the same code as before.  Handlers take and return ints, a real argument
+// is truncated.
+//
+// The worst case of a run is worked out from the tree: the instructions and
+// handler calls of each branch are bounded from what it generates, loops
+// only have a bound when they count between two constants.
+//
+// The parser and the passes over the tree are recursive.  To bound their
+// use of the native stack, scripts nested deeper than SCRIPT_NESTING or
+// whose tree is higher than SCRIPT_HEIGHT are rejected with ERROR_DEPTH.
+// Only blocks, statements, parentheses, calls and unary operators nest;
+// an else-if chain is one level, a long sum only adds to the height.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#ifndef __MYCOMPILER_H__
+#define __MYCOMPILER_H__
+#include "Arduino.h"
+#include "MyProgram.h"
+
+#ifndef SCRIPT_NESTING
+#define SCRIPT_NESTING	64	// Nested statements, parentheses and calls
+#endif
+#ifndef SCRIPT_HEIGHT
+#define SCRIPT_HEIGHT	128	// Height of the tree, e.g. terms of a sum
+#endif
+
+// Tokens, operators and jumps, shared with MyStaticCompiler.h
+
+enum TOKENS {
+  T_END = 0,
+  T_NUM = 256,
+  T_IDENT,
+  T_IF,
+  T_ELSE,
+  T_WHILE,
+  T_FOR,
+  T_BREAK,
+  T_CONTINUE,
+  T_OROR,
+  T_ANDAND,
+  T_EQ,
+  T_NE,
+  T_LE,
+  T_GE,
+  T_SHL,
+  T_SHR,
+  T_STR,
+  T_REAL,
+  T_SWITCH,
+  T_CASE,
+  T_DEFAULT,
+  T_IN
+};
+
+struct Keyword {
+  const char *name;
+  int len;
+  int tok;
+  int val;
+};
+
+static constexpr struct Keyword keywords[] = {
+  {"if", 2, T_IF, 0},
+  {"else", 4, T_ELSE, 0},
+  {"while", 5, T_WHILE, 0},
+  {"for", 3, T_FOR, 0},
+  {"break", 5, T_BREAK, 0},
+  {"continue", 8, T_CONTINUE, 0},
+  {"switch", 6, T_SWITCH, 0},
+  {"case", 4, T_CASE, 0},
+  {"default", 7, T_DEFAULT, 0},
+  {"in", 2, T_IN, 0},
+  // Constants
+  {"LOW", 3, T_NUM, 0},
+  {"HIGH", 4, T_NUM, 1},
+  {"false", 5, T_NUM, 0},
+  {"true", 4, T_NUM, 1},
+};
+
+#define KEYWORD_NUM (sizeof(keywords)/sizeof(keywords[0]))
+
+// Returns the precedence of a binary operator token, 0 if it is none
+static SCRIPT_CONSTEXPR int binaryPrec(int tok, uint8_t *op)
+{
+  switch (tok) {
+  case T_OROR:	*op = 0;	return 1;
+  case T_ANDAND: *op = 0;	return 2;
+  case '|':	*op = OP_OR;	return 3;
+  case '^':	*op = OP_XOR;	return 4;
+  case '&':	*op = OP_AND;	return 5;
+  case T_EQ:	*op = OP_EQ;	return 6;
+  case T_NE:	*op = OP_NE;	return 6;
+  case '<':	*op = OP_LT;	return 7;
+  case T_LE:	*op = OP_LE;	return 7;
+  case '>':	*op = OP_GT;	return 7;
+  case T_GE:	*op = OP_GE;	return 7;
+  case T_IN:	*op = 0;	return 7;
+  case T_SHL:	*op = OP_SHL;	return 8;
+  case T_SHR:	*op = OP_SHR;	return 8;
+  case '+':	*op = OP_ADD;	return 9;
+  case '-':	*op = OP_SUB;	return 9;
+  case '*':	*op = OP_MUL;	return 10;
+  case '/':	*op = OP_DIV;	return 10;
+  case '%':	*op = OP_MOD;	return 10;
+  default:	*op = 0;	return 0;
+  }
+}
+
+// The real version of an operator, 0 for those on integers only
+static SCRIPT_CONSTEXPR uint8_t realOp(uint8_t op)
+{
+  switch (op) {
+  case OP_NEG:	return OP_RNEG;
+  case OP_MUL:	return OP_RMUL;
+  case OP_DIV:	return OP_RDIV;
+  case OP_ADD:	return OP_RADD;
+  case OP_SUB:	return OP_RSUB;
+  case OP_LT:	return OP_RLT;
+  case OP_LE:	return OP_RLE;
+  case OP_GT:	return OP_RGT;
+  case OP_GE:	return OP_RGE;
+  case OP_EQ:	return OP_REQ;
+  case OP_NE:	return OP_RNE;
+  default:
+    return 0;
+  }
+}
+
+// Constant folding, division by zero is left for the run time to report.
+// Folding wraps around like the run time does, a shift out of range and
+// the one overflowing division are left to it as well.
+static SCRIPT_CONSTEXPR bool foldBinary(uint8_t op, int32_t a, int32_t b, int32_t *v)
+{
+  switch (op) {
+  case OP_MUL:	*v = intMul(a, b);	break;
+  case OP_DIV:
+  case OP_MOD:
+    if (b == 0)
+      return false;
+    *v = op == OP_DIV ? intDiv(a, b) : intMod(a, b);
+    break;
+  case OP_ADD:	*v = intAdd(a, b);	break;
+  case OP_SUB:	*v = intSub(a, b);	break;
+  case OP_SHL:	*v = intShl(a, b);	break;
+  case OP_SHR:	*v = intShr(a, b);	break;
+  case OP_LT:	*v = a < b;	break;
+  case OP_LE:	*v = a <= b;	break;
+  case OP_GT:	*v = a > b;	break;
+  case OP_GE:	*v = a >= b;	break;
+  case OP_EQ:	*v = a == b;	break;
+  case OP_NE:	*v = a != b;	break;
+  case OP_AND:	*v = a & b;	break;
+  case OP_XOR:	*v = a ^ b;	break;
+  case OP_OR:	*v = a | b;	break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+static SCRIPT_CONSTEXPR uint32_t addCost(uint32_t a, uint32_t b)
+{
+  return a > COST_UNBOUNDED - b ? COST_UNBOUNDED : a + b;
+}
+
+static SCRIPT_CONSTEXPR uint32_t mulCost(uint32_t a, uint32_t b)
+{
+  return b && a > COST_UNBOUNDED / b ? COST_UNBOUNDED : a * b;
+}
+
+// While generating, jumps carry the absolute target as 16 bits (TGET, FORT
+// and FORI before their operand), see emitJump(), and so do the entries of
+// a table.
+static SCRIPT_CONSTEXPR int wideSize(const uint8_t *p)
+{
+  switch (p[0]) {
+  case OP_PUSHB:
+  case OP_LOAD:
+  case OP_STORE:
+  case OP_CALL:
+  case OP_TSET:
+  case OP_PROBE:
+    return 2;
+  case OP_PUSHW:
+  case OP_TCLEAR:
+  case OP_CALLS:
+  case OP_JMP:
+  case OP_LOOP:
+  case OP_JZ:
+  case OP_ANDJ:
+  case OP_ORJ:
+    return 3;
+  case OP_TGET:
+  case OP_FORT:
+  case OP_FORI:
+    return 4;
+  case OP_PUSH:
+    return 5;
+  case OP_JTAB:
+    return JTAB_HEAD + 2 * tableCount(p);
+  case OP_JFIND:
+    return JFIND_HEAD + JFIND_ENTRY * tableCount(p);
+  case OP_INBITS:
+    return 6 + p[5];
+  case OP_INLIST:
+    return 3 + 4 * read16(p + 1);
+  default:
+    return 1;
+  }
+}
+
+static SCRIPT_CONSTEXPR bool isJump(uint8_t op)
+{
+  return op == OP_JMP || op == OP_LOOP || op == OP_JZ || op == OP_ANDJ
+    || op == OP_ORJ || op == OP_TGET || op == OP_FORT || op == OP_FORI;
+}
+
+// Jumps with an operand before the distance
+static SCRIPT_CONSTEXPR bool hasOperand(uint8_t op)
+{
+  return op == OP_TGET || op == OP_FORT || op == OP_FORI;
+}
+
+static SCRIPT_CONSTEXPR bool isBackward(uint8_t op)
+{
+  return op == OP_LOOP || op == OP_FORI;
+}
+
+enum TRACE_KINDS {
+  TRACE_STMT = 0,	// Statement about to be executed
+  TRACE_COND = 1,	// Condition evaluated, value on top of the stack
+  TRACE_VALUE = 2	// Value of a switch evaluated, on top of the stack
+};
+
+// Maps code back to the script, only built when tracing
+struct TracePoint {
+  uint16_t pc;
+  uint16_t pos;
+  uint16_t len;
+  uint8_t  kind;
+};
+
+// Source offset of a handler call, only built when profiling
+struct CallSite {
+  uint16_t pc;
+  uint16_t pos;
+};
+
+enum PROBE_KINDS {
+  PROBE_COND = 0,	// Condition, or operand of && and ||
+  PROBE_CALL = 1	// Handler call, taken counts the results not zero
+};
+
+// A condition or call counted by OP_PROBE, see MyCompiler::addProbes()
+struct ProbeSite {
+  uint16_t pos;
+  uint16_t len;
+  uint8_t  kind;
+  uint32_t count;	// Times reached
+  uint32_t taken;	// Of which true
+};
+
+#define PROBE_MAX	255	// Probes in a script, the others are not counted
+
+// Else branch generated after the end of the code, see useProfile()
+struct ColdBranch {
+  int16_t node;
+  int16_t jump;		// Taken to it when the condition is false
+  uint16_t end;		// Of the if, jumped back to
+  uint8_t depth;	// Of the value stack
+};
+
+enum NODES {
+  N_NUM,	// val
+  N_REAL,	// val: real constant
+  N_VAR,	// val: variable index
+  N_UNARY,	// op, a
+  N_BINARY,	// op, a, b
+  N_AND,	// a, b
+  N_OR,		// a, b
+  N_ASSIGN,	// val: variable index, a
+  N_CALL,	// val: import, op: number of arguments, a: first argument
+  N_STR,	// val: string, only as the first argument of a call
+  N_EXPR,	// a
+  N_BLOCK,	// a: first statement
+  N_IF,		// a: condition, b, c: else or -1
+  N_WHILE,	// a: condition, b
+  N_FOR,	// a: init, b: condition, c: increment, d
+  N_BREAK,
+  N_CONTINUE,
+  N_SWITCH,	// a: value, b: block of statements and labels
+  N_CASE,	// val: constant, a label in the block of a switch
+  N_DEFAULT,
+  N_IN		// a, b: first constant of the set
+};
+
+enum NODE_FLAGS {
+  NODE_PURE = 1,	// N_CALL of a pure handler
+  NODE_LOOP = 2,	// Does not change in the loop it is in
+  NODE_COVERED = 4	// Inside an expression already cached
+};
+
+#define EXPR_IMPURE	(1u << 26)	// Assigns or calls an impure handler
+
+enum TYPES {
+  TYPE_INT = 0,
+  TYPE_REAL
+};
+
+struct Node {
+  uint8_t  kind;
+  uint8_t  op;
+  uint8_t  flags;
+  int8_t   temp;	// Temporary caching the value or -1
+  uint8_t  height;	// Of the subtree, see SCRIPT_HEIGHT
+  uint8_t  type;	// Of the value, see inferTypes()
+  int16_t  a, b, c, d;	// Children
+  int16_t  next;	// Next statement or argument
+  uint16_t pos, len;	// Source span
+  int32_t  val;
+};
+
+class MyCompiler
+{
+  public:
+    MyCompiler();
+    ~MyCompiler();
+
+    // Declares a handler as pure: its result only depends on its arguments
+    // and it has no side effects, so repeated calls may be skipped
+    void addPure(const char *name, int arity);
+    // Counts each condition, operand of && and || and handler call with
+    // OP_PROBE, sites gets them in the order of their number
+    void addProbes(Vector<ProbeSite> *sites);
+    // Lays the code out for the counts of a probed run of the same source
+    void useProfile(const struct ProbeSite *sites, int count);
+    // Leaves repeated expressions uncached, as MyStaticCompiler does: the
+    // image is then the same as the one it builds
+    void noCaching() { caching = false; }
+    // Returns 0 or an error code, see errorPos() for the location
+    int compile(const char *prg, int len, Vector<TracePoint> *trace = NULL,
+		Vector<CallSite> *calls = NULL);
+    // Hands the compiled image over to the caller, who must free() it
+    uint8_t *release(int *len);
+    int errorPos() { return errPos; }
+
+  protected:
+    void next();
+    bool accept(int t);
+    bool expect(int t);
+    int fail(int pos);
+    int tooDeep(int pos);
+
+    int newNode(int kind, int pos);
+    int measure(int n);
+    int parseStatement();
+    int parseIf();
+    int parseBlock(int close);
+    int parseCases();
+    int parseExpr();
+    int parseBinary(int minPrec);
+    int parseUnary();
+    int parsePrimary();
+    int parseCall();
+    int parseSet(int l, int pos);
+    int import(const char *name, int len, int arity, bool *pure);
+    int addString(const char *s, int len);
+
+    uint32_t varsOf(int n);
+    uint32_t killsOf(int n);
+    uint32_t inputsOf(int n, uint32_t *defined);
+    int costOf(int n);
+    bool sameExpr(int x, int y);
+    void collect(int n, uint32_t kills, int16_t *list, int *count);
+    void cover(int n);
+    bool assignedBetween(uint32_t vars, int from, int to);
+    bool holds(int x, int y);
+    bool dominates(int root, int x, int y);
+    void optimize(int root);
+    const struct ProbeSite *siteOf(int n, uint8_t kind);
+    bool mayFail(int n);
+    bool jumpsOut(int n);
+    void reorderChain(int n);
+    void reorder(int n);
+    uint32_t exprCost(int n, uint32_t *calls);
+    uint32_t worstOf(int n, uint32_t *calls);
+    void inferTypes();
+
+    bool grow(uint8_t **buf, int *cap, int need);
+    void emit(uint8_t op);
+    void emit8(uint8_t op, uint8_t v);
+    int emitJump(uint8_t op, int target);
+    void patch(int chain, int target);
+    bool compact();
+    void addTrace(int n, uint8_t kind);
+    void addProbe(int n, uint8_t kind);
+    void push(int n);
+    void genSet(int n);
+    void genValue(int n);
+    void genExpr(int n);
+    void genAs(int n, int type);
+    void genTest(int n);
+    void genStore(int var);
+    void genEffect(int n);
+    int genCond(int n);
+    bool isCounted(int n);
+    void genCounted(int n);
+    void genSwitch(int n);
+    void genStatement(int n);
+
+  private:
+    const char *src;
+    const char *cur;
+    const char *end;
+    int tok;
+    int tokPos;
+    int lastEnd;
+    int tokLen;
+    int32_t tokVal;
+
+    Node *nodes;
+    int nodeCount;
+    int nodeCap;
+    int loopDepth;
+    int switchDepth;
+    int nesting;
+
+    Vector<const char *> pureNames;
+    Vector<int> pureArities;
+    uint32_t reals;		// Variables holding a real
+    int tempCount;
+    uint16_t tempKills[26];	// Temporaries depending on each variable
+
+    uint8_t *code;
+    int codeLen;
+    int codeCap;
+    uint8_t *imports;
+    int importLen;
+    int importCap;
+    int importCount;
+    uint8_t *strings;
+    int stringLen;
+    int stringCap;
+    int stringCount;
+    int depth;
+    int maxDepth;
+    int breakChain;
+    int continueChain;
+    Vector<TracePoint> *trace;
+    Vector<CallSite> *calls;
+    Vector<ProbeSite> *probes;
+    const struct ProbeSite *profile;
+    int profileCount;
+    bool caching;
+    Vector<ColdBranch> cold;
+
+    uint8_t *image;
+    int imageLen;
+    int err;
+    int errPos;
+};
+
+#endif
@@ -0,0 +1,246 @@
+// A SMING-compatible C interpreter
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyExecutor.h"
+#ifdef ARCH_HOST
+
+MyExecutor::MyExecutor(int workers)
+{
+  int i;
+
+  workerCount = workers > 0 ? workers : 1;
+  pool = new Worker[workerCount];
+  for (i=0; i<workerCount; i++) {
+    pool[i].contexts = NULL;
+    pool[i].orderedPending = 0;
+    pool[i].executed = 0;
+    pool[i].stolen = 0;
+  }
+  started = false;
+  stopping = false;
+  next = 0;
+  stealable = 0;
+  outstanding = 0;
+  sleepers = 0;
+}
+
+MyExecutor::~MyExecutor()
+{
+  int i, j;
+
+  stop();
+  for (i=0; i<workerCount; i++) {
+    if (!pool[i].contexts)
+      continue;
+    for (j=0; j<(int)scripts.count(); j++)
+      scripts[j]->removeContext(&pool[i].contexts[j]);
+    delete[] pool[i].contexts;
+  }
+  delete[] pool;
+  for (j=0; j<(int)seeds.count(); j++)
+    free(seeds[j]);
+}
+
+int MyExecutor::addScript(MyInterpreter *interpreter)
+{
+  struct Seed *seed;
+  int i;
+
+  if (started)
+    return -1;
+  seed = (struct Seed *)malloc(sizeof(*seed));
+  if (!seed)
+    return -1;
+  // The raw values, reals keep their fraction
+  memcpy(seed->variables, interpreter->context.variables, sizeof(seed->variables));
+  seed->reals = 0;
+  for (i=0; i<26; i++)
+    if (interpreter->isReal('a' + i))
+      seed->reals |= 1u << i;
+  scripts.add(interpreter);
+  seeds.add(seed);
+  return scripts.count() - 1;
+}
+
+// Must be called from the thread loading the scripts
+bool MyExecutor::start()
+{
+  int i, j;
+
+  if (started)
+    return false;
+  for (i=0; i<workerCount; i++) {
+    pool[i].contexts = new RunContext[scripts.count() ? scripts.count() : 1];
+    for (j=0; j<(int)scripts.count(); j++)
+      scripts[j]->addContext(&pool[i].contexts[j]);
+  }
+  started = true;
+  for (i=0; i<workerCount; i++)
+    pool[i].thread = std::thread(&MyExecutor::work, this, i);
+  return true;
+}
+
+// Waits for the queued jobs, then for the workers to exit
+void MyExecutor::stop()
+{
+  int i;
+
+  if (!started || stopping)
+    return;
+  drain();
+  stopping = true;
+  {
+    std::lock_guard<std::mutex> l(idleLock);
+    idle.notify_all();
+  }
+  for (i=0; i<workerCount; i++)
+    pool[i].thread.join();
+}
+
+bool MyExecutor::submit(const struct ExecutorJob &job)
+{
+  Worker *w;
+
+  if (!started || stopping || job.script < 0 || job.script >= (int)scripts.count()
+      || job.count < 0 || job.count > EXECUTOR_BINDINGS)
+    return false;
+
+  outstanding ++;
+  if (job.key == EXECUTOR_UNORDERED) {
+    w = pool + next++ % workerCount;
+    {
+      std::lock_guard<std::mutex> l(w->lock);
+      w->jobs.push_back(job);
+    }
+    stealable ++;
+  } else {
+    w = pool + (unsigned)job.key % workerCount;
+    {
+      std::lock_guard<std::mutex> l(w->lock);
+      w->ordered.push_back(job);
+    }
+    w->orderedPending ++;
+  }
+
+  // Only the pinned worker can take an ordered job, wake them all
+  if (sleepers > 0) {
+    std::lock_guard<std::mutex> l(idleLock);
+    if (job.key == EXECUTOR_UNORDERED)
+      idle.notify_one();
+    else
+      idle.notify_all();
+  }
+  return true;
+}
+
+// Waits until every submitted job has run
+void MyExecutor::drain()
+{
+  std::unique_lock<std::mutex> l(idleLock);
+  done.wait(l, [this] { return outstanding == 0; });
+}
+
+void MyExecutor::getStats(int worker, struct ExecutorStats *stats)
+{
+  stats->executed = 0;
+  stats->stolen = 0;
+  if (worker < 0 || worker >= workerCount)
+    return;
+  stats->executed = pool[worker].executed;
+  stats->stolen = pool[worker].stolen;
+}
+
+// Own ordered jobs first, then own jobs, then the other workers' jobs
+bool MyExecutor::take(int self, struct ExecutorJob *job, bool *stolen)
+{
+  Worker *w = pool + self;
+  int i;
+
+  *stolen = false;
+  {
+    std::lock_guard<std::mutex> l(w->lock);
+    if (!w->ordered.empty()) {
+      *job = w->ordered.front();
+      w->ordered.pop_front();
+      w->orderedPending --;
+      return true;
+    }
+    if (!w->jobs.empty()) {
+      *job = w->jobs.front();
+      w->jobs.pop_front();
+      stealable --;
+      return true;
+    }
+  }
+
+  for (i=1; i<workerCount && stealable > 0; i++) {
+    w = pool + (self + i) % workerCount;
+    std::lock_guard<std::mutex> l(w->lock);
+    if (!w->jobs.empty()) {
+      *job = w->jobs.front();
+      w->jobs.pop_front();
+      stealable --;
+      *stolen = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+void MyExecutor::execute(Worker *w, const struct ExecutorJob &job)
+{
+  RunContext *ctx = w->contexts + job.script;
+  struct Seed *seed = seeds[job.script];
+  int i, idx;
+
+  memcpy(ctx->variables, seed->variables, sizeof(ctx->variables));
+  for (i=0; i<job.count; i++) {
+    idx = job.names[i] >= 'a' ? job.names[i] - 'a' : job.names[i] - 'A';
+    if (idx >= 0 && idx < 26 && (seed->reals & (1u << idx)))
+      ctx->setVariable(job.names[i], realFromInt(job.values[i]));
+    else
+      ctx->setVariable(job.names[i], job.values[i]);
+  }
+  scripts[job.script]->run(ctx);
+}
+
+void MyExecutor::work(int self)
+{
+  Worker *w = pool + self;
+  struct ExecutorJob job;
+  bool stolen;
+
+  for (;;) {
+    if (take(self, &job, &stolen)) {
+      execute(w, job);
+      w->executed ++;
+      if (stolen)
+	w->stolen ++;
+      if (--outstanding == 0) {
+	std::lock_guard<std::mutex> l(idleLock);
+	done.notify_all();
+      }
+      continue;
+    }
+    if (stopping)
+      return;
+
+    // Announce the sleep before checking for work, see submit()
+    sleepers ++;
+    {
+      std::unique_lock<std::mutex> l(idleLock);
+      idle.wait(l, [this, w] {
+	  return stopping || stealable > 0 || w->orderedPending > 0;
+	});
+    }
+    sleepers --;
+  }
+}
+
+#endif
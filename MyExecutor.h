@@ -0,0 +1,106 @@
+// A SMING-compatible C interpreter
+//
+// Multi-threaded executor for the Linux (host) build.
+//
+// Jobs name a script and a few variable bindings.  They are spread over a
+// pool of worker threads, each worker runs them on its own RunContext
+// while the compiled programs are shared.  Idle workers steal jobs from the
+// busy ones.  Jobs given an order key (e.g. the node id) all go to the same
+// worker and are never stolen, so they run one after the other in the
+// order they were submitted.
+//
+// Handlers are called from the worker threads and must be thread safe.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#ifndef __MYEXECUTOR_H__
+#define __MYEXECUTOR_H__
+#ifdef ARCH_HOST
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "MyInterpreter.h"
+
+#define EXECUTOR_BINDINGS	8	// Variables a job can set
+#define EXECUTOR_UNORDERED	-1
+
+struct ExecutorJob {
+  int script;		// As returned by MyExecutor::addScript()
+  int key;		// Order key or EXECUTOR_UNORDERED
+  int count;		// Number of bindings
+  char names[EXECUTOR_BINDINGS];
+  int values[EXECUTOR_BINDINGS];
+};
+
+struct ExecutorStats {
+  uint32_t executed;
+  uint32_t stolen;	// Executed by another worker than the one queued to
+};
+
+class MyExecutor
+{
+  public:
+    MyExecutor(int workers);
+    ~MyExecutor();
+
+    // Scripts are added before start(), the variables set on the
+    // interpreter at that time are the starting values of every job.  Job
+    // bindings are ints, converted for the variables the script loaded at
+    // that time keeps reals in.
+    int addScript(MyInterpreter *interpreter);
+    bool start();
+    void stop();
+
+    bool submit(const struct ExecutorJob &job);
+    void drain();
+
+    int workers() { return workerCount; }
+    void getStats(int worker, struct ExecutorStats *stats);
+
+  protected:
+    struct Worker {
+      std::thread thread;
+      std::mutex lock;
+      std::deque<struct ExecutorJob> jobs;	// May be stolen
+      std::deque<struct ExecutorJob> ordered;	// Never stolen
+      std::atomic<int> orderedPending;
+      RunContext *contexts;			// One per script
+      std::atomic<uint32_t> executed;
+      std::atomic<uint32_t> stolen;
+    };
+
+    void work(int self);
+    bool take(int self, struct ExecutorJob *job, bool *stolen);
+    void execute(Worker *w, const struct ExecutorJob &job);
+
+  private:
+    struct Seed {
+      int variables[26];			// As kept in a RunContext
+      uint32_t reals;				// Variables the script keeps reals in
+    };
+
+    int workerCount;
+    Worker *pool;
+    Vector<MyInterpreter *> scripts;
+    Vector<struct Seed *> seeds;		// Starting variables per script
+    bool started;
+
+    std::atomic<bool> stopping;
+    std::atomic<unsigned> next;			// Round robin for unordered jobs
+    std::atomic<int> stealable;			// Unordered jobs queued
+    std::atomic<int> outstanding;		// Queued or running
+    std::atomic<int> sleepers;
+    std::mutex idleLock;
+    std::condition_variable idle;
+    std::condition_variable done;
+};
+
+#endif
+#endif
@@ -0,0 +1,226 @@
+// A SMING-compatible C interpreter
+//
+// The queue follows D. Vyukov's bounded queue: each cell carries the
+// position it is free (seq == pos) or full (seq == pos + 1) for.  A cell is
+// held with seq == pos + INGEST_BUSY while the consumer copies it out or a
+// producer coalesces into it, so the two never see half a message.
+//
+// A key points to the latest position claimed for it, set before the
+// message there is published.  A producer only coalesces into that
+// position, checked again while it holds the cell, so a value never lands
+// before a newer message of the same key.
+//
+// Only GCC __atomic builtins are used.  The ESP8266 has no compare and
+// swap instruction: there GCC calls __atomic_compare_exchange_4() and the
+// like, which the SDK must provide (masking interrupts).  This has only
+// been tested on the host build.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyIngestQueue.h"
+
+#define INGEST_BUSY	2
+#define INGEST_BATCH	16
+
+static uint32_t roundPow2(int n, uint32_t min)
+{
+  uint32_t v = min;
+
+  while (v < (uint32_t)n)
+    v <<= 1;
+  return v;
+}
+
+static bool cas(uint32_t *p, uint32_t expected, uint32_t desired)
+{
+  return __atomic_compare_exchange_n(p, &expected, desired, false,
+				     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+MyIngestQueue::MyIngestQueue(int capacity, int keys)
+{
+  uint32_t i, n = roundPow2(capacity, 4);
+
+  window = 0;
+  tail = head = 0;
+  enqueued = coalesced = dropped = drained = 0;
+
+  cells = (struct IngestCell *)malloc(n * sizeof(struct IngestCell));
+  mask = cells ? n - 1 : 0;
+  for (i=0; cells && i<n; i++)
+    cells[i].seq = i;
+
+  keyTable = NULL;
+  keyMask = 0;
+  if (keys > 0) {
+    // Keep the table at most half full
+    n = roundPow2(keys * 2, 8);
+    keyTable = (struct IngestKey *)calloc(n, sizeof(struct IngestKey));
+    keyMask = keyTable ? n - 1 : 0;
+  }
+}
+
+MyIngestQueue::~MyIngestQueue()
+{
+  free(cells);
+  free(keyTable);
+}
+
+// Finds or adds the coalescing entry of a key, NULL when the table is full
+struct IngestKey *MyIngestQueue::findKey(uint32_t key)
+{
+  struct IngestKey *e;
+  uint32_t i, h = key * 2654435761u;
+
+  for (i=0; i<=keyMask; i++) {
+    e = keyTable + ((h + i) & keyMask);
+    if (__atomic_load_n(&e->key, __ATOMIC_ACQUIRE) == key)
+      return e;
+    if (__atomic_load_n(&e->key, __ATOMIC_ACQUIRE) == 0
+	&& (cas(&e->key, 0, key) || __atomic_load_n(&e->key, __ATOMIC_ACQUIRE) == key))
+      return e;
+  }
+  return NULL;
+}
+
+// Makes a key point to a position claimed for it, unless a later one was
+// claimed meanwhile: the closest to the tail is the latest
+void MyIngestQueue::advanceKey(struct IngestKey *k, uint32_t pos, uint32_t now)
+{
+  uint32_t old, t;
+
+  do {
+    old = __atomic_load_n(&k->pos, __ATOMIC_ACQUIRE);
+    t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    if (t - pos > t - old)
+      return;
+  } while (!cas(&k->pos, old, pos));
+  __atomic_store_n(&k->time, now, __ATOMIC_RELEASE);
+}
+
+// Overwrites the message at a position if it is still queued for the key,
+// and still the latest one claimed for it
+bool MyIngestQueue::replace(struct IngestKey *k, uint32_t pos, uint8_t node, uint8_t sensor,
+			    uint8_t type, int value)
+{
+  struct IngestCell *c = cells + (pos & mask);
+
+  if (!cas(&c->seq, pos + 1, pos + INGEST_BUSY))
+    return false;
+  if (c->msg.node != node || c->msg.sensor != sensor
+      || __atomic_load_n(&k->pos, __ATOMIC_ACQUIRE) != pos) {
+    __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+    return false;
+  }
+  c->msg.type = type;
+  c->msg.value = value;
+  __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool MyIngestQueue::push(uint8_t node, uint8_t sensor, uint8_t type, int value)
+{
+  struct IngestKey *k = NULL;
+  struct IngestCell *c;
+  uint32_t pos, seq, now = millis();
+  int32_t diff;
+
+  if (!cells) {
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  if (window && keyTable) {
+    k = findKey(((node << 8) | sensor) + 1);
+    if (k && now - __atomic_load_n(&k->time, __ATOMIC_ACQUIRE) < window
+	&& replace(k, __atomic_load_n(&k->pos, __ATOMIC_ACQUIRE), node, sensor, type, value)) {
+      __atomic_fetch_add(&coalesced, 1, __ATOMIC_RELAXED);
+      return true;
+    }
+  }
+
+  // Claim a position
+  pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+  for (;;) {
+    c = cells + (pos & mask);
+    seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+    diff = (int32_t)(seq - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&tail, &pos, pos + 1, true,
+				      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	break;
+    } else if (diff < 0) {
+      __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+      return false;
+    } else {
+      pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    }
+  }
+
+  // Before publishing: a producer reading the key until then fails to
+  // coalesce into the cell, and one already holding an older cell for
+  // the key sees it is no longer the latest
+  if (k)
+    advanceKey(k, pos, now);
+  c->msg.node = node;
+  c->msg.sensor = sensor;
+  c->msg.type = type;
+  c->msg.value = value;
+  c->msg.time = now;
+  __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+  __atomic_fetch_add(&enqueued, 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+// Stops early at a cell a producer is coalescing into, it comes next time
+int MyIngestQueue::drain(struct IngestMessage *batch, int max)
+{
+  struct IngestCell *c;
+  int n = 0;
+
+  while (cells && n < max) {
+    c = cells + (head & mask);
+    if (!cas(&c->seq, head + 1, head + INGEST_BUSY))
+      break;
+    batch[n++] = c->msg;
+    __atomic_store_n(&c->seq, head + mask + 1, __ATOMIC_RELEASE);
+    head ++;
+  }
+  __atomic_fetch_add(&drained, n, __ATOMIC_RELAXED);
+  return n;
+}
+
+// Runs the script once per message with n, s and v set
+int MyIngestQueue::drain(MyInterpreter *interpreter, int max)
+{
+  struct IngestMessage batch[INGEST_BATCH];
+  int i, n, total = 0;
+
+  while (total < max) {
+    n = drain(batch, max - total < INGEST_BATCH ? max - total : INGEST_BATCH);
+    if (n == 0)
+      break;
+    for (i=0; i<n; i++) {
+      interpreter->setVariable('n', batch[i].node);
+      interpreter->setVariable('s', batch[i].sensor);
+      interpreter->setVariable('v', batch[i].value);
+      interpreter->run();
+    }
+    total += n;
+  }
+  return total;
+}
+
+void MyIngestQueue::getStats(struct IngestStats *stats)
+{
+  stats->depth = __atomic_load_n(&tail, __ATOMIC_RELAXED) - __atomic_load_n(&head, __ATOMIC_RELAXED);
+  stats->enqueued = __atomic_load_n(&enqueued, __ATOMIC_RELAXED);
+  stats->coalesced = __atomic_load_n(&coalesced, __ATOMIC_RELAXED);
+  stats->dropped = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+  stats->drained = __atomic_load_n(&drained, __ATOMIC_RELAXED);
+}
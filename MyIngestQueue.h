@@ -0,0 +1,91 @@
+// A SMING-compatible C interpreter
+//
+// Bounded lock free queue of sensor messages in front of the interpreter.
+//
+// Any number of producers (tasks, interrupt handlers, threads) push
+// messages; a single consumer drains them in batches and runs the script
+// once per message.  With a coalescing window, a message replaces the value
+// of a message still queued for the same (node, sensor) if that one was
+// queued less than the window ago, so bursts of repeated readings cost one
+// run.  Nothing ever blocks: a full queue drops the message and counts it.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#ifndef __MYINGESTQUEUE_H__
+#define __MYINGESTQUEUE_H__
+#include "MyInterpreter.h"
+
+struct IngestMessage {
+  uint8_t  node;
+  uint8_t  sensor;
+  uint8_t  type;
+  int      value;
+  uint32_t time;	// millis() when first queued
+};
+
+struct IngestStats {
+  uint32_t depth;	// Messages waiting
+  uint32_t enqueued;
+  uint32_t coalesced;	// Merged into a queued message
+  uint32_t dropped;	// Queue full
+  uint32_t drained;
+};
+
+struct IngestCell {
+  uint32_t seq;		// Position the cell is free or full for
+  struct IngestMessage msg;
+};
+
+struct IngestKey {
+  uint32_t key;		// (node, sensor) + 1, 0 when free
+  uint32_t pos;		// Latest position queued for the key
+  uint32_t time;
+};
+
+class MyIngestQueue
+{
+  public:
+    // The capacity is rounded up to a power of two, keys is the number of
+    // (node, sensor) pairs that can be coalesced, 0 to never coalesce
+    MyIngestQueue(int capacity, int keys = 0);
+    ~MyIngestQueue();
+
+    void setCoalesceWindow(uint32_t ms) { window = ms; }
+
+    // Producers
+    bool push(uint8_t node, uint8_t sensor, uint8_t type, int value);
+
+    // Single consumer
+    int drain(struct IngestMessage *batch, int max);
+    int drain(MyInterpreter *interpreter, int max);
+
+    void getStats(struct IngestStats *stats);
+
+  protected:
+    struct IngestKey *findKey(uint32_t key);
+    void advanceKey(struct IngestKey *k, uint32_t pos, uint32_t now);
+    bool replace(struct IngestKey *k, uint32_t pos, uint8_t node, uint8_t sensor,
+		 uint8_t type, int value);
+
+  private:
+    struct IngestCell *cells;
+    uint32_t mask;
+    struct IngestKey *keyTable;
+    uint32_t keyMask;
+    uint32_t window;
+
+    uint32_t tail;	// Next position to produce
+    uint32_t head;	// Next position to consume
+
+    uint32_t enqueued;
+    uint32_t coalesced;
+    uint32_t dropped;
+    uint32_t drained;
+};
+
+#endif
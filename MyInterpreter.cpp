@@ -12,1046 +12,2156 @@
 //
 
 #include "MyInterpreter.h"
+#ifdef ARCH_HOST
+#include "MyReplay.h"
+#endif
 
-//////////////////////////////////////////////////////////////////////////////
-// Global variables
-//////////////////////////////////////////////////////////////////////////////
-
-const struct ConstValue constants[] = {
-  {(char *)"LOW", 3, 0},
-  {(char *)"HIGH", 4, 1},
-  {(char *)"false", 5, 0},
-  {(char *)"true", 4, 1},
-};
-
-
-#define CONST_NUM (sizeof(constants)/sizeof(constants[0]))
-#define FUNC2_NUM (sizeof(func2)/sizeof(func2[0]))
-#define FUNC3_NUM (sizeof(func3)/sizeof(func3[0]))
+MyHandlers::MyHandlers()
+{
+  users = NULL;
+  profileOn = false;
+  slowThreshold = 0;
+  slowHead = slowTail = 0;
+  slowLock = false;
+  caches = 0;
+  retired = NULL;
+  epoch = 1;
+  reclaimHeld = false;
+}
 
-MyInterpreter::MyInterpreter()
+MyHandlers::~MyHandlers()
 {
-  runAnimate = 0;
-  runDelay = 0;
-  runStep = 0;
-  reportProgPos = 0;
+  int i;
 
-  scriptBuf[0] = 0;
-  scriptLen = 0;
-};
+  for (i=0; i<(int)func1.count(); i++) {
+    free(func1[i].name);
+    free(func1[i].stats);
+    free(func1[i].cache);
+  }
+  for (i=0; i<(int)func2.count(); i++) {
+    free(func2[i].name);
+    free(func2[i].stats);
+    free(func2[i].cache);
+  }
+  for (i=0; i<(int)func3.count(); i++) {
+    free(func3[i].name);
+    free(func3[i].stats);
+    free(func3[i].cache);
+  }
+  while (retired) {
+    struct HandlerCache *c = retired;
+
+    retired = c->retired;
+    free(c);
+  }
+  for (i=0; i<(int)funcS.count(); i++) {
+    free(funcS[i].name);
+    free(funcS[i].stats);
+  }
+}
 
 #ifdef USE_DELEGATES
-void MyInterpreter::registerFunc1(char *name, func1Delegate func)
+void MyHandlers::registerFunc1(char *name, func1Delegate func, bool pure)
 #else
-void MyInterpreter::registerFunc1(char *name, int (*func)(int))
+void MyHandlers::registerFunc1(char *name, int (*func)(int), bool pure)
 #endif
 {
   struct Function1 f;
-  f.len = strlen(name) + 1; // +1 for '('
+  f.len = strlen(name);
   f.name = (char *)malloc(f.len+1); // +1 for null
   if (!f.name)
   {
     Serial.println("registerFunc1 alloc failed");
     return;
   }
-  memcpy(f.name, name, strlen(name));
-  f.name[f.len-1] = '(';
-  f.name[f.len] = 0;
+  memcpy(f.name, name, f.len+1);
   f.func = func;
-  func1Handlers.add(f);
+  f.pure = pure;
+  f.stats = profileOn ? newStats() : NULL;
+  f.cache = NULL;
+  func1.add(f);
+  rebind();
 }
 
 #ifdef USE_DELEGATES
-void MyInterpreter::registerFunc2(char *name, func2Delegate func)
+void MyHandlers::registerFunc2(char *name, func2Delegate func, bool pure)
 #else
-void MyInterpreter::registerFunc2(char *name, int (*func)(int, int))
+void MyHandlers::registerFunc2(char *name, int (*func)(int, int), bool pure)
 #endif
 {
   struct Function2 f;
-  f.len = strlen(name) + 1; // +1 for '('
+  f.len = strlen(name);
   f.name = (char *)malloc(f.len+1); // +1 for null
   if (!f.name)
   {
-    Serial.println("registerFunc1 alloc failed");
+    Serial.println("registerFunc2 alloc failed");
     return;
   }
-  memcpy(f.name, name, strlen(name));
-  f.name[f.len-1] = '(';
-  f.name[f.len] = 0;
+  memcpy(f.name, name, f.len+1);
   f.func = func;
-  func2Handlers.add(f);
+  f.pure = pure;
+  f.stats = profileOn ? newStats() : NULL;
+  f.cache = NULL;
+  func2.add(f);
+  rebind();
 }
 
 #ifdef USE_DELEGATES
-void MyInterpreter::registerFunc3(char *name, func3Delegate func)
+void MyHandlers::registerFunc3(char *name, func3Delegate func, bool pure)
 #else
-void MyInterpreter::registerFunc3(char *name, int (*func)(int, int, int))
+void MyHandlers::registerFunc3(char *name, int (*func)(int, int, int), bool pure)
 #endif
 {
   struct Function3 f;
-  f.len = strlen(name) + 1; // +1 for '('
+  f.len = strlen(name);
   f.name = (char *)malloc(f.len+1); // +1 for null
   if (!f.name)
   {
-    Serial.println("registerFunc1 alloc failed");
+    Serial.println("registerFunc3 alloc failed");
     return;
   }
-  memcpy(f.name, name, strlen(name));
-  f.name[f.len-1] = '(';
-  f.name[f.len] = 0;
+  memcpy(f.name, name, f.len+1);
   f.func = func;
-  func3Handlers.add(f);
+  f.pure = pure;
+  f.stats = profileOn ? newStats() : NULL;
+  f.cache = NULL;
+  func3.add(f);
+  rebind();
 }
 
-void MyInterpreter::setVariable(char variable, int value)
+#ifdef USE_DELEGATES
+void MyHandlers::registerFuncS(char *name, funcSDelegate func, bool pure)
+#else
+void MyHandlers::registerFuncS(char *name, int (*func)(const char *, int, int), bool pure)
+#endif
 {
-  int idx;
-
-  if (variable >= 'a' && variable <= 'z')
-    idx = variable - 'a';
-  else if (variable >= 'A' && variable <= 'Z')
-    idx = variable - 'A';
-  else
+  struct FunctionS f;
+  f.len = strlen(name);
+  f.name = (char *)malloc(f.len+1); // +1 for null
+  if (!f.name)
+  {
+    Serial.println("registerFuncS alloc failed");
     return;
-
-  variables[idx] = value;
+  }
+  memcpy(f.name, name, f.len+1);
+  f.func = func;
+  f.pure = pure;
+  f.stats = profileOn ? newStats() : NULL;
+  funcS.add(f);
+  rebind();
 }
 
-int MyInterpreter::stepRun()
+// Binds the programs loaded so far to the handler just registered
+void MyHandlers::rebind()
 {
-  return 0;
-}
+  MyInterpreter *i;
 
-void MyInterpreter::printError(int err)
-{
-  switch (err)
-    {
-    case ERROR_DIV0:
-      Serial.println("Divided by 0");
-      break;
-    case ERROR_SYNTAX:
-      Serial.println("Syntax error");
-      break;
-    case STOPPED:
-      Serial.println("Stopped");
-      break;
-    case ERROR_INTERNAL:
-    default:
-      Serial.println("Syntax error");
-      break;
-    }
+  for (i = users; i; i = i->nextUser)
+    if (i->current)
+      i->bindHandlers(i->current);
 }
 
-int MyInterpreter::eval2(char *s, int len, int *val)
+int MyHandlers::find(int arity, const uint8_t *name, int len, bool *pure)
 {
-  int i, l;
-  char *e;
-  int v, varn = -1, err;
-
-  //fwrite(s, 1, len, stderr);
-  //fprintf(stderr, "\n");
-
-  e = s + len;
-  // Skip space
-  while (*s != 0 && s<e && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n'))
-    s ++;
-
-  if (*s == 0 || s == e) {
-    *val = 1;
-    return 0;
-  }
-
-  if (*s == '(') {
-    // ( で始まる場合
-    char *p;
-    int in = 1;
-
-    s ++;
-    while (*s != 0 && s<e && (*s == ' ' || *s == '\t'))
-      s ++;
-    if (*s == 0 || *s == ')')
-      return ERROR_SYNTAX;
-
-    p = s;
-    while (*s != 0 && s<e) {
-      if (*s == '(') {
-	in ++;
-      } else if (*s == ')') {
-	in --;
-	if (in == 0) {
-	  s ++;
-	  break;
-	}
+  int i;
+
+  // String handlers take the string and an optional argument
+  if (arity == (IMPORT_STRING | 1) || arity == (IMPORT_STRING | 2)) {
+    for (i=0; i<(int)funcS.count(); i++)
+      if (funcS[i].len == len && strncmp(funcS[i].name, (const char *)name, len) == 0) {
+	*pure = funcS[i].pure;
+	return i;
       }
-      s ++;
-    }
-    if (in > 0)
-      return ERROR_SYNTAX;
-    if ((err = eval2(p, s-p-1, &v)) != 0)
-      return err;
-  } else if ((*s == '!' && *(s+1) != '=') || *s == '~' || *s == '-' || *s == '+') {
-    // トークンが1項演算子の場合
-    char *p, op;
-    int in = 0;
-    op = *s;
-    s ++;
-    while (*s != 0 && s<e && (*s == ' ' || *s == '\t'))
-      s ++;
-    if (*s == 0 || s == e)
-      return ERROR_SYNTAX;
-    p = s;
-    while (*s != 0 && s<e && (in>0 || (*s != '+' && *s != '-' && *s != '>' && *s != '<' && *s != '='))) {
-      if (*s == '(') {
-	in ++;
-      } else if (*s == ')') {
-	in --;
-      }
-      s ++;
-    }
+    return -1;
+  }
 
-    if (eval2(p, s-p, &v) != 0)
-      return ERROR_SYNTAX;
-    if (op == '!')
-      v = !v;
-    else if (op == '~')
-      v = ~v;
-    else if (op == '-')
-      v = -v;
-  } else if (*s>='0' && *s<='9') {
-    // トークンが数値の場合
-    if (*s == '0' && *(s+1) == 'x') {
-      v = 0;
-      s += 2;
-      while (*s != 0 && s<e && ((*s>='0' && *s<='9') || 
-				(*s>='a' && *s<='f') || (*s>='A' && *s<='F'))) {
-	if (*s>='0' && *s<='9')
-	  v = (v<<4) + (*s - '0');
-	else if (*s>='a' && *s<='f')
-	  v = (v<<4) + (*s - 'a' + 0xa);
-	else if (*s>='A' && *s<='F')
-	  v = (v<<4) + (*s - 'A' + 0xa);
-	s ++;
-      }
-    } else if (*s == '0' && *(s+1) == 'b') {
-      v = 0;
-      s += 2;
-      while (*s != 0 && s<e && (*s>='0' && *s<='1')) {
-	v = (v<<1) + (*s - '0');
-	s ++;
-      }
-    } else {
-      v = 0;
-      while (*s != 0 && s<e && *s>='0' && *s<='9') {
-	v = v*10 + (*s - '0');
-	s ++;
+  switch (arity) {
+  case 1:
+    for (i=0; i<(int)func1.count(); i++)
+      if (func1[i].len == len && strncmp(func1[i].name, (const char *)name, len) == 0) {
+	*pure = func1[i].pure;
+	return i;
       }
-    }
-  } else if (((*s>='a' && *s<='z') || (*s>='A' && *s<='Z')) &&
-	     (!(*(s+1)>='a' && *(s+1)<='z') && !(*(s+1)>='A' && *(s+1)<='Z')))  {
-      // The token is a varibale
-    if (*s>='a' && *s<='z')
-      varn = *s - 'a';
-    else 
-      varn = *s - 'A';
-    v = variables[varn];
-    s ++;
-  } else {
-    // 定数かどうかをチェックする
-    for (i=0; i<CONST_NUM; i++) {
-      const struct ConstValue *c = constants+i;
-      if (e-s>=c->len && strncmp(c->name, s, 3) == 0) {
-	v = c->val;
-	s += c->len;
-	break;
+    break;
+  case 2:
+    for (i=0; i<(int)func2.count(); i++)
+      if (func2[i].len == len && strncmp(func2[i].name, (const char *)name, len) == 0) {
+	*pure = func2[i].pure;
+	return i;
       }
-    }
-    // Check if the token is a supported function
-    // 引数が1つの関数
-    for (i=0; i<func1Handlers.count(); i++) {
-      const struct Function1 *f = &func1Handlers[i];
-      if (e-s>=f->len && strncmp(f->name, s, f->len) == 0) {
-	char *p;
-	int in = 1, v1;
-	s += f->len;
-	p = s;
-	while (*s != 0 && s<e && in>0) {
-	  if (*s == '(') {
-	    in ++;
-	  } else if (*s == ')') {
-	    in --;
-	  }
-	  s ++;
-	}
-	if (in>0)
-	  return ERROR_SYNTAX;
-	if (eval2(p, s-p-1, &v1) != 0)
-	  return ERROR_SYNTAX;
-	
-#ifdef USE_DELEGATES
-	v = f->func(v1);
-#else
-        v = (*f->func)(v1);
-#endif
+    break;
+  case 3:
+    for (i=0; i<(int)func3.count(); i++)
+      if (func3[i].len == len && strncmp(func3[i].name, (const char *)name, len) == 0) {
+	*pure = func3[i].pure;
+	return i;
       }
-    }
+    break;
+  }
+  return -1;
+}
 
-    // 引数が2つの関数
-    for (i=0; i<func2Handlers.count(); i++) {
-      const struct Function2 *f = &func2Handlers[i];
-      if (e-s>=f->len && strncmp(f->name, s, f->len) == 0) {
-	char *p;
-	int in = 0, v1, v2;
-	s += f->len;
-	p = s;
-	while (*s != 0 && s<e && !(in == 0 && *s == ',')) {
-	  if (*s == '(')
-	    in ++;
-	  else if (*s == ')')
-	    in --;
-	  s ++;
-	}
-	if (*s != ',')
-	  return ERROR_SYNTAX;
-	if (eval2(p, s-p, &v1) != 0)
-	  return ERROR_SYNTAX;
-
-	s ++;
-	p = s;
-	in = 1;
-	while (*s != 0 && s<e && in>0) {
-	  if (*s == '(')
-	    in ++;
-	  else if (*s == ')')
-	    in --;
-	  s ++;
-	}
-	if (in>0)
-	  return ERROR_SYNTAX;
-	if (eval2(p, s-p-1, &v2) != 0)
-	  return ERROR_SYNTAX;
+// Vector keeps a pointer per slot and allocates each element on its own
+template <typename T> static uint32_t vectorBytes(const Vector<T> &v)
+{
+  return v.capacity() * sizeof(T *) + v.count() * sizeof(T);
+}
 
-#ifdef USE_DELEGATES
-	v = f->func(v1, v2);
-#else
-        v = (*f->func)(v1, v2);
-#endif
-        break;
-      }
-    }
+static uint32_t cacheBytes(const struct HandlerCache *c)
+{
+  return c ? sizeof(*c) + c->size * sizeof(struct CacheEntry) : 0;
+}
 
-    // 引数が3つの関数
-    for (i=0; i<func3Handlers.count(); i++) {
-      const struct Function3 *f = &func3Handlers[i];
-      if (e-s>=f->len && strncmp(f->name, s, f->len) == 0) {
-	char *p;
-	int in = 0, v1, v2, v3;
-	s += f->len;
-	p = s;
-	while (*s != 0 && s<e && !(in == 0 && *s == ',')) {
-	  if (*s == '(')
-	    in ++;
-	  else if (*s == ')')
-	    in --;
-	  s ++;
-	}
-	if (*s != ',')
-	  return ERROR_SYNTAX;
-	if (eval2(p, s-p, &v1) != 0)
-	  return ERROR_SYNTAX;
-
-	s ++;
-	p = s;
-	in = 0;
-	while (*s != 0 && s<e && !(in == 0 && *s == ',')) {
-	  if (*s == '(')
-	    in ++;
-	  else if (*s == ')')
-	    in --;
-	  s ++;
-	}
-	if (*s != ',')
-	  return ERROR_SYNTAX;
-	if (eval2(p, s-p-1, &v2) != 0)
-	  return ERROR_SYNTAX;
-
-	s ++;
-	p = s;
-	in = 1;
-	while (*s != 0 && s<e && in>0) {
-	  if (*s == '(')
-	    in ++;
-	  else if (*s == ')')
-	    in --;
-	  s ++;
-	}
-	if (in>0)
-	  return ERROR_SYNTAX;
-	if (eval2(p, s-p-1, &v3) != 0)
-	  return ERROR_SYNTAX;
+uint32_t MyHandlers::memoryUsed()
+{
+  struct HandlerCache *c;
+  uint32_t n = sizeof(*this);
+  int i;
+
+  n += vectorBytes(func1) + vectorBytes(func2) + vectorBytes(func3) + vectorBytes(funcS);
+  for (i=0; i<(int)func1.count(); i++)
+    n += func1[i].len + 1 + (func1[i].stats ? sizeof(struct CallStats) : 0) + cacheBytes(func1[i].cache);
+  for (i=0; i<(int)func2.count(); i++)
+    n += func2[i].len + 1 + (func2[i].stats ? sizeof(struct CallStats) : 0) + cacheBytes(func2[i].cache);
+  for (i=0; i<(int)func3.count(); i++)
+    n += func3[i].len + 1 + (func3[i].stats ? sizeof(struct CallStats) : 0) + cacheBytes(func3[i].cache);
+  for (i=0; i<(int)funcS.count(); i++)
+    n += funcS[i].len + 1 + (funcS[i].stats ? sizeof(struct CallStats) : 0);
+  for (c = retired; c; c = c->retired)
+    n += cacheBytes(c);
+  return n;
+}
 
-#ifdef USE_DELEGATES
-	v = f->func(v1, v2, v3);
-#else
-        v = (*f->func)(v1, v2, v3);
-#endif
-        break;
-      }
-    }
+struct CallStats *MyHandlers::newStats()
+{
+  return (struct CallStats *)calloc(1, sizeof(struct CallStats));
+}
+
+// The statistics are kept once allocated, runs may still be using them
+void MyHandlers::setProfiling(bool on)
+{
+  int i;
+
+  if (on) {
+    for (i=0; i<(int)func1.count(); i++)
+      if (!func1[i].stats)
+	func1[i].stats = newStats();
+    for (i=0; i<(int)func2.count(); i++)
+      if (!func2[i].stats)
+	func2[i].stats = newStats();
+    for (i=0; i<(int)func3.count(); i++)
+      if (!func3[i].stats)
+	func3[i].stats = newStats();
+    for (i=0; i<(int)funcS.count(); i++)
+      if (!funcS[i].stats)
+	funcS[i].stats = newStats();
+  }
+  __atomic_store_n(&profileOn, on, __ATOMIC_RELEASE);
+}
+
+struct CallStats *MyHandlers::statsOf(int arity, int handler, const char **name)
+{
+  switch (arity) {
+  case 1:
+    *name = func1[handler].name;
+    return func1[handler].stats;
+  case 2:
+    *name = func2[handler].name;
+    return func2[handler].stats;
+  case 3:
+    *name = func3[handler].name;
+    return func3[handler].stats;
+  default:
+    *name = funcS[handler].name;
+    return funcS[handler].stats;
   }
+}
 
-  // 次のトークンを確かめる
-    {
-      int v2;
+int MyHandlers::handlerCount()
+{
+  return func1.count() + func2.count() + func3.count() + funcS.count();
+}
 
-      // Skip space
-      while (*s != 0 && s<e && (*s == ' ' || *s == '\t'))
-	s ++;
+// Handlers are numbered by number of arguments, string handlers last, then
+// by registration order
+bool MyHandlers::getHandlerStats(int i, struct HandlerStats *stats)
+{
+  const struct CallStats *s;
+  int arity, b;
+
+  if (i < 0 || i >= handlerCount())
+    return false;
+  if (i < (int)func1.count())
+    arity = 1;
+  else if ((i -= func1.count()) < (int)func2.count())
+    arity = 2;
+  else if ((i -= func2.count()) < (int)func3.count())
+    arity = 3;
+  else
+    arity = IMPORT_STRING, i -= func3.count();
+
+  stats->arity = arity;
+  s = statsOf(arity, i, &stats->name);
+  memset(&stats->stats, 0, sizeof(stats->stats));
+  if (s) {
+    stats->stats.calls = __atomic_load_n(&s->calls, __ATOMIC_RELAXED);
+    stats->stats.micros = __atomic_load_n(&s->micros, __ATOMIC_RELAXED);
+    for (b=0; b<PROFILE_BUCKETS; b++)
+      stats->stats.histogram[b] = __atomic_load_n(&s->histogram[b], __ATOMIC_RELAXED);
+  }
+  return true;
+}
 
-      if (*s == 0 || s == e) { // 後ろに演算子はなかった
-	*val = v;
-	return 0;
-      }
+// The log is only locked by slow calls and by readers
+void MyHandlers::logSlowCall(const struct SlowCall &call)
+{
+  while (__atomic_test_and_set(&slowLock, __ATOMIC_ACQUIRE))
+    ;
+  slowLog[slowHead % PROFILE_SLOW_LOG] = call;
+  slowHead ++;
+  __atomic_clear(&slowLock, __ATOMIC_RELEASE);
+}
 
-      if (*s == '=' && *(s+1) != '=') {
-	char *p;
-	int op = *s, in = 0;
-
-	s ++;
-	while (*s != 0 && s<e && (*s == ' ' || *s == '\t'))
-	  s ++;
-	if (*s == 0 || s == e)
-	  return ERROR_SYNTAX;
-
-	p = s;
-	while (*s != 0 && s<e && (in>0 || 
-				  !(*s == '=' && *(s+1) == '='))) {
-	  if (*s == '(') {
-	    in ++;
-	  } else if (*s == ')') {
-	    in --;
-	  }
-	  s ++;
-	}
-	
-	if ((err = eval2(p, s-p, &v2)) != 0)
-	  return err;
+int MyHandlers::getSlowCalls(struct SlowCall *calls, int max)
+{
+  int n = 0;
+
+  while (__atomic_test_and_set(&slowLock, __ATOMIC_ACQUIRE))
+    ;
+  if (slowHead - slowTail > PROFILE_SLOW_LOG)
+    slowTail = slowHead - PROFILE_SLOW_LOG;
+  while (n < max && slowTail != slowHead)
+    calls[n++] = slowLog[slowTail++ % PROFILE_SLOW_LOG];
+  __atomic_clear(&slowLock, __ATOMIC_RELEASE);
+  return n;
+}
 
-	if (varn < 0 || varn>=sizeof(variables))
-	  return ERROR_INTERNAL;
-	v = variables[varn] = v2;
+void MyHandlers::resetStats()
+{
+  int i;
+
+  for (i=0; i<(int)func1.count(); i++)
+    if (func1[i].stats)
+      memset(func1[i].stats, 0, sizeof(struct CallStats));
+  for (i=0; i<(int)func2.count(); i++)
+    if (func2[i].stats)
+      memset(func2[i].stats, 0, sizeof(struct CallStats));
+  for (i=0; i<(int)func3.count(); i++)
+    if (func3[i].stats)
+      memset(func3[i].stats, 0, sizeof(struct CallStats));
+  for (i=0; i<(int)funcS.count(); i++)
+    if (funcS[i].stats)
+      memset(funcS[i].stats, 0, sizeof(struct CallStats));
+  while (__atomic_test_and_set(&slowLock, __ATOMIC_ACQUIRE))
+    ;
+  slowTail = slowHead;
+  __atomic_clear(&slowLock, __ATOMIC_RELEASE);
+}
 
-	if (*s == 0 || s == e) {
-	  *val = v;
-	  return 0;
-	}
-      }
+struct HandlerCache **MyHandlers::cacheSlot(const char *name, int arity)
+{
+  bool pure;
+  int i = find(arity, (const uint8_t *)name, strlen(name), &pure);
+
+  if (i < 0)
+    return NULL;
+  switch (arity) {
+  case 1:
+    return &func1[i].cache;
+  case 2:
+    return &func2[i].cache;
+  case 3:
+    return &func3[i].cache;
+  default:
+    return NULL;
+  }
+}
 
+// A cache is replaced rather than resized, runs may still be using the
+// old one.  It is retired until they are over, see reclaim().
+bool MyHandlers::setCacheable(const char *name, int arity, uint32_t ttl, int entries)
+{
+  struct HandlerCache **slot = cacheSlot(name, arity), *c = NULL, *old;
+
+  if (!slot || entries < 0 || entries > CACHE_ENTRIES)
+    return false;
+  if (entries) {
+    c = (struct HandlerCache *)calloc(1, sizeof(*c) + entries * sizeof(struct CacheEntry));
+    if (!c)
+      return false;
+    c->ttl = ttl;
+    c->size = entries;
+    c->entries = (struct CacheEntry *)(c + 1);
+  }
+  if (c && !*slot)
+    __atomic_add_fetch(&caches, 1, __ATOMIC_RELAXED);
+  else if (!c && *slot)
+    __atomic_sub_fetch(&caches, 1, __ATOMIC_RELAXED);
+  old = *slot;
+  __atomic_store_n(slot, c, __ATOMIC_SEQ_CST);
+  if (old) {
+    old->retiredAt = __atomic_fetch_add(&epoch, 1, __ATOMIC_SEQ_CST);
+    old->retired = retired;
+    retired = old;
+  }
+  reclaim();
+  return true;
+}
 
-      while (*s == '*' || *s == '/' || *s == '%') {
-	char *p;
-	int op = *s, in = 0;
-
-	s ++;
-	while (*s != 0 && s<e && (*s == ' ' || *s == '\t'))
-	  s ++;
-	if (*s == 0 || s == e)
-	  return ERROR_SYNTAX;
-
-	p = s;
-	while (*s != 0 && s<e && (in>0 || 
-			   (*s != '*' && *s != '/' && *s != '%' &&
-			    *s != '+' && *s != '-' && *s != '>' && *s != '<' &&
-			    !(*s == '=' && *(s+1) == '=')  && *s != '!'))) {
-	  if (*s == '(') {
-	    in ++;
-	  } else if (*s == ')') {
-	    in --;
-	  }
-	  s ++;
-	}
-	
-	if ((err = eval2(p, s-p, &v2)) != 0)
-	  return err;
-	switch (op) {
-	case '*':
-	  v = v*v2;
-	  break;
-	case '/':
-	  v = v/v2;
-	  break;
-	case '%':
-	  v = v%v2;
-	  break;
-	}
-	if (*s == 0 || s == e) {
-	  *val = v;
-	  return 0;
-	}
-      }
-	  
-      if (*s == '+' || *s == '-') {
-	char *p;
-	int op = *s, in = 0;
-
-	p = s;
-	while (*s != 0 && s<e && (in>0 || (*s != '>' && *s != '<' && *s != '=' && *s != '!'))) {
-	  if (*s == '(') {
-	    in ++;
-	  } else if (*s == ')') {
-	    in --;
-	  }
-	  s ++;
-	}
-	if (in != 0)
-	  return ERROR_SYNTAX;
-
-	// 演算子の右側を計算する
-	if ((err = eval2(p, s-p, &v2)) != 0)
-	  return err;
-	// 左と右を足す
-	v = v + v2;
-	if (*s == 0 || s==e) {
-	  *val = v;
-	  return 0;
-	}
-      }
+// Frees the replaced caches no run can still be using: a run started in
+// a later epoch found the new cache.  Done from the thread loading the
+// scripts, as are the changes to the contexts.  Held while several threads
+// load, the loader reclaims once they are done.
+void MyHandlers::reclaim()
+{
+  struct HandlerCache **pp = &retired, *c;
+  MyInterpreter *user;
+  RunContext *ctx;
+  uint32_t started;
 
-      if (*s == '>' || *s == '<' || (*s == '=' && *(s+1) == '=')
-	  || (*s == '!' && *(s+1) == '=')) {
-	char *p;
-	int op = *s, op2 = *(s+1), in = 0;
-
-	s ++;
-	if (op2 == '=' || op2 == '<' || op2 == '>')
-	  s ++;
-
-	p = s;
-	while (*s != 0 && s<e && (in>0 || (*s != '&' && *s != '^' && *s != '|'))) {
-	  if (*s == '(') {
-	    in ++;
-	  } else if (*s == ')') {
-	    in --;
-	  }
-	  s ++;
-	}
-	if (in != 0)
-	  return ERROR_SYNTAX;
-
-	// 演算子の右側を計算する
-	if ((err = eval2(p, s-p, &v2)) != 0)
-	  return err;
-
-	if (op == '>') {
-	    if (op2 == '=') {
-	      v = v>=v2;
-	    } else if (op2 == '>') {
-	      v = v>>v2;
-	    } else {
-	      v = v>v2;
-	    }
-	} else if (op == '<') {
-	  if (op2 == '=') {
-	    v = v<=v2;
-	  } else if (op2 == '<') {
-	    v = v<<v2;
-	  } else {
-	    v = v<v2;
-	  }
-	} else if (op == '=' && op2 == '=') {
-	  v = (v == v2);
-	} else if (op == '!' && op2 == '=') {
-	  v = (v != v2);
-	}
-	if (*s == 0 || s==e) {
-	  *val = v;
-	  return 0;
-	}
+  if (reclaimHeld)
+    return;
+  while ((c = *pp) != NULL) {
+    started = 0;
+    for (user = users; user && !started; user = user->nextUser)
+      for (ctx = user->contexts; ctx && !started; ctx = ctx->next) {
+	started = __atomic_load_n(&ctx->epoch, __ATOMIC_SEQ_CST);
+	if (started > c->retiredAt)
+	  started = 0;
       }
+    if (started) {
+      pp = &c->retired;
+    } else {
+      *pp = c->retired;
+      free(c);
+    }
+  }
+}
 
-      if ((*s == '&' && *(s+1) != '&') || (*s == '|' && *(s+1) != '|') ||
-	   *s == '^')  {
-	char *p;
-	int op = *s, in = 0;
-
-	s ++;
-	p = s;
-	while (*s != 0 && s<e && (in>0 || !((*s == '&' && *(s+1) == '&') ||
-					    (*s == '|' && *(s+1) == '|')))) {
-	  if (*s == '(') {
-	    in ++;
-	  } else if (*s == ')') {
-	    in --;
-	  }
-	  s ++;
-	}
-	if (in != 0)
-	  return ERROR_SYNTAX;
-
-	// 演算子の右側を計算する
-	if ((err = eval2(p, s-p, &v2)) != 0)
-	  return err;
-	if (op == '&')
-	  v = v & v2;
-	else if (op == '|')
-	  v = v | v2;
-	else if (op == '^')
-	  v = v ^ v2;
-	if (*s == 0 || s==e) {
-	  *val = v;
-	  return 0;
-	}
-      }
+bool MyHandlers::invalidateCache(const char *name, int arity)
+{
+  struct HandlerCache **slot = cacheSlot(name, arity), *c;
+
+  if (!slot || !(c = *slot))
+    return false;
+  while (__atomic_test_and_set(&c->lock, __ATOMIC_ACQUIRE))
+    ;
+  c->used = c->next = 0;
+  c->generation ++;
+  __atomic_clear(&c->lock, __ATOMIC_RELEASE);
+  return true;
+}
 
-      if ((*s == '&' && *(s+1) == '&') || (*s == '|' && *(s+1) == '|')) {
-	int op = *s;
+bool MyHandlers::getCacheStats(const char *name, int arity, struct CacheStats *stats)
+{
+  struct HandlerCache **slot = cacheSlot(name, arity), *c;
+
+  if (!slot || !(c = *slot))
+    return false;
+  while (__atomic_test_and_set(&c->lock, __ATOMIC_ACQUIRE))
+    ;
+  *stats = c->stats;
+  stats->entries = c->used;
+  __atomic_clear(&c->lock, __ATOMIC_RELEASE);
+  return true;
+}
 
-	s += 2;
-	// 演算子の右側を計算する
-	if ((err = eval2(s, e-s, &v2)) != 0)
-	  return err;
-	if (op == '&')
-	  v = v && v2;
-	else if (op == '|')
-	  v = v || v2;
+struct HandlerCache *MyHandlers::cacheOf(const struct Binding *b)
+{
+  switch (b->arity) {
+  case 1:
+    return __atomic_load_n(&func1[b->handler].cache, __ATOMIC_ACQUIRE);
+  case 2:
+    return __atomic_load_n(&func2[b->handler].cache, __ATOMIC_ACQUIRE);
+  case 3:
+    return __atomic_load_n(&func3[b->handler].cache, __ATOMIC_ACQUIRE);
+  default:
+    return NULL;
+  }
+}
 
-	*val = v;
-	return 0;
+// A cache is locked by the calls of its handler only.  A miss tells the
+// generation to store the result in.
+bool MyHandlers::cacheLookup(struct HandlerCache *c, const int *args, int argc, int *result,
+			     uint32_t *generation)
+{
+  uint32_t now = millis();
+  bool hit = false;
+  int i;
+
+  while (__atomic_test_and_set(&c->lock, __ATOMIC_ACQUIRE))
+    ;
+  for (i=0; i<c->used; i++)
+    if (memcmp(c->entries[i].args, args, argc * sizeof(int)) == 0) {
+      if (!c->ttl || now - c->entries[i].time < c->ttl) {
+	*result = c->entries[i].result;
+	hit = true;
       }
-
+      break;
     }
-error:
-  return ERROR_INTERNAL;
+  if (hit)
+    c->stats.hits ++;
+  else
+    c->stats.misses ++;
+  *generation = c->generation;
+  __atomic_clear(&c->lock, __ATOMIC_RELEASE);
+  return hit;
 }
 
-char *MyInterpreter::skipSpace(char *s, char *e)
+// The result replaces that of the same arguments, or once the cache is
+// full the oldest one stored.  It is dropped if the cache was invalidated
+// during the call, it may predate the change.
+void MyHandlers::cacheStore(struct HandlerCache *c, const int *args, int argc, int result,
+			    uint32_t generation)
 {
-  while (*s != 0 && s<e && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n'))
-    s ++;
-  return s;
+  uint32_t now = millis();
+  struct CacheEntry *e = NULL;
+  int i;
+
+  while (__atomic_test_and_set(&c->lock, __ATOMIC_ACQUIRE))
+    ;
+  if (c->generation != generation) {
+    __atomic_clear(&c->lock, __ATOMIC_RELEASE);
+    return;
+  }
+  for (i=0; i<c->used && !e; i++)
+    if (memcmp(c->entries[i].args, args, argc * sizeof(int)) == 0)
+      e = c->entries + i;
+  if (!e && c->used < c->size)
+    e = c->entries + c->used++;
+  if (!e) {
+    e = c->entries + c->next;
+    c->next = (c->next + 1) % c->size;
+  }
+  memcpy(e->args, args, argc * sizeof(int));
+  e->result = result;
+  e->time = now;
+  __atomic_clear(&c->lock, __ATOMIC_RELEASE);
 }
 
-int MyInterpreter::run(char *prg, int len)
+MyInterpreter::MyInterpreter(MyHandlers *shared)
 {
-  char *cur, *s, *e;
-  int err, in, v, skip;
-
-  s = prg;
-  e = prg + len;
+  runAnimate = 0;
+  runDelay = 0;
+  runStep = 0;
+  reportProgPos = 0;
 
-  for (;;) {
-    char *p, *start;
-    start = s = skipSpace(s, e);
-    if (*s == 0 || s>=e)
-      break;
-
-    WDT.alive();
-
-    skip = 0;
-    // fprintf(stderr, s);
-
-    if ((strncmp(s, "continue", 8) == 0
-	 && (*(s+8) == ';' ||
-	     *(s+8) == ' ' || *(s+8) == '\t' || 
-	     *(s+8) == '\r' || *(s+8) == '\n')) ||
-	(strncmp(s, "break", 5) == 0
-	 && (*(s+5) == ';' ||
-	     *(s+5) == ' ' || *(s+5) == '\t' || 
-	     *(s+5) == '\r' || *(s+5) == '\n'))) {
-      char *cond, *cond_e, *p1, *statement, *statement_e;
-      char *statement2 = NULL, *statement2_e;
-      int continue_break = 0;
-
-      p1 = s;
-      if (strncmp(s, "continue",8) == 0) {
-	continue_break = 1;
-	s += 8;
-      } else {
-	s += 5;
-      }
-      s = skipSpace(s, e);
-      if (*s != ';') {
-	writeS(p1, 20);
-	return ERROR_SYNTAX;
-      }
-      s ++;
-
-      if (continue_break == 0)
-	return FOUND_BREAK;
-      return FOUND_CONTINUE;
-    } else if ((strncmp(s, "while", 5) == 0
-	 && (*(s+5) == '(' ||
-	     *(s+5) == ' ' || *(s+5) == '\t' || 
-	     *(s+5) == '\r' || *(s+5) == '\n')) ||
-	(strncmp(s, "if", 2) == 0
-	 && (*(s+2) == '(' ||
-	     *(s+2) == ' ' || *(s+2) == '\t' || 
-	     *(s+2) == '\r' || *(s+2) == '\n'))) {
-      char *cond, *cond_e, *p1, *statement, *statement_e;
-      char *statement2 = NULL, *statement2_e;
-      int while_if = 0;
-      if (strncmp(s, "while", 5) == 0) {
-	while_if = 1;
-	s += 5;
-      } else
-	s += 2;
-      p1 = s;
-      s = skipSpace(s, e);
-      if (*s != '(') {
-	writeS(p1, 20);
-	return ERROR_SYNTAX;
-      }
-      s ++;
-      cond = s;
-      in = 1;
-      while (*s !=0 && s<e && (in>0 || *s != ')')) {
-	if (*s == '(')
-	  in ++;
-	if (*s == ')') {
-	  in --;
-	  if (in == 0)
-	    break;
-	}
-	s ++;
-      }
-      if (*s != ')') {
-	writeS(p1, s-p1);
-	return ERROR_SYNTAX;
-      }
-      cond_e = s;
-      s ++;
-      s = skipSpace(s, e);
-      if (*s == 0 || s>=e) {
-	writeS(p1, s-p1);
-	return ERROR_SYNTAX;
-      }
+  ownHandlers = shared == NULL;
+  handlers = shared ? shared : new MyHandlers;
+  nextUser = handlers->users;
+  handlers->users = this;
+  current = NULL;
+  retired = NULL;
+  loads = 0;
+  loadError = loadErrorPos = 0;
+  budgetOps = budgetCalls = 0;
+  budgetPolicy = BUDGET_REJECT;
+  adaptiveRuns = 0;
+  memset(&runStats, 0, sizeof(runStats));
+  contexts = &context;
+#ifdef ARCH_HOST
+  recorder = NULL;
+  recordId = 0;
+#endif
+};
 
-      statement = s;
-      in = 0;
-      while (*s !=0 && s<e && (in>0 || (*s != '}' && *s != ';'))) {
-	if (*s == '{')
-	  in ++;
-	else if (*s == '}') {
-	  in --;
-	  if (in == 0)
-	    break;
-	}
-	s ++;
-      }
-      if (*s == 0 || s>=e || (*s != ';' && *s != '}') || in > 0) {
-	writeS(p1, s-p1);
-	return ERROR_SYNTAX;
-      }
-      s ++;
-      statement_e = s;
-      // 必要なら else 部分を取り出す
-      s = skipSpace(s, e);
-      // fprintf(stderr, "*1 %s\n", s);
-      if (while_if == 0 && strncmp(s, "else", 4) == 0
-	  && (*(s+4) == '{' ||
-	      *(s+4) == ' ' || *(s+4) == '\t' || 
-	      *(s+4) == '\r' || *(s+4) == '\n')) {
-	s += 4;
-	s = skipSpace(s, e);
-	if (*s == 0 || s>=e) {
-	  writeS(p1, s-p1);
-	  return ERROR_SYNTAX;
-	}
-	//fprintf(stderr, "*2 %s\n", s);
-	statement2 = s;
-	in = 0;
-	while (*s !=0 && s<e && (in>0 || (*s != '}' && *s != ';'))) {
-	  if (*s == '{')
-	    in ++;
-	  else if (*s == '}') {
-	    in --;
-	    if (in == 0)
-	      break;
-	  }
-	  s ++;
-	}
-	if (*s == 0 || s>=e || (*s != ';' && *s != '}') || in > 0) {
-	  writeS(p1, s-p1);
-	  return ERROR_SYNTAX;
-	}
-	statement2_e = s;
-      }
+MyInterpreter::~MyInterpreter()
+{
+  MyInterpreter **pp;
 
-      if (while_if>0) {
-	// while 文の処理
-	if (!reportProgPos && (runAnimate || runStep)) {
-	  Serial.print("while (");
-	  writeS(cond, cond_e-cond);
-	  Serial.print(")\n");
-	}
-	if (!reportProgPos && (err = stepRun()) != 0)
-	  return err;
-	for (;;) {
-	  err = eval2(cond, cond_e-cond, &v);
-	  if (err)
-	    return err;
-	  if (!reportProgPos && (runAnimate || runStep)) {
-	    writeS(cond, cond_e-cond);
-	    Serial.print(": ");
-	    Serial.print(v ? "true" : "false");
-	    Serial.println("");
-	  }
-	  //fwrite(cond, 1, cond_e-cond, stderr);
-	  //fprintf(stderr, ": %d\n", v);
-	  if (v == 0)
-	    break;
-	  if (!reportProgPos && (runAnimate || runStep)) {
-	    if (err = stepRun() != 0)
-	      return err;
-	  }
-	  err = run(statement, statement_e-statement);
-	  if (err == FOUND_CONTINUE)
-	    continue;
-	  else if (err == FOUND_BREAK)
-	    break;
-	  else if (err)
-	    return err;
-	}
-      } else {
-	// if 文の処理
-	if (!reportProgPos && (runAnimate || runStep)) {
-	  Serial.print("if (");
-	  writeS(cond, cond_e-cond);
-	  Serial.print(")");
-	}
-	err = eval2(cond, cond_e-cond, &v);
-	if (err) {
-	  if (!reportProgPos && (runAnimate || runStep))
-	    Serial.println("");
-	  return err;
-	}
-	if (!reportProgPos && (runAnimate || runStep)) {
-	  Serial.print(": ");
-	  Serial.print(v ? "true" : "false");
-	  Serial.println("");
-	}
-	//fwrite(cond, 1, cond_e-cond, stderr);
-	//fprintf(stderr, ": %d\n", v);
-	if (v != 0) {
-	  err = run(statement, statement_e-statement);
-	  if (err)
-	    return err;
-	} else {
-	  if (statement2 != NULL) {
-	    err = run(statement2, statement2_e-statement2);
-	    if (err)
-	      return err;
-	  }
-	}
-      }
-    } else if ((strncmp(s, "for", 3) == 0
-	 && (*(s+3) == '(' ||
-	     *(s+3) == ' ' || *(s+3) == '\t' || 
-	     *(s+3) == '\r' || *(s+3) == '\n'))) {
-      char *init, *init_e;
-      char *cond, *cond_e, *inc, *inc_e;
-      char *statement, *statement_e, *p1;
-      p1 = s;
-      s += 3;
-      s = skipSpace(s, e);
-      if (*s != '(') {
-	writeS(p1, 20);
-	return ERROR_SYNTAX;
-      }
-      s ++;
-      s = skipSpace(s, e);
-      init = s;
-      while (*s !=0 && s<e && *s != ';')
-	s ++;
-      if (*s == 0 || s>=e) {
-	writeS(p1, 20);
-	return ERROR_SYNTAX;
-      }
-      init_e = s;
-      s ++;
-      s = skipSpace(s, e);
-      cond = s;
-      while (*s !=0 && s<e && *s != ';')
-	s ++;
-      if (*s == 0 || s>=e) {
-	writeS(p1, s-p1);
-	return ERROR_SYNTAX;
-      }
-      cond_e = s;
-      s ++;
-      inc = s = skipSpace(s, e);
-      in = 1;
-      while (*s !=0 && s<e && (in>0 || *s != ')')) {
-	if (*s == '(')
-	  in ++;
-	else if (*s == ')') {
-	  in --;
-	  if (in == 0)
-	    break;
-	}
-	s ++;
-      }
-      if (*s == 0 || s>=e) {
-	writeS(p1, s-p1);
-	return ERROR_SYNTAX;
-      }
-      inc_e = s;
-      s ++;
-      s = skipSpace(s, e);
-      statement = s;
-      in = 0;
-      while (*s !=0 && s<e && (in>0 || (*s != '}' && *s != ';'))) {
-	if (*s == '{')
-	  in ++;
-	else if (*s == '}') {
-	  in --;
-	  if (in == 0)
-	    break;
-	}
-	s ++;
-      }
-      if (*s == 0 || s>=e || (*s != ';' && *s != '}') || in > 0) {
-	writeS(p1, s-p1);
-	return ERROR_SYNTAX;
-      }
-      s ++;
-      statement_e = s;
-
-      // for 文の処理
-      if (runAnimate || runStep) {
-	Serial.print("for (");
-	writeS(init, init_e-init);
-	Serial.print("; ");
-	writeS(cond, cond_e-cond);
-	Serial.print("; ");
-	writeS(inc, inc_e-inc);
-	Serial.print(")\n");
-      }
-      if (!reportProgPos && (runAnimate || runStep)) {
-	if ((err = stepRun()) != 0)
-	  return err;
-	writeS(init, init_e-init);
-	Serial.println("");
-      }
-      if ((err = eval2(init, init_e-init, &v)) != 0) {
-	return err;
-      }
-      if (!reportProgPos && (runAnimate || runStep))
-	if(err = stepRun() != 0)
-	  return err;
-      for (;;) {
-	if ((err = eval2(cond, cond_e-cond, &v)) != 0) 
-	  return err;
-	if (!reportProgPos && (runAnimate || runStep)) {
-	  writeS(cond, cond_e-cond);
-	  Serial.print(": ");
-	  Serial.print(v ? "true" : "false");
-	  Serial.println("");
-	}
-	if (v == 0)
-	  break;
-	//fwrite(statement, 1, statement_e-statement, stderr);
-	if ((err = run(statement, statement_e-statement)) != 0) {
-	  if (err == FOUND_CONTINUE)
-	    ; /* DO_NOTHING */
-	  else if (err == FOUND_BREAK)
-	    break;
-	  else return err;
-	}
-	if (!reportProgPos && (runAnimate || runStep)) {
-	  writeS(inc, inc_e-inc);
-	  Serial.println("");
-	}
-	if ((err = eval2(inc, inc_e-inc, &v)) != 0)
-	  return err;
-	if (runAnimate || runStep) {
-	  if ((err = stepRun()) != 0)
-	    return err;
-	}
-      }
-    } else if (*s == '{' || *s == '}') {
-      s ++;
-      skip = 1;
-    } else { // 式文の処理
-      p = s;
-      in = 0;
-      while (*s != 0 && s<e && (in>0 || *s != ';'))
-	s ++;
-      if (*s == 0 && in>0) {
-	writeS(p, s-p);
-	return ERROR_SYNTAX;
-      }
-      if (s != p) {
-	if (!reportProgPos && (runAnimate != 0 || runStep)) {
-	  writeS(p, s-p);
-	  Serial.println("");
-	}
-	if ((err = eval2(p, s-p, &v)) != 0) {
-	  writeS(p, s-p);
-	  Serial.println("");
-	  return err;
-	}
-      } else
-	skip = 1;
-      s ++;
-#if 0
-      printf("%d\n", v);
+#ifdef ARCH_HOST
+  if (recorder)
+    recorder->removeScript(recordId);
 #endif
-      if (skip == 0) {
-	if ((err = stepRun()) != 0)
-	  return err;
-      }
+  freeProgram(current);
+  current = NULL;
+  contexts = NULL;
+  reclaim();
+  for (pp = &handlers->users; *pp; pp = &(*pp)->nextUser) {
+    if (*pp == this) {
+      *pp = nextUser;
+      break;
     }
   }
-  return 0;
+  if (ownHandlers)
+    delete handlers;
 }
 
-void MyInterpreter::writeS(const char *s, int len)
+#ifdef USE_DELEGATES
+void MyInterpreter::registerFunc1(char *name, func1Delegate func, bool pure)
+#else
+void MyInterpreter::registerFunc1(char *name, int (*func)(int), bool pure)
+#endif
 {
-  Serial.print(s);
+  handlers->registerFunc1(name, func, pure);
 }
 
-bool MyInterpreter::load(char *prg, int len)
+#ifdef USE_DELEGATES
+void MyInterpreter::registerFunc2(char *name, func2Delegate func, bool pure)
+#else
+void MyInterpreter::registerFunc2(char *name, int (*func)(int, int), bool pure)
+#endif
 {
-    if (len > sizeof(scriptBuf) - 1)
-    {
-        debugf("Scripts exceeds max length of %d bytes", sizeof(scriptBuf) - 1);
-        return false;
-    }
-
-    scriptLen = len;
-    memcpy(scriptBuf, prg, len);
-    scriptBuf[scriptLen] = 0;
+  handlers->registerFunc2(name, func, pure);
+}
 
-    return true;
+#ifdef USE_DELEGATES
+void MyInterpreter::registerFunc3(char *name, func3Delegate func, bool pure)
+#else
+void MyInterpreter::registerFunc3(char *name, int (*func)(int, int, int), bool pure)
+#endif
+{
+  handlers->registerFunc3(name, func, pure);
 }
 
-#ifndef DISABLE_SPIFFS
-bool MyInterpreter::loadFile(char *fileName)
+#ifdef USE_DELEGATES
+void MyInterpreter::registerFuncS(char *name, funcSDelegate func, bool pure)
+#else
+void MyInterpreter::registerFuncS(char *name, int (*func)(const char *, int, int), bool pure)
+#endif
 {
+  handlers->registerFuncS(name, func, pure);
+}
+
+// Reals are converted to and from ints, as the loaded script types them
+void MyInterpreter::setVariable(char variable, int value)
+{
+  store(variable, isReal(variable) ? realFromInt(value) : value);
+}
+
+int MyInterpreter::getVariable(char variable)
+{
+  int value = context.getVariable(variable);
+
+  return isReal(variable) ? realToInt(value) : value;
+}
+
+void MyInterpreter::setVariableReal(char variable, double value)
+{
+  store(variable, isReal(variable) ? realFrom(value) : (int)value);
+}
+
+double MyInterpreter::getVariableReal(char variable)
+{
+  int value = context.getVariable(variable);
+
+  return isReal(variable) ? realValue(value) : value;
+}
+
+void MyInterpreter::store(char variable, int value)
+{
+  context.setVariable(variable, value);
+#ifdef ARCH_HOST
+  if (recorder)
+    recorder->bind(recordId, variable, value);
+#endif
+}
+
+// Tells if the loaded script keeps a real in a variable
+bool MyInterpreter::isReal(char variable)
+{
+  struct LoadedProgram *prog = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+  int idx = variable >= 'a' ? variable - 'a' : variable - 'A';
+
+  return prog && idx >= 0 && idx < 26
+    && (((const struct ProgramHeader *)prog->image)->reals & (1u << idx));
+}
+
+RunContext::RunContext()
+{
+  memset(variables, 0, sizeof(variables));
+  ops = 0;
+  calls = 0;
+  changed = 0;
+  serial = 0;
+  nesting = 0;
+  epoch = 0;
+  active = NULL;
+  next = NULL;
+}
+
+void RunContext::setVariable(char variable, int value)
+{
+  int idx;
+
+  if (variable >= 'a' && variable <= 'z')
+    idx = variable - 'a';
+  else if (variable >= 'A' && variable <= 'Z')
+    idx = variable - 'A';
+  else
+    return;
+
+  if (variables[idx] != value)
+    changed |= 1u << idx;
+  variables[idx] = value;
+}
+
+int RunContext::getVariable(char variable)
+{
+  if (variable >= 'a' && variable <= 'z')
+    return variables[variable - 'a'];
+  else if (variable >= 'A' && variable <= 'Z')
+    return variables[variable - 'A'];
+  return 0;
+}
+
+int MyInterpreter::stepRun()
+{
+  return 0;
+}
+
+void MyInterpreter::printError(int err)
+{
+  switch (err)
+    {
+    case ERROR_DIV0:
+      Serial.println("Divided by 0");
+      break;
+    case ERROR_SYNTAX:
+      Serial.println("Syntax error");
+      break;
+    case STOPPED:
+      Serial.println("Stopped");
+      break;
+    case ERROR_UNBOUND:
+      Serial.println("Unknown function");
+      break;
+    case ERROR_PROGRAM:
+      Serial.println("Invalid program");
+      break;
+    case ERROR_MEMORY:
+      Serial.println("Out of memory");
+      break;
+    case ERROR_TOO_BIG:
+      Serial.println("Script too big");
+      break;
+    case ERROR_DEPTH:
+      Serial.println("Nested too deep");
+      break;
+    case ERROR_FILE:
+      Serial.println("Cannot read file");
+      break;
+    case ERROR_BUDGET:
+      Serial.println("Over budget");
+      break;
+    case ERROR_INTERNAL:
+    default:
+      Serial.println("Syntax error");
+      break;
+    }
+}
+
+// Resolves the imports of the program to the registered handlers by name.
+// Handlers must not be registered while runs are in progress.  Returns
+// ERROR_UNBOUND when handlers are missing, ERROR_PROGRAM when the program
+// was optimized for a handler that is no longer registered as pure.
+int MyInterpreter::bindHandlers(struct LoadedProgram *prog)
+{
+  const struct ProgramHeader *hdr = (const struct ProgramHeader *)prog->image;
+  const uint8_t *p = prog->image + sizeof(*hdr) + hdr->codeLen;
+  struct Binding *b = prog->bindings;
+  int i, h, err = 0;
+  bool pure;
+
+  for (i=0; i<hdr->importCount; i++) {
+    b[i].arity = p[0] & ~IMPORT_PURE;
+    h = handlers->find(b[i].arity, p+2, p[1], &pure);
+    if (h >= 0 && (p[0] & IMPORT_PURE) && !pure) {
+      debugf("Handler %.*s is not pure any more", p[1], p+2);
+      err = ERROR_PROGRAM;
+      h = -1;
+    }
+    b[i].handler = h >= 0 && h < PROGRAM_UNBOUND ? h : PROGRAM_UNBOUND;
+    if (b[i].handler == PROGRAM_UNBOUND && !err) {
+      if (b[i].arity & IMPORT_STRING)
+	debugf("String handler %.*s is not registered", p[1], p+2);
+      else
+	debugf("Handler %.*s with %d arguments is not registered", p[1], p+2, b[i].arity);
+      err = ERROR_UNBOUND;
+    }
+    p += 2 + p[1];
+  }
+  return err;
+}
+
+// Target of a jump other than a table
+static int jumpTarget(const uint8_t *code, int pc)
+{
+  const uint8_t *p = code + pc + 1 + (code[pc] == OP_TGET || code[pc] == OP_FORT || code[pc] == OP_FORI);
+  int d = readDist(&p);
+
+  return code[pc] == OP_LOOP || code[pc] == OP_FORI ? (p - code) - d : (p - code) + d;
+}
+
+// Records the depth an instruction is first reached with, to be followed
+// once; any other path must reach it with the same
+static bool reach(int16_t *depth, uint16_t *work, int *n, int pc, int d)
+{
+  if (depth[pc] < 0) {
+    depth[pc] = d;
+    work[(*n)++] = pc;
+  }
+  return depth[pc] == d;
+}
+
+// Follows the value stack through the code of a program whose jumps were
+// checked: each instruction must find the values it takes, stay within
+// maxStack and be reached with the same depth on every path.  A handler
+// call takes the arguments of its import, which must match the call.
+static bool checkStack(const uint8_t *code, const struct ProgramHeader *hdr)
+{
+  const uint8_t *p = code + hdr->codeLen;
+  int16_t *depth;		// Of each instruction reached, -1 until then
+  uint16_t *work;		// Instructions reached but not followed yet
+  uint8_t *arity;
+  int pc, d, take, next, jump, target, i, n = 0;
+  bool ok = false;
+
+  depth = (int16_t *)malloc((sizeof(int16_t) + sizeof(uint16_t)) * hdr->codeLen + hdr->importCount);
+  if (!depth)
+    return false;
+  work = (uint16_t *)(depth + hdr->codeLen);
+  arity = (uint8_t *)(work + hdr->codeLen);
+  for (i=0; i<hdr->importCount; i++) {
+    arity[i] = p[0] & ~IMPORT_PURE;
+    p += 2 + p[1];
+  }
+  for (pc=0; pc<hdr->codeLen; pc++)
+    depth[pc] = -1;
+
+  depth[0] = 0;
+  work[n++] = 0;
+  while (n > 0) {
+    pc = work[--n];
+    d = depth[pc];
+    take = 0;
+    next = d;		// After the instruction, -1 if it does not go on
+    jump = -1;		// At the jump target, -1 if none
+    switch (code[pc]) {
+    case OP_HALT:
+      next = -1;
+      break;
+    case OP_PUSHB:
+    case OP_PUSH:
+    case OP_PUSHW:
+    case OP_LOAD:
+      next = d + 1;
+      break;
+    case OP_STORE:
+    case OP_POP:
+      take = 1;
+      next = d - 1;
+      break;
+    case OP_DUP:
+      take = 1;
+      next = d + 1;
+      break;
+    case OP_NEG:
+    case OP_NOT:
+    case OP_BNOT:
+    case OP_BOOL:
+    case OP_ITOR:
+    case OP_RTOI:
+    case OP_RNZ:
+    case OP_RNEG:
+    case OP_TSET:
+    case OP_INBITS:
+    case OP_INLIST:
+    case OP_PROBE:
+      take = 1;
+      break;
+    case OP_JMP:
+    case OP_LOOP:
+      jump = d;
+      next = -1;
+      break;
+    case OP_JZ:
+      take = 1;
+      next = jump = d - 1;
+      break;
+    case OP_ANDJ:
+    case OP_ORJ:
+      take = 1;
+      next = d - 1;
+      jump = d;
+      break;
+    case OP_TGET:
+      jump = d + 1;
+      break;
+    case OP_FORT:
+    case OP_FORI:
+      take = 1;
+      jump = d;
+      break;
+    case OP_JTAB:
+    case OP_JFIND:
+      take = 1;
+      next = -1;
+      break;
+    case OP_CALL:
+      if (arity[code[pc+1]] & IMPORT_STRING)
+	goto done;
+      take = arity[code[pc+1]];
+      next = d - take + 1;
+      break;
+    case OP_CALLS:
+      if (!(arity[code[pc+1]] & IMPORT_STRING))
+	goto done;
+      take = (arity[code[pc+1]] & ~IMPORT_STRING) - 1;
+      next = d - take + 1;
+      break;
+    case OP_TCLEAR:
+      break;
+    default:
+      // Binary operators
+      take = 2;
+      next = d - 1;
+      break;
+    }
+    if (d < take || next > hdr->maxStack || jump > hdr->maxStack)
+      goto done;
+
+    if ((next >= 0 && !reach(depth, work, &n, pc + opSize(code + pc), next))
+	|| (jump >= 0 && !reach(depth, work, &n, jumpTarget(code, pc), jump)))
+      goto done;
+    if (code[pc] == OP_JTAB || code[pc] == OP_JFIND)
+      for (i = -1; i < tableCount(code + pc); i ++) {
+	target = pc + opSize(code + pc) + read16(code + pc + tableEntry(code + pc, i));
+	if (!reach(depth, work, &n, target, d - 1))
+	  goto done;
+      }
+  }
+  ok = true;
+
+done:
+  free(depth);
+  return ok;
+}
+
+// Takes ownership of a program image after checking it, unless it is used
+// in place.  Only a program just compiled has probes.
+struct LoadedProgram *MyInterpreter::newProgram(const uint8_t *image, int len, bool rom,
+						int probes)
+{
+  const struct ProgramHeader *hdr = (const struct ProgramHeader *)image;
+  const uint8_t *code, *p, *e;
+  struct LoadedProgram *prog;
+  uint8_t *starts = NULL;	// Bitmap of the instruction starts
+  int pc, d, i, target;
+
+  if (len < (int)sizeof(*hdr) || hdr->magic != PROGRAM_MAGIC
+      || hdr->version != PROGRAM_VERSION || hdr->realFormat != PROGRAM_REAL
+      || len != (int)sizeof(*hdr) + hdr->codeLen + hdr->importLen + hdr->stringLen
+      || hdr->checksum != hash32(image + sizeof(*hdr), len - sizeof(*hdr)))
+    goto error;
+
+  // Make sure the code cannot run off the image or the stacks
+  code = image + sizeof(*hdr);
+  if (hdr->maxStack > PROGRAM_STACK || hdr->temps > PROGRAM_TEMPS
+      || hdr->codeLen == 0 || hdr->codeLen > PROGRAM_DIST
+      || code[hdr->codeLen-1] != OP_HALT)
+    goto error;
+  starts = (uint8_t *)calloc((hdr->codeLen + 7) / 8, 1);
+  if (!starts)
+    goto error;
+  for (pc = 0; pc < hdr->codeLen; pc += opSize(code + pc)) {
+    // The code ends with OP_HALT, only the operand of TGET, FORT or FORI
+    // and the head of a table or a set can be read past it
+    if (code[pc] >= OP_COUNT
+	|| ((code[pc] == OP_TGET || code[pc] == OP_FORT || code[pc] == OP_FORI)
+	    && pc + 2 >= hdr->codeLen)
+	|| (code[pc] == OP_JTAB && pc + JTAB_HEAD > hdr->codeLen)
+	|| (code[pc] == OP_JFIND && pc + JFIND_HEAD > hdr->codeLen)
+	|| (code[pc] == OP_INBITS && pc + 6 > hdr->codeLen)
+	|| (code[pc] == OP_INLIST && pc + 3 > hdr->codeLen)
+	|| pc + opSize(code + pc) > hdr->codeLen)
+      goto error;
+    starts[pc / 8] |= 1 << (pc % 8);
+    switch (code[pc]) {
+    case OP_LOAD:
+    case OP_STORE:
+    case OP_FORT:
+    case OP_FORI:
+      if (code[pc+1] >= 26)
+	goto error;
+      break;
+    case OP_CALL:
+      if (code[pc+1] >= hdr->importCount)
+	goto error;
+      break;
+    case OP_CALLS:
+      if (code[pc+1] >= hdr->importCount || code[pc+2] >= hdr->stringCount)
+	goto error;
+      break;
+    case OP_TSET:
+    case OP_TGET:
+      if (code[pc+1] >= hdr->temps)
+	goto error;
+      break;
+    case OP_PROBE:
+      if (code[pc+1] >= probes)
+	goto error;
+      break;
+    }
+  }
+  // Jumps must land on an instruction
+  for (pc = 0; pc < hdr->codeLen; pc += opSize(code + pc)) {
+    switch (code[pc]) {
+    case OP_JMP:
+    case OP_JZ:
+    case OP_ANDJ:
+    case OP_ORJ:
+    case OP_TGET:
+    case OP_FORT:
+    case OP_LOOP:
+    case OP_FORI:
+      target = jumpTarget(code, pc);
+      if (target < 0 || target >= hdr->codeLen || !(starts[target / 8] & (1 << (target % 8))))
+	goto error;
+      break;
+    case OP_JTAB:
+    case OP_JFIND:
+      for (i = -1; i < tableCount(code + pc); i ++) {
+	target = pc + opSize(code + pc) + read16(code + pc + tableEntry(code + pc, i));
+	if (target >= hdr->codeLen || !(starts[target / 8] & (1 << (target % 8))))
+	  goto error;
+      }
+      break;
+    }
+  }
+  free(starts);
+  starts = NULL;
+
+  p = code + hdr->codeLen;
+  e = p + hdr->importLen;
+  for (pc = 0; pc < hdr->importCount; pc ++) {
+    if (p + 2 > e || p + 2 + p[1] > e)
+      goto error;
+    d = p[0] & ~IMPORT_PURE;
+    if (d != 1 && d != 2 && d != 3 && d != (IMPORT_STRING | 1) && d != (IMPORT_STRING | 2))
+      goto error;
+    p += 2 + p[1];
+  }
+  if (p != e)
+    goto error;
+  e = p + hdr->stringLen;
+  for (pc = 0; pc < hdr->stringCount; pc ++) {
+    if (p + 2 > e || p + 2 + p[0] > e || p[1 + p[0]] != 0)
+      goto error;
+    p += 2 + p[0];
+  }
+  if (p != e)
+    goto error;
+  if (!checkStack(code, hdr))
+    goto error;
+
+  prog = (struct LoadedProgram *)malloc(sizeof(*prog) + sizeof(struct ScriptString) * hdr->stringCount
+					+ sizeof(struct Binding) * hdr->importCount);
+  if (!prog)
+    goto error;
+  prog->image = image;
+  prog->len = len;
+  prog->rom = rom;
+  prog->strings = (struct ScriptString *)(prog + 1);
+  prog->bindings = (struct Binding *)(prog->strings + hdr->stringCount);
+  // Handlers get views into the image
+  p = code + hdr->codeLen + hdr->importLen;
+  for (pc = 0; pc < hdr->stringCount; pc ++) {
+    prog->strings[pc].str = (const char *)p + 1;
+    prog->strings[pc].len = p[0];
+    p += 2 + p[0];
+  }
+  prog->trace = NULL;
+  prog->calls = NULL;
+  prog->probes = NULL;
+  prog->capped = false;
+  prog->next = NULL;
+  return prog;
+
+error:
+  free(starts);
+  if (!rom)
+    free((void *)image);
+  return NULL;
+}
+
+void MyInterpreter::freeProgram(struct LoadedProgram *prog)
+{
+  if (!prog)
+    return;
+  if (!prog->rom)
+    free((void *)prog->image);
+  free(prog->trace);
+  free(prog->calls);
+  free(prog->probes);
+  free(prog);
+}
+
+// Bytes of a program, its debug information and an image used in place
+// apart
+static uint32_t programBytes(const struct LoadedProgram *prog)
+{
+  const struct ProgramHeader *hdr = (const struct ProgramHeader *)prog->image;
+
+  return sizeof(*prog) + sizeof(struct ScriptString) * hdr->stringCount
+    + sizeof(struct Binding) * hdr->importCount + (prog->rom ? 0 : prog->len);
+}
+
+static uint32_t traceBytes(const struct LoadedProgram *prog)
+{
+  const struct ProgramTrace *t = prog->trace;
+  const struct ProgramCalls *c = prog->calls;
+  const struct ProgramProbes *pr = prog->probes;
+
+  return (t ? sizeof(*t) + sizeof(struct TracePoint) * t->count + strlen(t->source) + 1 : 0)
+    + (c ? sizeof(*c) + sizeof(struct CallSite) * c->count : 0)
+    + (pr ? sizeof(*pr) + sizeof(struct ProbeSite) * pr->count + pr->len + 1 : 0);
+}
+
+// Called from the thread that loads the scripts
+void MyInterpreter::getMemoryUsage(struct MemoryUsage *usage)
+{
+  struct LoadedProgram *prog;
+
+  usage->interpreter = sizeof(*this);
+  usage->program = current ? programBytes(current) : 0;
+  usage->trace = current ? traceBytes(current) : 0;
+  usage->retired = 0;
+  for (prog = retired; prog; prog = prog->next)
+    usage->retired += programBytes(prog) + traceBytes(prog);
+  usage->handlers = handlers->memoryUsed();
+  usage->total = usage->interpreter + usage->program + usage->trace
+    + usage->retired + usage->handlers;
+}
+
+int MyInterpreter::getLoadError(int *pos)
+{
+  if (pos)
+    *pos = loadErrorPos;
+  return loadError;
+}
+
+void MyInterpreter::setBudget(uint32_t ops, uint32_t calls, int policy)
+{
+  budgetOps = ops;
+  budgetCalls = calls;
+  budgetPolicy = policy;
+}
+
+bool MyInterpreter::getCost(struct ScriptCost *cost)
+{
+  struct LoadedProgram *prog = current;
+  const struct ProgramHeader *hdr;
+
+  if (!prog)
+    return false;
+  hdr = (const struct ProgramHeader *)prog->image;
+  cost->ops = hdr->worstOps;
+  cost->calls = hdr->worstCalls;
+  cost->capped = prog->capped;
+  return true;
+}
+
+// Copies counts the runs may be adding to
+static void copySites(struct ProbeSite *to, const struct ProbeSite *from, int count)
+{
+  int i;
+
+  for (i=0; i<count; i++) {
+    to[i].pos = from[i].pos;
+    to[i].len = from[i].len;
+    to[i].kind = from[i].kind;
+    to[i].count = __atomic_load_n(&from[i].count, __ATOMIC_RELAXED);
+    to[i].taken = __atomic_load_n(&from[i].taken, __ATOMIC_RELAXED);
+  }
+}
+
+// Called from the thread that loads the scripts
+int MyInterpreter::getProfile(struct ProbeSite *sites, int max)
+{
+  const struct ProgramProbes *pr = current ? current->probes : NULL;
+  int n;
+
+  if (!pr)
+    return 0;
+  n = pr->count < max ? pr->count : max;
+  copySites(sites, pr->sites, n);
+  return n;
+}
+
+// Compiles the probed program again for its counts once it ran often
+// enough.  A failed attempt is made again as many runs later.
+void MyInterpreter::adapt()
+{
+  struct ProgramProbes *pr = current ? current->probes : NULL, *profile;
+
+  if (!pr || pr->optimized || ++pr->runs < adaptiveRuns)
+    return;
+  pr->runs = 0;
+  profile = (struct ProgramProbes *)malloc(sizeof(*profile) + sizeof(struct ProbeSite) * pr->count);
+  if (!profile)
+    return;
+  *profile = *pr;
+  profile->sites = (struct ProbeSite *)(profile + 1);
+  copySites(profile->sites, pr->sites, pr->count);
+  // Publishing may free the probed version, source included
+  compile(pr->source, pr->len, profile);
+  free(profile);
+}
+
+void MyInterpreter::getRunStats(struct RunStats *stats)
+{
+  stats->compiles = runStats.compiles;
+  stats->compileMicros = runStats.compileMicros;
+  stats->runs = __atomic_load_n(&runStats.runs, __ATOMIC_RELAXED);
+  stats->runMicros = __atomic_load_n(&runStats.runMicros, __ATOMIC_RELAXED);
+  stats->handlerMicros = __atomic_load_n(&runStats.handlerMicros, __ATOMIC_RELAXED);
+}
+
+void MyInterpreter::resetRunStats()
+{
+  memset(&runStats, 0, sizeof(runStats));
+}
+
+// Makes a program the one new runs start with.  Runs are never blocked: the
+// replaced version is only retired, see reclaim().  Loading (publishing)
+// must not be done from several threads at once.  A program over budget
+// is freed instead when the policy is BUDGET_REJECT.  The same version
+// compiled again keeps the serial, runIfDirty() has no reason to run it.
+bool MyInterpreter::publish(struct LoadedProgram *prog, bool sameVersion)
+{
+  const struct ProgramHeader *hdr = (const struct ProgramHeader *)prog->image;
+  struct LoadedProgram *old = current;
+
+  if ((budgetOps && hdr->worstOps > budgetOps)
+      || (budgetCalls && hdr->worstCalls > budgetCalls)) {
+    if (budgetPolicy == BUDGET_REJECT) {
+      printError(ERROR_BUDGET);
+      loadError = ERROR_BUDGET;
+      loadErrorPos = 0;
+      freeProgram(prog);
+      return false;
+    }
+    prog->capped = true;
+  }
+
+  loadError = bindHandlers(prog);
+  loadErrorPos = 0;
+  prog->serial = sameVersion && old ? old->serial : ++loads;
+  __atomic_store_n(&current, prog, __ATOMIC_SEQ_CST);
+  if (old) {
+    old->next = retired;
+    retired = old;
+  }
+  reclaim();
+  return true;
+}
+
+// Frees the retired programs no context is running any more
+void MyInterpreter::reclaim()
+{
+  struct LoadedProgram **pp = &retired, *prog;
+  RunContext *ctx;
+
+  while ((prog = *pp) != NULL) {
+    for (ctx = contexts; ctx; ctx = ctx->next)
+      if (__atomic_load_n(&ctx->active, __ATOMIC_SEQ_CST) == prog)
+	break;
+    if (ctx) {
+      pp = &prog->next;
+    } else {
+      *pp = prog->next;
+      freeProgram(prog);
+    }
+  }
+  handlers->reclaim();
+}
+
+// Contexts are added and removed by the thread that loads the scripts
+void MyInterpreter::addContext(RunContext *ctx)
+{
+  ctx->active = NULL;
+  ctx->serial = 0;
+  ctx->next = contexts;
+  contexts = ctx;
+}
+
+void MyInterpreter::removeContext(RunContext *ctx)
+{
+  RunContext **pp;
+
+  for (pp = &contexts; *pp; pp = &(*pp)->next) {
+    if (*pp == ctx) {
+      *pp = ctx->next;
+      break;
+    }
+  }
+}
+
+// With counts, compiles a probed program again, laid out for them
+bool MyInterpreter::compile(const char *src, int len, const struct ProgramProbes *counts)
+{
+  MyCompiler compiler;
+  struct LoadedProgram *prog;
+  struct ProgramTrace *t;
+  struct ProgramCalls *c;
+  struct ProgramProbes *pr;
+  Vector<struct TracePoint> tracePoints;
+  Vector<struct CallSite> callSites;
+  Vector<struct ProbeSite> probeSites;
+  bool trace = runAnimate || runStep, profile = handlers->profiling();
+  bool probe = adaptiveRuns && !trace && !counts;
+  uint32_t start = profile ? micros() : 0;
+  uint8_t *image;
+  int i, n, err;
+
+  for (i=0; i<(int)handlers->func1.count(); i++)
+    if (handlers->func1[i].pure)
+      compiler.addPure(handlers->func1[i].name, 1);
+  for (i=0; i<(int)handlers->func2.count(); i++)
+    if (handlers->func2[i].pure)
+      compiler.addPure(handlers->func2[i].name, 2);
+  for (i=0; i<(int)handlers->func3.count(); i++)
+    if (handlers->func3[i].pure)
+      compiler.addPure(handlers->func3[i].name, 3);
+  for (i=0; i<(int)handlers->funcS.count(); i++)
+    if (handlers->funcS[i].pure) {
+      compiler.addPure(handlers->funcS[i].name, IMPORT_STRING | 1);
+      compiler.addPure(handlers->funcS[i].name, IMPORT_STRING | 2);
+    }
+
+  if (probe)
+    compiler.addProbes(&probeSites);
+  else if (counts)
+    compiler.useProfile(counts->sites, counts->count);
+  err = compiler.compile(src, len, trace ? &tracePoints : NULL,
+			 profile ? &callSites : NULL);
+  if (profile) {
+    runStats.compiles ++;
+    runStats.compileMicros += micros() - start;
+  }
+  if (err) {
+    debugf("Script error at offset %d", compiler.errorPos());
+    printError(err);
+    loadError = err;
+    loadErrorPos = compiler.errorPos();
+    return false;
+  }
+
+  image = compiler.release(&n);
+  if ((prog = newProgram(image, n, false, probeSites.count())) == NULL) {
+    printError(ERROR_PROGRAM);
+    loadError = ERROR_PROGRAM;
+    loadErrorPos = 0;
+    return false;
+  }
+  if (trace) {
+    n = tracePoints.count();
+    t = (struct ProgramTrace *)malloc(sizeof(*t) + sizeof(struct TracePoint) * n + len + 1);
+    if (t) {
+      t->count = n;
+      t->points = (struct TracePoint *)(t + 1);
+      t->source = (char *)(t->points + n);
+      for (i=0; i<n; i++)
+	t->points[i] = tracePoints[i];
+      memcpy(t->source, src, len);
+      t->source[len] = 0;
+    }
+    prog->trace = t;
+  }
+  if (profile) {
+    n = callSites.count();
+    c = (struct ProgramCalls *)malloc(sizeof(*c) + sizeof(struct CallSite) * n);
+    if (c) {
+      c->count = n;
+      c->sites = (struct CallSite *)(c + 1);
+      for (i=0; i<n; i++)
+	c->sites[i] = callSites[i];
+    }
+    prog->calls = c;
+  }
+  // The source is kept until the program is compiled again, the counts
+  // as long as the version laid out for them
+  if (probe || counts) {
+    n = probe ? probeSites.count() : counts->count;
+    len = probe ? len : 0;
+    pr = (struct ProgramProbes *)malloc(sizeof(*pr) + sizeof(struct ProbeSite) * n + len + 1);
+    if (pr) {
+      pr->count = n;
+      pr->sites = (struct ProbeSite *)(pr + 1);
+      pr->source = (char *)(pr->sites + n);
+      pr->len = len;
+      pr->runs = 0;
+      pr->optimized = !probe;
+      for (i=0; i<n; i++)
+	pr->sites[i] = probe ? probeSites[i] : counts->sites[i];
+      memcpy(pr->source, src, len);
+      pr->source[len] = 0;
+    } else if (probe) {
+      freeProgram(prog);
+      printError(ERROR_MEMORY);
+      loadError = ERROR_MEMORY;
+      loadErrorPos = 0;
+      return false;
+    }
+    prog->probes = pr;
+  }
+  return publish(prog, counts != NULL);
+}
+
+int MyInterpreter::traceStep(const struct LoadedProgram *prog, int pc, int v)
+{
+  const struct ProgramTrace *tr = prog->trace;
+  int lo = 0, hi, mid;
+
+  if (!tr)
+    return 0;
+  hi = tr->count - 1;
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    const struct TracePoint &t = tr->points[mid];
+    if (t.pc < pc) {
+      lo = mid + 1;
+    } else if (t.pc > pc) {
+      hi = mid - 1;
+    } else {
+      writeS(tr->source + t.pos, t.len);
+      if (t.kind == TRACE_COND) {
+	Serial.print(": ");
+	Serial.print(v ? "true" : "false");
+      } else if (t.kind == TRACE_VALUE) {
+	Serial.print(": ");
+	Serial.print(v);
+      }
+      Serial.println("");
+      return t.kind == TRACE_STMT ? stepRun() : 0;
+    }
+  }
+  return 0;
+}
+
+// Instantiated once per tracing, profiling and budget policy, so the
+// production build of the loop has no trace, profiling or budget checks
+template <bool TRACE, bool PROFILE, bool LIMIT>
+int MyInterpreter::execute(const struct LoadedProgram *prog, RunContext *ctx)
+{
+  const uint8_t *code = prog->image + sizeof(struct ProgramHeader);
+  const uint8_t *pc = code;
+  const struct Binding *b;
+  const struct ScriptString *str;
+  struct HandlerCache *cache;
+  uint32_t generation = 0;	// Of the cache when the call missed it
+  struct ProbeSite *site;
+  int *variables = ctx->variables;
+  int stack[PROGRAM_STACK];
+  int temps[PROGRAM_TEMPS];
+  uint16_t set = 0;		// Temporaries holding a value
+  int sp = 0, t, d, err;
+  int lo, hi, mid;		// Search of OP_JFIND and OP_INLIST
+  uint32_t index;
+  int args[3];
+  uint32_t start = 0;
+  uint32_t steps = 0, callCount = 0;	// Counted against the budget
+
+  for (;;) {
+#ifdef COUNT_OPS
+    ctx->ops ++;
+#endif
+    if (TRACE && (err = traceStep(prog, pc - code, sp > 0 ? stack[sp-1] : 0)) != 0)
+      return err;
+    if (LIMIT && budgetOps && ++steps > budgetOps)
+      return ERROR_BUDGET;
+
+    switch (*pc++) {
+    case OP_HALT:
+      return 0;
+    case OP_PUSHB:
+      stack[sp++] = (int8_t)*pc++;
+      break;
+    case OP_PUSH:
+      stack[sp++] = read32(pc);
+      pc += 4;
+      break;
+    case OP_PUSHW:
+      stack[sp++] = (int16_t)read16(pc);
+      pc += 2;
+      break;
+    case OP_LOAD:
+      stack[sp++] = variables[*pc++];
+      break;
+    case OP_STORE:
+      variables[*pc++] = stack[--sp];
+      break;
+    case OP_TGET:
+      t = *pc++;
+      d = readDist(&pc);
+      if (set & (1 << t)) {
+	stack[sp++] = temps[t];
+	pc += d;
+      }
+      break;
+    case OP_TSET:
+      temps[*pc] = stack[sp-1];
+      set |= 1 << *pc++;
+      break;
+    case OP_TCLEAR:
+      set &= ~read16(pc);
+      pc += 2;
+      break;
+    case OP_DUP:
+      stack[sp] = stack[sp-1];
+      sp ++;
+      break;
+    case OP_POP:
+      sp --;
+      break;
+
+    case OP_NEG:
+      stack[sp-1] = intNeg(stack[sp-1]);
+      break;
+    case OP_NOT:
+      stack[sp-1] = !stack[sp-1];
+      break;
+    case OP_BNOT:
+      stack[sp-1] = ~stack[sp-1];
+      break;
+    case OP_BOOL:
+      stack[sp-1] = stack[sp-1] != 0;
+      break;
+
+    case OP_MUL:
+      sp --;
+      stack[sp-1] = intMul(stack[sp-1], stack[sp]);
+      break;
+    case OP_DIV:
+      sp --;
+      if (stack[sp] == 0)
+	return ERROR_DIV0;
+      stack[sp-1] = intDiv(stack[sp-1], stack[sp]);
+      break;
+    case OP_MOD:
+      sp --;
+      if (stack[sp] == 0)
+	return ERROR_DIV0;
+      stack[sp-1] = intMod(stack[sp-1], stack[sp]);
+      break;
+    case OP_ADD:
+      sp --;
+      stack[sp-1] = intAdd(stack[sp-1], stack[sp]);
+      break;
+    case OP_SUB:
+      sp --;
+      stack[sp-1] = intSub(stack[sp-1], stack[sp]);
+      break;
+    case OP_SHL:
+      sp --;
+      stack[sp-1] = intShl(stack[sp-1], stack[sp]);
+      break;
+    case OP_SHR:
+      sp --;
+      stack[sp-1] = intShr(stack[sp-1], stack[sp]);
+      break;
+    case OP_LT:
+      sp --;
+      stack[sp-1] = stack[sp-1] < stack[sp];
+      break;
+    case OP_LE:
+      sp --;
+      stack[sp-1] = stack[sp-1] <= stack[sp];
+      break;
+    case OP_GT:
+      sp --;
+      stack[sp-1] = stack[sp-1] > stack[sp];
+      break;
+    case OP_GE:
+      sp --;
+      stack[sp-1] = stack[sp-1] >= stack[sp];
+      break;
+    case OP_EQ:
+      sp --;
+      stack[sp-1] = stack[sp-1] == stack[sp];
+      break;
+    case OP_NE:
+      sp --;
+      stack[sp-1] = stack[sp-1] != stack[sp];
+      break;
+    case OP_AND:
+      sp --;
+      stack[sp-1] = stack[sp-1] & stack[sp];
+      break;
+    case OP_XOR:
+      sp --;
+      stack[sp-1] = stack[sp-1] ^ stack[sp];
+      break;
+    case OP_OR:
+      sp --;
+      stack[sp-1] = stack[sp-1] | stack[sp];
+      break;
+
+    case OP_ITOR:
+      stack[sp-1] = realFromInt(stack[sp-1]);
+      break;
+    case OP_RTOI:
+      stack[sp-1] = realToInt(stack[sp-1]);
+      break;
+    case OP_RNZ:
+      stack[sp-1] = realTrue(stack[sp-1]);
+      break;
+    case OP_RNEG:
+      stack[sp-1] = realNeg(stack[sp-1]);
+      break;
+    case OP_RMUL:
+      sp --;
+      stack[sp-1] = realMul(stack[sp-1], stack[sp]);
+      break;
+    case OP_RDIV:
+      sp --;
+      if (!realTrue(stack[sp]))
+	return ERROR_DIV0;
+      stack[sp-1] = realDiv(stack[sp-1], stack[sp]);
+      break;
+    case OP_RADD:
+      sp --;
+      stack[sp-1] = realAdd(stack[sp-1], stack[sp]);
+      break;
+    case OP_RSUB:
+      sp --;
+      stack[sp-1] = realSub(stack[sp-1], stack[sp]);
+      break;
+    case OP_RLT:
+      sp --;
+      stack[sp-1] = realLess(stack[sp-1], stack[sp]);
+      break;
+    case OP_RLE:
+      sp --;
+      stack[sp-1] = realLess(stack[sp-1], stack[sp]) || realEqual(stack[sp-1], stack[sp]);
+      break;
+    case OP_RGT:
+      sp --;
+      stack[sp-1] = realLess(stack[sp], stack[sp-1]);
+      break;
+    case OP_RGE:
+      sp --;
+      stack[sp-1] = realLess(stack[sp], stack[sp-1]) || realEqual(stack[sp-1], stack[sp]);
+      break;
+    case OP_REQ:
+      sp --;
+      stack[sp-1] = realEqual(stack[sp-1], stack[sp]);
+      break;
+    case OP_RNE:
+      sp --;
+      stack[sp-1] = !realEqual(stack[sp-1], stack[sp]);
+      break;
+
+    case OP_JMP:
+      d = readDist(&pc);
+      pc += d;
+      break;
+    case OP_LOOP:
+      WDT.alive();
+      d = readDist(&pc);
+      pc -= d;
+      break;
+    case OP_FORT:
+      t = *pc++;
+      d = readDist(&pc);
+      if (!(variables[t] < stack[sp-1]))
+	pc += d;
+      break;
+    case OP_FORI:
+      t = *pc++;
+      d = readDist(&pc);
+      if (++variables[t] < stack[sp-1]) {
+	WDT.alive();
+	pc -= d;
+      }
+      break;
+    case OP_JZ:
+      d = readDist(&pc);
+      if (stack[--sp] == 0)
+	pc += d;
+      break;
+    case OP_ANDJ:
+      d = readDist(&pc);
+      if (stack[sp-1] == 0)
+	pc += d;
+      else
+	sp --;
+      break;
+    case OP_ORJ:
+      d = readDist(&pc);
+      if (stack[sp-1] != 0) {
+	stack[sp-1] = 1;
+	pc += d;
+      } else {
+	sp --;
+      }
+      break;
+    case OP_JTAB:
+      // Values below the range wrap around above it
+      index = (uint32_t)stack[--sp] - (uint32_t)read32(pc);
+      d = read16(pc + 4);
+      t = read16(pc + (index < (uint32_t)d ? 8 + 2 * index : 6));
+      pc += 8 + 2 * d + t;
+      break;
+    case OP_JFIND:
+      d = read16(pc);
+      t = read16(pc + 2);
+      for (lo = 0, hi = d; lo < hi; ) {
+	mid = (lo + hi) / 2;
+	if (read32(pc + 4 + JFIND_ENTRY * mid) == stack[sp-1]) {
+	  t = read16(pc + 8 + JFIND_ENTRY * mid);
+	  break;
+	}
+	if (read32(pc + 4 + JFIND_ENTRY * mid) < stack[sp-1])
+	  lo = mid + 1;
+	else
+	  hi = mid;
+      }
+      sp --;
+      pc += 4 + JFIND_ENTRY * d + t;
+      break;
+
+    case OP_INBITS:
+      index = (uint32_t)stack[sp-1] - (uint32_t)read32(pc);
+      stack[sp-1] = index < 8u * pc[4] && (pc[5 + index / 8] & (1 << (index % 8)));
+      pc += 5 + pc[4];
+      break;
+    case OP_INLIST:
+      d = read16(pc);
+      for (lo = 0, hi = d, t = 0; lo < hi && !t; ) {
+	mid = (lo + hi) / 2;
+	if (read32(pc + 2 + 4 * mid) == stack[sp-1])
+	  t = 1;
+	else if (read32(pc + 2 + 4 * mid) < stack[sp-1])
+	  lo = mid + 1;
+	else
+	  hi = mid;
+      }
+      stack[sp-1] = t;
+      pc += 2 + 4 * d;
+      break;
+
+    case OP_PROBE:
+      // Counted from any context, but not against the budget
+      site = prog->probes->sites + *pc++;
+      __atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED);
+      if (stack[sp-1])
+	__atomic_fetch_add(&site->taken, 1, __ATOMIC_RELAXED);
+      if (LIMIT)
+	steps --;
+      break;
+
+    case OP_CALL:
+      if (LIMIT && budgetCalls && ++callCount > budgetCalls)
+	return ERROR_BUDGET;
+      b = prog->bindings + *pc++;
+      // A cached result spares the call
+      cache = NULL;
+      if (__atomic_load_n(&handlers->caches, __ATOMIC_RELAXED) && b->handler != PROGRAM_UNBOUND
+	  && (cache = handlers->cacheOf(b)) != NULL) {
+	if (handlers->cacheLookup(cache, stack + sp - b->arity, b->arity, &t, &generation)) {
+	  sp -= b->arity - 1;
+	  stack[sp-1] = t;
+	  break;
+	}
+	memcpy(args, stack + sp - b->arity, sizeof(int) * b->arity);
+      }
+      if (PROFILE && b->handler != PROGRAM_UNBOUND && b->arity <= 3) {
+	memcpy(args, stack + sp - b->arity, sizeof(int) * b->arity);
+	start = micros();
+      }
+      switch (b->handler == PROGRAM_UNBOUND ? 0 : b->arity) {
+      case 1:
+#ifdef USE_DELEGATES
+	stack[sp-1] = handlers->func1[b->handler].func(stack[sp-1]);
+#else
+	stack[sp-1] = (*handlers->func1[b->handler].func)(stack[sp-1]);
+#endif
+	break;
+      case 2:
+	sp --;
+#ifdef USE_DELEGATES
+	stack[sp-1] = handlers->func2[b->handler].func(stack[sp-1], stack[sp]);
+#else
+	stack[sp-1] = (*handlers->func2[b->handler].func)(stack[sp-1], stack[sp]);
+#endif
+	break;
+      case 3:
+	sp -= 2;
+#ifdef USE_DELEGATES
+	stack[sp-1] = handlers->func3[b->handler].func(stack[sp-1], stack[sp], stack[sp+1]);
+#else
+	stack[sp-1] = (*handlers->func3[b->handler].func)(stack[sp-1], stack[sp], stack[sp+1]);
+#endif
+	break;
+      default:
+	return ERROR_UNBOUND;
+      }
+      ctx->calls ++;
+      if (cache)
+	handlers->cacheStore(cache, args, b->arity, stack[sp-1], generation);
+      if (PROFILE)
+	profileCall(prog, b, pc - 2 - code, args, b->arity, micros() - start);
+      break;
+
+    case OP_CALLS:
+      if (LIMIT && budgetCalls && ++callCount > budgetCalls)
+	return ERROR_BUDGET;
+      b = prog->bindings + *pc++;
+      str = prog->strings + *pc++;
+      if (PROFILE) {
+	args[0] = b->arity == (IMPORT_STRING | 2) ? stack[sp-1] : 0;
+	start = micros();
+      }
+      switch (b->handler == PROGRAM_UNBOUND ? 0 : b->arity) {
+      case IMPORT_STRING | 1:
+#ifdef USE_DELEGATES
+	stack[sp++] = handlers->funcS[b->handler].func(str->str, str->len, 0);
+#else
+	stack[sp++] = (*handlers->funcS[b->handler].func)(str->str, str->len, 0);
+#endif
+	break;
+      case IMPORT_STRING | 2:
+#ifdef USE_DELEGATES
+	stack[sp-1] = handlers->funcS[b->handler].func(str->str, str->len, stack[sp-1]);
+#else
+	stack[sp-1] = (*handlers->funcS[b->handler].func)(str->str, str->len, stack[sp-1]);
+#endif
+	break;
+      default:
+	return ERROR_UNBOUND;
+      }
+      ctx->calls ++;
+      if (PROFILE)
+	profileCall(prog, b, pc - 3 - code, args, (b->arity & ~IMPORT_STRING) - 1, micros() - start);
+      break;
+
+    default:
+      return ERROR_INTERNAL;
+    }
+  }
+}
+
+static int bucketOf(uint32_t us)
+{
+  int b = us ? 32 - __builtin_clz(us) : 0;
+
+  return b < PROFILE_BUCKETS ? b : PROFILE_BUCKETS - 1;
+}
+
+// String handlers are logged with the argument following the string
+void MyInterpreter::profileCall(const struct LoadedProgram *prog, const struct Binding *b,
+				int pc, const int *args, int argc, uint32_t us)
+{
+  const struct ProgramCalls *c = prog->calls;
+  struct CallStats *s;
+  struct SlowCall call;
+  uint32_t slow;
+  int lo, hi, mid;
+
+  s = handlers->statsOf(b->arity, b->handler, &call.name);
+  __atomic_fetch_add(&runStats.handlerMicros, us, __ATOMIC_RELAXED);
+  if (s) {
+    __atomic_fetch_add(&s->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->micros, us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->histogram[bucketOf(us)], 1, __ATOMIC_RELAXED);
+  }
+  slow = __atomic_load_n(&handlers->slowThreshold, __ATOMIC_RELAXED);
+  if (!slow || us < slow)
+    return;
+
+  call.arity = b->arity;
+  memset(call.args, 0, sizeof(call.args));
+  memcpy(call.args, args, sizeof(int) * argc);
+  call.micros = us;
+  call.time = millis();
+  call.pos = -1;
+  for (lo = 0, hi = c ? c->count - 1 : -1; lo <= hi; ) {
+    mid = (lo + hi) / 2;
+    if (c->sites[mid].pc < pc) {
+      lo = mid + 1;
+    } else if (c->sites[mid].pc > pc) {
+      hi = mid - 1;
+    } else {
+      call.pos = c->sites[mid].pos;
+      break;
+    }
+  }
+  handlers->logSlowCall(call);
+}
+
+void MyInterpreter::writeS(const char *s, int len)
+{
+  Serial.write((const uint8_t *)s, len);
+}
+
+bool MyInterpreter::load(char *prg, int len)
+{
+    if (len > SCRIPT_MAX)
+    {
+        debugf("Scripts exceeds max length of %d bytes", SCRIPT_MAX);
+        loadError = ERROR_TOO_BIG;
+        loadErrorPos = 0;
+        return false;
+    }
+
+    return compile(prg, len);
+}
+
+bool MyInterpreter::loadCompiled(const uint8_t *image, int len)
+{
+    struct LoadedProgram *prog;
+    uint8_t *copy;
+
+    copy = (uint8_t *)malloc(len > 0 ? len : 1);
+    if (!copy)
+        return false;
+    memcpy(copy, image, len);
+
+    if ((prog = newProgram(copy, len)) == NULL)
+    {
+        debugf("Invalid compiled program");
+        loadError = ERROR_PROGRAM;
+        loadErrorPos = 0;
+        return false;
+    }
+    return publish(prog);
+}
+
+bool MyInterpreter::loadStatic(const uint8_t *image, int len)
+{
+    struct LoadedProgram *prog;
+
+    if ((prog = newProgram(image, len, true)) == NULL)
+    {
+        debugf("Invalid compiled program");
+        loadError = ERROR_PROGRAM;
+        loadErrorPos = 0;
+        return false;
+    }
+    return publish(prog);
+}
+
+#ifndef DISABLE_SPIFFS
+bool MyInterpreter::loadFile(char *fileName)
+{
+    char cacheName[64];
+    char *script;
+    int len;
+    bool ok;
+
     if (!fileExist(fileName))
     {
         debugf("Script file %s does not exist", fileName);
+        loadError = ERROR_FILE;
+        loadErrorPos = 0;
         return false;
     }
 
-    if (fileGetSize(fileName) > sizeof(scriptBuf) - 1)
+    len = fileGetSize(fileName);
+    if (len > SCRIPT_MAX)
     {
-        debugf("Scripts exceeds max length of %d bytes", sizeof(scriptBuf) - 1);
+        debugf("Scripts exceeds max length of %d bytes", SCRIPT_MAX);
+        loadError = ERROR_TOO_BIG;
+        loadErrorPos = 0;
         return false;
     }
 
-    scriptLen = fileGetSize(fileName);
-    fileGetContent(fileName, scriptBuf, sizeof(scriptBuf));
-    scriptBuf[scriptLen] = 0;
+    // The source is only held while loading
+    script = (char *)malloc(len + 1);
+    if (!script)
+    {
+        printError(ERROR_MEMORY);
+        return false;
+    }
+    fileGetContent(fileName, script, len + 1);
+    script[len] = 0;
 
-    return true;
+    // Tracing needs the debug information only a fresh compile provides,
+    // adapting to the runs needs the probes
+    if (runAnimate || runStep || adaptiveRuns ||
+        strlen(fileName) + sizeof(PROGRAM_FILE_SUFFIX) > sizeof(cacheName))
+    {
+        ok = compile(script, len);
+    }
+    else
+    {
+        strcpy(cacheName, fileName);
+        strcat(cacheName, PROGRAM_FILE_SUFFIX);
+        ok = loadCached(cacheName, script, len);
+        if (!ok && (ok = compile(script, len)))
+            saveCompiled(cacheName);
+    }
+    free(script);
+    return ok;
+}
+
+// Reuses the compiled copy if it was made from this very source
+bool MyInterpreter::loadCached(char *cacheName, const char *script, int scriptLen)
+{
+    const struct ProgramHeader *hdr;
+    struct LoadedProgram *prog;
+    uint8_t *image;
+    file_t file;
+    int len;
+
+    len = fileExist(cacheName) ? fileGetSize(cacheName) : 0;
+    if (len <= 0 || (image = (uint8_t *)malloc(len)) == NULL)
+        return false;
+
+    file = fileOpen(cacheName, eFO_ReadOnly);
+    if (file >= 0 && fileRead(file, image, len) == len)
+    {
+        fileClose(file);
+        // A handler may have lost its purity since the compile
+        if ((prog = newProgram(image, len)) != NULL)
+        {
+            hdr = (const struct ProgramHeader *)prog->image;
+            if (hdr->sourceHash == hash32((const uint8_t *)script, scriptLen)
+                && bindHandlers(prog) != ERROR_PROGRAM)
+            {
+                return publish(prog);
+            }
+            freeProgram(prog);
+        }
+    }
+    else
+    {
+        if (file >= 0)
+            fileClose(file);
+        free(image);
+    }
+    debugf("Compiled script %s is stale, recompiling", cacheName);
+    return false;
+}
+
+bool MyInterpreter::saveCompiled(char *fileName)
+{
+    file_t file;
+    bool ok;
+
+    // Probes are only valid in memory
+    if (!current || (current->probes && !current->probes->optimized))
+        return false;
+
+    file = fileOpen(fileName, eFO_CreateNewAlways | eFO_WriteOnly);
+    if (file < 0)
+    {
+        debugf("Cannot create %s", fileName);
+        return false;
+    }
+    ok = fileWrite(file, current->image, current->len) == current->len;
+    fileClose(file);
+
+    return ok;
 }
 #endif
 
 void MyInterpreter::run()
 {
-    if (!scriptLen)
-        return;
+#ifdef ARCH_HOST
+    if (recorder)
+        recorder->record(recordId, REPLAY_RUN);
+#endif
+    runProgram(&context, false);
+    if (adaptiveRuns)
+        adapt();
+}
+
+void MyInterpreter::run(RunContext *ctx)
+{
+    runProgram(ctx, false);
+}
+
+bool MyInterpreter::runIfDirty()
+{
+    bool ran;
 
-    run(scriptBuf, scriptLen);
+#ifdef ARCH_HOST
+    if (recorder)
+        recorder->record(recordId, REPLAY_DIRTY);
+#endif
+    ran = runProgram(&context, true);
+    if (ran && adaptiveRuns)
+        adapt();
+    return ran;
+}
+
+bool MyInterpreter::runIfDirty(RunContext *ctx)
+{
+    return runProgram(ctx, true);
+}
+
+// Lock free: the program is announced in the context before use so that
+// a concurrent load() cannot free it, a nested run keeps the outer version.
+// A nested run leaves the variables as it found them: the run it is nested
+// in keeps values of them in temporaries and in the bounds of its counted
+// loops.
+bool MyInterpreter::runProgram(RunContext *ctx, bool dirtyOnly)
+{
+    struct LoadedProgram *prog, *outer = ctx->active;
+    const struct ProgramHeader *hdr;
+    bool profile = handlers->profiling();
+    uint32_t start = profile ? micros() : 0;
+    int saved[26];
+    int err;
+
+    // Each nested run takes a frame of the native stack
+    if (ctx->nesting >= RUN_NESTING)
+    {
+        printError(ERROR_DEPTH);
+        return false;
+    }
+
+    prog = outer;
+    while (!prog)
+    {
+        prog = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+        if (!prog)
+            return false;
+        __atomic_store_n(&ctx->active, prog, __ATOMIC_SEQ_CST);
+        if (prog != __atomic_load_n(&current, __ATOMIC_SEQ_CST))
+            prog = NULL;
+    }
+
+    // Skip the run if no input changed since this version last ran
+    hdr = (const struct ProgramHeader *)prog->image;
+    if (dirtyOnly && ctx->serial == prog->serial && !(ctx->changed & hdr->inputs))
+    {
+        __atomic_store_n(&ctx->active, outer, __ATOMIC_SEQ_CST);
+        return false;
+    }
+    ctx->serial = prog->serial;
+    ctx->changed = 0;
+
+    // Caches replaced from now on wait for the run, see MyHandlers::reclaim()
+    if (!ctx->nesting)
+        __atomic_store_n(&ctx->epoch, __atomic_load_n(&handlers->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+
+    if (ctx->nesting)
+        memcpy(saved, ctx->variables, sizeof(saved));
+
+    // Traced only when compiled with the debug information
+    ctx->nesting ++;
+    if (prog->trace && !reportProgPos && (runAnimate || runStep))
+        err = profile ? execute<true, true, true>(prog, ctx) : execute<true, false, true>(prog, ctx);
+    else if (prog->capped)
+        err = profile ? execute<false, true, true>(prog, ctx) : execute<false, false, true>(prog, ctx);
+    else
+        err = profile ? execute<false, true, false>(prog, ctx) : execute<false, false, false>(prog, ctx);
+    ctx->nesting --;
+    if (ctx->nesting)
+        memcpy(ctx->variables, saved, sizeof(saved));
+    else
+        __atomic_store_n(&ctx->epoch, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ctx->active, outer, __ATOMIC_SEQ_CST);
+    if (profile)
+    {
+        __atomic_fetch_add(&runStats.runs, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&runStats.runMicros, micros() - start, __ATOMIC_RELAXED);
+    }
+    if (err < 0)
+        printError(err);
+    return true;
 }
@@ -14,8 +14,21 @@
 #ifndef __MYINTERPRETER_H__
 #define __MYINTERPRETER_H__
 #include "Arduino.h"
+#include "MyProgram.h"
+#include "MyCompiler.h"
 
 #define USE_DELEGATES
+//#define COUNT_OPS		// Count the instructions run in RunContext::ops
+
+#define SCRIPT_MAX	1024	// Longest script load() accepts
+#ifndef RUN_NESTING
+#define RUN_NESTING	4	// Runs a handler may start on the same context,
+				// their assignments are undone when they return
+#endif
+
+#define PROFILE_BUCKETS	16	// Latency histogram buckets
+#define PROFILE_SLOW_LOG	8	// Slow calls kept
+#define CACHE_ENTRIES	64	// Results a handler cache holds at most
 
 enum ERRORS {
   STOPPED = 10,
@@ -23,24 +36,97 @@ enum ERRORS {
   FOUND_BREAK = 2,
   ERROR_DIV0 = -1, 
   ERROR_SYNTAX = -2,
-  ERROR_INTERNAL = -3
+  ERROR_INTERNAL = -3,
+  ERROR_UNBOUND = -4,
+  ERROR_PROGRAM = -5,
+  ERROR_MEMORY = -6,
+  ERROR_TOO_BIG = -7,
+  ERROR_DEPTH = -8,
+  ERROR_FILE = -9,
+  ERROR_BUDGET = -10
 };
 
-struct ConstValue {
-  char *name;
-  int   len;
-  int   val;
+enum BUDGET_POLICIES {
+  BUDGET_REJECT,	// load() refuses scripts over budget
+  BUDGET_CAP		// Loaded, but a run is stopped once over budget
 };
 
 #ifdef USE_DELEGATES
 typedef Delegate<int(int)> func1Delegate;
 typedef Delegate<int(int, int)> func2Delegate;
 typedef Delegate<int(int, int, int)> func3Delegate;
+// A string literal (as a view into the program, null terminated) and the
+// argument following it, 0 if none
+typedef Delegate<int(const char *, int, int)> funcSDelegate;
 #endif
 
+// Calls of a handler while profiling.  Bucket 0 counts the calls under
+// 1 us, bucket i those from 2^(i-1) us, the last one all longer calls.
+struct CallStats {
+  uint32_t calls;
+  uint32_t micros;	// Total time
+  uint32_t histogram[PROFILE_BUCKETS];
+};
+
+struct HandlerStats {
+  const char *name;
+  int arity;		// IMPORT_STRING for string handlers
+  struct CallStats stats;
+};
+
+// A handler call that took longer than the slow call threshold
+struct SlowCall {
+  const char *name;
+  uint8_t  arity;	// With IMPORT_STRING for string handlers, the
+  int      args[3];	// string is then left out of the arguments
+  int      pos;		// Source offset, -1 if the script was compiled
+			// without profiling
+  uint32_t micros;
+  uint32_t time;	// millis() at the end of the call
+};
+
+// Totals of one interpreter while profiling
+struct RunStats {
+  uint32_t compiles;
+  uint32_t compileMicros;	// Parsing and code generation
+  uint32_t runs;
+  uint32_t runMicros;		// Executing, handler calls included
+  uint32_t handlerMicros;	// Of which in handlers
+};
+
+// Results of a cacheable handler, see MyHandlers::setCacheable().  One
+// allocation: the entries follow the structure.
+struct CacheEntry {
+  int      args[3];
+  int      result;
+  uint32_t time;	// millis() when the handler returned it
+};
+
+struct CacheStats {
+  uint32_t hits;	// Calls served from the cache
+  uint32_t misses;	// Calls made to the handler
+  uint32_t entries;	// Results held
+};
+
+struct HandlerCache {
+  uint32_t ttl;		// ms, 0 if results do not expire
+  int size;
+  int used;
+  int next;		// Entry replaced once full
+  uint32_t generation;	// Bumped by each invalidation
+  struct CacheStats stats;
+  bool lock;
+  struct CacheEntry *entries;
+  uint32_t retiredAt;	// Epoch it was replaced in, see MyHandlers::reclaim()
+  struct HandlerCache *retired;
+};
+
 struct Function1 {
   char *name;
   int   len;
+  bool  pure;
+  struct CallStats *stats;	// Allocated while profiling
+  struct HandlerCache *cache;	// Allocated when cacheable
 #ifdef USE_DELEGATES
   func1Delegate func;
 #else
@@ -51,6 +137,9 @@ struct Function1 {
 struct Function2 {
   char *name;
   int   len;
+  bool  pure;
+  struct CallStats *stats;
+  struct HandlerCache *cache;
 #ifdef USE_DELEGATES
   func2Delegate func;
 #else
@@ -61,6 +150,9 @@ struct Function2 {
 struct Function3 {
   char *name;
   int   len;
+  bool  pure;
+  struct CallStats *stats;
+  struct HandlerCache *cache;
 #ifdef USE_DELEGATES
   func3Delegate func;
 #else
@@ -68,49 +160,339 @@ struct Function3 {
 #endif
 };
 
+struct FunctionS {
+  char *name;
+  int   len;
+  bool  pure;
+  struct CallStats *stats;
+#ifdef USE_DELEGATES
+  funcSDelegate func;
+#else
+  int (*func)(const char *, int, int);
+#endif
+};
+
+// A string literal of the loaded program, resolved when it is loaded
+struct ScriptString {
+  const char *str;
+  int len;
+};
+
+class MyInterpreter;
+#ifdef ARCH_HOST
+class MyRecorder;
+#endif
+
+// Handler an import of the loaded program is bound to
+struct Binding {
+  uint8_t arity;
+  uint8_t handler;	// Index into MyHandlers::funcN or PROGRAM_UNBOUND
+};
+
+// Debug information, only kept when tracing.  One allocation: the trace
+// points follow the structure, the source follows them.
+struct ProgramTrace {
+  char *source;
+  int count;
+  struct TracePoint *points;
+};
+
+// Call sites, only kept when compiled while profiling.  One allocation
+// like ProgramTrace.
+struct ProgramCalls {
+  int count;
+  struct CallSite *sites;
+};
+
+// Counts of a program compiled with probes, see setAdaptive().  One
+// allocation like ProgramTrace: the sites follow the structure, the source
+// follows them.
+struct ProgramProbes {
+  char *source;			// Empty once laid out for the counts
+  int len;
+  int count;
+  struct ProbeSite *sites;	// Counted by the runs
+  uint32_t runs;		// Of run() and runIfDirty() so far
+  bool optimized;		// Copy kept by the version laid out for them
+};
+
+// A compiled program as seen by the runs.  Once published it is never
+// changed: load() publishes a new version with a single pointer store and
+// the replaced one is freed when no context runs it any more.  The
+// strings and bindings are allocated along with the structure.
+struct LoadedProgram {
+  const uint8_t *image;
+  int len;
+  bool rom;			// Image used in place, not freed
+  struct ScriptString *strings;
+  struct Binding *bindings;
+  struct ProgramTrace *trace;
+  struct ProgramCalls *calls;
+  struct ProgramProbes *probes;
+  uint32_t serial;		// Number of the load that published it
+  bool capped;			// Over budget, runs are counted
+  struct LoadedProgram *next;	// Retired versions
+};
+
+// Worst case of a run found when the script was compiled
+struct ScriptCost {
+  uint32_t ops;		// Instructions, COST_UNBOUNDED if there is no bound
+  uint32_t calls;	// Handler calls, idem
+  bool capped;		// Loaded over budget with BUDGET_CAP
+};
+
+// Bytes allocated for an interpreter, allocator overhead not included
+struct MemoryUsage {
+  uint32_t interpreter;	// The object itself
+  uint32_t program;	// Current program: image and bindings
+  uint32_t trace;	// Debug information and counts of the current program
+  uint32_t retired;	// Versions still used by a run
+  uint32_t handlers;	// Handler table, counted by each interpreter sharing it
+  uint32_t total;
+};
+
+// Handlers scripts can call.  A table can be shared by many interpreters,
+// e.g. one per rule, so the registrations are only stored once.
+class MyHandlers
+{
+  public:
+    MyHandlers();
+    ~MyHandlers();
+
+#ifdef USE_DELEGATES
+    // A pure handler returns a result that only depends on its arguments
+    // and has no side effects, scripts may then call it less often
+    void registerFunc1(char *name, func1Delegate func, bool pure = false);
+    void registerFunc2(char *name, func2Delegate func, bool pure = false);
+    void registerFunc3(char *name, func3Delegate func, bool pure = false);
+    // Called as name("text") or name("text", value)
+    void registerFuncS(char *name, funcSDelegate func, bool pure = false);
+#else
+    void registerFunc1(char *name, int (*func)(int), bool pure = false);
+    void registerFunc2(char *name, int (*func)(int, int), bool pure = false);
+    void registerFunc3(char *name, int (*func)(int, int, int), bool pure = false);
+    void registerFuncS(char *name, int (*func)(const char *, int, int), bool pure = false);
+#endif
+
+    int find(int arity, const uint8_t *name, int len, bool *pure);
+    uint32_t memoryUsed();
+
+    // Profiling costs nothing while off.  Runs started after it is turned
+    // on are measured, scripts loaded after it also record the source
+    // offset of their calls for the slow call log.
+    void setProfiling(bool on);
+    bool profiling() { return __atomic_load_n(&profileOn, __ATOMIC_RELAXED); }
+    // Calls taking at least that long are logged, 0 to log none
+    void setSlowCallThreshold(uint32_t us) { __atomic_store_n(&slowThreshold, us, __ATOMIC_RELAXED); }
+    int handlerCount();
+    bool getHandlerStats(int i, struct HandlerStats *stats);
+    // Moves the logged slow calls, oldest first, out of the log
+    int getSlowCalls(struct SlowCall *calls, int max);
+    void resetStats();
+
+    // Calls of a handler taking ints with the arguments of a call made less
+    // than ttl ms before (0 for no limit) get its result without calling
+    // it, for handlers whose result changes slowly, e.g. configuration
+    // reads.  The last entries results are kept, 0 stops caching.
+    bool setCacheable(const char *name, int arity, uint32_t ttl, int entries);
+    // Forgets the results, e.g. once the data behind the handler changed
+    bool invalidateCache(const char *name, int arity);
+    bool getCacheStats(const char *name, int arity, struct CacheStats *stats);
+
+  protected:
+    void rebind();
+    struct CallStats *newStats();
+    struct CallStats *statsOf(int arity, int handler, const char **name);
+    void logSlowCall(const struct SlowCall &call);
+    struct HandlerCache **cacheSlot(const char *name, int arity);
+    struct HandlerCache *cacheOf(const struct Binding *b);
+    bool cacheLookup(struct HandlerCache *c, const int *args, int argc, int *result,
+		     uint32_t *generation);
+    void cacheStore(struct HandlerCache *c, const int *args, int argc, int result,
+		    uint32_t generation);
+    void reclaim();
+
+  private:
+    Vector<struct Function1> func1;
+    Vector<struct Function2> func2;
+    Vector<struct Function3> func3;
+    Vector<struct FunctionS> funcS;
+    MyInterpreter *users;		// Interpreters using the table
+
+    bool profileOn;
+    uint32_t slowThreshold;
+    struct SlowCall slowLog[PROFILE_SLOW_LOG];
+    uint32_t slowHead;			// Calls logged
+    uint32_t slowTail;			// Calls taken out
+    bool slowLock;
+    int caches;				// Handlers with a cache
+    struct HandlerCache *retired;	// Replaced, runs may use them
+    uint32_t epoch;			// Caches replaced so far, plus one
+    bool reclaimHeld;			// While MyLoader loads from several threads
+
+  friend class MyInterpreter;
+  friend class MyLoader;
+};
+
+// Variables of one execution.  Runs on different contexts may overlap, each
+// context must be added to the interpreter before it is used.
+class RunContext
+{
+  public:
+    RunContext();
+
+    void setVariable(char variable, int value);
+    int getVariable(char variable);
+
+    int variables[26];		// Reals as their bits, see MyProgram.h
+    uint32_t ops;		// Instructions executed, counted with COUNT_OPS
+    uint32_t calls;		// Handlers called, cached results not included
+
+  private:
+    uint32_t changed;		// Variables set to a new value since the last run
+    uint32_t serial;		// Version of the program last run
+    int nesting;		// Runs in progress
+    uint32_t epoch;		// Cache epoch the run started in, 0 if none runs
+    struct LoadedProgram *active;	// Program in use, never reclaimed
+    RunContext *next;
+
+  friend class MyHandlers;
+  friend class MyInterpreter;
+};
+
 class MyInterpreter
 {
   public:
-    MyInterpreter();
-    ~MyInterpreter() {};
+    // Without a shared table the interpreter gets one of its own
+    MyInterpreter(MyHandlers *shared = NULL);
+    ~MyInterpreter();
+
+    MyHandlers *getHandlers() { return handlers; }
 
+    // Registers into the handler table, see MyHandlers
 #ifdef USE_DELEGATES
-    void registerFunc1(char *name, func1Delegate func);
-    void registerFunc2(char *name, func2Delegate func);
-    void registerFunc3(char *name, func3Delegate func);
+    void registerFunc1(char *name, func1Delegate func, bool pure = false);
+    void registerFunc2(char *name, func2Delegate func, bool pure = false);
+    void registerFunc3(char *name, func3Delegate func, bool pure = false);
+    void registerFuncS(char *name, funcSDelegate func, bool pure = false);
 #else
-    void registerFunc1(char *name, int (*func)(int));
-    void registerFunc2(char *name, int (*func)(int, int));
-    void registerFunc3(char *name, int (*func)(int, int, int));
+    void registerFunc1(char *name, int (*func)(int), bool pure = false);
+    void registerFunc2(char *name, int (*func)(int, int), bool pure = false);
+    void registerFunc3(char *name, int (*func)(int, int, int), bool pure = false);
+    void registerFuncS(char *name, int (*func)(const char *, int, int), bool pure = false);
 #endif
 
+    // Variables the script assigns a real to are converted from and to
+    // ints, or can be set and read as reals
     void setVariable(char variable, int value);
+    int getVariable(char variable);
+    void setVariableReal(char variable, double value);
+    double getVariableReal(char variable);
 
 #ifndef DISABLE_SPIFFS
     bool loadFile(char *fileName);
 #endif
     bool load(char *prg, int len);
+    bool loadCompiled(const uint8_t *image, int len);
+    // Runs an image which stays in memory, e.g. one of MyStaticCompiler.h,
+    // without copying it
+    bool loadStatic(const uint8_t *image, int len);
+#ifndef DISABLE_SPIFFS
+    bool saveCompiled(char *fileName);
+#endif
     void run();
+    void run(RunContext *ctx);
+    // Runs only if a variable the script reads before assigning it was
+    // changed by setVariable() since the last run, or if a new version was
+    // loaded.  Handler results are assumed not to change in between.
+    bool runIfDirty();
+    bool runIfDirty(RunContext *ctx);
+
+    void addContext(RunContext *ctx);
+    void removeContext(RunContext *ctx);
+    void reclaim();
+
+    // Scripts which may take more than ops instructions or make more than
+    // calls handler calls in a run (0 for no limit), e.g. because of a loop
+    // without a known bound, are refused with ERROR_BUDGET.  With
+    // BUDGET_CAP they are loaded, a run going over is stopped instead.
+    void setBudget(uint32_t ops, uint32_t calls, int policy = BUDGET_REJECT);
+    bool getCost(struct ScriptCost *cost);
+
+    // Scripts loaded from source afterwards are compiled with probes first,
+    // counting how often each condition holds and each handler is called.
+    // After runs runs of run() or runIfDirty() they are compiled again,
+    // laid out for these counts, and the new version takes over like a
+    // load() without counting as one for runIfDirty().  0 turns it off.
+    void setAdaptive(uint32_t runs) { adaptiveRuns = runs; }
+    // Copies the counts of the current program, probed or laid out for
+    // them, and returns how many
+    int getProfile(struct ProbeSite *sites, int max);
+
+    // Why the last load failed, or ERROR_UNBOUND if it loaded but calls a
+    // handler not registered; 0 if all went well.  pos gets the offset of
+    // a syntax error.
+    int getLoadError(int *pos = NULL);
+
+    void getMemoryUsage(struct MemoryUsage *usage);
+    // Compile and run times, only counted while the handlers are profiled
+    void getRunStats(struct RunStats *stats);
+    void resetRunStats();
 
   protected:
     void printError(int err);
-    int eval2(char *s, int len, int *val);
-    char *skipSpace(char *s, char *e);
+    bool isReal(char variable);
+    void store(char variable, int value);
+    bool compile(const char *src, int len, const struct ProgramProbes *counts = NULL);
+    void adapt();
+#ifndef DISABLE_SPIFFS
+    bool loadCached(char *cacheName, const char *script, int scriptLen);
+#endif
+    struct LoadedProgram *newProgram(const uint8_t *image, int len, bool rom = false,
+				     int probes = 0);
+    void freeProgram(struct LoadedProgram *p);
+    bool publish(struct LoadedProgram *p, bool sameVersion = false);
+    int bindHandlers(struct LoadedProgram *p);
+    template <bool TRACE, bool PROFILE, bool LIMIT>
+    int execute(const struct LoadedProgram *p, RunContext *ctx);
+    void profileCall(const struct LoadedProgram *p, const struct Binding *b,
+		     int pc, const int *args, int argc, uint32_t us);
+    bool runProgram(RunContext *ctx, bool dirtyOnly);
+    int traceStep(const struct LoadedProgram *p, int pc, int v);
     void writeS(const char *s, int len);
     int stepRun();
-    int run(char *prg, int len);
 
   private:
-    char scriptBuf[1025];
-    int scriptLen;
-    int variables[26];
-    Vector<struct Function1> func1Handlers;
-    Vector<struct Function2> func2Handlers;
-    Vector<struct Function3> func3Handlers;
+    MyHandlers *handlers;
+    bool ownHandlers;
+    MyInterpreter *nextUser;		// Sharing the same handlers
+    struct LoadedProgram *current;
+    struct LoadedProgram *retired;
+    uint32_t loads;
+    int loadError;
+    int loadErrorPos;
+    uint32_t budgetOps;
+    uint32_t budgetCalls;
+    int budgetPolicy;
+    uint32_t adaptiveRuns;		// See setAdaptive()
+    struct RunStats runStats;
+    RunContext context;
+    RunContext *contexts;
+#ifdef ARCH_HOST
+    MyRecorder *recorder;		// Recording the runs on context
+    int recordId;
+#endif
     int runAnimate = 0;
     int runDelay = 0;
     int runStep = 0;
     bool reportProgPos = 0;
+
+  friend class MyHandlers;
+#ifdef ARCH_HOST
+  friend class MyExecutor;
+  friend class MyRecorder;
+  friend class MyReplay;
+#endif
 };
 
 #endif
@@ -0,0 +1,170 @@
+// A SMING-compatible C interpreter
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyLoader.h"
+#ifdef ARCH_HOST
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+static bool endsWith(const char *s, const char *suffix)
+{
+  int n = strlen(s), m = strlen(suffix);
+
+  return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static int byName(const void *a, const void *b)
+{
+  return strcmp(((const struct LoaderFile *)a)->name, ((const struct LoaderFile *)b)->name);
+}
+
+MyLoader::MyLoader(MyHandlers *handlers, int threads)
+{
+  this->handlers = handlers;
+  threadCount = threads > 0 ? threads : 1;
+  files = NULL;
+  fileCount = 0;
+  next = 0;
+  loadMicros = 0;
+}
+
+MyLoader::~MyLoader()
+{
+  clear();
+}
+
+void MyLoader::clear()
+{
+  int i;
+
+  for (i=0; i<fileCount; i++) {
+    delete files[i].interpreter;
+    free(files[i].name);
+  }
+  free(files);
+  files = NULL;
+  fileCount = 0;
+}
+
+int MyLoader::loadDirectory(const char *dir, const char *suffix)
+{
+  Vector<char *> names;
+  std::thread *pool;
+  struct dirent *e;
+  struct stat st;
+  DIR *d;
+  char *path;
+  uint32_t start = micros();
+  int i, n, loaded = 0;
+
+  clear();
+  if ((d = opendir(dir)) == NULL)
+    return -1;
+  while ((e = readdir(d)) != NULL) {
+    if (e->d_name[0] == '.'
+	|| (suffix ? !endsWith(e->d_name, suffix) : endsWith(e->d_name, PROGRAM_FILE_SUFFIX)))
+      continue;
+    path = (char *)malloc(strlen(dir) + strlen(e->d_name) + 2);
+    if (!path)
+      break;
+    sprintf(path, "%s/%s", dir, e->d_name);
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+      names.add(path);
+    else
+      free(path);
+  }
+  closedir(d);
+
+  n = names.count();
+  files = (struct LoaderFile *)calloc(n ? n : 1, sizeof(struct LoaderFile));
+  if (!files) {
+    for (i=0; i<n; i++)
+      free(names[i]);
+    return -1;
+  }
+  for (i=0; i<n; i++)
+    files[i].name = names[i];
+  qsort(files, n, sizeof(struct LoaderFile), byName);
+  // Joining the handler table is not thread safe
+  for (i=0; i<n; i++)
+    files[i].interpreter = new MyInterpreter(handlers);
+  fileCount = n;
+
+  next = 0;
+  n = fileCount < threadCount ? fileCount : threadCount;
+  pool = new std::thread[n];
+  // Nor is freeing the retired caches, each load would try
+  handlers->reclaimHeld = true;
+  for (i=0; i<n; i++)
+    pool[i] = std::thread(&MyLoader::work, this);
+  for (i=0; i<n; i++)
+    pool[i].join();
+  delete[] pool;
+  handlers->reclaimHeld = false;
+  handlers->reclaim();
+  loadMicros = micros() - start;
+
+  for (i=0; i<fileCount; i++)
+    if (!files[i].error)
+      loaded ++;
+  return loaded;
+}
+
+void MyLoader::work()
+{
+  int i;
+
+  while ((i = next++) < fileCount)
+    loadOne(files + i);
+}
+
+void MyLoader::loadOne(struct LoaderFile *f)
+{
+  struct stat st;
+  void *p = MAP_FAILED;
+  uint32_t start = micros();
+  int fd;
+
+  fd = open(f->name, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    f->error = ERROR_FILE;
+  } else if (st.st_size > SCRIPT_MAX) {
+    f->error = ERROR_TOO_BIG;
+  } else if (st.st_size > 0
+	     && (p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    f->error = ERROR_FILE;
+  } else {
+    // The script is compiled from the mapping, nothing is copied
+    f->interpreter->load((char *)(p != MAP_FAILED ? p : ""), st.st_size);
+    f->error = f->interpreter->getLoadError(&f->errorPos);
+    if (p != MAP_FAILED)
+      munmap(p, st.st_size);
+  }
+  if (fd >= 0)
+    close(fd);
+  f->micros = micros() - start;
+}
+
+void MyLoader::getStats(struct LoaderStats *stats)
+{
+  int i;
+
+  stats->files = fileCount;
+  stats->failed = 0;
+  for (i=0; i<fileCount; i++)
+    if (files[i].error)
+      stats->failed ++;
+  stats->micros = loadMicros;
+}
+
+#endif
@@ -0,0 +1,72 @@
+// A SMING-compatible C interpreter
+//
+// Bulk loader for the Linux (host) build.
+//
+// Loads every script of a directory into an interpreter of its own, all of
+// them sharing one handler table.  The files are mapped rather than copied
+// and compiled by a pool of threads, each taking the next file as soon as
+// it is done with one, so a start with hundreds of rules takes a fraction
+// of loading them one after the other.
+//
+// The handlers must be registered before loading and must not change while
+// it runs.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#ifndef __MYLOADER_H__
+#define __MYLOADER_H__
+#ifdef ARCH_HOST
+#include <atomic>
+#include "MyInterpreter.h"
+
+struct LoaderFile {
+  char *name;			// Path of the script
+  MyInterpreter *interpreter;
+  int error;			// 0 or an error code, see getLoadError()
+  int errorPos;			// Offset of a syntax error
+  uint32_t micros;		// Taken to map and compile the file
+};
+
+struct LoaderStats {
+  int files;
+  int failed;
+  uint32_t micros;		// Taken by the whole load
+};
+
+class MyLoader
+{
+  public:
+    MyLoader(MyHandlers *handlers, int threads);
+    // Deletes the interpreters
+    ~MyLoader();
+
+    // Loads the files of a directory whose name ends with suffix (all but
+    // compiled copies without one), in name order.  Returns the number of
+    // files loaded without error, -1 if the directory cannot be read.
+    int loadDirectory(const char *dir, const char *suffix = NULL);
+
+    int count() { return fileCount; }
+    struct LoaderFile *file(int i) { return i >= 0 && i < fileCount ? files + i : NULL; }
+    void getStats(struct LoaderStats *stats);
+
+  protected:
+    void clear();
+    void work();
+    void loadOne(struct LoaderFile *f);
+
+  private:
+    MyHandlers *handlers;
+    int threadCount;
+    struct LoaderFile *files;
+    int fileCount;
+    std::atomic<int> next;			// File to load next
+    uint32_t loadMicros;
+};
+
+#endif
+#endif
@@ -0,0 +1,485 @@
+// A SMING-compatible C interpreter
+//
+// Compiled program image.
+//
+// A script is compiled once into a small image made of a header, the
+// bytecode, an import table naming the handlers the script calls and the
+// string literals passed to them.  The
+// image holds no pointers and no handler addresses, so it can be written to
+// flash as is and used again after a single read: imports are re-bound by
+// name (and number of arguments) to the registerFunc* registrations.
+//
+// All multi-byte values are stored little endian and must be read bytewise,
+// the code is not aligned.  Operands are kept small: constants take one, two
+// or four bytes, jumps a one or two byte distance (see readDist()).
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#ifndef __MYPROGRAM_H__
+#define __MYPROGRAM_H__
+#include <stdint.h>
+
+#define PROGRAM_MAGIC	0x5049594d	// "MYIP"
+#define PROGRAM_VERSION	9
+#ifndef PROGRAM_STACK
+#define PROGRAM_STACK	32		// Depth of the value stack, 255 at most
+#endif
+#define PROGRAM_TEMPS	16		// Cached values, see MyCompiler.h
+#define PROGRAM_UNBOUND	0xff		// Import not bound to a handler
+#define IMPORT_PURE	0x80		// Arity flag, see MyCompiler::addPure()
+#define IMPORT_STRING	0x40		// Arity flag: first argument is a string
+#define STRING_MAX	255		// Longest string literal
+#define COST_UNBOUNDED	0xffffffff	// No bound known, see worstOps
+
+// The helpers shared with MyStaticCompiler.h can be evaluated while the
+// firmware is built from C++14 on
+#if __cplusplus >= 201402L
+#define SCRIPT_CONSTEXPR constexpr
+#else
+#define SCRIPT_CONSTEXPR inline
+#endif
+
+#ifndef PROGRAM_FILE_SUFFIX
+#define PROGRAM_FILE_SUFFIX ".bc"	// Compiled copy stored next to a script
+#endif
+
+enum OPCODES {
+  OP_HALT = 0,
+  OP_PUSHB,	// int8:  push constant
+  OP_PUSH,	// int32: push constant
+  OP_PUSHW,	// int16: push constant
+  OP_LOAD,	// uint8: push variable
+  OP_STORE,	// uint8: pop into variable
+  OP_DUP,
+  OP_POP,
+  OP_NEG,
+  OP_NOT,
+  OP_BNOT,
+  OP_MUL,
+  OP_DIV,
+  OP_MOD,
+  OP_ADD,
+  OP_SUB,
+  OP_SHL,
+  OP_SHR,
+  OP_LT,
+  OP_LE,
+  OP_GT,
+  OP_GE,
+  OP_EQ,
+  OP_NE,
+  OP_AND,
+  OP_XOR,
+  OP_OR,
+  OP_BOOL,	// Convert top of stack to 0/1
+  OP_JMP,	// dist: jump forward
+  OP_LOOP,	// dist: jump backward, keeps the watchdog alive
+  OP_JZ,	// dist: pop, jump if zero
+  OP_ANDJ,	// dist: jump if top is zero (keeping it), pop otherwise
+  OP_ORJ,	// dist: set top to 1 and jump if not zero, pop otherwise
+  OP_CALL,	// uint8:  call import, arguments are popped, result pushed
+  OP_CALLS,	// uint8, uint8: call import with a string, then the arguments
+  OP_TGET,	// uint8, dist: push temporary and jump if it is set
+  OP_TSET,	// uint8:  copy top into temporary, marking it set
+  OP_TCLEAR,	// uint16: mark the temporaries in the mask unset
+  OP_ITOR,	// Convert top of stack from int to real
+  OP_RTOI,	// Convert top of stack from real to int, truncating
+  OP_RNZ,	// Convert real top of stack to 0/1
+  OP_RNEG,
+  OP_RMUL,
+  OP_RDIV,
+  OP_RADD,
+  OP_RSUB,
+  OP_RLT,
+  OP_RLE,
+  OP_RGT,
+  OP_RGE,
+  OP_REQ,
+  OP_RNE,
+  OP_FORT,	// uint8, dist: jump forward unless the variable is below the top
+  OP_FORI,	// uint8, dist: increment the variable, jump backward while below
+  OP_JTAB,	// int32 low, uint16 count, uint16 default, count x uint16:
+		// pop, jump to entry value - low, to default out of range
+  OP_JFIND,	// uint16 count, uint16 default, count x { int32, uint16 }:
+		// pop, jump to the entry of the value, searched, or default
+  OP_INBITS,	// int32 low, uint8 count, count x uint8: replace top by 1 if
+		// bit top - low of the set is 1, by 0 otherwise
+  OP_INLIST,	// uint16 count, count x int32: replace top by 1 if it is one
+		// of the values, sorted, by 0 otherwise
+  OP_PROBE,	// uint8: count the probe, and if top is not zero, see
+		// MyCompiler::addProbes(); only in programs compiled in memory
+  OP_COUNT
+};
+
+struct ProgramHeader {
+  uint32_t magic;
+  uint8_t  version;
+  uint8_t  importCount;
+  uint8_t  maxStack;	// Deepest use of the value stack
+  uint8_t  temps;	// Temporaries used
+  uint32_t inputs;	// Variables read before being assigned, bit 0 is 'a'
+  uint32_t reals;	// Variables holding a real
+  uint32_t worstOps;	// Instructions a run takes at most, or COST_UNBOUNDED
+  uint32_t worstCalls;	// Handler calls a run makes at most, or COST_UNBOUNDED
+  uint32_t sourceHash;	// hash32() of the script source
+  uint32_t checksum;	// hash32() of everything following the header
+  uint16_t codeLen;
+  uint16_t importLen;	// Size of the import table in bytes
+  uint16_t stringLen;	// Size of the string table in bytes
+  uint8_t  stringCount;
+  uint8_t  realFormat;	// PROGRAM_REAL of the compiler
+};
+
+// Import table entries follow the code:
+//   uint8_t arity, uint8_t nameLen, char name[nameLen]
+// The arity has IMPORT_PURE set when the code was optimized on the
+// assumption that the handler is pure, IMPORT_STRING when the handler takes
+// a string before the arguments (the arity counts it).
+//
+// String table entries follow the imports, with a terminating null so a
+// handler can use them as C strings:
+//   uint8_t len, char text[len], 0
+
+// Integer arithmetic of the scripts, the same whether the compiler folds
+// it or the interpreter runs it: it wraps around on overflow, shift counts
+// are taken modulo 32 and INT32_MIN / -1 gives INT32_MIN, remainder 0.
+// The divisor must not be 0.
+static SCRIPT_CONSTEXPR int32_t intNeg(int32_t a)
+{
+  return (int32_t)(0u - (uint32_t)a);
+}
+
+static SCRIPT_CONSTEXPR int32_t intMul(int32_t a, int32_t b)
+{
+  return (int32_t)((uint32_t)a * (uint32_t)b);
+}
+
+static SCRIPT_CONSTEXPR int32_t intDiv(int32_t a, int32_t b)
+{
+  return b == -1 ? intNeg(a) : a / b;
+}
+
+static SCRIPT_CONSTEXPR int32_t intMod(int32_t a, int32_t b)
+{
+  return b == -1 ? 0 : a % b;
+}
+
+static SCRIPT_CONSTEXPR int32_t intAdd(int32_t a, int32_t b)
+{
+  return (int32_t)((uint32_t)a + (uint32_t)b);
+}
+
+static SCRIPT_CONSTEXPR int32_t intSub(int32_t a, int32_t b)
+{
+  return (int32_t)((uint32_t)a - (uint32_t)b);
+}
+
+static SCRIPT_CONSTEXPR int32_t intShl(int32_t a, int32_t b)
+{
+  return (int32_t)((uint32_t)a << (b & 31));
+}
+
+// Keeps the sign
+static SCRIPT_CONSTEXPR int32_t intShr(int32_t a, int32_t b)
+{
+  return a >> (b & 31);
+}
+
+// Reals are IEEE floats, or Q16.16 fixed point (-32768 to 32767.99998) when
+// built with SCRIPT_FIXED, for chips without a floating point unit.  Either
+// way a real takes the 32 bits of an int, on the stack and in the variables.
+// Fixed point results out of range saturate, as constants do, much as
+// floats go to infinity.
+//#define SCRIPT_FIXED
+#ifdef SCRIPT_FIXED
+#define PROGRAM_REAL	1
+#else
+#define PROGRAM_REAL	0
+#endif
+
+#ifdef SCRIPT_FIXED
+static inline int32_t realSaturate(int64_t v)
+{
+  return v > INT32_MAX ? INT32_MAX : v < INT32_MIN ? INT32_MIN : (int32_t)v;
+}
+
+static inline int32_t realFrom(double v)
+{
+  if (v >= 32768.0)
+    return INT32_MAX;
+  if (v <= -32768.0)
+    return INT32_MIN;
+  return (int32_t)(v * 65536.0 + (v < 0 ? -0.5 : 0.5));
+}
+
+static inline double realValue(int32_t r)
+{
+  return r / 65536.0;
+}
+
+static inline int32_t realFromInt(int32_t v)
+{
+  return realSaturate((int64_t)v * 65536);
+}
+
+static inline int32_t realToInt(int32_t r)
+{
+  return r / 65536;
+}
+
+static inline bool realTrue(int32_t r)
+{
+  return r != 0;
+}
+
+static inline int32_t realNeg(int32_t r)
+{
+  return realSaturate(-(int64_t)r);
+}
+
+static inline int32_t realAdd(int32_t a, int32_t b)
+{
+  return realSaturate((int64_t)a + b);
+}
+
+static inline int32_t realSub(int32_t a, int32_t b)
+{
+  return realSaturate((int64_t)a - b);
+}
+
+static inline int32_t realMul(int32_t a, int32_t b)
+{
+  return realSaturate(((int64_t)a * b) >> 16);
+}
+
+// b must not be 0
+static inline int32_t realDiv(int32_t a, int32_t b)
+{
+  return realSaturate(((int64_t)a * 65536) / b);
+}
+
+static inline bool realLess(int32_t a, int32_t b)
+{
+  return a < b;
+}
+
+static inline bool realEqual(int32_t a, int32_t b)
+{
+  return a == b;
+}
+#else
+static inline float realBits(int32_t r)
+{
+  union { int32_t i; float f; } u;
+
+  u.i = r;
+  return u.f;
+}
+
+static inline int32_t realFromFloat(float f)
+{
+  union { int32_t i; float f; } u;
+
+  u.f = f;
+  return u.i;
+}
+
+static inline int32_t realFrom(double v)
+{
+  return realFromFloat((float)v);
+}
+
+static inline double realValue(int32_t r)
+{
+  return realBits(r);
+}
+
+static inline int32_t realFromInt(int32_t v)
+{
+  return realFromFloat((float)v);
+}
+
+// Saturates out of range, NaN gives 0
+static inline int32_t realToInt(int32_t r)
+{
+  float f = realBits(r);
+
+  if (f != f)
+    return 0;
+  if (f >= 2147483648.0f)
+    return INT32_MAX;
+  if (f <= -2147483648.0f)
+    return INT32_MIN;
+  return (int32_t)f;
+}
+
+static inline bool realTrue(int32_t r)
+{
+  return realBits(r) != 0.0f;
+}
+
+static inline int32_t realNeg(int32_t r)
+{
+  return realFromFloat(-realBits(r));
+}
+
+static inline int32_t realAdd(int32_t a, int32_t b)
+{
+  return realFromFloat(realBits(a) + realBits(b));
+}
+
+static inline int32_t realSub(int32_t a, int32_t b)
+{
+  return realFromFloat(realBits(a) - realBits(b));
+}
+
+static inline int32_t realMul(int32_t a, int32_t b)
+{
+  return realFromFloat(realBits(a) * realBits(b));
+}
+
+static inline int32_t realDiv(int32_t a, int32_t b)
+{
+  return realFromFloat(realBits(a) / realBits(b));
+}
+
+static inline bool realLess(int32_t a, int32_t b)
+{
+  return realBits(a) < realBits(b);
+}
+
+static inline bool realEqual(int32_t a, int32_t b)
+{
+  return realBits(a) == realBits(b);
+}
+#endif
+
+// FNV-1a, used for the source hash and the image checksum
+static SCRIPT_CONSTEXPR uint32_t hash32(const uint8_t *p, int len, uint32_t h = 2166136261u)
+{
+  while (len-- > 0)
+    h = (h ^ *p++) * 16777619u;
+  return h;
+}
+
+static SCRIPT_CONSTEXPR uint16_t read16(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static SCRIPT_CONSTEXPR int32_t read32(const uint8_t *p)
+{
+  return (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static SCRIPT_CONSTEXPR void write16(uint8_t *p, uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static SCRIPT_CONSTEXPR void write32(uint8_t *p, int32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+// Jump distances are counted from the end of the instruction.  They take
+// one byte below 0x80, two (high byte first, flagged) up to PROGRAM_DIST.
+#define PROGRAM_DIST	0x7fff
+
+static inline int readDist(const uint8_t **pc)
+{
+  const uint8_t *p = *pc;
+
+  if (p[0] < 0x80) {
+    *pc = p + 1;
+    return p[0];
+  }
+  *pc = p + 2;
+  return ((p[0] & 0x7f) << 8) | p[1];
+}
+
+static SCRIPT_CONSTEXPR int distSize(int d)
+{
+  return d < 0x80 ? 1 : 2;
+}
+
+static SCRIPT_CONSTEXPR int writeDist(uint8_t *p, int d)
+{
+  if (d < 0x80) {
+    p[0] = d;
+    return 1;
+  }
+  p[0] = 0x80 | (d >> 8);
+  p[1] = d;
+  return 2;
+}
+
+// Jump tables of a switch.  Their targets are two byte distances forward
+// from the end of the instruction, the values of OP_JFIND are sorted.
+#define JTAB_HEAD	9	// op, int32 low, uint16 count, uint16 default
+#define JFIND_HEAD	5	// op, uint16 count, uint16 default
+#define JFIND_ENTRY	6	// int32 value, uint16 target
+
+static SCRIPT_CONSTEXPR int tableCount(const uint8_t *p)
+{
+  return read16(p + (p[0] == OP_JTAB ? 5 : 1));
+}
+
+// Offset of the target of entry i of a table, of the default for -1
+static SCRIPT_CONSTEXPR int tableEntry(const uint8_t *p, int i)
+{
+  if (p[0] == OP_JTAB)
+    return i < 0 ? 7 : JTAB_HEAD + 2 * i;
+  return i < 0 ? 3 : JFIND_HEAD + JFIND_ENTRY * i + 4;
+}
+
+// Size of the instruction at p including its operand
+static inline int opSize(const uint8_t *p)
+{
+  switch (p[0]) {
+  case OP_PUSHB:
+  case OP_LOAD:
+  case OP_STORE:
+  case OP_CALL:
+  case OP_TSET:
+  case OP_PROBE:
+    return 2;
+  case OP_PUSHW:
+  case OP_TCLEAR:
+  case OP_CALLS:
+    return 3;
+  case OP_JMP:
+  case OP_LOOP:
+  case OP_JZ:
+  case OP_ANDJ:
+  case OP_ORJ:
+    return 1 + (p[1] < 0x80 ? 1 : 2);
+  case OP_TGET:
+  case OP_FORT:
+  case OP_FORI:
+    return 2 + (p[2] < 0x80 ? 1 : 2);
+  case OP_PUSH:
+    return 5;
+  case OP_JTAB:
+    return JTAB_HEAD + 2 * tableCount(p);
+  case OP_JFIND:
+    return JFIND_HEAD + JFIND_ENTRY * tableCount(p);
+  case OP_INBITS:
+    return 6 + p[5];
+  case OP_INLIST:
+    return 3 + 4 * read16(p + 1);
+  default:
+    return 1;
+  }
+}
+
+#endif
@@ -0,0 +1,265 @@
+// A SMING-compatible C interpreter
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyReplay.h"
+#ifdef ARCH_HOST
+#include <unistd.h>
+
+#define REPLAY_HEADER	5	// Magic and version
+#define REPLAY_RECORD	7	// Record without its bindings
+#define REPLAY_BINDING	5
+
+MyRecorder::MyRecorder()
+{
+  file = NULL;
+  last = 0;
+}
+
+MyRecorder::~MyRecorder()
+{
+  int i;
+
+  close();
+  for (i=0; i<(int)scripts.count(); i++) {
+    if (scripts[i])
+      scripts[i]->recorder = NULL;
+    free(values[i]);
+  }
+}
+
+bool MyRecorder::open(const char *fileName)
+{
+  uint8_t header[REPLAY_HEADER];
+
+  close();
+  file = fopen(fileName, "wb");
+  if (!file)
+    return false;
+  write32(header, REPLAY_MAGIC);
+  header[4] = REPLAY_VERSION;
+  last = micros();
+  return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+void MyRecorder::close()
+{
+  if (file)
+    fclose(file);
+  file = NULL;
+}
+
+int MyRecorder::addScript(MyInterpreter *interpreter)
+{
+  int *v;
+
+  if (scripts.count() >= 255 || (v = (int *)malloc(26 * sizeof(int))) == NULL)
+    return -1;
+  interpreter->recorder = this;
+  interpreter->recordId = scripts.count();
+  scripts.add(interpreter);
+  pending.add(0);
+  values.add(v);
+  return interpreter->recordId;
+}
+
+// The number stays taken, the trace may already hold runs of the script
+void MyRecorder::removeScript(int script)
+{
+  scripts[script] = NULL;
+}
+
+// Only the last value set before a run is kept
+void MyRecorder::bind(int script, int variable, int value)
+{
+  int idx = variable >= 'a' ? variable - 'a' : variable - 'A';
+
+  if (idx < 0 || idx >= 26)
+    return;
+  pending[script] |= 1u << idx;
+  values[script][idx] = value;
+}
+
+void MyRecorder::record(int script, int kind)
+{
+  uint8_t buf[REPLAY_RECORD + 26 * REPLAY_BINDING], *p;
+  uint32_t now = micros();
+  int i;
+
+  if (!file)
+    return;
+  write32(buf, now - last);
+  buf[4] = script;
+  buf[5] = kind;
+  buf[6] = 0;
+  p = buf + REPLAY_RECORD;
+  for (i=0; i<26; i++) {
+    if (pending[script] & (1u << i)) {
+      p[0] = i;
+      write32(p+1, values[script][i]);
+      p += REPLAY_BINDING;
+      buf[6] ++;
+    }
+  }
+  pending[script] = 0;
+  last = now;
+  fwrite(buf, 1, p - buf, file);
+}
+
+static int stub1(int)
+{
+  return 0;
+}
+
+static int stub2(int, int)
+{
+  return 0;
+}
+
+static int stub3(int, int, int)
+{
+  return 0;
+}
+
+static int stubS(const char *, int, int)
+{
+  return 0;
+}
+
+MyReplay::MyReplay()
+{
+  trace = NULL;
+  traceLen = 0;
+}
+
+MyReplay::~MyReplay()
+{
+  free(trace);
+}
+
+int MyReplay::addScript(MyInterpreter *interpreter)
+{
+  scripts.add(interpreter);
+  return scripts.count() - 1;
+}
+
+int MyReplay::stubHandlers(MyInterpreter *interpreter)
+{
+  const struct LoadedProgram *prog = interpreter->current;
+  const struct ProgramHeader *hdr;
+  const uint8_t *p;
+  char name[256];
+  int i, n = 0;
+
+  if (!prog)
+    return 0;
+  hdr = (const struct ProgramHeader *)prog->image;
+  p = prog->image + sizeof(*hdr) + hdr->codeLen;
+  for (i=0; i<hdr->importCount; i++, p += 2 + p[1]) {
+    if (prog->bindings[i].handler != PROGRAM_UNBOUND)
+      continue;
+    memcpy(name, p+2, p[1]);
+    name[p[1]] = 0;
+    if (prog->bindings[i].arity & IMPORT_STRING)
+      interpreter->registerFuncS(name, stubS);
+    else if (prog->bindings[i].arity == 1)
+      interpreter->registerFunc1(name, stub1);
+    else if (prog->bindings[i].arity == 2)
+      interpreter->registerFunc2(name, stub2);
+    else
+      interpreter->registerFunc3(name, stub3);
+    n ++;
+  }
+  return n;
+}
+
+bool MyReplay::open(const char *fileName)
+{
+  FILE *f;
+  long len;
+
+  free(trace);
+  trace = NULL;
+  traceLen = 0;
+  if ((f = fopen(fileName, "rb")) == NULL)
+    return false;
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (len >= REPLAY_HEADER && (trace = (uint8_t *)malloc(len)) != NULL
+      && fread(trace, 1, len, f) == (size_t)len
+      && (uint32_t)read32(trace) == REPLAY_MAGIC && trace[4] == REPLAY_VERSION) {
+    traceLen = len;
+  } else {
+    free(trace);
+    trace = NULL;
+  }
+  fclose(f);
+  return trace != NULL;
+}
+
+static int byLatency(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+// Stops at the first record which does not fit the trace or the scripts
+bool MyReplay::replay(bool timed, struct ReplayStats *stats)
+{
+  const uint8_t *p, *e = trace + traceLen;
+  uint32_t *latency = NULL, start, at, now, calls;
+  MyInterpreter *in;
+  int i, n, count = 0;
+
+  memset(stats, 0, sizeof(*stats));
+  if (!trace)
+    return false;
+  // One latency per record at most
+  latency = (uint32_t *)malloc((traceLen / REPLAY_RECORD + 1) * sizeof(uint32_t));
+  if (!latency)
+    return false;
+
+  start = at = micros();
+  for (p = trace + REPLAY_HEADER; p + REPLAY_RECORD <= e; p += n) {
+    n = REPLAY_RECORD + p[6] * REPLAY_BINDING;
+    if (p + n > e || p[4] >= scripts.count())
+      break;
+    in = scripts[p[4]];
+    at += read32(p);
+    if (timed && (int32_t)(at - (now = micros())) > 0)
+      usleep(at - now);
+
+    for (i=0; i<p[6]; i++)
+      in->context.setVariable('a' + p[REPLAY_RECORD + i*REPLAY_BINDING],
+			      read32(p + REPLAY_RECORD + i*REPLAY_BINDING + 1));
+    calls = in->context.calls;
+    now = micros();
+    if (p[5] == REPLAY_DIRTY)
+      in->runProgram(&in->context, true);
+    else
+      in->runProgram(&in->context, false);
+    latency[count++] = micros() - now;
+    stats->calls += in->context.calls - calls;
+  }
+
+  stats->messages = count;
+  stats->micros = micros() - start;
+  stats->perSecond = stats->micros ? (uint64_t)count * 1000000 / stats->micros : 0;
+  if (count) {
+    qsort(latency, count, sizeof(uint32_t), byLatency);
+    stats->p50 = latency[(count - 1) * 50 / 100];
+    stats->p99 = latency[(count - 1) * 99 / 100];
+    stats->p999 = latency[(int)((count - 1) * 999LL / 1000)];
+  }
+  free(latency);
+  return p == e;
+}
+
+#endif
@@ -0,0 +1,100 @@
+// A SMING-compatible C interpreter
+//
+// Recording and replay of script runs for the Linux (host) build.
+//
+// MyRecorder writes what the scripts added to it were run with to a trace
+// file: for each run(), or runIfDirty(), the time since the previous one,
+// the script and the variables set by setVariable() since its last run.
+// MyReplay feeds a trace to the same rule set as fast as possible or with
+// the recorded timing, to compare interpreter changes on real traffic.
+//
+// A trace starts with REPLAY_MAGIC and REPLAY_VERSION (uint32, uint8),
+// followed by the records, stored little endian like program images:
+//   uint32_t delay (us), uint8_t script, uint8_t kind, uint8_t count,
+//   count x { uint8_t variable, int32_t value }
+// Values are kept as stored in the variables, reals as their bits.
+//
+// Only the interpreter's own context is recorded, runs on a RunContext of
+// their own (see MyExecutor) are not.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#ifndef __MYREPLAY_H__
+#define __MYREPLAY_H__
+#ifdef ARCH_HOST
+#include <stdio.h>
+#include "MyInterpreter.h"
+
+#define REPLAY_MAGIC	0x5254594d	// "MYTR"
+#define REPLAY_VERSION	1
+
+enum REPLAY_KINDS {
+  REPLAY_RUN = 0,
+  REPLAY_DIRTY = 1	// runIfDirty()
+};
+
+class MyRecorder
+{
+  public:
+    MyRecorder();
+    ~MyRecorder();
+
+    bool open(const char *fileName);
+    void close();
+    // Records the runs of an interpreter, returns its number in the trace
+    int addScript(MyInterpreter *interpreter);
+
+  protected:
+    void bind(int script, int variable, int value);
+    void record(int script, int kind);
+    void removeScript(int script);
+
+  private:
+    FILE *file;
+    uint32_t last;			// micros() of the previous record
+    Vector<MyInterpreter *> scripts;	// NULL once destroyed
+    Vector<uint32_t> pending;		// Variables set since the last run
+    Vector<int *> values;		// 26 per script
+
+  friend class MyInterpreter;
+};
+
+struct ReplayStats {
+  uint32_t messages;	// Runs replayed
+  uint32_t micros;	// Taken by the whole replay
+  uint32_t perSecond;
+  uint32_t p50;		// Latency of a run, us
+  uint32_t p99;
+  uint32_t p999;
+  uint32_t calls;	// Handler calls, cached results not included
+};
+
+class MyReplay
+{
+  public:
+    MyReplay();
+    ~MyReplay();
+
+    // Scripts are added in the order they were added to the recorder
+    int addScript(MyInterpreter *interpreter);
+    // Registers handlers returning 0 for those the script calls but which
+    // are not registered
+    int stubHandlers(MyInterpreter *interpreter);
+
+    bool open(const char *fileName);
+    // With timed, runs are spaced as recorded instead of back to back
+    bool replay(bool timed, struct ReplayStats *stats);
+
+  private:
+    uint8_t *trace;
+    int traceLen;
+    Vector<MyInterpreter *> scripts;
+};
+
+#endif
+#endif
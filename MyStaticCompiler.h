@@ -0,0 +1,1784 @@
+// A SMING-compatible C interpreter
+//
+// Compiler run while the firmware is built, for scripts written as string
+// literals.  The C++ compiler (C++17 or later) turns the script into a
+// constant program image: a syntax error stops the build and loading the
+// rule neither parses nor copies anything.
+//
+//   STATIC_SCRIPT(rule, "if(n==40){print(v);}");
+//
+//   interpreter.loadStatic(rule.image(), rule.length());
+//
+// The grammar and the code are those of MyCompiler, less the caching of
+// repeated expressions which depends on the handlers registered as pure.
+// The image is used in place and read a byte at a time, so it must stay
+// in memory allowing that.  SCRIPT_ROM may name a section of such memory;
+// it is empty by default.  Not the flash of the ESP8266
+// (ICACHE_RODATA_ATTR, PROGMEM): it only allows aligned 32 bit reads.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#ifndef __MYSTATICCOMPILER_H__
+#define __MYSTATICCOMPILER_H__
+#if __cplusplus < 201703L
+#error "MyStaticCompiler.h needs C++17"
+#endif
+#include "MyInterpreter.h"
+
+#ifndef SCRIPT_ROM
+#define SCRIPT_ROM
+#endif
+
+// Room for the code of a script of len characters, before its jumps are
+// made short
+#define STATIC_CODE(len)	(4 * (len) + 16)
+
+// Compiles a script literal into name, a MyStaticProgram.  The compiler
+// itself only lives while the C++ compiler evaluates it.
+#define STATIC_SCRIPT(name, script)					\
+  static constexpr SCRIPT_ROM auto name = [] {				\
+    constexpr MyStaticCompiler<sizeof(script)> compiler(script);	\
+    static_assert(!compiler.error(), "Script does not compile: " script); \
+    return MyStaticProgram<compiler.bodyLength()>(compiler);		\
+  }()
+
+// The real constant nearest to v, see realFrom()
+static constexpr int32_t realConst(double v)
+{
+#ifdef SCRIPT_FIXED
+  return v >= 32768.0 ? INT32_MAX : v <= -32768.0 ? INT32_MIN
+    : (int32_t)(v * 65536.0 + (v < 0 ? -0.5 : 0.5));
+#else
+  uint32_t sign = v < 0 ? 0x80000000u : 0;
+  float f = 0;
+  int e = 0;
+
+  if (v != v)
+    return 0x7fc00000;
+  if (v < 0)
+    v = -v;
+  // Rounding up past the largest float gives infinity
+  if (v >= 3.4028235677973366e38)
+    return sign | 0x7f800000;
+  f = v > 3.4028234663852886e38 ? 3.4028234663852886e38f : (float)v;
+  if (f == 0)
+    return sign;
+  // Scaled to [1, 2) unless it is denormal, which is exact
+  while (f >= 2) {
+    f /= 2;
+    e ++;
+  }
+  while (f < 1 && e > -126) {
+    f *= 2;
+    e --;
+  }
+  if (f < 1)
+    return sign | (uint32_t)(f * 8388608.0f);
+  return sign | (uint32_t)(e + 127) << 23 | (uint32_t)((f - 1) * 8388608.0f);
+#endif
+}
+
+// As realNeg()
+static constexpr int32_t realConstNeg(int32_t r)
+{
+#ifdef SCRIPT_FIXED
+  return r == INT32_MIN ? INT32_MAX : -r;
+#else
+  return (int32_t)((uint32_t)r ^ 0x80000000u);
+#endif
+}
+
+template <int N>
+class MyStaticCompiler
+{
+  public:
+    constexpr MyStaticCompiler(const char (&script)[N]);
+
+    // 0 or an error code, see MyCompiler::compile()
+    constexpr int error() const { return err; }
+    constexpr int errorPos() const { return errPos; }
+    // Bytes of the image following the header
+    constexpr int bodyLength() const { return codeLen + importLen + stringLen; }
+    constexpr struct ProgramHeader header() const { return hdr; }
+    constexpr uint8_t body(int i) const
+    {
+      return i < codeLen ? code[i]
+	: i < codeLen + importLen ? imports[i - codeLen]
+	: strings[i - codeLen - importLen];
+    }
+
+  private:
+    enum {
+      NODE_CAP = N + 1,
+      CODE_CAP = STATIC_CODE(N),
+      TABLE_CAP = N + 2
+    };
+
+    constexpr void next();
+    constexpr bool accept(int t);
+    constexpr bool expect(int t);
+    constexpr int fail(int pos);
+    constexpr int tooBig();
+    constexpr int tooDeep(int pos);
+
+    constexpr int newNode(int kind, int pos);
+    constexpr int measure(int n);
+    constexpr int parseBlock(int close);
+    constexpr int parseCases();
+    constexpr int parseStatement();
+    constexpr int statement();
+    constexpr int parseIf();
+    constexpr int parseExpr();
+    constexpr int expression();
+    constexpr int parseBinary(int minPrec);
+    constexpr int parseUnary();
+    constexpr int unary();
+    constexpr int parsePrimary();
+    constexpr int parseCall();
+    constexpr int parseSet(int l, int pos);
+    constexpr int import(int name, int len, int arity);
+    constexpr int addString(int s, int len);
+
+    constexpr uint32_t varsOf(int n);
+    constexpr uint32_t killsOf(int n);
+    constexpr uint32_t inputsOf(int n, uint32_t *defined);
+    constexpr void inferTypes();
+    constexpr uint32_t exprCost(int n, uint32_t *calls);
+    constexpr uint32_t worstOf(int n, uint32_t *calls);
+
+    constexpr bool room(int len);
+    constexpr void emit(uint8_t op);
+    constexpr void emit8(uint8_t op, uint8_t v);
+    constexpr int emitJump(uint8_t op, int target);
+    constexpr void patch(int chain, int target);
+    constexpr void compact();
+    constexpr void push(int n);
+    constexpr void genSet(int n);
+    constexpr void genValue(int n);
+    constexpr void genAs(int n, int type);
+    constexpr void genTest(int n);
+    constexpr void genEffect(int n);
+    constexpr int genCond(int n);
+    constexpr bool isCounted(int n);
+    constexpr void genCounted(int n);
+    constexpr void genSwitch(int n);
+    constexpr void genStatement(int n);
+
+    const char *src;
+    int cur;
+    int end;
+    int tok = 0;
+    int tokPos = 0;
+    int lastEnd = 0;
+    int tokLen = 0;
+    int32_t tokVal = 0;
+
+    Node nodes[NODE_CAP] = {};
+    int nodeCount = 0;
+    int loopDepth = 0;
+    int switchDepth = 0;
+    int nesting = 0;
+    uint32_t reals = 0;
+
+    uint8_t code[CODE_CAP] = {};
+    int codeLen = 0;
+    uint8_t imports[TABLE_CAP] = {};
+    int importLen = 0;
+    int importCount = 0;
+    uint8_t strings[TABLE_CAP] = {};
+    int stringLen = 0;
+    int stringCount = 0;
+    int depth = 0;
+    int maxDepth = 0;
+    int breakChain = -1;
+    int continueChain = -1;
+
+    struct ProgramHeader hdr = {};
+    int err = 0;
+    int errPos = 0;
+};
+
+// A compiled script, laid out like the images of MyCompiler
+template <int L>
+class MyStaticProgram
+{
+  public:
+    template <int N>
+    constexpr MyStaticProgram(const MyStaticCompiler<N> &compiler)
+      : hdr(compiler.header())
+    {
+      for (int i = 0; i < L; i ++)
+	body[i] = compiler.body(i);
+    }
+
+    const uint8_t *image() const { return (const uint8_t *)this; }
+    int length() const { return sizeof(struct ProgramHeader) + L; }
+
+  private:
+    struct ProgramHeader hdr;
+    uint8_t body[L > 0 ? L : 1] = {};
+};
+
+template <int N>
+constexpr MyStaticCompiler<N>::MyStaticCompiler(const char (&script)[N])
+  : src(script), cur(0), end(N - 1)
+{
+  uint32_t defined = 0, worstCalls = 0, worstOps = 0, h = 2166136261u;
+  int root = -1, i = 0;
+
+  // As load() would
+  if (end > SCRIPT_MAX) {
+    err = ERROR_TOO_BIG;
+    return;
+  }
+  next();
+  root = parseBlock(T_END);
+  if (root < 0)
+    return;
+  inferTypes();
+  worstOps = worstOf(root, &worstCalls);
+  genStatement(root);
+  emit(OP_HALT);
+  if (!err && maxDepth > PROGRAM_STACK)
+    err = ERROR_DEPTH;
+  if (err)
+    return;
+  compact();
+  if (codeLen > PROGRAM_DIST) {
+    err = ERROR_TOO_BIG;
+    return;
+  }
+
+  for (i = 0; i < end; i ++)
+    h = (h ^ (uint8_t)src[i]) * 16777619u;
+  hdr.magic = PROGRAM_MAGIC;
+  hdr.version = PROGRAM_VERSION;
+  hdr.importCount = importCount;
+  hdr.maxStack = maxDepth;
+  hdr.temps = 0;
+  hdr.inputs = inputsOf(root, &defined);
+  hdr.reals = reals;
+  hdr.worstOps = worstOps;
+  hdr.worstCalls = worstCalls;
+  hdr.sourceHash = h;
+  hdr.codeLen = codeLen;
+  hdr.importLen = importLen;
+  hdr.stringLen = stringLen;
+  hdr.stringCount = stringCount;
+  hdr.realFormat = PROGRAM_REAL;
+  h = hash32(code, codeLen);
+  h = hash32(imports, importLen, h);
+  hdr.checksum = hash32(strings, stringLen, h);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Lexer
+//////////////////////////////////////////////////////////////////////////////
+
+template <int N>
+constexpr void MyStaticCompiler<N>::next()
+{
+  int s = cur, p = 0, i = 0;
+  uint32_t v = 0;
+  double r = 0, frac = 0, scale = 1;
+  bool real = false;
+
+  lastEnd = cur;
+  for (;;) {
+    while (s<end && (src[s] == ' ' || src[s] == '\t' || src[s] == '\r' || src[s] == '\n'))
+      s ++;
+    if (s+1<end && src[s] == '/' && src[s+1] == '/') {
+      while (s<end && src[s] != '\n')
+	s ++;
+    } else if (s+1<end && src[s] == '/' && src[s+1] == '*') {
+      for (s += 2; s<end && !(src[s] == '*' && s+1<end && src[s+1] == '/'); s ++)
+	;
+      s = s<end ? s + 2 : end;
+    } else {
+      break;
+    }
+  }
+  tokPos = s;
+
+  if (s>=end || src[s] == 0) {
+    tok = T_END;
+  } else if (src[s]>='0' && src[s]<='9') {
+    if (src[s] == '0' && s+1<end && (src[s+1] == 'x' || src[s+1] == 'X')) {
+      for (s += 2;; s ++) {
+	if (s<end && src[s]>='0' && src[s]<='9')
+	  v = (v<<4) + (src[s] - '0');
+	else if (s<end && src[s]>='a' && src[s]<='f')
+	  v = (v<<4) + (src[s] - 'a' + 0xa);
+	else if (s<end && src[s]>='A' && src[s]<='F')
+	  v = (v<<4) + (src[s] - 'A' + 0xa);
+	else
+	  break;
+      }
+    } else if (src[s] == '0' && s+1<end && (src[s+1] == 'b' || src[s+1] == 'B')) {
+      for (s += 2; s<end && (src[s] == '0' || src[s] == '1'); s ++)
+	v = (v<<1) + (src[s] - '0');
+    } else {
+      for (; s<end && src[s]>='0' && src[s]<='9'; s ++)
+	v = v*10 + (src[s] - '0');
+      // A fraction makes it a real
+      if (s+1<end && src[s] == '.' && src[s+1]>='0' && src[s+1]<='9') {
+	for (i = tokPos; i < s; i ++)
+	  r = r*10 + (src[i] - '0');
+	for (s ++; s<end && src[s]>='0' && src[s]<='9'; s ++) {
+	  frac = frac*10 + (src[s] - '0');
+	  scale *= 10;
+	}
+	real = true;
+      }
+    }
+    tok = real ? T_REAL : T_NUM;
+    tokVal = real ? realConst(r + frac / scale) : (int32_t)v;
+  } else if (src[s] == '"') {
+    // Escapes are decoded by addString()
+    for (s ++; s<end && src[s] != '"' && src[s] != '\n'; s ++)
+      if (src[s] == '\\' && s+1<end)
+	s ++;
+    if (s<end && src[s] == '"') {
+      s ++;
+      tok = T_STR;
+    } else {
+      tok = '"';
+    }
+  } else if ((src[s]>='a' && src[s]<='z') || (src[s]>='A' && src[s]<='Z') || src[s] == '_') {
+    for (p = s; s<end && ((src[s]>='a' && src[s]<='z') || (src[s]>='A' && src[s]<='Z')
+			  || src[s] == '_' || (src[s]>='0' && src[s]<='9')); s ++)
+      ;
+    tok = T_IDENT;
+    for (i = 0; i < (int)KEYWORD_NUM; i ++) {
+      const struct Keyword &k = keywords[i];
+      int j = 0;
+
+      if (s-p != k.len)
+	continue;
+      while (j < k.len && k.name[j] == src[p+j])
+	j ++;
+      if (j == k.len) {
+	tok = k.tok;
+	tokVal = k.val;
+	break;
+      }
+    }
+  } else {
+    char c = src[s++], c2 = s<end ? src[s] : 0;
+
+    tok = (uint8_t)c;
+    if (c == '|' && c2 == '|')
+      tok = T_OROR;
+    else if (c == '&' && c2 == '&')
+      tok = T_ANDAND;
+    else if (c == '=' && c2 == '=')
+      tok = T_EQ;
+    else if (c == '!' && c2 == '=')
+      tok = T_NE;
+    else if (c == '<' && c2 == '=')
+      tok = T_LE;
+    else if (c == '>' && c2 == '=')
+      tok = T_GE;
+    else if (c == '<' && c2 == '<')
+      tok = T_SHL;
+    else if (c == '>' && c2 == '>')
+      tok = T_SHR;
+    if (tok >= 256)
+      s ++;
+  }
+
+  tokLen = s - tokPos;
+  cur = s;
+}
+
+template <int N>
+constexpr bool MyStaticCompiler<N>::accept(int t)
+{
+  if (tok != t)
+    return false;
+  next();
+  return true;
+}
+
+template <int N>
+constexpr bool MyStaticCompiler<N>::expect(int t)
+{
+  if (accept(t))
+    return true;
+  fail(tokPos);
+  return false;
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::fail(int pos)
+{
+  if (!err) {
+    err = ERROR_SYNTAX;
+    errPos = pos;
+  }
+  return -1;
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::tooBig()
+{
+  if (!err)
+    err = ERROR_TOO_BIG;
+  return -1;
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::tooDeep(int pos)
+{
+  if (!err) {
+    err = ERROR_DEPTH;
+    errPos = pos;
+  }
+  return -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Parser
+//////////////////////////////////////////////////////////////////////////////
+
+template <int N>
+constexpr int MyStaticCompiler<N>::newNode(int kind, int pos)
+{
+  Node *n = nodes + nodeCount;
+
+  if (nodeCount >= NODE_CAP)
+    return tooBig();
+  n->kind = kind;
+  n->op = 0;
+  n->flags = 0;
+  n->temp = -1;
+  n->height = 1;
+  n->type = TYPE_INT;
+  n->a = n->b = n->c = n->d = n->next = -1;
+  n->pos = pos;
+  n->len = lastEnd - pos;
+  n->val = 0;
+  return nodeCount++;
+}
+
+// Records the height of a node once its children are set
+template <int N>
+constexpr int MyStaticCompiler<N>::measure(int n)
+{
+  Node *p = nodes + n;
+  int h = 0, c = -1;
+
+  if (p->kind == N_BLOCK || p->kind == N_CALL) {
+    for (c = p->a; c >= 0; c = nodes[c].next)
+      if (nodes[c].height > h)
+	h = nodes[c].height;
+  } else {
+    if (p->a >= 0 && nodes[p->a].height > h)
+      h = nodes[p->a].height;
+    if (p->b >= 0 && nodes[p->b].height > h)
+      h = nodes[p->b].height;
+    if (p->c >= 0 && nodes[p->c].height > h)
+      h = nodes[p->c].height;
+    if (p->d >= 0 && nodes[p->d].height > h)
+      h = nodes[p->d].height;
+  }
+  if (h >= SCRIPT_HEIGHT)
+    return tooDeep(p->pos);
+  p->height = h + 1;
+  return n;
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::parseBlock(int close)
+{
+  int n = newNode(N_BLOCK, tokPos), s = -1, last = -1;
+
+  if (n < 0)
+    return -1;
+  while (tok != close) {
+    if (tok == T_END)
+      return fail(tokPos);
+    if ((s = parseStatement()) < 0)
+      return -1;
+    if (last < 0)
+      nodes[n].a = s;
+    else
+      nodes[last].next = s;
+    last = s;
+  }
+  nodes[n].len = tokPos - nodes[n].pos;
+  return measure(n);
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::parseCases()
+{
+  int n = -1, s = -1, e = -1, c = -1, kind = N_CASE, last = -1, pos = 0;
+
+  if (!expect('{') || (n = newNode(N_BLOCK, tokPos)) < 0)
+    return -1;
+  while (tok != '}') {
+    pos = tokPos;
+    if (tok == T_END)
+      return fail(tokPos);
+    if (tok == T_CASE || tok == T_DEFAULT) {
+      kind = tok == T_CASE ? N_CASE : N_DEFAULT;
+      next();
+      if (kind == N_CASE) {
+	if ((e = parseExpr()) < 0)
+	  return -1;
+	if (nodes[e].kind != N_NUM)
+	  return fail(nodes[e].pos);
+      }
+      if (!expect(':'))
+	return -1;
+      for (c = nodes[n].a; c >= 0; c = nodes[c].next)
+	if (nodes[c].kind == kind && (kind == N_DEFAULT || nodes[c].val == nodes[e].val))
+	  return fail(pos);
+      if ((s = newNode(kind, pos)) < 0)
+	return -1;
+      if (kind == N_CASE)
+	nodes[s].val = nodes[e].val;
+    } else if ((s = parseStatement()) < 0) {
+      return -1;
+    }
+    if (last < 0)
+      nodes[n].a = s;
+    else
+      nodes[last].next = s;
+    last = s;
+  }
+  nodes[n].len = tokPos - nodes[n].pos;
+  return measure(n);
+}
+
+// The parser counts its recursion like MyCompiler, whose limits apply
+template <int N>
+constexpr int MyStaticCompiler<N>::parseStatement()
+{
+  int n = -1;
+
+  nesting ++;
+  n = statement();
+  nesting --;
+  return n;
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::statement()
+{
+  int n = -1, a = -1, b = -1, c = -1, d = -1, kind = N_BLOCK, pos = tokPos;
+
+  if (nesting > SCRIPT_NESTING)
+    return tooDeep(pos);
+
+  switch (tok) {
+  case '{':
+    next();
+    if ((n = parseBlock('}')) < 0 || !expect('}'))
+      return -1;
+    return n;
+
+  case ';':
+    next();
+    return newNode(N_BLOCK, pos);
+
+  case T_IF:
+    return parseIf();
+
+  case T_WHILE:
+    kind = N_WHILE;
+    next();
+    if (!expect('(') || (a = parseExpr()) < 0 || !expect(')'))
+      return -1;
+    loopDepth ++;
+    b = parseStatement();
+    loopDepth --;
+    if (b < 0)
+      return -1;
+    break;
+
+  case T_FOR:
+    kind = N_FOR;
+    next();
+    if (!expect('('))
+      return -1;
+    if (tok != ';' && (a = parseExpr()) < 0)
+      return -1;
+    if (!expect(';'))
+      return -1;
+    if (tok != ';' && (b = parseExpr()) < 0)
+      return -1;
+    if (!expect(';'))
+      return -1;
+    if (tok != ')' && (c = parseExpr()) < 0)
+      return -1;
+    if (!expect(')'))
+      return -1;
+    loopDepth ++;
+    d = parseStatement();
+    loopDepth --;
+    if (d < 0)
+      return -1;
+    break;
+
+  case T_SWITCH:
+    kind = N_SWITCH;
+    next();
+    if (!expect('(') || (a = parseExpr()) < 0 || !expect(')'))
+      return -1;
+    switchDepth ++;
+    b = parseCases();
+    switchDepth --;
+    if (b < 0 || !expect('}'))
+      return -1;
+    break;
+
+  case T_BREAK:
+  case T_CONTINUE:
+    kind = tok == T_BREAK ? N_BREAK : N_CONTINUE;
+    if (!loopDepth && !(kind == N_BREAK && switchDepth))
+      return fail(pos);
+    next();
+    if (!expect(';'))
+      return -1;
+    break;
+
+  default:
+    kind = N_EXPR;
+    if ((a = parseExpr()) < 0)
+      return -1;
+    // The last statement of a script may omit the ';'
+    if (tok != T_END && !expect(';'))
+      return -1;
+    break;
+  }
+
+  if ((n = newNode(kind, pos)) < 0)
+    return -1;
+  nodes[n].a = a;
+  nodes[n].b = b;
+  nodes[n].c = c;
+  nodes[n].d = d;
+  return measure(n);
+}
+
+// An else-if chain takes one level of nesting, see MyCompiler::parseIf()
+template <int N>
+constexpr int MyStaticCompiler<N>::parseIf()
+{
+  int n = -1, a = -1, b = -1, first = -1, last = -1, pos = 0;
+
+  for (;;) {
+    pos = tokPos;
+    next();
+    if (!expect('(') || (a = parseExpr()) < 0 || !expect(')')
+	|| (b = parseStatement()) < 0 || (n = newNode(N_IF, pos)) < 0)
+      return -1;
+    nodes[n].a = a;
+    nodes[n].b = b;
+    nodes[n].d = last;
+    if (last < 0)
+      first = n;
+    else
+      nodes[last].c = n;
+    last = n;
+    if (!accept(T_ELSE))
+      break;
+    if (tok != T_IF) {
+      if ((nodes[last].c = parseStatement()) < 0)
+	return -1;
+      break;
+    }
+  }
+
+  for (n = last; n >= 0; n = a) {
+    a = nodes[n].d;
+    nodes[n].d = -1;
+    nodes[n].len = lastEnd - nodes[n].pos;
+    if (measure(n) < 0)
+      return -1;
+  }
+  return first;
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::parseExpr()
+{
+  int n = -1;
+
+  nesting ++;
+  n = expression();
+  nesting --;
+  return n;
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::expression()
+{
+  int n = -1, l = -1, r = -1, pos = tokPos;
+
+  if (nesting > SCRIPT_NESTING)
+    return tooDeep(pos);
+  if ((l = parseBinary(1)) < 0 || tok != '=')
+    return l;
+  if (nodes[l].kind != N_VAR)
+    return fail(tokPos);
+  next();
+  if ((r = parseExpr()) < 0 || (n = newNode(N_ASSIGN, pos)) < 0)
+    return -1;
+  nodes[n].val = nodes[l].val;
+  nodes[n].a = r;
+  return measure(n);
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::parseBinary(int minPrec)
+{
+  int n = -1, l = -1, r = -1, t = 0, prec = 0, pos = tokPos;
+  int32_t v = 0;
+  uint8_t op = 0;
+
+  if ((l = parseUnary()) < 0)
+    return -1;
+  while ((prec = binaryPrec(tok, &op)) >= minPrec) {
+    t = tok;
+    next();
+    if (t == T_IN) {
+      if ((l = parseSet(l, pos)) < 0)
+	return -1;
+      continue;
+    }
+    if ((r = parseBinary(prec + 1)) < 0)
+      return -1;
+
+    if (nodes[l].kind == N_NUM && nodes[r].kind == N_NUM) {
+      if (t == T_OROR || t == T_ANDAND) {
+	v = t == T_OROR ? (nodes[l].val || nodes[r].val)
+	  : (nodes[l].val && nodes[r].val);
+	nodes[l].val = v;
+	nodes[l].len = lastEnd - pos;
+	continue;
+      } else if (foldBinary(op, nodes[l].val, nodes[r].val, &v)) {
+	nodes[l].val = v;
+	nodes[l].len = lastEnd - pos;
+	continue;
+      }
+    }
+
+    if ((n = newNode(t == T_OROR ? N_OR : t == T_ANDAND ? N_AND : N_BINARY, pos)) < 0)
+      return -1;
+    nodes[n].op = op;
+    nodes[n].a = l;
+    nodes[n].b = r;
+    if ((l = measure(n)) < 0)
+      return -1;
+  }
+  return l;
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::parseSet(int l, int pos)
+{
+  int n = -1, e = -1, first = -1, last = -1, count = 0;
+  bool found = false;
+
+  if (!expect('{'))
+    return -1;
+  while (tok != '}') {
+    if (count && !expect(','))
+      return -1;
+    if ((e = parseExpr()) < 0)
+      return -1;
+    if (nodes[e].kind != N_NUM)
+      return fail(nodes[e].pos);
+    found = found || (nodes[l].kind == N_NUM && nodes[l].val == nodes[e].val);
+    if (last < 0)
+      first = e;
+    else
+      nodes[last].next = e;
+    last = e;
+    count ++;
+  }
+  next();
+
+  if (nodes[l].kind == N_NUM) {
+    nodes[l].val = found;
+    nodes[l].pos = pos;
+    nodes[l].len = lastEnd - pos;
+    return l;
+  }
+  if ((n = newNode(N_IN, pos)) < 0)
+    return -1;
+  nodes[n].a = l;
+  nodes[n].b = first;
+  nodes[n].val = count;
+  return measure(n);
+}
+
+// Only an operator takes a level
+template <int N>
+constexpr int MyStaticCompiler<N>::parseUnary()
+{
+  int n = -1;
+
+  if (tok != '-' && tok != '+' && tok != '!' && tok != '~')
+    return parsePrimary();
+  nesting ++;
+  n = unary();
+  nesting --;
+  return n;
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::unary()
+{
+  int n = -1, a = -1, t = tok, pos = tokPos;
+  uint8_t op = 0;
+
+  if (nesting > SCRIPT_NESTING)
+    return tooDeep(pos);
+
+  next();
+  if ((a = parseUnary()) < 0)
+    return -1;
+  if (t == '+')
+    return a;
+
+  op = t == '-' ? OP_NEG : (t == '!' ? OP_NOT : OP_BNOT);
+  if (nodes[a].kind == N_REAL && op == OP_NEG) {
+    nodes[a].val = realConstNeg(nodes[a].val);
+    nodes[a].pos = pos;
+    nodes[a].len = lastEnd - pos;
+    return a;
+  }
+  if (nodes[a].kind == N_NUM) {
+    if (op == OP_NEG)
+      nodes[a].val = intNeg(nodes[a].val);
+    else if (op == OP_NOT)
+      nodes[a].val = !nodes[a].val;
+    else
+      nodes[a].val = ~nodes[a].val;
+    nodes[a].pos = pos;
+    nodes[a].len = lastEnd - pos;
+    return a;
+  }
+
+  if ((n = newNode(N_UNARY, pos)) < 0)
+    return -1;
+  nodes[n].op = op;
+  nodes[n].a = a;
+  return measure(n);
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::parsePrimary()
+{
+  int n = -1, s = cur, pos = tokPos, kind = N_NUM;
+  int32_t v = tokVal;
+  char c = 0;
+
+  switch (tok) {
+  case T_NUM:
+  case T_REAL:
+    kind = tok == T_REAL ? N_REAL : N_NUM;
+    next();
+    if ((n = newNode(kind, pos)) < 0)
+      return -1;
+    nodes[n].val = v;
+    return n;
+
+  case '(':
+    next();
+    if ((n = parseExpr()) < 0 || !expect(')'))
+      return -1;
+    return n;
+
+  case T_IDENT:
+    // A name followed by '(' calls a handler
+    while (s<end && (src[s] == ' ' || src[s] == '\t' || src[s] == '\r' || src[s] == '\n'))
+      s ++;
+    if (s<end && src[s] == '(')
+      return parseCall();
+
+    // Otherwise it must be one of the variables a-z (or A-Z)
+    c = src[tokPos];
+    if (tokLen != 1 || c == '_')
+      return fail(pos);
+    next();
+    if ((n = newNode(N_VAR, pos)) < 0)
+      return -1;
+    nodes[n].val = c>='a' ? c - 'a' : c - 'A';
+    return n;
+
+  default:
+    return fail(pos);
+  }
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::parseCall()
+{
+  int n = -1, a = -1, imp = -1, name = tokPos, nameLen = tokLen, pos = tokPos;
+  int argc = 0, last = -1;
+
+  next();
+  next(); // '('
+  // A string literal can only come first
+  if (tok == T_STR) {
+    if ((a = newNode(N_STR, tokPos)) < 0
+	|| (nodes[a].val = addString(tokPos + 1, tokLen - 2)) < 0)
+      return -1;
+    next();
+    n = last = a;
+    argc = 1;
+    if (tok != ')' && !expect(','))
+      return -1;
+  }
+  if (tok != ')') {
+    for (;;) {
+      if ((a = parseExpr()) < 0)
+	return -1;
+      if (last >= 0)
+	nodes[last].next = a;
+      if (argc++ == 0)
+	n = a;
+      last = a;
+      if (!accept(','))
+	break;
+    }
+  }
+  if (!expect(')'))
+    return -1;
+  // Handlers take one to three arguments, a string and one more at most
+  if (argc < 1 || argc > (nodes[n].kind == N_STR ? 2 : 3))
+    return fail(pos);
+  if ((imp = import(name, nameLen, argc | (nodes[n].kind == N_STR ? IMPORT_STRING : 0))) < 0)
+    return -1;
+
+  a = n;
+  if ((n = newNode(N_CALL, pos)) < 0)
+    return -1;
+  nodes[n].op = argc;
+  nodes[n].val = imp;
+  nodes[n].a = a;
+  return measure(n);
+}
+
+// Handlers are never assumed pure
+template <int N>
+constexpr int MyStaticCompiler<N>::import(int name, int len, int arity)
+{
+  int i = 0, j = 0, p = 0;
+
+  for (i = 0; i < importCount; i ++) {
+    if (imports[p] == arity && imports[p+1] == len) {
+      for (j = 0; j < len && imports[p+2+j] == (uint8_t)src[name+j]; j ++)
+	;
+      if (j == len)
+	return i;
+    }
+    p += 2 + imports[p+1];
+  }
+
+  if (importCount >= PROGRAM_UNBOUND || len > 255 || importLen + 2 + len > TABLE_CAP)
+    return tooBig();
+  imports[importLen] = arity;
+  imports[importLen+1] = len;
+  for (j = 0; j < len; j ++)
+    imports[importLen+2+j] = src[name+j];
+  importLen += 2 + len;
+  return importCount++;
+}
+
+// Adds a string literal to the string table, once, and returns its number
+template <int N>
+constexpr int MyStaticCompiler<N>::addString(int s, int len)
+{
+  uint8_t text[STRING_MAX] = {};
+  int i = 0, j = 0, n = 0, p = 0;
+
+  for (i = 0; i < len; i ++) {
+    if (n >= STRING_MAX)
+      return tooBig();
+    if (src[s+i] != '\\' || i+1 == len) {
+      text[n++] = src[s+i];
+      continue;
+    }
+    switch (src[s + ++i]) {
+    case 'n':	text[n++] = '\n';	break;
+    case 'r':	text[n++] = '\r';	break;
+    case 't':	text[n++] = '\t';	break;
+    case '0':	text[n++] = 0;		break;
+    default:	text[n++] = src[s+i];	break;
+    }
+  }
+
+  for (i = 0; i < stringCount; i ++) {
+    if (strings[p] == n) {
+      for (j = 0; j < n && strings[p+1+j] == text[j]; j ++)
+	;
+      if (j == n)
+	return i;
+    }
+    p += 2 + strings[p];
+  }
+  if (stringCount >= 255 || stringLen + 2 + n > TABLE_CAP)
+    return tooBig();
+  strings[stringLen] = n;
+  for (j = 0; j < n; j ++)
+    strings[stringLen+1+j] = text[j];
+  strings[stringLen+1+n] = 0;
+  stringLen += 2 + n;
+  return stringCount++;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Analysis, see MyCompiler
+//////////////////////////////////////////////////////////////////////////////
+
+// Variables an expression reads, with EXPR_IMPURE
+template <int N>
+constexpr uint32_t MyStaticCompiler<N>::varsOf(int n)
+{
+  const Node *p = nodes + n;
+  uint32_t v = 0;
+  int a = -1;
+
+  switch (p->kind) {
+  case N_VAR:
+    return 1u << p->val;
+  case N_UNARY:
+  case N_IN:
+    return varsOf(p->a);
+  case N_BINARY:
+  case N_AND:
+  case N_OR:
+    return varsOf(p->a) | varsOf(p->b);
+  case N_ASSIGN:
+    return EXPR_IMPURE | varsOf(p->a);
+  case N_CALL:
+    for (a = p->a; a >= 0; a = nodes[a].next)
+      v |= varsOf(a);
+    return v | EXPR_IMPURE;
+  default:
+    return 0;
+  }
+}
+
+// Variables a statement or expression assigns
+template <int N>
+constexpr uint32_t MyStaticCompiler<N>::killsOf(int n)
+{
+  const Node *p = nodes + n;
+  uint32_t v = p->kind == N_ASSIGN ? 1u << p->val : 0;
+  int c = -1;
+
+  if (p->kind == N_BLOCK || p->kind == N_CALL) {
+    for (c = p->a; c >= 0; c = nodes[c].next)
+      v |= killsOf(c);
+    return v;
+  }
+  if (p->a >= 0)
+    v |= killsOf(p->a);
+  if (p->b >= 0)
+    v |= killsOf(p->b);
+  if (p->c >= 0)
+    v |= killsOf(p->c);
+  if (p->d >= 0)
+    v |= killsOf(p->d);
+  return v;
+}
+
+// Variables a statement or expression may read before assigning them
+template <int N>
+constexpr uint32_t MyStaticCompiler<N>::inputsOf(int n, uint32_t *defined)
+{
+  const Node *p = nodes + n;
+  uint32_t v = 0, d = 0, e = 0;
+  int c = -1;
+
+  switch (p->kind) {
+  case N_VAR:
+    return (1u << p->val) & ~*defined;
+  case N_UNARY:
+  case N_EXPR:
+  case N_IN:
+    return inputsOf(p->a, defined);
+  case N_BINARY:
+    v = inputsOf(p->a, defined);
+    return v | inputsOf(p->b, defined);
+  case N_AND:
+  case N_OR:
+  case N_WHILE:
+    v = inputsOf(p->a, defined);
+    d = *defined;
+    return v | inputsOf(p->b, &d);
+  case N_ASSIGN:
+    v = inputsOf(p->a, defined);
+    *defined |= 1u << p->val;
+    return v;
+  case N_CALL:
+  case N_BLOCK:
+    for (c = p->a; c >= 0; c = nodes[c].next)
+      v |= inputsOf(c, defined);
+    return v;
+  case N_IF:
+    v = inputsOf(p->a, defined);
+    d = e = *defined;
+    v |= inputsOf(p->b, &d);
+    if (p->c >= 0) {
+      v |= inputsOf(p->c, &e);
+      *defined = d & e;
+    }
+    return v;
+  case N_SWITCH:
+    v = inputsOf(p->a, defined);
+    for (c = nodes[p->b].a, d = *defined; c >= 0; c = nodes[c].next) {
+      if (nodes[c].kind == N_CASE || nodes[c].kind == N_DEFAULT)
+	d = *defined;
+      v |= inputsOf(c, &d);
+    }
+    return v;
+  case N_FOR:
+    if (p->a >= 0)
+      v |= inputsOf(p->a, defined);
+    if (p->b >= 0)
+      v |= inputsOf(p->b, defined);
+    // A continue may skip to the increment
+    d = e = *defined;
+    v |= inputsOf(p->d, &d);
+    if (p->c >= 0)
+      v |= inputsOf(p->c, &e);
+    return v;
+  default:
+    return 0;
+  }
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::inferTypes()
+{
+  Node *p = nodes;
+  uint32_t known = 0;
+  int i = 0;
+
+  do {
+    known = reals;
+    for (i = 0; i < nodeCount; i ++) {
+      p = nodes + i;
+      switch (p->kind) {
+      case N_REAL:
+	p->type = TYPE_REAL;
+	break;
+      case N_VAR:
+	p->type = reals & (1u << p->val) ? TYPE_REAL : TYPE_INT;
+	break;
+      case N_UNARY:
+	p->type = p->op == OP_NEG ? nodes[p->a].type : (uint8_t)TYPE_INT;
+	break;
+      case N_BINARY:
+	p->type = (p->op == OP_MUL || p->op == OP_DIV || p->op == OP_ADD || p->op == OP_SUB)
+	  && (nodes[p->a].type == TYPE_REAL || nodes[p->b].type == TYPE_REAL)
+	  ? TYPE_REAL : TYPE_INT;
+	break;
+      case N_ASSIGN:
+	if (nodes[p->a].type == TYPE_REAL)
+	  reals |= 1u << p->val;
+	p->type = reals & (1u << p->val) ? TYPE_REAL : TYPE_INT;
+	break;
+      }
+    }
+  } while (reals != known);
+}
+
+template <int N>
+constexpr uint32_t MyStaticCompiler<N>::exprCost(int n, uint32_t *calls)
+{
+  const Node *p = nodes + n;
+  uint32_t c = 3;
+  int a = -1;
+
+  switch (p->kind) {
+  case N_NUM:
+  case N_REAL:
+  case N_VAR:
+  case N_STR:
+    return 1;
+  case N_UNARY:
+    return c + 1 + exprCost(p->a, calls);
+  case N_IN:
+    return c + 2 + exprCost(p->a, calls);
+  case N_BINARY:
+  case N_AND:
+  case N_OR:
+    c += 3 + exprCost(p->a, calls);
+    return addCost(c, exprCost(p->b, calls));
+  case N_ASSIGN:
+    return c + 3 + exprCost(p->a, calls);
+  case N_CALL:
+    *calls = addCost(*calls, 1);
+    for (a = p->a; a >= 0; a = nodes[a].next)
+      c = addCost(c, 1 + exprCost(a, calls));
+    return c;
+  default:
+    return c;
+  }
+}
+
+template <int N>
+constexpr uint32_t MyStaticCompiler<N>::worstOf(int n, uint32_t *calls)
+{
+  const Node *p = nodes + n;
+  uint32_t c = 0, t = 0, e = 0, tc = 0, ec = 0, bodyCalls = 0;
+  int s = -1, init = -1;
+  int32_t from = 0, to = 0;
+
+  switch (p->kind) {
+  case N_BLOCK:
+    for (s = p->a; s >= 0; s = nodes[s].next)
+      c = addCost(c, worstOf(s, calls));
+    return c;
+
+  case N_EXPR:
+    return 1 + exprCost(p->a, calls);
+
+  case N_IF:
+    c = 2 + exprCost(p->a, calls);
+    t = worstOf(p->b, &tc);
+    e = p->c >= 0 ? worstOf(p->c, &ec) : 0;
+    *calls = addCost(*calls, tc > ec ? tc : ec);
+    return addCost(c + 1, t > e ? t : e);
+
+  case N_SWITCH:
+    c = 2 + exprCost(p->a, calls);
+    return addCost(c, worstOf(p->b, calls));
+
+  case N_WHILE:
+  case N_FOR:
+    if (p->kind == N_FOR && p->a >= 0)
+      c = 1 + exprCost(p->a, calls);
+    // Never entered
+    s = p->kind == N_WHILE ? p->a : p->b;
+    if (s >= 0 && nodes[s].kind == N_NUM && !nodes[s].val)
+      return c + 1;
+
+    // Counting from a constant to a constant
+    init = p->kind == N_FOR ? p->a : -1;
+    if (init < 0 || !isCounted(n) || nodes[init].kind != N_ASSIGN
+	|| nodes[init].val != nodes[nodes[p->b].a].val || nodes[nodes[init].a].kind != N_NUM
+	|| nodes[nodes[p->b].b].kind != N_NUM) {
+      *calls = COST_UNBOUNDED;
+      return COST_UNBOUNDED;
+    }
+    from = nodes[nodes[init].a].val;
+    to = nodes[nodes[p->b].b].val;
+
+    t = worstOf(p->d, &bodyCalls);
+    t = addCost(t, 4 + exprCost(p->b, &bodyCalls) + exprCost(p->c, &bodyCalls));
+    e = from < to ? (uint32_t)to - (uint32_t)from : 0;
+    *calls = addCost(*calls, mulCost(bodyCalls, e));
+    return addCost(c + 4 + exprCost(p->b, calls), mulCost(t, e));
+
+  default:
+    return 1;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Code generator, see MyCompiler
+//////////////////////////////////////////////////////////////////////////////
+
+template <int N>
+constexpr bool MyStaticCompiler<N>::room(int len)
+{
+  if (codeLen + len <= CODE_CAP)
+    return true;
+  tooBig();
+  return false;
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::emit(uint8_t op)
+{
+  if (room(1))
+    code[codeLen++] = op;
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::emit8(uint8_t op, uint8_t v)
+{
+  if (room(2)) {
+    code[codeLen++] = op;
+    code[codeLen++] = v;
+  }
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::emitJump(uint8_t op, int target)
+{
+  int at = codeLen;
+
+  if (!room(3))
+    return -1;
+  code[codeLen] = op;
+  write16(code + codeLen + 1, target < 0 ? 0xffff : target);
+  codeLen += 3;
+  return at;
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::patch(int chain, int target)
+{
+  int prev = 0;
+
+  while (chain >= 0) {
+    prev = read16(code + chain + 1);
+    write16(code + chain + 1, target);
+    chain = prev == 0xffff ? -1 : prev;
+  }
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::compact()
+{
+  uint16_t at[CODE_CAP + 1] = {};
+  uint8_t wide[CODE_CAP + 1] = {};
+  uint8_t out[CODE_CAP] = {};
+  int pc = 0, n = 0, t = 0, d = 0, i = 0;
+  bool changed = false;
+
+  do {
+    for (pc = n = 0; pc < codeLen; pc += wideSize(code + pc)) {
+      at[pc] = n;
+      if (isJump(code[pc]))
+	n += (hasOperand(code[pc]) ? 3 : 2) + wide[pc];
+      else
+	n += wideSize(code + pc);
+    }
+    at[codeLen] = n;
+
+    changed = false;
+    for (pc = 0; pc < codeLen; pc += wideSize(code + pc)) {
+      if (!isJump(code[pc]) || wide[pc])
+	continue;
+      t = read16(code + pc + 1);
+      n = at[pc] + (hasOperand(code[pc]) ? 3 : 2);
+      d = isBackward(code[pc]) ? n - at[t] : at[t] - n;
+      if (d >= 0x80) {
+	wide[pc] = 1;
+	changed = true;
+      }
+    }
+  } while (changed);
+
+  for (pc = n = 0; pc < codeLen; pc += wideSize(code + pc)) {
+    if (!isJump(code[pc])) {
+      for (t = 0; t < wideSize(code + pc); t ++)
+	out[n++] = code[pc + t];
+      if (code[pc] == OP_JTAB || code[pc] == OP_JFIND)
+	for (i = -1; i < tableCount(code + pc); i ++)
+	  write16(out + at[pc] + tableEntry(code + pc, i),
+		  at[read16(code + pc + tableEntry(code + pc, i))] - n);
+      continue;
+    }
+    t = at[read16(code + pc + 1)];
+    out[n++] = code[pc];
+    if (hasOperand(code[pc]))
+      out[n++] = code[pc + 3];
+    d = isBackward(code[pc]) ? n + 1 + wide[pc] - t : t - (n + 1 + wide[pc]);
+    n += writeDist(out + n, d);
+  }
+
+  for (pc = 0; pc < n; pc ++)
+    code[pc] = out[pc];
+  codeLen = n;
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::push(int n)
+{
+  depth += n;
+  if (depth > maxDepth)
+    maxDepth = depth;
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::genSet(int n)
+{
+  const Node *p = nodes + n;
+  int e = -1, f = -1, i = 0, j = 0, k = 0, at = 0, size = 0, count = 0;
+  int32_t low = 0, high = 0;
+  uint32_t span = 0;
+  bool bits = false;
+
+  for (e = p->b; e >= 0; e = nodes[e].next) {
+    for (f = p->b; f != e && nodes[f].val != nodes[e].val; f = nodes[f].next)
+      ;
+    if (f != e)
+      continue;
+    if (!count || nodes[e].val < low)
+      low = nodes[e].val;
+    if (!count || nodes[e].val > high)
+      high = nodes[e].val;
+    count ++;
+  }
+  span = (uint32_t)high - (uint32_t)low;
+  bits = count && span < 8 * 255 && 7 + (int)span / 8 <= 3 + 4 * count;
+  size = bits ? 7 + span / 8 : 3 + 4 * count;
+
+  genAs(p->a, TYPE_INT);
+  at = codeLen;
+  if (!room(size))
+    return;
+  for (i = 0; i < size; i ++)
+    code[at + i] = 0;
+  if (bits) {
+    code[at] = OP_INBITS;
+    write32(code + at + 1, low);
+    code[at + 5] = span / 8 + 1;
+    for (e = p->b; e >= 0; e = nodes[e].next) {
+      i = (uint32_t)nodes[e].val - (uint32_t)low;
+      code[at + 6 + i / 8] |= 1 << (i % 8);
+    }
+  } else {
+    code[at] = OP_INLIST;
+    write16(code + at + 1, count);
+    for (e = p->b, i = 0; e >= 0; e = nodes[e].next) {
+      for (j = 0; j < i && read32(code + at + 3 + 4 * j) < nodes[e].val; j ++)
+	;
+      if (j < i && read32(code + at + 3 + 4 * j) == nodes[e].val)
+	continue;
+      for (k = 4 * (i - j) - 1; k >= 0; k --)
+	code[at + 7 + 4 * j + k] = code[at + 3 + 4 * j + k];
+      write32(code + at + 3 + 4 * j, nodes[e].val);
+      i ++;
+    }
+  }
+  codeLen += size;
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::genValue(int n)
+{
+  const Node *p = nodes + n;
+  int a = -1, j = -1, t = TYPE_INT;
+
+  switch (p->kind) {
+  case N_NUM:
+  case N_REAL:
+    if (p->val >= -128 && p->val <= 127) {
+      emit8(OP_PUSHB, p->val);
+    } else if (p->val >= -32768 && p->val <= 32767) {
+      if (room(3)) {
+	code[codeLen] = OP_PUSHW;
+	write16(code + codeLen + 1, p->val);
+	codeLen += 3;
+      }
+    } else if (room(5)) {
+      code[codeLen] = OP_PUSH;
+      write32(code + codeLen + 1, p->val);
+      codeLen += 5;
+    }
+    push(1);
+    break;
+  case N_VAR:
+    emit8(OP_LOAD, p->val);
+    push(1);
+    break;
+  case N_UNARY:
+    if (p->op == OP_NOT)
+      genTest(p->a);
+    else
+      genAs(p->a, p->type);
+    emit(p->type == TYPE_REAL ? realOp(p->op) : p->op);
+    break;
+  case N_BINARY:
+    t = realOp(p->op) && (nodes[p->a].type == TYPE_REAL || nodes[p->b].type == TYPE_REAL)
+      ? TYPE_REAL : TYPE_INT;
+    genAs(p->a, t);
+    genAs(p->b, t);
+    emit(t == TYPE_REAL ? realOp(p->op) : p->op);
+    push(-1);
+    break;
+  case N_AND:
+  case N_OR:
+    genTest(p->a);
+    j = emitJump(p->kind == N_AND ? OP_ANDJ : OP_ORJ, -1);
+    push(-1);
+    genTest(p->b);
+    emit(OP_BOOL);
+    patch(j, codeLen);
+    break;
+  case N_ASSIGN:
+    genAs(p->a, p->type);
+    emit(OP_DUP);
+    push(1);
+    emit8(OP_STORE, p->val);
+    push(-1);
+    break;
+  case N_CALL:
+    a = p->a;
+    if (nodes[a].kind == N_STR)
+      a = nodes[a].next;
+    for (; a >= 0; a = nodes[a].next)
+      genAs(a, TYPE_INT);
+    if (nodes[p->a].kind == N_STR) {
+      emit8(OP_CALLS, p->val);
+      emit(nodes[p->a].val);
+      push(2 - p->op);
+    } else {
+      emit8(OP_CALL, p->val);
+      push(1 - p->op);
+    }
+    break;
+  case N_IN:
+    genSet(n);
+    break;
+  }
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::genAs(int n, int type)
+{
+  genValue(n);
+  if (nodes[n].type != type)
+    emit(type == TYPE_REAL ? OP_ITOR : OP_RTOI);
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::genTest(int n)
+{
+  genValue(n);
+  if (nodes[n].type == TYPE_REAL)
+    emit(OP_RNZ);
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::genEffect(int n)
+{
+  if (nodes[n].kind == N_ASSIGN) {
+    genAs(nodes[n].a, nodes[n].type);
+    emit8(OP_STORE, nodes[n].val);
+  } else {
+    genValue(n);
+    emit(OP_POP);
+  }
+  push(-1);
+}
+
+template <int N>
+constexpr int MyStaticCompiler<N>::genCond(int n)
+{
+  int j = -1;
+
+  if (nodes[n].kind == N_NUM)
+    return nodes[n].val ? -1 : emitJump(OP_JMP, -1);
+  genTest(n);
+  j = emitJump(OP_JZ, -1);
+  push(-1);
+  return j;
+}
+
+template <int N>
+constexpr bool MyStaticCompiler<N>::isCounted(int n)
+{
+  const Node *p = nodes + n, *cond = NULL, *inc = NULL, *sum = NULL;
+  uint32_t kills = 0;
+  int var = 0;
+
+  if (p->b < 0 || p->c < 0)
+    return false;
+  cond = nodes + p->b;
+  if (cond->kind != N_BINARY || cond->op != OP_LT || nodes[cond->a].kind != N_VAR
+      || nodes[cond->a].type != TYPE_INT || nodes[cond->b].type != TYPE_INT)
+    return false;
+  var = nodes[cond->a].val;
+
+  inc = nodes + p->c;
+  if (inc->kind != N_ASSIGN || inc->val != var)
+    return false;
+  sum = nodes + inc->a;
+  if (sum->kind != N_BINARY || sum->op != OP_ADD
+      || !((nodes[sum->a].kind == N_VAR && nodes[sum->a].val == var
+	    && nodes[sum->b].kind == N_NUM && nodes[sum->b].val == 1)
+	   || (nodes[sum->b].kind == N_VAR && nodes[sum->b].val == var
+	       && nodes[sum->a].kind == N_NUM && nodes[sum->a].val == 1)))
+    return false;
+
+  kills = killsOf(p->d);
+  return !(kills & (1u << var)) && !(varsOf(cond->b) & (kills | EXPR_IMPURE | (1u << var)));
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::genCounted(int n)
+{
+  const Node *p = nodes + n;
+  int var = nodes[nodes[p->b].a].val, top = 0, j = -1;
+  int brk = breakChain, cont = continueChain;
+
+  breakChain = continueChain = -1;
+  if (p->a >= 0)
+    genEffect(p->a);
+  genValue(nodes[p->b].b);
+  j = emitJump(OP_FORT, -1);
+  emit(var);
+  top = codeLen;
+  genStatement(p->d);
+  patch(continueChain, codeLen);
+  emitJump(OP_FORI, top);
+  emit(var);
+  patch(j, codeLen);
+  patch(breakChain, codeLen);
+  emit(OP_POP);
+  push(-1);
+
+  breakChain = brk;
+  continueChain = cont;
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::genSwitch(int n)
+{
+  const Node *p = nodes + n;
+  int s = -1, i = 0, j = 0, k = 0, at = 0, size = 0, count = 0, brk = breakChain;
+  int32_t low = 0, high = 0;
+  uint32_t span = 0;
+  bool dense = false;
+
+  for (s = nodes[p->b].a; s >= 0; s = nodes[s].next)
+    if (nodes[s].kind == N_CASE) {
+      if (!count || nodes[s].val < low)
+	low = nodes[s].val;
+      if (!count || nodes[s].val > high)
+	high = nodes[s].val;
+      count ++;
+    }
+  span = (uint32_t)high - (uint32_t)low;
+  dense = count && span < 0x7fff
+    && JTAB_HEAD + 2 * ((int)span + 1) <= JFIND_HEAD + JFIND_ENTRY * count;
+  size = dense ? JTAB_HEAD + 2 * ((int)span + 1) : JFIND_HEAD + JFIND_ENTRY * count;
+
+  genAs(p->a, TYPE_INT);
+  at = codeLen;
+  if (!room(size))
+    return;
+  for (i = 0; i < size; i ++)
+    code[at + i] = 0xff;
+  code[at] = dense ? OP_JTAB : OP_JFIND;
+  if (dense) {
+    write32(code + at + 1, low);
+    write16(code + at + 5, span + 1);
+  } else {
+    write16(code + at + 1, count);
+    for (s = nodes[p->b].a, i = 0; s >= 0; s = nodes[s].next) {
+      if (nodes[s].kind != N_CASE)
+	continue;
+      for (j = i++; j > 0 && read32(code + at + JFIND_HEAD + JFIND_ENTRY * (j-1)) > nodes[s].val; j --)
+	for (k = 0; k < JFIND_ENTRY; k ++)
+	  code[at + JFIND_HEAD + JFIND_ENTRY * j + k] = code[at + JFIND_HEAD + JFIND_ENTRY * (j-1) + k];
+      write32(code + at + JFIND_HEAD + JFIND_ENTRY * j, nodes[s].val);
+    }
+  }
+  codeLen += size;
+  push(-1);
+
+  breakChain = -1;
+  for (s = nodes[p->b].a; s >= 0; s = nodes[s].next) {
+    if (nodes[s].kind == N_CASE) {
+      for (i = 0; !dense && read32(code + at + JFIND_HEAD + JFIND_ENTRY * i) != nodes[s].val; i ++)
+	;
+      write16(code + at + tableEntry(code + at, dense ? nodes[s].val - low : i), codeLen);
+    } else if (nodes[s].kind == N_DEFAULT) {
+      write16(code + at + tableEntry(code + at, -1), codeLen);
+    } else {
+      genStatement(s);
+    }
+  }
+  if (read16(code + at + tableEntry(code + at, -1)) == 0xffff)
+    write16(code + at + tableEntry(code + at, -1), codeLen);
+  for (i = 0; i < tableCount(code + at); i ++)
+    if (read16(code + at + tableEntry(code + at, i)) == 0xffff)
+      write16(code + at + tableEntry(code + at, i), read16(code + at + tableEntry(code + at, -1)));
+  patch(breakChain, codeLen);
+  breakChain = brk;
+}
+
+template <int N>
+constexpr void MyStaticCompiler<N>::genStatement(int n)
+{
+  const Node *p = nodes + n;
+  int s = -1, j = -1, e = -1, top = 0, brk = -1, cont = -1;
+
+  switch (p->kind) {
+  case N_BLOCK:
+    for (s = p->a; s >= 0; s = nodes[s].next)
+      genStatement(s);
+    break;
+
+  case N_EXPR:
+    genEffect(p->a);
+    break;
+
+  case N_IF:
+    j = genCond(p->a);
+    genStatement(p->b);
+    if (p->c >= 0) {
+      e = emitJump(OP_JMP, -1);
+      patch(j, codeLen);
+      genStatement(p->c);
+      patch(e, codeLen);
+    } else {
+      patch(j, codeLen);
+    }
+    break;
+
+  case N_WHILE:
+  case N_FOR:
+    if (p->kind == N_FOR && isCounted(n)) {
+      genCounted(n);
+      break;
+    }
+    brk = breakChain;
+    cont = continueChain;
+    breakChain = continueChain = -1;
+
+    if (p->kind == N_FOR && p->a >= 0)
+      genEffect(p->a);
+    top = codeLen;
+    if (p->kind == N_WHILE)
+      j = genCond(p->a);
+    else
+      j = p->b >= 0 ? genCond(p->b) : -1;
+    genStatement(p->kind == N_WHILE ? p->b : p->d);
+    patch(continueChain, codeLen);
+    if (p->kind == N_FOR && p->c >= 0)
+      genEffect(p->c);
+    emitJump(OP_LOOP, top);
+    patch(j, codeLen);
+    patch(breakChain, codeLen);
+
+    breakChain = brk;
+    continueChain = cont;
+    break;
+
+  case N_SWITCH:
+    genSwitch(n);
+    break;
+
+  case N_BREAK:
+    breakChain = emitJump(OP_JMP, breakChain);
+    break;
+
+  case N_CONTINUE:
+    continueChain = emitJump(OP_JMP, continueChain);
+    break;
+  }
+}
+
+#endif
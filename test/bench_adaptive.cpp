@@ -0,0 +1,108 @@
+// A SMING-compatible C interpreter
+//
+// Gain of laying a rule out for its traffic: instructions (COUNT_OPS) and
+// time per run of the same skewed messages, on the rule as compiled and
+// on the version laid out for the counts of its first runs.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <random>
+#include "MyInterpreter.h"
+
+#define WARMUP	2000	// Runs, the adaptive rule is laid out after half
+#define RUNS	2000000
+
+static const char *rule =
+  "if(n==40&&s==1&&v>1000){send(n,s,v);}"
+  "if(n==41||n==42||v<0){print(v);}"
+  "if(v<900){c=c+1;}else{send(n,2,v);print(c);c=0;}"
+  "if(s in {1,3,5}&&v%2==0&&n!=7){t=t+v;}";
+
+static int vn[RUNS], vs[RUNS], vv[RUNS];
+static volatile int sink;
+
+static int print(int a)
+{
+  sink += a;
+  return a;
+}
+
+static int send(int a, int b, int c)
+{
+  sink += a + b + c;
+  return 0;
+}
+
+// Mostly node 40, sensor 1 and a value below 900
+static void messages()
+{
+  std::mt19937 rng(7);
+  int i;
+
+  for (i=0; i<RUNS; i++) {
+    vn[i] = rng() % 10 ? 40 : 30 + rng() % 20;
+    vs[i] = rng() % 10 ? 1 : rng() % 6;
+    vv[i] = rng() % 20 ? rng() % 900 : 900 + rng() % 400;
+  }
+}
+
+// Instructions and nanoseconds per run, and the variables left behind
+static void measure(bool adaptive, double *ops, double *ns, int *result)
+{
+  MyInterpreter interpreter;
+  RunContext ctx;
+  unsigned long start;
+  int i;
+
+  interpreter.registerFunc1((char *)"print", print);
+  interpreter.registerFunc3((char *)"send", send);
+  if (adaptive)
+    interpreter.setAdaptive(WARMUP / 2);
+  interpreter.load((char *)rule, strlen(rule));
+  // Only run() lays the rule out, the runs measured count on their own context
+  for (i=0; i<WARMUP; i++) {
+    interpreter.setVariable('n', vn[i]);
+    interpreter.setVariable('s', vs[i]);
+    interpreter.setVariable('v', vv[i]);
+    interpreter.run();
+  }
+  interpreter.addContext(&ctx);
+  ctx.ops = 0;
+  start = micros();
+  for (i=0; i<RUNS; i++) {
+    ctx.setVariable('n', vn[i]);
+    ctx.setVariable('s', vs[i]);
+    ctx.setVariable('v', vv[i]);
+    interpreter.run(&ctx);
+  }
+  start = micros() - start;
+  *ops = (double)ctx.ops / RUNS;
+  *ns = start * 1000.0 / RUNS;
+  *result = ctx.getVariable('c') * 31 + ctx.getVariable('t');
+  interpreter.removeContext(&ctx);
+}
+
+int main()
+{
+  double ops[2], ns[2];
+  int result[2], k;
+
+  messages();
+  printf("adaptive: instructions and ns per run, as compiled and laid out for the traffic\n");
+  for (k=0; k<3; k++) {
+    measure(false, &ops[0], &ns[0], &result[0]);
+    measure(true, &ops[1], &ns[1], &result[1]);
+    printf("  %.2f -> %.2f ops (%.0f%%), %.1f -> %.1f ns (%.0f%%)\n",
+	   ops[0], ops[1], 100 * ops[1] / ops[0], ns[0], ns[1], 100 * ns[1] / ns[0]);
+    if (result[0] != result[1]) {
+      printf("adaptive: the laid out rule ends with other variables\n");
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,103 @@
+// A SMING-compatible C interpreter
+//
+// Scaling of the worker pool: the same jobs, a quarter of them ordered by
+// a key, run on 1 to 8 workers.  Reports jobs per second, the speedup over
+// one worker and how many jobs were stolen.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <atomic>
+#include <thread>
+#include "MyExecutor.h"
+
+#define JOBS	200000
+#define KEYS	37
+
+static std::atomic<long> sum;
+static std::atomic<int> last[KEYS];
+static std::atomic<int> unordered;
+
+// Jobs of a key must come in submission order
+static int record(int key, int v)
+{
+  if (v <= last[key].exchange(v))
+    unordered ++;
+  return 0;
+}
+
+static int work(int x)
+{
+  sum += x;
+  return x;
+}
+
+static double measure(int workers, uint32_t *stolen)
+{
+  char rule[] = "record(n,v);";
+  char loop[] = "x=0;for(i=0;i<200;i=i+1){x=x+i*v;}work(x);";
+  MyInterpreter ordered, busy;
+  MyExecutor executor(workers);
+  struct ExecutorStats stats;
+  unsigned long start;
+  int a, b, i, w;
+
+  ordered.registerFunc2((char *)"record", record);
+  busy.registerFunc1((char *)"work", work);
+  ordered.load(rule, strlen(rule));
+  busy.load(loop, strlen(loop));
+  a = executor.addScript(&ordered);
+  b = executor.addScript(&busy);
+  for (i=0; i<KEYS; i++)
+    last[i] = -1;
+  executor.start();
+  start = micros();
+  for (i=0; i<JOBS; i++) {
+    ExecutorJob job;
+    if (i % 4 == 0) {
+      job.script = a;
+      job.key = i % KEYS;
+      job.count = 2;
+      job.names[0] = 'n'; job.values[0] = i % KEYS;
+      job.names[1] = 'v'; job.values[1] = i;
+    } else {
+      job.script = b;
+      job.key = EXECUTOR_UNORDERED;
+      job.count = 1;
+      job.names[0] = 'v'; job.values[0] = i;
+    }
+    executor.submit(job);
+  }
+  executor.drain();
+  start = micros() - start;
+  *stolen = 0;
+  for (w=0; w<executor.workers(); w++) {
+    executor.getStats(w, &stats);
+    *stolen += stats.stolen;
+  }
+  executor.stop();
+  return JOBS / (start / 1e6);
+}
+
+int main()
+{
+  double rate, base = 0;
+  uint32_t stolen;
+  int workers;
+
+  printf("executor: %d jobs, %u hardware threads\n", JOBS, std::thread::hardware_concurrency());
+  unordered = 0;
+  for (workers = 1; workers <= 8; workers *= 2) {
+    rate = measure(workers, &stolen);
+    if (workers == 1)
+      base = rate;
+    printf("  %d workers: %.0f jobs/s, %.2fx, %u stolen\n", workers, rate, rate / base, stolen);
+  }
+  if (unordered)
+    printf("executor: %d ordered jobs out of order\n", unordered.load());
+  return unordered != 0;
+}
@@ -0,0 +1,104 @@
+// A SMING-compatible C interpreter
+//
+// Instructions executed per run, counted with COUNT_OPS, and time per run
+// of a few typical rules compiled with and without cached expressions.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyInterpreter.h"
+
+#define RUNS	200000
+
+static const char *rules[] = {
+  "if(n==40){if(s==0&&v%2==0){print(v);}if(s==1&&v%2==0){print(v+1);}if(s==2&&v%2==0){print(v+2);}}",
+  "x=0;for(i=0;i<100;i=i+1){x=x+sq(n)*(s+3)+i;}print(x);",
+  "x=0;i=0;while(i<50&&i<n*2+s){i=i+1;if(sq(v)>mx(n,s)){x=x+sq(v)-mx(n,s);}}print(x);",
+  "switch(s){case 0:print(v*v+n);break;case 1:print(v*v-n);break;default:print(v*v);}",
+  "if(n in {40,41,52}&&v>sq(s)){print(v);}if(n in {40,41,52}&&v<sq(s)+10){print(-v);}",
+};
+
+static volatile int sink;
+
+static int print(int a)
+{
+  sink += a;
+  return a;
+}
+
+static int sq(int a)
+{
+  return a * a + 1;
+}
+
+static int mx(int a, int b)
+{
+  return a > b ? a : b;
+}
+
+static bool load(MyInterpreter *interpreter, const char *src, bool caching)
+{
+  MyCompiler compiler;
+  uint8_t *image;
+  bool loaded;
+  int len;
+
+  interpreter->registerFunc1((char *)"print", print);
+  interpreter->registerFunc1((char *)"sq", sq, true);
+  interpreter->registerFunc2((char *)"mx", mx, true);
+  if (!caching)
+    compiler.noCaching();
+  if (compiler.compile(src, strlen(src)))
+    return false;
+  image = compiler.release(&len);
+  loaded = interpreter->loadCompiled(image, len);
+  free(image);
+  return loaded;
+}
+
+// Instructions and nanoseconds per run
+static bool measure(const char *src, bool caching, double *ops, double *ns)
+{
+  MyInterpreter interpreter;
+  RunContext ctx;
+  unsigned long start;
+  int i;
+
+  if (!load(&interpreter, src, caching))
+    return false;
+  interpreter.addContext(&ctx);
+  ctx.setVariable('n', 40);
+  ctx.setVariable('s', 1);
+  ctx.ops = 0;
+  start = micros();
+  for (i=0; i<RUNS; i++) {
+    ctx.setVariable('v', i & 15);
+    interpreter.run(&ctx);
+  }
+  start = micros() - start;
+  interpreter.removeContext(&ctx);
+  *ops = (double)ctx.ops / RUNS;
+  *ns = start * 1000.0 / RUNS;
+  return true;
+}
+
+int main()
+{
+  double ops[2], ns[2];
+  int n;
+
+  printf("ops: instructions and ns per run, without and with cached expressions\n");
+  for (n=0; n<(int)(sizeof(rules) / sizeof(rules[0])); n++) {
+    if (!measure(rules[n], false, &ops[0], &ns[0]) || !measure(rules[n], true, &ops[1], &ns[1])) {
+      printf("ops: %s does not load\n", rules[n]);
+      return 1;
+    }
+    printf("  %-40.40s %7.1f -> %7.1f ops (%3.0f%%), %7.1f -> %7.1f ns\n",
+	   rules[n], ops[0], ops[1], 100 * ops[1] / ops[0], ns[0], ns[1]);
+  }
+  return 0;
+}
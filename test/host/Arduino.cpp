@@ -0,0 +1,13 @@
+// A SMING-compatible C interpreter
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "Arduino.h"
+
+HostSerial Serial;
+HostWatchdog WDT;
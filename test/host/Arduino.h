@@ -0,0 +1,190 @@
+// A SMING-compatible C interpreter
+//
+// Stand-in for the few Sming APIs the interpreter uses, so the tests and
+// benchmarks can be built and run on the Linux (host) build machine.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#ifndef __HOST_ARDUINO_H__
+#define __HOST_ARDUINO_H__
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <functional>
+#include <vector>
+
+template <class T> class Delegate;
+template <class R, class... A> class Delegate<R(A...)>
+{
+  public:
+    Delegate() {}
+    template <class F> Delegate(F f) : fn(f) {}
+    R operator()(A... a) const { return fn(a...); }
+    operator bool() const { return (bool)fn; }
+
+  private:
+    std::function<R(A...)> fn;
+};
+
+template <class T> class Vector
+{
+  public:
+    unsigned int count() const { return v.size(); }
+    unsigned int size() const { return v.size(); }
+    bool add(const T &t) { v.push_back(t); return true; }
+    T &operator[](unsigned int i) { return v[i]; }
+    const T &operator[](unsigned int i) const { return v[i]; }
+    T &elementAt(unsigned int i) { return v[i]; }
+    void remove(unsigned int i) { v.erase(v.begin() + i); }
+    void removeElementAt(unsigned int i) { v.erase(v.begin() + i); }
+    void clear() { v.clear(); }
+    void removeAllElements() { v.clear(); }
+    bool isEmpty() const { return v.empty(); }
+    unsigned int capacity() const { return v.capacity(); }
+
+  private:
+    std::vector<T> v;
+};
+
+class HostSerial
+{
+  public:
+    void print(const char *s) { fputs(s, stdout); }
+    void print(int v) { ::printf("%d", v); }
+    void print(unsigned v) { ::printf("%u", v); }
+    void print(long v) { ::printf("%ld", v); }
+    void print(unsigned long v) { ::printf("%lu", v); }
+    void print(double v) { ::printf("%.2f", v); }
+    void println(const char *s) { puts(s); }
+    void println(int v) { ::printf("%d\n", v); }
+    void println(unsigned v) { ::printf("%u\n", v); }
+    void println(long v) { ::printf("%ld\n", v); }
+    void println(unsigned long v) { ::printf("%lu\n", v); }
+    void println(double v) { ::printf("%.2f\n", v); }
+    void println() { puts(""); }
+    size_t write(const uint8_t *b, size_t n) { return fwrite(b, 1, n, stdout); }
+    size_t write(uint8_t c) { return fputc(c, stdout) != EOF; }
+    void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+    {
+      va_list ap;
+
+      va_start(ap, fmt);
+      vprintf(fmt, ap);
+      va_end(ap);
+    }
+};
+extern HostSerial Serial;
+
+class HostWatchdog
+{
+  public:
+    void alive() {}
+    void enable(bool) {}
+};
+extern HostWatchdog WDT;
+
+#define debugf(fmt, ...) fprintf(stderr, "[debugf] " fmt "\n", ##__VA_ARGS__)
+
+static inline unsigned long millis()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000UL + tv.tv_usec / 1000;
+}
+
+static inline unsigned long micros()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+
+static inline void delay(int ms)
+{
+  usleep(ms * 1000);
+}
+
+// SPIFFS calls on top of the host file system
+typedef int file_t;
+
+enum FileOpenFlags {
+  eFO_ReadOnly = 1,
+  eFO_WriteOnly = 2,
+  eFO_ReadWrite = 3,
+  eFO_CreateIfNotExist = 4,
+  eFO_Truncate = 8,
+  eFO_CreateNewAlways = 12
+};
+
+static inline FileOpenFlags operator|(FileOpenFlags a, FileOpenFlags b)
+{
+  return (FileOpenFlags)((int)a | (int)b);
+}
+
+static inline bool fileExist(const char *name)
+{
+  struct stat st;
+
+  return stat(name, &st) == 0;
+}
+
+static inline int fileGetSize(const char *name)
+{
+  struct stat st;
+
+  return stat(name, &st) ? 0 : st.st_size;
+}
+
+static inline file_t fileOpen(const char *name, FileOpenFlags flags)
+{
+  int f = (flags & 3) == eFO_ReadOnly ? O_RDONLY : (flags & 3) == eFO_WriteOnly ? O_WRONLY : O_RDWR;
+
+  if (flags & eFO_CreateIfNotExist)
+    f |= O_CREAT;
+  if (flags & eFO_Truncate)
+    f |= O_TRUNC;
+  return open(name, f, 0644);
+}
+
+static inline int fileRead(file_t file, void *data, size_t size)
+{
+  return read(file, data, size);
+}
+
+static inline int fileWrite(file_t file, const void *data, size_t size)
+{
+  return write(file, data, size);
+}
+
+static inline void fileClose(file_t file)
+{
+  close(file);
+}
+
+static inline int fileGetContent(const char *name, char *buf, size_t size)
+{
+  int f = open(name, O_RDONLY), n;
+
+  if (f < 0)
+    return 0;
+  n = read(f, buf, size - 1);
+  close(f);
+  n = n < 0 ? 0 : n;
+  buf[n] = 0;
+  return n;
+}
+
+#endif
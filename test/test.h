@@ -0,0 +1,42 @@
+// A SMING-compatible C interpreter
+//
+// Checks shared by the host tests.  A test is a program returning non
+// zero when a check failed, see the Makefile.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#ifndef __TEST_H__
+#define __TEST_H__
+#include <stdio.h>
+
+static int checks, failures;
+
+#define CHECK(cond) do {						\
+    checks ++;								\
+    if (!(cond)) {							\
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+      failures ++;							\
+    }									\
+  } while (0)
+
+#define CHECK_EQ(a, b) do {						\
+    long long _a = (a), _b = (b);					\
+    checks ++;								\
+    if (_a != _b) {							\
+      printf("%s:%d: %s is %lld, not %lld\n", __FILE__, __LINE__, #a, _a, _b); \
+      failures ++;							\
+    }									\
+  } while (0)
+
+static inline int report(const char *name)
+{
+  printf("%s: %d checks, %d failed\n", name, checks, failures);
+  return failures != 0;
+}
+
+#endif
@@ -0,0 +1,152 @@
+// A SMING-compatible C interpreter
+//
+// Scripts laid out again for the counts of their runs: they take over
+// after the given number of runs and behave as before, operands with side
+// effects or which may divide by zero staying where they were.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <random>
+#include <string>
+#include "MyInterpreter.h"
+#include "test.h"
+
+#define RUNS	50	// Before the script is laid out again
+
+static std::string called;
+
+static int send(int a)
+{
+  called += "s" + std::to_string(a) + ";";
+  return a;
+}
+
+static int note(int a)
+{
+  called += "n" + std::to_string(a) + ";";
+  return a & 1;
+}
+
+static const char *scripts[] = {
+  "if(n==40&&v>1000){send(v);}",
+  "if(n==41||n==42||v<0){send(n);}",
+  "if(v<900){c=c+1;}else{send(c);c=0;}",
+  // The division mostly fails, it must not be tried before the guard
+  "x=0;if(v!=0&&100/v>3&&n==40){send(v);}x=1;",
+  // Nor the call with a side effect
+  "if(note(n)&&v>1000){send(v);}if(v>1000||note(s)){send(s);}",
+  "if(s in {1,3,5}&&v%2==0&&n!=7){t=t+v;}else{t=t-1;}",
+  "i=0;while(i<5&&(v>1000||n==40)){i=i+1;if(s==1||v==0){t=t+i;}}",
+  "switch(s){case 1:if(v>1000&&n==40){send(v);}break;default:if(n==40||v==3){send(s);}}",
+};
+
+// Mostly n=40, s=1 and a small v
+static void message(std::mt19937 *rng, int *n, int *s, int *v)
+{
+  *n = (*rng)() % 10 ? 40 : 30 + (*rng)() % 20;
+  *s = (*rng)() % 10 ? 1 : (*rng)() % 6;
+  *v = (*rng)() % 20 ? (*rng)() % 900 : 900 + (*rng)() % 400;
+  if ((*rng)() % 8 == 0)
+    *v = (*rng)() % 3 - 1;
+}
+
+static void runBoth(MyInterpreter *adaptive, MyInterpreter *plain, int n, int s, int v,
+		    const char *src)
+{
+  std::string a, b;
+  int i;
+
+  adaptive->setVariable('n', n);
+  adaptive->setVariable('s', s);
+  adaptive->setVariable('v', v);
+  plain->setVariable('n', n);
+  plain->setVariable('s', s);
+  plain->setVariable('v', v);
+  called.clear();
+  adaptive->run();
+  a = called;
+  called.clear();
+  plain->run();
+  b = called;
+  if (a != b) {
+    printf("adaptive: %s for n=%d s=%d v=%d calls %s, not %s\n", src, n, s, v, a.c_str(), b.c_str());
+    CHECK(false);
+  }
+  for (i = 0; i < 26; i++)
+    if (adaptive->getVariable('a' + i) != plain->getVariable('a' + i)) {
+      printf("adaptive: %s for n=%d s=%d v=%d sets %c to %d, not %d\n", src, n, s, v,
+	     'a' + i, adaptive->getVariable('a' + i), plain->getVariable('a' + i));
+      CHECK(false);
+    }
+}
+
+static void testScripts()
+{
+  std::mt19937 rng(7);
+  struct RunStats stats;
+  int k, r, n, s, v;
+
+  for (k = 0; k < (int)(sizeof(scripts) / sizeof(scripts[0])); k++) {
+    MyInterpreter adaptive, plain;
+
+    adaptive.registerFunc1((char *)"send", send);
+    adaptive.registerFunc1((char *)"note", note);
+    plain.registerFunc1((char *)"send", send);
+    plain.registerFunc1((char *)"note", note);
+    // Counts the compiles
+    adaptive.getHandlers()->setProfiling(true);
+    adaptive.setAdaptive(RUNS);
+    CHECK(adaptive.load((char *)scripts[k], strlen(scripts[k])));
+    CHECK(plain.load((char *)scripts[k], strlen(scripts[k])));
+    for (r = 0; r < RUNS; r++) {
+      message(&rng, &n, &s, &v);
+      runBoth(&adaptive, &plain, n, s, v, scripts[k]);
+    }
+
+    // Compiled again once, and only once
+    adaptive.getRunStats(&stats);
+    CHECK_EQ(stats.compiles, 2);
+    for (r = 0; r < 4 * RUNS; r++) {
+      message(&rng, &n, &s, &v);
+      runBoth(&adaptive, &plain, n, s, v, scripts[k]);
+    }
+    adaptive.getRunStats(&stats);
+    CHECK_EQ(stats.compiles, 2);
+  }
+}
+
+// The counts are kept by the version laid out for them
+static void testProfile()
+{
+  char src[] = "if(n==40&&v>1000){send(v);}";
+  MyInterpreter interpreter;
+  struct ProbeSite before[8], after[8];
+  int r, n, i;
+
+  interpreter.registerFunc1((char *)"send", send);
+  interpreter.setAdaptive(RUNS);
+  CHECK(interpreter.load(src, strlen(src)));
+  interpreter.setVariable('n', 40);
+  for (r = 0; r < RUNS - 1; r++) {
+    interpreter.setVariable('v', r);
+    interpreter.run();
+  }
+  n = interpreter.getProfile(before, 8);
+  CHECK(n > 0);
+  interpreter.run();
+  CHECK_EQ(interpreter.getProfile(after, 8), n);
+  for (i = 0; i < n; i++)
+    CHECK(after[i].count >= before[i].count);
+}
+
+int main()
+{
+  testScripts();
+  testProfile();
+  return report("adaptive");
+}
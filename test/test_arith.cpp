@@ -0,0 +1,122 @@
+// A SMING-compatible C interpreter
+//
+// Integer arithmetic gives the same results folded by the compiler and
+// run by the interpreter, including overflow, shift counts out of range
+// and INT32_MIN / -1.  Reals go to infinity as floats and saturate in
+// fixed point (built with SCRIPT_FIXED) like constants out of range.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyInterpreter.h"
+#include "test.h"
+
+static const char *ops[] = { "*", "/", "%", "+", "-", "<<", ">>" };
+
+static const int32_t values[] = {
+  0, 1, -1, 2, -2, 3, 7, -8, 31, 32, 33, -33, 100, 0x7fff, -0x8000,
+  INT32_MAX, INT32_MAX - 1, INT32_MIN, INT32_MIN + 1,
+};
+
+#define COUNT(a)	((int)(sizeof(a) / sizeof((a)[0])))
+
+static int run(MyInterpreter *interpreter, const char *src, int32_t a, int32_t b)
+{
+  char buf[128];
+
+  snprintf(buf, sizeof(buf), "%s", src);
+  if (!interpreter->load(buf, strlen(buf)))
+    return 0x5a5a5a5a;
+  interpreter->setVariable('a', a);
+  interpreter->setVariable('b', b);
+  interpreter->run();
+  return interpreter->getVariable('x');
+}
+
+static void testFoldedAsRun()
+{
+  MyInterpreter interpreter;
+  char folded[128], run1[128];
+  int i, j, k, v, w;
+
+  for (k=0; k<COUNT(ops); k++)
+    for (i=0; i<COUNT(values); i++)
+      for (j=0; j<COUNT(values); j++) {
+	if (values[j] == 0 && (k == 1 || k == 2))
+	  continue;
+	// Negative literals are folded negations, INT32_MIN only fits that way
+	snprintf(folded, sizeof(folded), "x=(0-%u-1+1)%s(0-%u-1+1);",
+		 0u - (uint32_t)values[i], ops[k], 0u - (uint32_t)values[j]);
+	snprintf(run1, sizeof(run1), "x=a%sb;", ops[k]);
+	v = run(&interpreter, folded, 0, 0);
+	w = run(&interpreter, run1, values[i], values[j]);
+	CHECK_EQ(v, w);
+      }
+}
+
+static void testSemantics()
+{
+  MyInterpreter interpreter;
+
+  CHECK_EQ(run(&interpreter, "x=a/b;", INT32_MIN, -1), INT32_MIN);
+  CHECK_EQ(run(&interpreter, "x=a%b;", INT32_MIN, -1), 0);
+  CHECK_EQ(run(&interpreter, "x=a<<b;", -5, 3), -40);
+  CHECK_EQ(run(&interpreter, "x=a<<b;", 1, 33), 2);
+  CHECK_EQ(run(&interpreter, "x=a>>b;", -8, 1), -4);
+  CHECK_EQ(run(&interpreter, "x=a>>b;", 256, -1), 0);
+  CHECK_EQ(run(&interpreter, "x=a+b;", INT32_MAX, 1), INT32_MIN);
+  CHECK_EQ(run(&interpreter, "x=-a;", INT32_MIN, 0), INT32_MIN);
+  CHECK_EQ(run(&interpreter, "x=-5<<3;", 0, 0), -40);
+  CHECK_EQ(run(&interpreter, "x=1<<33;", 0, 0), 2);
+}
+
+// Real t computed from a and b
+static double runReal(MyInterpreter *interpreter, const char *src, int32_t a, int32_t b)
+{
+  run(interpreter, src, a, b);
+  return interpreter->getVariableReal('t');
+}
+
+static void testReals()
+{
+  MyInterpreter interpreter;
+
+  CHECK(runReal(&interpreter, "t=0.5*a;", 3, 0) == 1.5);
+  CHECK(runReal(&interpreter, "t=a/4.0-b;", 3, 1) == -0.25);
+#ifdef SCRIPT_FIXED
+  const double max = INT32_MAX / 65536.0, min = -32768.0;
+
+  CHECK(runReal(&interpreter, "t=32767.5+1.0;", 0, 0) == max);
+  CHECK(runReal(&interpreter, "t=-32767.5-1.0-a;", 0, 0) == min);
+  CHECK(runReal(&interpreter, "t=40000.0;", 0, 0) == max);
+  CHECK(runReal(&interpreter, "t=-40000.0;", 0, 0) == -max);
+  CHECK(runReal(&interpreter, "t=a*1.0;", 40000, 0) == max);
+  CHECK(runReal(&interpreter, "t=a*1.0;", -40000, 0) == min);
+  CHECK(runReal(&interpreter, "t=a*200.5;", 200, 0) == max);
+  CHECK(runReal(&interpreter, "t=a*200.5;", -200, 0) == min);
+  CHECK(runReal(&interpreter, "t=a/0.001;", 100, 0) == max);
+  CHECK(runReal(&interpreter, "t=-(0.0-32768.0);", 0, 0) == max);
+  CHECK(runReal(&interpreter, "t=32767.0+0.5;", 0, 0) == 32767.5);
+  // Back to an int from the largest real
+  CHECK_EQ(run(&interpreter, "t=40000.0;x=t;", 0, 0), 32767);
+#else
+  CHECK(runReal(&interpreter, "t=32767.5+1.0;", 0, 0) == 32768.5);
+  CHECK(runReal(&interpreter, "t=a*1.0;", 40000, 0) == 40000.0);
+#endif
+}
+
+int main()
+{
+  testFoldedAsRun();
+  testSemantics();
+  testReals();
+#ifdef SCRIPT_FIXED
+  return report("arith (fixed)");
+#else
+  return report("arith");
+#endif
+}
@@ -0,0 +1,124 @@
+// A SMING-compatible C interpreter
+//
+// Results of cacheable handlers: kept per arguments, forgotten when
+// invalidated, even during the call, and replaced caches freed once no run
+// uses them.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyInterpreter.h"
+#include "test.h"
+
+static MyHandlers *handlers;
+static int calls;
+static int setting = 10;
+static bool invalidating, replacing;
+
+// Reads a setting which may change while it is read
+static int cfg(int a)
+{
+  int value = setting * a;
+
+  calls ++;
+  if (invalidating) {
+    setting ++;
+    handlers->invalidateCache("cfg", 1);
+  }
+  if (replacing)
+    handlers->setCacheable("cfg", 1, 0, 4);
+  return value;
+}
+
+static void testCached()
+{
+  char src[] = "x=cfg(1)+cfg(1)+cfg(2);";
+  MyInterpreter interpreter;
+  struct CacheStats stats;
+  int i;
+
+  handlers = interpreter.getHandlers();
+  interpreter.registerFunc1((char *)"cfg", cfg);
+  CHECK(!handlers->setCacheable("cfg", 2, 0, 4));
+  CHECK(!handlers->setCacheable("cfg", 1, 0, CACHE_ENTRIES + 1));
+  CHECK(handlers->setCacheable("cfg", 1, 0, 4));
+  CHECK(interpreter.load(src, strlen(src)));
+  calls = 0;
+  for (i=0; i<10; i++)
+    interpreter.run();
+  CHECK_EQ(interpreter.getVariable('x'), 40);
+  CHECK_EQ(calls, 2);
+  CHECK(handlers->getCacheStats("cfg", 1, &stats));
+  CHECK_EQ(stats.hits, 28u);
+  CHECK_EQ(stats.misses, 2u);
+
+  setting = 20;
+  handlers->invalidateCache("cfg", 1);
+  interpreter.run();
+  CHECK_EQ(interpreter.getVariable('x'), 80);
+  CHECK_EQ(calls, 4);
+  setting = 10;
+}
+
+// A result read before an invalidation is not kept after it
+static void testInvalidatedDuringCall()
+{
+  char src[] = "x=cfg(1);";
+  MyInterpreter interpreter;
+  struct CacheStats stats;
+
+  handlers = interpreter.getHandlers();
+  interpreter.registerFunc1((char *)"cfg", cfg);
+  CHECK(handlers->setCacheable("cfg", 1, 0, 4));
+  CHECK(interpreter.load(src, strlen(src)));
+  calls = 0;
+  invalidating = true;
+  interpreter.run();
+  invalidating = false;
+  CHECK_EQ(interpreter.getVariable('x'), 10);
+  CHECK(handlers->getCacheStats("cfg", 1, &stats));
+  CHECK_EQ(stats.entries, 0u);
+  interpreter.run();
+  CHECK_EQ(interpreter.getVariable('x'), 11);
+  CHECK_EQ(calls, 2);
+  setting = 10;
+}
+
+// The cache replaced during the call is still written after it, then
+// freed: the table does not grow
+static void testReplaced()
+{
+  char src[] = "x=cfg(1);";
+  MyInterpreter interpreter;
+  uint32_t used;
+  int i;
+
+  handlers = interpreter.getHandlers();
+  interpreter.registerFunc1((char *)"cfg", cfg);
+  CHECK(handlers->setCacheable("cfg", 1, 0, 4));
+  CHECK(interpreter.load(src, strlen(src)));
+  used = handlers->memoryUsed();
+  for (i=0; i<100; i++)
+    CHECK(handlers->setCacheable("cfg", 1, 0, 4));
+  CHECK_EQ(handlers->memoryUsed(), used);
+
+  replacing = true;
+  interpreter.run();
+  replacing = false;
+  CHECK(handlers->memoryUsed() > used);
+  interpreter.reclaim();
+  CHECK_EQ(handlers->memoryUsed(), used);
+  CHECK_EQ(interpreter.getVariable('x'), 10);
+}
+
+int main()
+{
+  testCached();
+  testInvalidatedDuringCall();
+  testReplaced();
+  return report("cache");
+}
@@ -0,0 +1,163 @@
+// A SMING-compatible C interpreter
+//
+// Worst case cost of a run: never below the instructions (counted with
+// COUNT_OPS) and handler calls a run takes, unbounded for loops without a
+// known bound, and a budget below it refuses the script or stops its runs.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyInterpreter.h"
+#include "test.h"
+
+static int sq(int a)
+{
+  return a * a;
+}
+
+static int note(const char *, int, int a)
+{
+  return a;
+}
+
+static const char *bounded[] = {
+  "x=v+1;",
+  "if(v>2){x=sq(v);y=sq(x%100);}else{x=-v;}",
+  "x=0;for(i=0;i<10;i=i+1){x=x+sq(i);if(x>v)break;}",
+  "x=0;for(i=0;i<4;i=i+1){for(j=0;j<3;j=j+1){x=x+i*j;}}",
+  "switch(v){case 1:x=sq(v);case 2:x=x+1;break;case 7:note(\"seven\",v);break;default:x=0;}",
+  "x=v&&sq(v)>4||v in {1,5,9};note(\"x\");",
+  "x=v*2.5;y=x/2;z=y>3;",
+};
+
+static const char *unbounded[] = {
+  "i=0;while(i<v){i=i+1;}",
+  "for(i=0;i<v;i=i+1){x=x+i;}",
+  "for(i=0;i<10;i=i+1){i=i-1;}",
+  "while(1){break;}",
+};
+
+// Each run of the bounded scripts stays within their cost
+static void testBounded()
+{
+  MyInterpreter interpreter;
+  struct ScriptCost cost;
+  RunContext ctx;
+  int n, v;
+  bool within;
+
+  interpreter.registerFunc1((char *)"sq", sq);
+  interpreter.registerFuncS((char *)"note", note);
+  interpreter.addContext(&ctx);
+  for (n = 0; n < (int)(sizeof(bounded) / sizeof(bounded[0])); n++) {
+    CHECK(interpreter.load((char *)bounded[n], strlen(bounded[n])));
+    CHECK(interpreter.getCost(&cost));
+    CHECK(cost.ops != COST_UNBOUNDED);
+    CHECK(cost.calls != COST_UNBOUNDED);
+    CHECK(!cost.capped);
+    within = true;
+    for (v = -3; v < 12; v++) {
+      ctx.setVariable('v', v);
+      ctx.ops = 0;
+      ctx.calls = 0;
+      interpreter.run(&ctx);
+      if (ctx.ops > cost.ops || ctx.calls > cost.calls) {
+	printf("cost: %s for v=%d takes %u ops and %u calls, not at most %u and %u\n",
+	       bounded[n], v, ctx.ops, ctx.calls, cost.ops, cost.calls);
+	within = false;
+      }
+    }
+    CHECK(within);
+  }
+  interpreter.removeContext(&ctx);
+}
+
+static void testUnbounded()
+{
+  MyInterpreter interpreter;
+  struct ScriptCost cost;
+  int n;
+
+  for (n = 0; n < (int)(sizeof(unbounded) / sizeof(unbounded[0])); n++) {
+    CHECK(interpreter.load((char *)unbounded[n], strlen(unbounded[n])));
+    CHECK(interpreter.getCost(&cost));
+    CHECK_EQ(cost.ops, COST_UNBOUNDED);
+  }
+}
+
+// Below the cost, the script is refused and the one loaded before stays
+static void testReject()
+{
+  const char *src = bounded[2];
+  MyInterpreter interpreter;
+  struct ScriptCost cost;
+
+  interpreter.registerFunc1((char *)"sq", sq);
+  CHECK(interpreter.load((char *)src, strlen(src)));
+  CHECK(interpreter.getCost(&cost));
+
+  interpreter.setBudget(cost.ops - 1, 0, BUDGET_REJECT);
+  CHECK(!interpreter.load((char *)src, strlen(src)));
+  CHECK_EQ(interpreter.getLoadError(), ERROR_BUDGET);
+  interpreter.setBudget(0, cost.calls - 1, BUDGET_REJECT);
+  CHECK(!interpreter.load((char *)src, strlen(src)));
+  CHECK_EQ(interpreter.getLoadError(), ERROR_BUDGET);
+  CHECK(!interpreter.load((char *)unbounded[0], strlen(unbounded[0])));
+  CHECK_EQ(interpreter.getLoadError(), ERROR_BUDGET);
+
+  // At the cost it loads
+  interpreter.setBudget(cost.ops, cost.calls, BUDGET_REJECT);
+  CHECK(interpreter.load((char *)src, strlen(src)));
+  CHECK_EQ(interpreter.getLoadError(), 0);
+  interpreter.setVariable('v', 1000);
+  interpreter.run();
+  CHECK_EQ(interpreter.getVariable('x'), 285);
+}
+
+// Capped, a run stops once over budget
+static void testCap()
+{
+  const char *src = "x=0;while(1){x=x+1;}";
+  const char *calls = "x=0;i=0;while(i<v){i=i+1;x=sq(i);}";
+  MyInterpreter interpreter;
+  struct ScriptCost cost;
+  RunContext ctx;
+
+  interpreter.registerFunc1((char *)"sq", sq);
+  interpreter.addContext(&ctx);
+  interpreter.setBudget(200, 5, BUDGET_CAP);
+  CHECK(interpreter.load((char *)src, strlen(src)));
+  CHECK(interpreter.getCost(&cost));
+  CHECK(cost.capped);
+  ctx.ops = 0;
+  interpreter.run(&ctx);
+  CHECK(ctx.getVariable('x') > 0);
+  CHECK(ctx.getVariable('x') < 200);
+  CHECK(ctx.ops <= 201);
+
+  // Within the budget, a run ends as usual
+  CHECK(interpreter.load((char *)calls, strlen(calls)));
+  ctx.setVariable('v', 3);
+  interpreter.run(&ctx);
+  CHECK_EQ(ctx.getVariable('x'), 9);
+  // Stopped at the sixth call
+  ctx.setVariable('v', 10);
+  ctx.calls = 0;
+  interpreter.run(&ctx);
+  CHECK_EQ(ctx.getVariable('x'), 25);
+  CHECK_EQ(ctx.calls, 5u);
+  interpreter.removeContext(&ctx);
+}
+
+int main()
+{
+  testBounded();
+  testUnbounded();
+  testReject();
+  testCap();
+  return report("cost");
+}
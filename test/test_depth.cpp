@@ -0,0 +1,147 @@
+// A SMING-compatible C interpreter
+//
+// Deeply nested scripts: long else-if ladders, braced or not, nested
+// parentheses and long sums are compiled and run as in C; only input
+// nested past SCRIPT_NESTING or higher than SCRIPT_HEIGHT is refused.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <string>
+#include "MyInterpreter.h"
+#include "test.h"
+
+// if(s==0)x=0;else if(s==1)x=1;... else x=-1;
+static std::string chain(int n)
+{
+  std::string src;
+  int i;
+
+  for (i = 0; i < n; i++)
+    src += (i ? "else if(s==" : "if(s==") + std::to_string(i) + ")x=" + std::to_string(i) + ";";
+  return src + "else x=-1;";
+}
+
+// if(s==0){x=0;}else{if(s==1){x=1;}else{...}}
+static std::string braced(int n)
+{
+  std::string src;
+  int i;
+
+  for (i = 0; i < n; i++)
+    src += "if(s==" + std::to_string(i) + "){x=" + std::to_string(i) + ";}else{";
+  src += "x=-1;";
+  for (i = 0; i < n; i++)
+    src += "}";
+  return src;
+}
+
+// x=s+s+...+s;
+static std::string sum(int n)
+{
+  std::string src = "x=s";
+  int i;
+
+  for (i = 1; i < n; i++)
+    src += "+s";
+  return src + ";";
+}
+
+static std::string repeat(const char *open, int n, const char *inner, const char *close)
+{
+  std::string src;
+  int i;
+
+  for (i = 0; i < n; i++)
+    src += open;
+  src += inner;
+  for (i = 0; i < n; i++)
+    src += close;
+  return src;
+}
+
+// x=((...(1+s)+s)...+s);
+static std::string parens(int n)
+{
+  return "x=" + repeat("(", n, "1", "+s)") + ";";
+}
+
+static bool load(MyInterpreter *interpreter, const std::string &src)
+{
+  return interpreter->load((char *)src.c_str(), src.size());
+}
+
+// Each rung of a ladder picks its own branch
+static void testLadders()
+{
+  MyInterpreter interpreter;
+  int n, s;
+
+  for (n = 15; n <= 30; n += 15) {
+    CHECK(load(&interpreter, chain(n)));
+    for (s = -1; s <= n; s++) {
+      interpreter.setVariable('s', s);
+      interpreter.run();
+      CHECK_EQ(interpreter.getVariable('x'), s < n ? s : -1);
+    }
+    CHECK(load(&interpreter, braced(n)));
+    for (s = -1; s <= n; s++) {
+      interpreter.setVariable('s', s);
+      interpreter.run();
+      CHECK_EQ(interpreter.getVariable('x'), s < n ? s : -1);
+    }
+  }
+}
+
+static void testExpressions()
+{
+  MyInterpreter interpreter;
+  int n;
+
+  CHECK(load(&interpreter, parens(20)));
+  interpreter.setVariable('s', 3);
+  interpreter.run();
+  CHECK_EQ(interpreter.getVariable('x'), 1 + 20 * 3);
+  for (n = 63; n <= 100; n += 37) {
+    CHECK(load(&interpreter, sum(n)));
+    interpreter.run();
+    CHECK_EQ(interpreter.getVariable('x'), n * 3);
+  }
+  // Many unary operators in a row, each one a level
+  CHECK(load(&interpreter, "x=" + std::string(20, '-') + "s;"));
+  interpreter.run();
+  CHECK_EQ(interpreter.getVariable('x'), 3);
+  CHECK(load(&interpreter, repeat("{", 40, "x=s;", "}")));
+  interpreter.run();
+  CHECK_EQ(interpreter.getVariable('x'), 3);
+}
+
+// Only past the limits
+static void testRefused()
+{
+  MyInterpreter interpreter;
+  int pos;
+
+  CHECK(!load(&interpreter, parens(200)));
+  CHECK_EQ(interpreter.getLoadError(&pos), ERROR_DEPTH);
+  CHECK(!load(&interpreter, "x=" + std::string(500, '-') + "s;"));
+  CHECK_EQ(interpreter.getLoadError(&pos), ERROR_DEPTH);
+  CHECK(!load(&interpreter, repeat("{", 200, "x=s;", "}")));
+  CHECK_EQ(interpreter.getLoadError(&pos), ERROR_DEPTH);
+  CHECK(!load(&interpreter, repeat("if(s)", 100, "x=s;", "")));
+  CHECK_EQ(interpreter.getLoadError(&pos), ERROR_DEPTH);
+  CHECK(!load(&interpreter, sum(300)));
+  CHECK_EQ(interpreter.getLoadError(&pos), ERROR_DEPTH);
+}
+
+int main()
+{
+  testLadders();
+  testExpressions();
+  testRefused();
+  return report("depth");
+}
@@ -0,0 +1,91 @@
+// A SMING-compatible C interpreter
+//
+// Jobs of the worker pool: bindings and starting values reach the script
+// as it types them, ints or reals.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <atomic>
+#include "MyExecutor.h"
+#include "test.h"
+
+#define JOBS	1000
+
+static std::atomic<int> total;
+static std::atomic<int> wrong;
+
+static int expect(int a, int b)
+{
+  if (a != b)
+    wrong ++;
+  total += a;
+  return a;
+}
+
+static void submit(MyExecutor *executor, int script, int key, int v)
+{
+  ExecutorJob job;
+
+  job.script = script;
+  job.key = key;
+  job.count = 2;
+  job.names[0] = 'v'; job.values[0] = v;
+  job.names[1] = 'n'; job.values[1] = v * 3;
+  executor->submit(job);
+}
+
+static void testInts()
+{
+  char src[] = "expect(v*3,n);";
+  MyInterpreter interpreter;
+  MyExecutor executor(4);
+  int i, script;
+
+  interpreter.registerFunc2((char *)"expect", expect);
+  CHECK(interpreter.load(src, strlen(src)));
+  script = executor.addScript(&interpreter);
+  CHECK(executor.start());
+  total = 0;
+  wrong = 0;
+  for (i=0; i<JOBS; i++)
+    submit(&executor, script, EXECUTOR_UNORDERED, i);
+  executor.drain();
+  CHECK_EQ(wrong.load(), 0);
+  CHECK_EQ(total.load(), 3 * JOBS * (JOBS - 1) / 2);
+}
+
+// v and w are reals in the script: the binding of v is converted, the
+// starting value of w keeps its fraction
+static void testReals()
+{
+  char src[] = "if(n<0){v=0.5;}w=w+0.0;r=v*2.0+w*2.0;expect(r,n);";
+  MyInterpreter interpreter;
+  MyExecutor executor(4);
+  int i, script;
+
+  interpreter.registerFunc2((char *)"expect", expect);
+  CHECK(interpreter.load(src, strlen(src)));
+  interpreter.setVariableReal('w', 0.5);
+  script = executor.addScript(&interpreter);
+  CHECK(executor.start());
+  total = 0;
+  wrong = 0;
+  // r = 2v + 1 and n = 3v meet for v = 1
+  for (i=0; i<JOBS; i++)
+    submit(&executor, script, i % 7, 1);
+  executor.drain();
+  CHECK_EQ(wrong.load(), 0);
+  CHECK_EQ(total.load(), 3 * JOBS);
+}
+
+int main()
+{
+  testInts();
+  testReals();
+  return report("executor");
+}
@@ -0,0 +1,171 @@
+// A SMING-compatible C interpreter
+//
+// Loading and checking of compiled program images: images made by the
+// compiler load, truncated, tampered or hand made ones which would run
+// off the value stack are refused.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyInterpreter.h"
+#include "test.h"
+
+static int printed;
+
+static int print(int a)
+{
+  printed = a;
+  return a;
+}
+
+static uint8_t *compile(const char *src, int *len)
+{
+  MyCompiler compiler;
+
+  if (compiler.compile(src, strlen(src)))
+    return NULL;
+  return compiler.release(len);
+}
+
+// An image around hand written code, with a valid checksum
+static int makeImage(uint8_t *image, const uint8_t *code, int codeLen, int maxStack,
+		     const char *import = NULL, int arity = 0)
+{
+  struct ProgramHeader *hdr = (struct ProgramHeader *)image;
+  uint8_t *p = image + sizeof(*hdr);
+
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->magic = PROGRAM_MAGIC;
+  hdr->version = PROGRAM_VERSION;
+  hdr->maxStack = maxStack;
+  hdr->realFormat = PROGRAM_REAL;
+  hdr->codeLen = codeLen;
+  memcpy(p, code, codeLen);
+  p += codeLen;
+  if (import) {
+    hdr->importCount = 1;
+    *p++ = arity;
+    *p++ = strlen(import);
+    memcpy(p, import, strlen(import));
+    p += strlen(import);
+    hdr->importLen = p - (image + sizeof(*hdr) + codeLen);
+  }
+  hdr->checksum = hash32(image + sizeof(*hdr), p - (image + sizeof(*hdr)));
+  return p - image;
+}
+
+static bool loads(const uint8_t *code, int codeLen, int maxStack,
+		  const char *import = NULL, int arity = 0)
+{
+  MyInterpreter interpreter;
+  uint8_t image[256];
+
+  interpreter.registerFunc1((char *)"print", print);
+  return interpreter.loadCompiled(image, makeImage(image, code, codeLen, maxStack, import, arity));
+}
+
+static void testCompiled()
+{
+  const char *scripts[] = {
+    "if(n==40){if(s==0){print(n);}else{print(s);}}",
+    "x=0;for(i=0;i<10;i=i+1){x=x+i;}print(x);",
+    "i=0;while(i<5&&(v||s)){i=i+1;if(i==3)continue;print(i);}",
+    "switch(s){case 0:print(1);case 1:print(2);break;case 9:print(3);default:print(4);}",
+    "print(v in {1,2,3,500,-7});t=v*0.5;print(t>1.0);",
+  };
+  MyInterpreter interpreter;
+  uint8_t *image;
+  int len, n;
+
+  interpreter.registerFunc1((char *)"print", print);
+  for (n = 0; n < (int)(sizeof(scripts) / sizeof(scripts[0])); n++) {
+    image = compile(scripts[n], &len);
+    CHECK(image != NULL);
+    if (!image)
+      continue;
+    CHECK(interpreter.loadCompiled(image, len));
+    free(image);
+  }
+}
+
+static void testTruncated()
+{
+  MyInterpreter interpreter;
+  uint8_t *image;
+  int len, cut;
+
+  image = compile("if(v>3){print(v);}else{print(-v);}", &len);
+  CHECK(image != NULL);
+  for (cut = 0; cut < len; cut++)
+    CHECK(!interpreter.loadCompiled(image, cut));
+  CHECK(interpreter.loadCompiled(image, len));
+  free(image);
+}
+
+static void testTampered()
+{
+  MyInterpreter interpreter;
+  const struct ProgramHeader *hdr;
+  uint8_t *image;
+  int len, i;
+
+  interpreter.registerFunc1((char *)"print", print);
+  image = compile("x=v+1;print(x);", &len);
+  hdr = (const struct ProgramHeader *)image;
+  CHECK(image != NULL);
+
+  // Any change to the body breaks the checksum
+  for (i = sizeof(*hdr); i < len; i++) {
+    image[i] ^= 0x20;
+    CHECK(!interpreter.loadCompiled(image, len));
+    image[i] ^= 0x20;
+  }
+
+  // A forged checksum does not help a header claiming a deeper stack
+  ((struct ProgramHeader *)image)->maxStack = PROGRAM_STACK + 1;
+  CHECK(!interpreter.loadCompiled(image, len));
+  ((struct ProgramHeader *)image)->maxStack = 1;
+  CHECK(!interpreter.loadCompiled(image, len));
+  free(image);
+}
+
+// Hand made code with a valid checksum must still keep to its stack
+static void testStack()
+{
+  const uint8_t fine[] = { OP_PUSHB, 1, OP_PUSHB, 2, OP_ADD, OP_POP, OP_HALT };
+  const uint8_t underflow[] = { OP_POP, OP_HALT };
+  const uint8_t binary[] = { OP_PUSHB, 1, OP_ADD, OP_POP, OP_HALT };
+  // Each iteration leaves a value behind
+  const uint8_t growing[] = { OP_PUSHB, 1, OP_LOOP, 4, OP_HALT };
+  // The two paths reach the end with different depths
+  const uint8_t join[] = { OP_PUSHB, 0, OP_JZ, 2, OP_PUSHB, 1, OP_HALT };
+  const uint8_t call[] = { OP_PUSHB, 5, OP_CALL, 0, OP_POP, OP_HALT };
+  const uint8_t table[] = { OP_JTAB, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, OP_HALT };
+
+  CHECK(loads(fine, sizeof(fine), 2));
+  CHECK(!loads(fine, sizeof(fine), 1));
+  CHECK(!loads(underflow, sizeof(underflow), 2));
+  CHECK(!loads(binary, sizeof(binary), 2));
+  CHECK(!loads(growing, sizeof(growing), PROGRAM_STACK));
+  CHECK(!loads(join, sizeof(join), 2));
+  CHECK(loads(call, sizeof(call), 1, "print", 1));
+  // The import takes more arguments than the call pushed
+  CHECK(!loads(call, sizeof(call), 1, "print", 2));
+  // A call of a string handler without its string
+  CHECK(!loads(call, sizeof(call), 1, "print", IMPORT_STRING | 2));
+  // A table pops the value it dispatches on
+  CHECK(!loads(table, sizeof(table), 1));
+}
+
+int main()
+{
+  testCompiled();
+  testTruncated();
+  testTampered();
+  testStack();
+  return report("image");
+}
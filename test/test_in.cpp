@@ -0,0 +1,110 @@
+// A SMING-compatible C interpreter
+//
+// The in operator: sets close together (a bitset) and spread out (a
+// search), empty or with repeated values, at the extreme ints, and its
+// precedence.  Malformed sets are refused.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <set>
+#include <string>
+#include <vector>
+#include "MyInterpreter.h"
+#include "test.h"
+
+static int sq(int a)
+{
+  return a * a;
+}
+
+static const std::vector<std::vector<int>> sets = {
+  {}, {5}, {40, 41, 52}, {1, 1, 1, 2}, {-3, -1, 0, 2, 7}, {0, 2047}, {0, 2040},
+  {-100, 0, 100, 1000, 100000}, {2147483647, -2147483647 - 1},
+  {10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33},
+};
+
+static const int probes[] = {
+  -2147483647 - 1, -101, -100, -4, -3, -2, -1, 0, 1, 2, 3, 5, 6, 7, 8, 9, 10, 33, 34,
+  40, 41, 42, 52, 99, 100, 1000, 2039, 2040, 2041, 2046, 2047, 2048, 100000, 2147483647
+};
+
+// x tells whether v is in the set, y whether v+1 is not
+static void testSets()
+{
+  MyInterpreter interpreter;
+  std::string src, values;
+  size_t n, i;
+  int v;
+
+  for (n = 0; n < sets.size(); n++) {
+    std::set<int> set(sets[n].begin(), sets[n].end());
+    values.clear();
+    for (i = 0; i < sets[n].size(); i++)
+      values += (i ? "," : "") + std::to_string(sets[n][i]);
+    src = "x=v in {" + values + "};y=!(v+1 in {" + values + "})&&1;";
+    CHECK(interpreter.load((char *)src.c_str(), src.size()));
+    for (i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+      v = probes[i];
+      interpreter.setVariable('v', v);
+      interpreter.run();
+      if (interpreter.getVariable('x') != (int)set.count(v)
+	  || interpreter.getVariable('y') != !set.count((int)((unsigned)v + 1))) {
+	printf("in: %s for v=%d gives %d %d\n", src.c_str(), v,
+	       interpreter.getVariable('x'), interpreter.getVariable('y'));
+	CHECK(false);
+	break;
+      }
+    }
+  }
+}
+
+static const struct {
+  const char *src;
+  int x;
+} results[] = {
+  { "x=3 in {1,2,3};", 1 },
+  { "x=4 in {1,2,3};", 0 },
+  { "x=1+2 in {3};", 1 },
+  { "x=2<3 in {1};", 1 },
+  { "t=2.5;x=t in {2};", 1 },
+  { "x=sq(3) in {9}+sq(3) in {9,10};", 1 },
+  { "x=0;for(i=0;i<10;i=i+1)if(i in {2,3,7})x=x+i;", 12 },
+  { "x=(v in {1,2})+(v in {-1,1,1000});", 2 },
+};
+
+static const char *refused[] = {
+  "x=v in {v};",
+  "x=v in {1,};",
+  "x=v in {1 2};",
+  "x=v in 3;",
+  "x=v in {1.5};",
+  "x=v in {1",
+};
+
+static void testExpressions()
+{
+  MyInterpreter interpreter;
+  int n;
+
+  interpreter.registerFunc1((char *)"sq", sq, true);
+  for (n = 0; n < (int)(sizeof(results) / sizeof(results[0])); n++) {
+    CHECK(interpreter.load((char *)results[n].src, strlen(results[n].src)));
+    interpreter.setVariable('v', 1);
+    interpreter.run();
+    CHECK_EQ(interpreter.getVariable('x'), results[n].x);
+  }
+  for (n = 0; n < (int)(sizeof(refused) / sizeof(refused[0])); n++)
+    CHECK(!interpreter.load((char *)refused[n], strlen(refused[n])));
+}
+
+int main()
+{
+  testSets();
+  testExpressions();
+  return report("in");
+}
@@ -0,0 +1,197 @@
+// A SMING-compatible C interpreter
+//
+// The ingestion queue under several producers and a draining consumer:
+// every message accepted is drained once, in the order each producer
+// pushed it, and coalescing keeps the newest value of a key in the place
+// of the older one.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "MyIngestQueue.h"
+#include "test.h"
+
+#define PRODUCERS	4
+#define MESSAGES	20000	// Per producer
+#define KEYS		8	// Sensors shared by the producers
+
+static std::atomic<bool> producing;
+
+// Values are the producer and a count, so each producer's order shows
+static int valueOf(int producer, int n)
+{
+  return producer << 24 | n;
+}
+
+static void produce(MyIngestQueue *queue, int producer, bool shared, std::vector<int> *accepted)
+{
+  int n, sensor;
+
+  for (n = 0; n < MESSAGES; n++) {
+    sensor = shared ? n % KEYS : 0;
+    if (queue->push(shared ? 1 : producer, sensor, 0, valueOf(producer, n)))
+      accepted->push_back(n);
+    else
+      std::this_thread::yield();
+  }
+}
+
+static void consume(MyIngestQueue *queue, std::vector<IngestMessage> *out)
+{
+  struct IngestMessage batch[16];
+  int i, n;
+
+  for (;;) {
+    bool last = !producing;
+
+    n = queue->drain(batch, 16);
+    for (i = 0; i < n; i++)
+      out->push_back(batch[i]);
+    if (!n && last)
+      break;
+  }
+}
+
+static void run(MyIngestQueue *queue, bool shared, std::vector<int> *accepted,
+		std::vector<IngestMessage> *drained)
+{
+  std::thread producers[PRODUCERS];
+  int p;
+
+  producing = true;
+  std::thread consumer(consume, queue, drained);
+  for (p = 0; p < PRODUCERS; p++)
+    producers[p] = std::thread(produce, queue, p, shared, accepted + p);
+  for (p = 0; p < PRODUCERS; p++)
+    producers[p].join();
+  producing = false;
+  consumer.join();
+}
+
+// Without coalescing nothing accepted is lost, nor drained twice
+static void testNoLoss()
+{
+  MyIngestQueue queue(64);
+  std::vector<int> accepted[PRODUCERS];
+  std::vector<IngestMessage> drained;
+  std::vector<size_t> next(PRODUCERS, 0);
+  struct IngestStats stats;
+  size_t i, total = 0;
+  int p;
+  bool ordered = true;
+
+  run(&queue, false, accepted, &drained);
+  for (i = 0; i < drained.size(); i++) {
+    p = drained[i].node;
+    // The next one this producer got accepted
+    if (p >= PRODUCERS || next[p] >= accepted[p].size()
+	|| drained[i].value != valueOf(p, accepted[p][next[p]]))
+      ordered = false;
+    else
+      next[p] ++;
+  }
+  CHECK(ordered);
+  for (p = 0; p < PRODUCERS; p++) {
+    CHECK_EQ(next[p], accepted[p].size());
+    total += accepted[p].size();
+  }
+
+  queue.getStats(&stats);
+  CHECK_EQ(stats.depth, 0u);
+  CHECK_EQ(stats.enqueued, total);
+  CHECK_EQ(stats.drained, total);
+  CHECK_EQ(stats.coalesced, 0u);
+  CHECK_EQ(stats.enqueued + stats.dropped, (uint32_t)(PRODUCERS * MESSAGES));
+}
+
+// Producers sharing keys: a value replaces an older one of its key, never
+// lands before it, and the last value of each key is drained last
+static void testCoalesced()
+{
+  MyIngestQueue queue(64, KEYS);
+  std::vector<int> accepted[PRODUCERS];
+  std::vector<IngestMessage> drained;
+  int seen[KEYS][PRODUCERS], last[KEYS];
+  struct IngestStats stats;
+  size_t i;
+  int k, p, n;
+  bool ordered = true, newest = true;
+
+  queue.setCoalesceWindow(1000000);
+  run(&queue, true, accepted, &drained);
+  for (k = 0; k < KEYS; k++) {
+    last[k] = -1;
+    for (p = 0; p < PRODUCERS; p++)
+      seen[k][p] = -1;
+  }
+  for (i = 0; i < drained.size(); i++) {
+    k = drained[i].sensor;
+    p = drained[i].value >> 24;
+    n = drained[i].value & 0xffffff;
+    if (drained[i].node != 1 || k >= KEYS || p >= PRODUCERS || n % KEYS != k
+	|| n <= seen[k][p])
+      ordered = false;
+    else
+      seen[k][p] = n;
+    last[k] = drained[i].value;
+  }
+  CHECK(ordered);
+  // The latest value of a key came from a producer's last push to it
+  for (k = 0; k < KEYS; k++) {
+    p = last[k] >> 24;
+    for (n = accepted[p].size() - 1; n >= 0 && accepted[p][n] % KEYS != k; n--)
+      ;
+    if (last[k] < 0 || n < 0 || last[k] != valueOf(p, accepted[p][n]))
+      newest = false;
+  }
+  CHECK(newest);
+
+  queue.getStats(&stats);
+  CHECK_EQ(stats.depth, 0u);
+  CHECK_EQ(stats.drained, (uint32_t)drained.size());
+  CHECK_EQ(stats.drained, stats.enqueued);
+  CHECK_EQ(stats.enqueued + stats.coalesced + stats.dropped, (uint32_t)(PRODUCERS * MESSAGES));
+}
+
+// One producer: a key keeps its place in the queue and its newest value
+static void testOrder()
+{
+  MyIngestQueue queue(8, 4);
+  struct IngestMessage batch[8];
+  struct IngestStats stats;
+
+  queue.setCoalesceWindow(1000000);
+  CHECK(queue.push(1, 1, 0, 10));
+  CHECK(queue.push(1, 2, 0, 20));
+  CHECK(queue.push(1, 1, 0, 11));
+  CHECK(queue.push(2, 1, 0, 30));
+  CHECK(queue.push(1, 2, 0, 21));
+  CHECK_EQ(queue.drain(batch, 8), 3);
+  CHECK_EQ(batch[0].sensor, 1);
+  CHECK_EQ(batch[0].value, 11);
+  CHECK_EQ(batch[1].value, 21);
+  CHECK_EQ(batch[2].value, 30);
+  // Drained, the key takes a new place
+  CHECK(queue.push(1, 1, 0, 12));
+  CHECK_EQ(queue.drain(batch, 8), 1);
+  CHECK_EQ(batch[0].value, 12);
+  queue.getStats(&stats);
+  CHECK_EQ(stats.enqueued, 4u);
+  CHECK_EQ(stats.coalesced, 2u);
+  CHECK_EQ(stats.drained, 4u);
+}
+
+int main()
+{
+  testOrder();
+  testNoLoss();
+  testCoalesced();
+  return report("ingest");
+}
@@ -0,0 +1,112 @@
+// A SMING-compatible C interpreter
+//
+// Loading a directory on several threads: each file gets its own error and
+// offset, files too big, empty or wrong are told apart, and each
+// interpreter runs its own script with the shared handlers.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "MyLoader.h"
+#include "test.h"
+
+#define RULES	24	// Good ones, rule<i>.txt sets x to i * v + 1
+
+static int twice(int a)
+{
+  return 2 * a;
+}
+
+static void writeFile(const std::string &dir, const char *name, const std::string &text)
+{
+  std::string path = dir + "/" + name;
+  FILE *f = fopen(path.c_str(), "w");
+
+  CHECK(f != NULL);
+  if (f) {
+    fwrite(text.data(), 1, text.size(), f);
+    fclose(f);
+  }
+}
+
+static void removeDir(const std::string &dir, const std::vector<std::string> &names)
+{
+  size_t i;
+
+  for (i = 0; i < names.size(); i++)
+    unlink((dir + "/" + names[i]).c_str());
+  rmdir(dir.c_str());
+}
+
+static void testDirectory(int threads)
+{
+  char tmpl[] = "/tmp/test_loaderXXXXXX";
+  std::vector<std::string> names;
+  std::string dir, name;
+  MyHandlers handlers;
+  struct LoaderStats stats;
+  struct LoaderFile *f;
+  int i, loaded;
+
+  CHECK(mkdtemp(tmpl) != NULL);
+  dir = tmpl;
+  handlers.registerFunc1((char *)"twice", twice);
+  for (i = 0; i < RULES; i++) {
+    name = "rule" + std::string(i < 10 ? "0" : "") + std::to_string(i) + ".txt";
+    writeFile(dir, name.c_str(), "x=" + std::to_string(i) + "*v+1;y=twice(v);");
+    names.push_back(name);
+  }
+  // After the rules in name order
+  writeFile(dir, "z_big.txt", "x=1;" + std::string(SCRIPT_MAX, ' '));
+  writeFile(dir, "z_empty.txt", "");
+  writeFile(dir, "z_syntax.txt", "x=1;\ny=;");
+  // Skipped for its suffix
+  writeFile(dir, "notes.md", "not a script");
+  names.insert(names.end(), { "z_big.txt", "z_empty.txt", "z_syntax.txt", "notes.md" });
+
+  MyLoader loader(&handlers, threads);
+  loaded = loader.loadDirectory(dir.c_str(), ".txt");
+  CHECK_EQ(loaded, RULES + 1);
+  CHECK_EQ(loader.count(), RULES + 3);
+  loader.getStats(&stats);
+  CHECK_EQ(stats.files, RULES + 3);
+  CHECK_EQ(stats.failed, 2);
+
+  for (i = 0; i < RULES; i++) {
+    f = loader.file(i);
+    CHECK_EQ(f->error, 0);
+    f->interpreter->setVariable('v', 3);
+    f->interpreter->run();
+    CHECK_EQ(f->interpreter->getVariable('x'), i * 3 + 1);
+    CHECK_EQ(f->interpreter->getVariable('y'), 6);
+  }
+  f = loader.file(RULES);
+  CHECK(strstr(f->name, "z_big.txt") != NULL);
+  CHECK_EQ(f->error, ERROR_TOO_BIG);
+  f = loader.file(RULES + 1);
+  CHECK(strstr(f->name, "z_empty.txt") != NULL);
+  CHECK_EQ(f->error, 0);
+  f->interpreter->run();
+  f = loader.file(RULES + 2);
+  CHECK(strstr(f->name, "z_syntax.txt") != NULL);
+  CHECK_EQ(f->error, ERROR_SYNTAX);
+  CHECK_EQ(f->errorPos, 7);
+  CHECK(loader.file(RULES + 3) == NULL);
+
+  removeDir(dir, names);
+  CHECK_EQ(loader.loadDirectory(dir.c_str(), ".txt"), -1);
+}
+
+int main()
+{
+  testDirectory(1);
+  testDirectory(4);
+  return report("loader");
+}
@@ -0,0 +1,142 @@
+// A SMING-compatible C interpreter
+//
+// Counted for loops: they run as the same loop in C, also when they break,
+// continue, start past their bound or end at the largest int, and loops
+// which change their counter or bound are left to the general code.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <functional>
+#include "MyInterpreter.h"
+#include "test.h"
+
+static unsigned printed;
+
+// Each value printed, in order
+static int print(int a)
+{
+  printed = printed * 31 + a;
+  return a;
+}
+
+struct Loop {
+  const char *src;
+  std::function<int(int, unsigned *)> expect;	// x given v, gets the printed sum
+};
+
+#define LOOP(body) { #body, [](int v, unsigned *p) { int x = 0, i = 0, j = 0, n = v + 2; \
+      auto print = [p](int a) { *p = *p * 31 + a; return a; };		\
+      (void)i; (void)j; (void)n; (void)print; body; return x; } }
+
+static int isq(int a)
+{
+  return a * a;
+}
+
+static const struct Loop loops[] = {
+  LOOP(x=0;for(i=0;i<v;i=i+1){x=x+i;}),
+  LOOP(x=0;for(i=v;i<3;i=1+i){x=x*2+i;}),
+  LOOP(x=0;for(i=0;i<n*2;i=i+1){print(i);}),
+  LOOP(x=0;for(i=0;i<v;i=i+1){if(i==3)break;x=x+1;}x=x*100+i;),
+  LOOP(x=0;for(i=0;i<v;i=i+1){if(i%2==0)continue;x=x+i;}x=x*100+i;),
+  LOOP(x=0;for(i=0;i<v;i=i+1){for(j=i;j<v;j=j+1){x=x+j-i;}}),
+  LOOP(x=0;for(i=0;i<v;i=i+1){x=x+i;i=i+1;}),
+  LOOP(x=0;n=v;for(i=0;i<n;i=i+1){x=x+1;n=n-1;}),
+  LOOP(x=0;for(i=2147483640;i<2147483647;i=i+1){x=x+1;}x=x*10+i%10;),
+  LOOP(x=0;for(i=-2147483647-1;i<-2147483640+v;i=i+1){x=x+1;}),
+  LOOP(x=0;for(i=0;i<isq(v)-5;i=i+1){x=x+i%3;}),
+};
+
+// A bound which is a real is not counted
+static const char *reals = "x=0;t=v*0.5;for(i=0;i<t;i=i+1){x=x+1;}";
+
+static void testLoops()
+{
+  MyInterpreter interpreter;
+  unsigned want;
+  int n, v;
+
+  interpreter.registerFunc1((char *)"print", print);
+  interpreter.registerFunc1((char *)"isq", isq, true);
+  for (n = 0; n < (int)(sizeof(loops) / sizeof(loops[0])); n++) {
+    CHECK(interpreter.load((char *)loops[n].src, strlen(loops[n].src)));
+    for (v = -3; v < 12; v++) {
+      interpreter.setVariable('v', v);
+      interpreter.setVariable('n', v + 2);
+      printed = 0;
+      interpreter.run();
+      want = 0;
+      if (interpreter.getVariable('x') != loops[n].expect(v, &want) || printed != want) {
+	printf("loops: %s for v=%d gives %d\n", loops[n].src, v, interpreter.getVariable('x'));
+	CHECK(false);
+	break;
+      }
+    }
+  }
+
+  CHECK(interpreter.load((char *)reals, strlen(reals)));
+  for (v = -3; v < 12; v++) {
+    interpreter.setVariable('v', v);
+    interpreter.run();
+    CHECK_EQ(interpreter.getVariable('x'), v > 0 ? (v + 1) / 2 : 0);
+  }
+}
+
+// The counter is left at the bound, or where the loop broke out
+static void testCounter()
+{
+  char src[] = "for(i=v;i<n;i=i+1){if(i==7)break;}";
+  MyInterpreter interpreter;
+
+  CHECK(interpreter.load(src, strlen(src)));
+  interpreter.setVariable('v', 0);
+  interpreter.setVariable('n', 5);
+  interpreter.run();
+  CHECK_EQ(interpreter.getVariable('i'), 5);
+  interpreter.setVariable('v', 9);
+  interpreter.run();
+  CHECK_EQ(interpreter.getVariable('i'), 9);
+  interpreter.setVariable('v', 0);
+  interpreter.setVariable('n', 50);
+  interpreter.run();
+  CHECK_EQ(interpreter.getVariable('i'), 7);
+}
+
+// A counted loop takes fewer instructions than the same loop traced, which
+// is compiled without it: only the counted one finishes within the budget
+static void testCost()
+{
+  const char *src = "x=0;for(i=0;i<n;i=i+1){x=x+i;}";
+  MyInterpreter counted, traced;
+  Vector<TracePoint> trace;
+  MyCompiler compiler;
+  uint8_t *image;
+  int len;
+
+  counted.setBudget(100, 0, BUDGET_CAP);
+  traced.setBudget(100, 0, BUDGET_CAP);
+  CHECK(counted.load((char *)src, strlen(src)));
+  CHECK(!compiler.compile(src, strlen(src), &trace));
+  image = compiler.release(&len);
+  CHECK(traced.loadCompiled(image, len));
+  free(image);
+  counted.setVariable('n', 10);
+  traced.setVariable('n', 10);
+  counted.run();
+  traced.run();
+  CHECK_EQ(counted.getVariable('x'), 45);
+  CHECK(traced.getVariable('x') < 45);
+}
+
+int main()
+{
+  testLoops();
+  testCounter();
+  testCost();
+  return report("loops");
+}
@@ -0,0 +1,155 @@
+// A SMING-compatible C interpreter
+//
+// Memory usage: the program counts its image, strings and bindings, a
+// replaced version counts as retired while a run still uses it and not
+// once reclaimed, and runs or variables set take nothing more.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyInterpreter.h"
+#include "test.h"
+
+static const char small[] = "x=v+1;";
+static const char large[] = "x=v+1;y=twice(x);note(\"a string\");note(\"another\",y);"
+  "if(x>3){z=x*y;}else{z=x-y;}";
+
+static MyInterpreter *reloaded;
+static struct MemoryUsage during;
+
+static int twice(int a)
+{
+  return 2 * a;
+}
+
+static int note(const char *, int, int a)
+{
+  return a;
+}
+
+// Loads the small script in the middle of a run of the large one
+static int reload(int a)
+{
+  reloaded->load((char *)small, strlen(small));
+  reloaded->getMemoryUsage(&during);
+  return a;
+}
+
+// Bytes of a program loaded from a compiled image
+static uint32_t bytesOf(const char *src, uint8_t **image, int *len)
+{
+  const struct ProgramHeader *hdr;
+  MyCompiler compiler;
+
+  CHECK(!compiler.compile(src, strlen(src)));
+  *image = compiler.release(len);
+  hdr = (const struct ProgramHeader *)*image;
+  return sizeof(struct LoadedProgram) + sizeof(struct ScriptString) * hdr->stringCount
+    + sizeof(struct Binding) * hdr->importCount + *len;
+}
+
+static void checkTotal(const struct MemoryUsage *u)
+{
+  CHECK_EQ(u->total, u->interpreter + u->program + u->trace + u->retired + u->handlers);
+}
+
+static void testPrograms()
+{
+  MyHandlers handlers;
+  MyInterpreter interpreter(&handlers);
+  struct MemoryUsage u, v;
+  uint8_t *image[2];
+  uint32_t bytes[2];
+  int len[2], i;
+
+  handlers.registerFunc1((char *)"twice", twice);
+  handlers.registerFuncS((char *)"note", note);
+  interpreter.getMemoryUsage(&u);
+  CHECK_EQ(u.interpreter, sizeof(MyInterpreter));
+  CHECK_EQ(u.program, 0u);
+  CHECK_EQ(u.trace, 0u);
+  CHECK_EQ(u.retired, 0u);
+  CHECK_EQ(u.handlers, handlers.memoryUsed());
+  checkTotal(&u);
+
+  bytes[0] = bytesOf(small, &image[0], &len[0]);
+  bytes[1] = bytesOf(large, &image[1], &len[1]);
+  CHECK(bytes[1] > bytes[0]);
+  for (i = 0; i < 2; i++) {
+    CHECK(interpreter.loadCompiled(image[i], len[i]));
+    interpreter.getMemoryUsage(&u);
+    CHECK_EQ(u.program, bytes[i]);
+    CHECK_EQ(u.retired, 0u);
+    checkTotal(&u);
+    // Compiled from source to the same image
+    CHECK(interpreter.load((char *)(i ? large : small), strlen(i ? large : small)));
+    interpreter.getMemoryUsage(&v);
+    CHECK_EQ(v.program, bytes[i]);
+    CHECK_EQ(v.total, u.total);
+  }
+
+  // Used in place, only the bindings and strings count
+  CHECK(interpreter.loadStatic(image[1], len[1]));
+  interpreter.getMemoryUsage(&u);
+  CHECK_EQ(u.program, bytes[1] - len[1]);
+
+  // Runs and variables take nothing
+  CHECK(interpreter.load((char *)large, strlen(large)));
+  interpreter.getMemoryUsage(&u);
+  for (i = 0; i < 10; i++) {
+    interpreter.setVariable('a' + i, i);
+    interpreter.setVariable('v', i);
+    interpreter.run();
+  }
+  interpreter.getMemoryUsage(&v);
+  CHECK_EQ(v.total, u.total);
+
+  // A handler more counts its name
+  handlers.registerFunc1((char *)"thrice", twice);
+  interpreter.getMemoryUsage(&v);
+  CHECK(v.handlers >= u.handlers + strlen("thrice") + 1);
+  free(image[0]);
+  free(image[1]);
+}
+
+// Replaced in a run, the large version is retired until the run is over
+static void testRetired()
+{
+  MyInterpreter interpreter;
+  struct MemoryUsage u;
+  uint8_t *image;
+  uint32_t smallBytes, largeBytes;
+  int len;
+
+  smallBytes = bytesOf(small, &image, &len);
+  free(image);
+  largeBytes = bytesOf(large, &image, &len);
+  free(image);
+
+  interpreter.registerFunc1((char *)"twice", reload);
+  interpreter.registerFuncS((char *)"note", note);
+  CHECK(interpreter.load((char *)large, strlen(large)));
+  reloaded = &interpreter;
+  interpreter.run();
+  CHECK_EQ(during.program, smallBytes);
+  CHECK_EQ(during.retired, largeBytes);
+  checkTotal(&during);
+
+  // Gone with the next load or reclaim
+  interpreter.reclaim();
+  interpreter.getMemoryUsage(&u);
+  CHECK_EQ(u.program, smallBytes);
+  CHECK_EQ(u.retired, 0u);
+  CHECK_EQ(u.total, during.total - largeBytes);
+}
+
+int main()
+{
+  testPrograms();
+  testRetired();
+  return report("memory");
+}
@@ -0,0 +1,77 @@
+// A SMING-compatible C interpreter
+//
+// Runs started by a handler on the context of the run calling it: the
+// variables of the calling run, its counted loops and its cached values are
+// left as they were.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyInterpreter.h"
+#include "test.h"
+
+static MyInterpreter *interpreter;
+static int depth, nested, seen;
+
+// Runs the script again from within itself, once
+static int again(int a)
+{
+  if (depth == 0) {
+    depth ++;
+    interpreter->run();
+    nested ++;
+    depth --;
+  }
+  return a;
+}
+
+static int peek(int a)
+{
+  seen = a;
+  return a;
+}
+
+static void testLoop()
+{
+  char src[] = "x=0;for(i=0;i<n;i=i+1){x=x+again(i)+n*n;}n=n+1;";
+  MyInterpreter in;
+
+  interpreter = &in;
+  in.registerFunc1((char *)"again", again);
+  CHECK(in.load(src, strlen(src)));
+  in.setVariable('n', 5);
+  nested = 0;
+  in.run();
+  CHECK_EQ(nested, 5);
+  // Neither the loop variable nor the cached n*n changed under the loop
+  CHECK_EQ(in.getVariable('x'), 0 + 1 + 2 + 3 + 4 + 5 * 25);
+  CHECK_EQ(in.getVariable('i'), 5);
+  CHECK_EQ(in.getVariable('n'), 6);
+}
+
+// The nested run starts from the variables of the calling run
+static void testSeen()
+{
+  char src[] = "v=v+1;peek(v);again(0);w=v;";
+  MyInterpreter in;
+
+  interpreter = &in;
+  in.registerFunc1((char *)"again", again);
+  in.registerFunc1((char *)"peek", peek);
+  CHECK(in.load(src, strlen(src)));
+  in.setVariable('v', 10);
+  in.run();
+  CHECK_EQ(seen, 12);
+  CHECK_EQ(in.getVariable('w'), 11);
+}
+
+int main()
+{
+  testLoop();
+  testSeen();
+  return report("nesting");
+}
@@ -0,0 +1,264 @@
+// A SMING-compatible C interpreter
+//
+// Cached expressions: scripts compiled with the optimizer give the same
+// handler calls and variables as without it, and call pure handlers no
+// more often.  Random scripts mix pure calls, loops, switch and in.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <random>
+#include <string>
+#include "MyInterpreter.h"
+#include "test.h"
+
+#define SCRIPTS	2000
+
+static std::string printed;
+static int pureCalls;
+
+static int print(int a)
+{
+  printed += std::to_string(a) + ";";
+  return a;
+}
+
+static int sq(int a)
+{
+  pureCalls ++;
+  return (int)((unsigned)a * a + 1);
+}
+
+static int mx(int a, int b)
+{
+  pureCalls ++;
+  return a > b ? a : b;
+}
+
+static void setup(MyInterpreter *interpreter)
+{
+  interpreter->registerFunc1((char *)"print", print);
+  interpreter->registerFunc1((char *)"sq", sq, true);
+  interpreter->registerFunc2((char *)"mx", mx, true);
+}
+
+struct Outcome {
+  std::string printed;
+  int variables[26];
+  int pureCalls;
+};
+
+static void run(MyInterpreter *interpreter, const int *start, struct Outcome *out)
+{
+  int i;
+
+  for (i=0; i<26; i++)
+    interpreter->setVariable('a' + i, start[i]);
+  printed.clear();
+  pureCalls = 0;
+  interpreter->run();
+  out->printed = printed;
+  for (i=0; i<26; i++)
+    out->variables[i] = interpreter->getVariable('a' + i);
+  out->pureCalls = pureCalls;
+}
+
+static bool loadUncached(MyInterpreter *interpreter, const char *src)
+{
+  MyCompiler compiler;
+  uint8_t *image;
+  bool loaded;
+  int len;
+
+  compiler.noCaching();
+  if (compiler.compile(src, strlen(src)))
+    return false;
+  image = compiler.release(&len);
+  loaded = interpreter->loadCompiled(image, len);
+  free(image);
+  return loaded;
+}
+
+static std::mt19937 rng(1);
+static std::string common[4];
+
+static int pick(int n)
+{
+  return rng() % n;
+}
+
+static std::string expr(int depth)
+{
+  static const char *binary[] = { "+", "-", "*", "==", "<", "&", "^" };
+  std::string s;
+  int i, n;
+
+  if (depth <= 0 || pick(4) == 0)
+    return pick(2) ? std::string(1, "abcdexyz"[pick(8)]) : std::to_string(pick(7) - 2);
+  switch (pick(10)) {
+  case 0:
+    return "sq(" + expr(depth - 1) + ")";
+  case 1:
+    return "mx(" + expr(depth - 1) + "," + expr(depth - 1) + ")";
+  case 2:
+    return "(" + expr(depth - 1) + (pick(2) ? "&&" : "||") + expr(depth - 1) + ")";
+  case 3:
+    return "-" + expr(depth - 1);
+  case 4:
+    s = "(" + expr(depth - 1) + " in {";
+    for (i=0, n=pick(6); i<n; i++)
+      s += (i ? "," : "") + std::to_string(pick(20) - 3);
+    return s + "})";
+  case 5:
+    // An odd divisor, the run is not cut short by a division by 0
+    return "(" + expr(depth - 1) + (pick(2) ? "/" : "%") + "(" + expr(depth - 1) + "*2+1))";
+  default:
+    return "(" + expr(depth - 1) + binary[pick(7)] + expr(depth - 1) + ")";
+  }
+}
+
+// Often one of a few shared expressions, for the optimizer to find
+static std::string operand()
+{
+  return pick(3) == 0 ? common[pick(4)] : expr(2);
+}
+
+static std::string stmt(int depth, int loop)
+{
+  std::string s, l(1, "ijk"[loop < 3 ? loop : 0]);
+  int i, n;
+
+  switch (depth <= 0 ? 0 : pick(8)) {
+  case 0:
+  case 1:
+    return std::string(1, "abcdexyz"[pick(8)]) + "=" + operand() + ";";
+  case 3:
+    return "if(" + operand() + "){" + stmt(depth - 1, loop) + stmt(depth - 1, loop) + "}else{"
+      + stmt(depth - 1, loop) + "}";
+  case 4:
+    if (loop < 3)
+      return "for(" + l + "=0;" + l + "<" + std::to_string(pick(4)) + ";" + l + "=" + l + "+1){"
+	+ stmt(depth - 1, loop + 1) + stmt(depth - 1, loop + 1) + "}";
+    break;
+  case 5:
+    if (loop < 3)
+      return l + "=0;while(" + l + "<" + std::to_string(pick(4)) + "&&" + expr(1) + "){"
+	+ l + "=" + l + "+1;" + stmt(depth - 1, loop + 1) + stmt(depth - 1, loop + 1) + "}";
+    break;
+  case 6:
+    s = "switch(" + operand() + "){";
+    for (i=0, n=1+pick(4); i<n; i++) {
+      s += "case " + std::to_string(i - 1) + ":";
+      if (pick(3))
+	s += stmt(depth - 1, loop);
+      if (pick(2))
+	s += "break;";
+    }
+    return s + "}";
+  case 7:
+    if (loop && pick(4) == 0)
+      return pick(2) ? "break;" : "continue;";
+    break;
+  }
+  return "print(" + operand() + ");";
+}
+
+static void testRandom()
+{
+  MyInterpreter cached, uncached;
+  struct Outcome a, b;
+  std::string src;
+  int start[26];
+  int t, i, n;
+
+  setup(&cached);
+  setup(&uncached);
+  for (t=0; t<SCRIPTS; t++) {
+    for (i=0; i<4; i++)
+      common[i] = expr(2);
+    src.clear();
+    for (i=0, n=2+pick(5); i<n; i++)
+      src += stmt(3, 0);
+    if (src.size() > 1024) {
+      t--;
+      continue;
+    }
+    for (i=0; i<26; i++)
+      start[i] = pick(9) - 4;
+    CHECK(cached.load((char *)src.c_str(), src.size()));
+    CHECK(loadUncached(&uncached, src.c_str()));
+    run(&cached, start, &a);
+    run(&uncached, start, &b);
+    if (a.printed != b.printed || memcmp(a.variables, b.variables, sizeof(a.variables))
+	|| a.pureCalls > b.pureCalls) {
+      printf("optimizer: %s\n  printed %s, %d pure calls\n  not %s, %d pure calls\n",
+	     src.c_str(), a.printed.c_str(), a.pureCalls, b.printed.c_str(), b.pureCalls);
+      CHECK(false);
+    }
+  }
+}
+
+static int pureCallsOf(const char *src, int v)
+{
+  MyInterpreter interpreter;
+
+  setup(&interpreter);
+  CHECK(interpreter.load((char *)src, strlen(src)));
+  interpreter.setVariable('v', v);
+  interpreter.setVariable('n', 4);
+  pureCalls = 0;
+  interpreter.run();
+  return pureCalls;
+}
+
+static void testCached()
+{
+  // Repeated, loop invariant, changed in between
+  CHECK_EQ(pureCallsOf("if(sq(v)>3){print(sq(v));}else{print(-sq(v));}", 2), 1);
+  CHECK_EQ(pureCallsOf("x=0;for(i=0;i<10;i=i+1){x=x+mx(n,v)*i;}", 2), 1);
+  CHECK_EQ(pureCallsOf("x=0;for(i=0;i<0;i=i+1){x=x+mx(n,v);}", 2), 0);
+  CHECK_EQ(pureCallsOf("x=sq(v);v=v+1;y=sq(v);", 2), 2);
+  CHECK_EQ(pureCallsOf("i=0;while(i<n){i=i+1;v=v+sq(n);}", 2), 1);
+  CHECK_EQ(pureCallsOf("i=0;while(i<n){i=i+1;n=n-sq(v)+sq(v);}", 2), 1);
+}
+
+// Temporaries of a script
+static int tempsOf(const char *src)
+{
+  MyCompiler compiler;
+  uint8_t *image;
+  int len, temps;
+
+  CHECK(!compiler.compile(src, strlen(src)));
+  image = compiler.release(&len);
+  temps = ((struct ProgramHeader *)image)->temps;
+  free(image);
+  return temps;
+}
+
+// Only where the first one is evaluated on every way to the next
+static void testDominated()
+{
+  CHECK_EQ(tempsOf("x=v*3+n;if(s){y=v*3+n;}"), 1);
+  CHECK_EQ(tempsOf("if(s){x=v*3+n;y=v*3+n;}else{z=v*3+n;}"), 1);
+  CHECK_EQ(tempsOf("i=0;while(i<n){i=i+1;x=v*3+i;y=v*3+i;}"), 1);
+  CHECK_EQ(tempsOf("switch(s){case 1:x=v*3+n;y=v*3+n;break;}"), 1);
+  CHECK_EQ(tempsOf("if(s){x=v*3+n;}else{y=v*3+n;}"), 0);
+  CHECK_EQ(tempsOf("if(s){x=v*3+n;}z=v*3+n;"), 0);
+  CHECK_EQ(tempsOf("switch(s){case 1:x=v*3+n;break;case 2:y=v*3+n;}"), 0);
+  CHECK_EQ(tempsOf("switch(s){case 1:x=v*3+n;case 2:y=v*3+n;}"), 0);
+  CHECK_EQ(tempsOf("x=s&&v*3+n>2;y=v*3+n;"), 0);
+  CHECK_EQ(tempsOf("x=n>2||v*3+n>2;y=v*3+n;"), 0);
+}
+
+int main()
+{
+  testRandom();
+  testCached();
+  testDominated();
+  return report("optimizer");
+}
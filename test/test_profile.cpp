@@ -0,0 +1,188 @@
+// A SMING-compatible C interpreter
+//
+// Profiling: the calls of each handler, the slow ones logged against the
+// threshold with their arguments and place in the script, and the runs of
+// an interpreter, counted while profiling is on and only then.  Scripts
+// run alike with it on or off, budget capped or not.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyInterpreter.h"
+#include "test.h"
+
+#define SLOW_US		3000	// A slow call takes that long
+#define THRESHOLD_US	1000
+
+// The loop has no bound: with a budget, the run is capped
+static const char src[] = "x=fast(v);if(v>2){y=slow(v,x);}note(\"v\",v);i=0;while(i<1){i=i+1;}";
+
+static int fast(int a)
+{
+  return a + 1;
+}
+
+static int slow(int a, int b)
+{
+  unsigned long start = micros();
+
+  while (micros() - start < SLOW_US)
+    ;
+  return a * b;
+}
+
+static int note(const char *, int, int a)
+{
+  return a;
+}
+
+// Calls of a handler as profiled, -1 if it is not registered
+static int callsOf(MyHandlers *handlers, const char *name, struct HandlerStats *stats)
+{
+  int i, b;
+  uint32_t sum = 0;
+
+  for (i = 0; i < handlers->handlerCount(); i++) {
+    CHECK(handlers->getHandlerStats(i, stats));
+    if (strcmp(stats->name, name))
+      continue;
+    // Each call falls in one bucket
+    for (b = 0; b < PROFILE_BUCKETS; b++)
+      sum += stats->stats.histogram[b];
+    CHECK_EQ(sum, stats->stats.calls);
+    return stats->stats.calls;
+  }
+  return -1;
+}
+
+// v from 0 to 4: fast and note called 5 times, slow twice
+static void runAll(MyInterpreter *interpreter)
+{
+  int v;
+
+  for (v = 0; v < 5; v++) {
+    interpreter->setVariable('v', v);
+    interpreter->setVariable('y', 0);
+    interpreter->run();
+    CHECK_EQ(interpreter->getVariable('x'), v + 1);
+    CHECK_EQ(interpreter->getVariable('y'), v > 2 ? v * (v + 1) : 0);
+  }
+}
+
+static void setup(MyHandlers *handlers)
+{
+  handlers->registerFunc1((char *)"fast", fast);
+  handlers->registerFunc2((char *)"slow", slow);
+  handlers->registerFuncS((char *)"note", note);
+  handlers->setSlowCallThreshold(THRESHOLD_US);
+}
+
+static void testOff()
+{
+  MyHandlers handlers;
+  MyInterpreter interpreter(&handlers);
+  struct HandlerStats stats;
+  struct SlowCall calls[4];
+  struct RunStats run;
+
+  setup(&handlers);
+  CHECK(interpreter.load((char *)src, strlen(src)));
+  runAll(&interpreter);
+  CHECK_EQ(callsOf(&handlers, "fast", &stats), 0);
+  CHECK_EQ(callsOf(&handlers, "slow", &stats), 0);
+  CHECK_EQ(handlers.getSlowCalls(calls, 4), 0);
+  interpreter.getRunStats(&run);
+  CHECK_EQ(run.compiles, 0u);
+  CHECK_EQ(run.runs, 0u);
+}
+
+static void testOn(bool capped)
+{
+  MyHandlers handlers;
+  MyInterpreter interpreter(&handlers);
+  struct HandlerStats stats;
+  struct SlowCall calls[4];
+  struct RunStats run;
+  struct ScriptCost cost;
+
+  setup(&handlers);
+  handlers.setProfiling(true);
+  // Capped far over what the script takes, it runs the checking executor
+  if (capped)
+    interpreter.setBudget(1000, 10, BUDGET_CAP);
+  CHECK(interpreter.load((char *)src, strlen(src)));
+  interpreter.getCost(&cost);
+  CHECK_EQ(cost.ops, COST_UNBOUNDED);
+  runAll(&interpreter);
+
+  CHECK_EQ(callsOf(&handlers, "fast", &stats), 5);
+  CHECK_EQ(stats.arity, 1);
+  CHECK_EQ(callsOf(&handlers, "slow", &stats), 2);
+  CHECK(stats.stats.micros >= 2 * SLOW_US);
+  CHECK_EQ(callsOf(&handlers, "note", &stats), 5);
+  CHECK_EQ(stats.arity, IMPORT_STRING);
+
+  // Only the calls of slow, with where they are
+  CHECK_EQ(handlers.getSlowCalls(calls, 4), 2);
+  CHECK(!strcmp(calls[0].name, "slow"));
+  CHECK_EQ(calls[0].arity, 2);
+  CHECK_EQ(calls[0].args[0], 3);
+  CHECK_EQ(calls[0].args[1], 4);
+  CHECK_EQ(calls[1].args[0], 4);
+  CHECK_EQ(calls[0].pos, (int)(strstr(src, "slow(") - src));
+  CHECK(calls[0].micros >= SLOW_US);
+  // Moved out of the log
+  CHECK_EQ(handlers.getSlowCalls(calls, 4), 0);
+
+  interpreter.getRunStats(&run);
+  CHECK_EQ(run.compiles, 1u);
+  CHECK_EQ(run.runs, 5u);
+  CHECK(run.handlerMicros >= 2 * SLOW_US);
+  CHECK(run.runMicros >= run.handlerMicros);
+
+  // Off again, the counts stay
+  handlers.setProfiling(false);
+  runAll(&interpreter);
+  CHECK_EQ(callsOf(&handlers, "fast", &stats), 5);
+  CHECK_EQ(handlers.getSlowCalls(calls, 4), 0);
+  interpreter.getRunStats(&run);
+  CHECK_EQ(run.runs, 5u);
+
+  handlers.resetStats();
+  interpreter.resetRunStats();
+  CHECK_EQ(callsOf(&handlers, "slow", &stats), 0);
+  interpreter.getRunStats(&run);
+  CHECK_EQ(run.runs, 0u);
+}
+
+// Loaded before profiling is turned on, the slow calls have no offset
+static void testLoadedBefore()
+{
+  MyHandlers handlers;
+  MyInterpreter interpreter(&handlers);
+  struct SlowCall calls[4];
+  struct RunStats run;
+
+  setup(&handlers);
+  CHECK(interpreter.load((char *)src, strlen(src)));
+  handlers.setProfiling(true);
+  runAll(&interpreter);
+  CHECK_EQ(handlers.getSlowCalls(calls, 4), 2);
+  CHECK_EQ(calls[0].pos, -1);
+  interpreter.getRunStats(&run);
+  CHECK_EQ(run.compiles, 0u);
+  CHECK_EQ(run.runs, 5u);
+}
+
+int main()
+{
+  testOff();
+  testOn(false);
+  testOn(true);
+  testLoadedBefore();
+  return report("profile");
+}
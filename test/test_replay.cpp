@@ -0,0 +1,107 @@
+// A SMING-compatible C interpreter
+//
+// Recording runs and replaying them: the same runs with the same
+// variables, the handler calls counted without profiling, and a recorder
+// outliving the interpreters it recorded.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyReplay.h"
+#include "test.h"
+
+#define TRACE_FILE	"build/replay.trace"
+#define RUNS		500
+
+static const char *rule1 = "if(v>100)send(n,v);t=v*0.5;";
+static const char *rule2 = "x=0;for(i=0;i<n;i=i+1)x=x+log(\"k\",i);";
+
+static int sent, total;
+
+static int send(int a, int b)
+{
+  sent ++;
+  total += a + b;
+  return 0;
+}
+
+static void load(MyInterpreter *interpreter, const char *src)
+{
+  char buf[128];
+
+  snprintf(buf, sizeof(buf), "%s", src);
+  CHECK(interpreter->load(buf, strlen(buf)));
+}
+
+// Two rules sharing a table, the second calls a handler only stubbed
+static void record()
+{
+  MyHandlers handlers;
+  MyReplay stubs;
+  MyRecorder *recorder = new MyRecorder;
+  MyInterpreter *a = new MyInterpreter(&handlers), *b = new MyInterpreter(&handlers);
+  int i;
+
+  handlers.registerFunc2((char *)"send", send);
+  load(a, rule1);
+  load(b, rule2);
+  CHECK_EQ(stubs.stubHandlers(b), 1);
+  CHECK(recorder->open(TRACE_FILE));
+  CHECK_EQ(recorder->addScript(a), 0);
+  CHECK_EQ(recorder->addScript(b), 1);
+  for (i=0; i<RUNS; i++) {
+    a->setVariable('n', i % 7);
+    a->setVariable('v', i % 200);
+    a->run();
+    if (i % 10 == 0) {
+      b->setVariable('n', i % 13);
+      b->runIfDirty();
+    }
+  }
+  // The recorder must not touch them once they are gone
+  delete a;
+  delete b;
+  recorder->close();
+  delete recorder;
+}
+
+static void replay()
+{
+  MyHandlers handlers;
+  MyInterpreter a(&handlers), b(&handlers);
+  MyReplay replay;
+  struct ReplayStats stats;
+  int recordedSent = sent, recordedTotal = total, logs = 0, i;
+
+  handlers.registerFunc2((char *)"send", send);
+  load(&a, rule1);
+  load(&b, rule2);
+  CHECK_EQ(replay.addScript(&a), 0);
+  CHECK_EQ(replay.addScript(&b), 1);
+  CHECK_EQ(replay.stubHandlers(&b), 1);
+  CHECK(replay.open(TRACE_FILE));
+  sent = total = 0;
+  CHECK(replay.replay(false, &stats));
+  CHECK_EQ(sent, recordedSent);
+  CHECK_EQ(total, recordedTotal);
+  CHECK_EQ(stats.messages, RUNS + RUNS / 10);
+  CHECK(!handlers.profiling());
+  // Every run of the second rule calls log() n times
+  for (i=0; i<RUNS; i+=10)
+    logs += i % 13;
+  CHECK_EQ(stats.calls, (uint32_t)(sent + logs));
+  CHECK(stats.p50 <= stats.p99 && stats.p99 <= stats.p999);
+  CHECK_EQ(a.getVariableReal('t'), ((RUNS - 1) % 200) * 0.5);
+}
+
+int main()
+{
+  record();
+  replay();
+  remove(TRACE_FILE);
+  return report("replay");
+}
@@ -0,0 +1,136 @@
+// A SMING-compatible C interpreter
+//
+// MyStaticCompiler.h builds the same images as MyCompiler without caching:
+// a corpus of scripts, written and generated, is compiled both ways and the
+// images compared byte for byte.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include "MyStaticCompiler.h"
+#include "test.h"
+
+#define CORPUS(X) \
+  X(c0, "") \
+  X(c1, "/* nothing */ // at all") \
+  X(c2, "if(n==40){if(s==0){print(n);print(s);if(v%2==0){print(v);updateSensorState(n,1,0);}else{updateSensorState(n,1,1);}}}") \
+  X(c3, "t=v*0.1;u=-2.5;w=t<u;x=1.0;y=-t;") \
+  X(c4, "log(\"temperature\",v);log(\"tab\\there\");log(\"temperature\",-v);") \
+  X(c5, "x=0x7fffffff+0xFFFFFFFF+0b1011+4294967295+2147483648;y=-2147483648;") \
+  X(c6, "x=a*b/c%d+e-f<<g>>h;y=(a<b)+(a<=b)+(a>b)+(a>=b)+(a==b)+(a!=b);z=a&b^c|d;w=!a+~b+-c;") \
+  X(c7, "x=1<<33;y=-5<<3;z=-8>>1;w=(0-2147483647-1)/-1;u=7%-1;") \
+  X(c8, "i=0;while(i<10){i=i+1;if(i==3)continue;if(i==8)break;print(i);}") \
+  X(c9, "x=0;for(i=0;i<10;i=i+1){x=x+i;}for(j=n;j<v;j=j+2){print(j);}for(;;){break;}") \
+  X(c10, "for(i=0;i<n;i=i+1){for(j=0;j<i;j=j+1){if(j==5)break;x=x+j;}}") \
+  X(c11, "i=0;while(i<5&&(v||s)){i=i+1;if(i==3)continue;print(i);}") \
+  X(c12, "switch(s){case 0:print(1);case 1:print(2);break;case 2:case 3:print(3);break;default:print(4);}") \
+  X(c13, "switch(v){case -1000:x=1;break;case 7:x=2;break;case 90000:x=3;break;case 5:default:x=4;}") \
+  X(c14, "switch(n){case 1:switch(s){case 0:break;default:x=1;}break;}switch(v){}") \
+  X(c15, "print(v in {1,2,3,500,-7});print(n in {40,41,42,43});print(s in {});x=v in {2147483647,-2147483648};") \
+  X(c16, "if(a&&b||c&&!d){x=1;}else if(a||b){x=2;}else{x=3;}y=a&&b;z=a||b;") \
+  X(c17, "x=mx(sq(a),sq(b));y=sq(sq(sq(v)));z=mx(mx(1,2),mx(3,v));") \
+  X(c18, "x=v*3+v*3;y=(v*3+1)*(v*3+1);while(i<n){i=i+1;z=n*n+v;}") \
+  X(c19, "a=1;b=2.5;c=a+b;d=c*2;e=d/0.5;f=e-1;g=f<c;h=-e;i=e;if(e){print(e);}") \
+  X(c20, "a=(sq(b)^b);z=(sq(0.98)!=x);print(sq(b));") \
+  X(c21, "d=mx(sq(2.97),(e>=x));for(i=0;i<1;i=i+1){for(j=0;j<2;j=j+1){print((a^(c in {640,494,-49,349,-767})));z=lg(\"t2\\n\",!0.85);}if(e){print(4);print(((c!=0.75)||-4));}else{for(j=0;j<0;j=j+1){a=((c!=0.75)||-4);x=z;}}}i=0;while(i<3&&!!d){i=i+1;print(lg(\"t0\\n\",(0.41%b)));x=((c!=0.75)||-4);}switch(z){case -1:print(((c!=0.75)||-4));case 0:i=0;while(i<3&&!!d){i=i+1;if(((d<<0.42) in {1403,1446,816,1016,210})){a=(d%(z==-35772));z=(c%13008);}else{x=((c!=0.75)||-4);}if(lg(\"t1\\n\",x))continue;x=lg(\"t0\\n\",(-48884<<x));}case 1:break;case 2:print(mx(d,mx(e,-28125)));break;}") \
+  X(c22, "z=(lg(\"t0\\n\",z)-(y in {1723,977,1248,36}));i=0;while(i<1&&(32056 in {1983,1792,92,-691})){i=i+1;for(j=0;j<2;j=j+1){switch(lg(\"t0\\n\",lg(\"t1\\n\",40509))){default:case -1:x=lg(\"t0\\n\",lg(\"t1\\n\",40509));case 0:}if((3281^sq(2.73))){y=((x&&x)<<(e%y));e=((x in {1089,848,845,-186,1605})^(c>=-35097));}else{z=x;}}switch(sq(-14234)){case -2000:j=0;while(j<3&&y){j=j+1;x=lg(\"t0\\n\",lg(\"t1\\n\",40509));if((a in {1836,895}))continue;x=lg(\"t2\\n\",lg(\"t1\\n\",y));}case -1000:print(((c in {0,13})>=lg(\"t0\\n\",1.87)));}}i=0;while(i<2&&sq(3)){i=i+1;y=(43918>=(c*0.21));y=((2*-2)==e);}") \
+  X(c23, "i=0;while(i<0&&x){i=i+1;if(((z+3)&&(y&d))){switch(b){case -1:a=z;}if(((47902 in {})%sq(3))){a=(sq(2.51)/mx(a,a));z=x;}else{c=(lg(\"t2\\n\",a)!=(x&0.76));}}else{for(j=0;j<0;j=j+1){c=-7797;a=z;}}a=(lg(\"t2\\n\",a)!=(x&0.76));}i=0;while(i<0&&(x in {})){i=i+1;e=(lg(\"t2\\n\",a)!=(x&0.76));if((24519%sq(e)))continue;j=0;while(j<2&&(3 in {1873,666,-532,1241})){j=j+1;switch(lg(\"t1\\n\",(z&&b))){case -2000:y=(3 in {1873,666,-532,1241});break;}print(mx((1.44/1),a));}}print((sq(d)&&lg(\"t1\\n\",d)));") \
+  X(c24, "b=sq((31664<1.72));if(((z in {256,1324})%(c in {1112,1860,1378}))){for(i=0;i<1;i=i+1){switch((c in {13,11})){default:case -2000:b=((1.49^46487)^lg(\"t2\\n\",c));case -1000:y=lg(\"t2\\n\",c);case 0:a=((d in {-56,1703,-252})%0.63);case 1000:break;case 2000:c=lg(\"t2\\n\",mx(0.46,2.20));break;}switch((0.3>=(-4616%x))){case -1:d=(sq(-22315)<<(2.95||a));break;case 0:x=(y in {2,5});case 1:default:case 2:break;}}i=0;while(i<1&&(31138 in {3,-1,-2,5})){i=i+1;print((y in {2,5}));if(sq((c in {10,-2,6,4,16})))continue;switch((y in {2,5})){case -1:b=sq((c in {10,-2,6,4,16}));case 0:break;case 1:default:case 2:y=2.13;break;case 3:d=(-2 in {4,0,12});break;}}}else{if(sq((c in {10,-2,6,4,16}))){b=(a&(0.15&&-2));i=0;while(i<1&&sq((c in {10,-2,6,4,16}))){i=i+1;d=mx(x,-4);c=((x^23997)%(15285>=14999));}}else{e=sq((c in {10,-2,6,4,16}));}}print((lg(\"t1\\n\",1) in {}));") \
+  X(c25, "for(i=0;i<3;i=i+1){print(0.41);switch(lg(\"t1\\n\",a)){case -1:c=((b/b)/mx(4,x));break;}}i=0;while(i<3&&(2.20 in {-596,-796,-237,-69,1570})){i=i+1;switch((z*lg(\"t1\\n\",x))){case -2000:if(((b/b)/mx(4,x))){d=(lg(\"t2\\n\",z)/2.72);y=lg(\"t1\\n\",mx(d,d));}else{x=((b/b)/mx(4,x));}break;case -1000:case 0:print(-1);break;case 1000:print(((0.93==y)%2));break;}a=((y!=-2) in {485,1960,1873});}d=sq(1.10);i=0;while(i<1&&mx((-11746&x),(b^2.70))){i=i+1;switch(mx((2&&2.78),!y)){case -2000:if((!d!=e)){c=!mx(-1,1.75);b=lg(\"t1\\n\",a);}else{b=mx((-11746&x),(b^2.70));}case -1000:if(a){b=(sq(z)<lg(\"t2\\n\",2.41));a=lg(\"t0\\n\",(e^-17379));}else{c=x;}break;default:case 0:}j=0;while(j<1&&0.41){j=j+1;z=((b/b)/mx(4,x));if(((b/b)/mx(4,x)))continue;e=2.67;}}") \
+  X(c26, "print((sq(2.28) in {5,7,11,-1,-3}));print(-1);i=0;while(i<3&&(d<(x==-2))){i=i+1;switch((c in {-3,12,13,11,15})){case -1:print((lg(\"t0\\n\",1.35)<(a+d)));case 0:break;default:case 1:for(j=0;j<0;j=j+1){x=(c in {-3,12,13,11,15});d=-(b in {5,1,0});}case 2:break;}j=0;while(j<0&&mx(a,2.78)){j=j+1;b=lg(\"t1\\n\",(2.69 in {8}));d=1.22;}}") \
+  X(c27, "for(i=0;i<3;i=i+1){z=-15427;c=y;}z=11367;print((mx(3,e)!=-z));") \
+  X(c28, "switch((lg(\"t1\\n\",d) in {-431,-849,1069,-521})){case -1:e=((45963 in {1893})||sq(z));break;case 0:print((lg(\"t0\\n\",-30095)^sq(3)));break;case 1:x=(mx(3,y)!=sq(4));break;case 2:break;case 3:break;}i=0;while(i<3&&(lg(\"t1\\n\",y)&&!a)){i=i+1;break;switch((1.22/(b||c))){case -2000:switch(((a+e)%a)){case -1:break;case 0:break;default:case 1:c=mx((2*z),(z&&e));break;case 2:c=sq(e);break;}}}i=0;while(i<2&&d){i=i+1;e=0;y=(2&&42966);}switch((lg(\"t1\\n\",y)&&!a)){default:case -1:}print((lg(\"t1\\n\",d) in {-431,-849,1069,-521}));") \
+  X(c29, "switch(6780){case -2000:switch(4){default:case -2000:print(-1);break;}break;case -1000:break;case 0:b=e;break;}if(y){for(i=0;i<3;i=i+1){z=-1;print(-18210);}print(((-2&&0.44)*sq(d)));}else{print(((e%y)&&sq(d)));}i=0;while(i<0&&a){i=i+1;b=sq(45105);if(mx(y,a))continue;if(-(0.60%14240)){print(e);if((z^(2.37<<21993))){c=((1.38&z)&&sq(z));x=(sq(38906) in {9,5});}else{a=-(3||2.60);}}else{print(-1);}}c=(23253==!d);b=z;print(sq(x));") \
+  X(c30, "d=mx((29217*2.42),lg(\"t1\\n\",b));if(((y^e)^2.17)){for(i=0;i<0;i=i+1){for(j=0;j<0;j=j+1){z=((2.86+b)+(1.56 in {2,-3,9,13}));e=2;}switch(!(2.63-x)){case -1:y=!(x in {79,1613,442,1359});}}for(i=0;i<2;i=i+1){j=0;while(j<2&&!(x in {79,1613,442,1359})){j=j+1;e=mx(-46246,(2.88 in {14}));b=(lg(\"t2\\n\",b)!=(7147>=0));}for(j=0;j<2;j=j+1){y=!(z==d);c=z;}}}else{b=((e!=2.63)%(a&&y));}for(i=0;i<0;i=i+1){continue;print(1.31);}for(i=0;i<0;i=i+1){continue;for(j=0;j<1;j=j+1){switch(mx((29217*2.42),lg(\"t1\\n\",b))){case -1:e=z;break;case 0:e=((34761+43771)&&e);case 1:break;}b=z;}}y=((c<e)&&y);") \
+  X(c31, "switch((-c*b)){default:case -2000:break;case -1000:if(0.72){if((c<(d&&-2))){z=((0.81 in {152,-313})>=lg(\"t2\\n\",1.25));z=0.0;}else{z=d;}e=mx((-1118&&z),(2.58||b));}else{i=0;while(i<3&&((0.81 in {152,-313})>=lg(\"t2\\n\",1.25))){i=i+1;x=(d in {-717});e=((b&&x) in {736});}}break;case 0:switch(0.93){default:case -1:y=(mx(26560,d)&&(2*-25863));case 0:d=((-46527&&-1)&a);break;}break;case 1000:break;case 2000:switch(0){case -2000:print(lg(\"t2\\n\",c));break;default:case -1000:case 0:x=mx(0.28,(-10137-30179));break;case 1000:z=sq(lg(\"t1\\n\",-1));}break;}for(i=0;i<1;i=i+1){switch((d in {-122})){case -2000:for(j=0;j<0;j=j+1){a=mx(mx(d,c),sq(1.92));d=(lg(\"t2\\n\",2)||(a%0));}break;}e=39013;}print(!35188);") \
+  X(c32, "for(i=0;i<3;i=i+1){print(((b--2212)/(x-z)));print(c);}i=0;while(i<1&&((b--2212)/(x-z))){i=i+1;y=(z*sq(0.51));print(!mx(b,-1));}for(i=0;i<1;i=i+1){switch(((b--2212)/(x-z))){case -1:if(x){a=sq((0.41%-32501));y=(b||(z&&z));}else{z=lg(\"t2\\n\",sq(z));}}e=a;}e=y;for(i=0;i<3;i=i+1){continue;b=!mx(b,-1);}") \
+  X(c33, "print(-b);b=mx(y,lg(\"t0\\n\",x));x=mx(sq(0.55),-2);i=0;while(i<0&&((z<1.92)%(0.7&&d))){i=i+1;for(j=0;j<3;j=j+1){a=((d<2)%(y<b));for(k=0;k<2;k=k+1){z=(-0+mx(z,x));z=((z<1.92)%(0.7&&d));}}print(4);}for(i=0;i<0;i=i+1){print(lg(\"t2\\n\",(c>=y)));c=((d^c)&&(16615==26864));}") \
+  X(c34, "d=!(e<<z);print(((z!=8610) in {-919}));") \
+  X(c35, "z=y;print(((b in {10,1,14,-2,0})!=sq(-1)));for(i=0;i<1;i=i+1){print((b%(1.86>=e)));for(j=0;j<3;j=j+1){z=(0.85 in {1764,684,1194,-253,224});print(((11077||-13435)&&(a<<c)));}}") \
+  X(c36, "c=c;switch(0){case -2000:i=0;while(i<0&&(7597%0)){i=i+1;e=-(35001>=d);print(((e>=4)%(2.74/d)));}break;case -1000:print(y);break;}for(i=0;i<2;i=i+1){print(((-1/z)<(0.5 in {})));switch((mx(2.15,41416)/(9973^-47909))){case -1:j=0;while(j<3&&!2.48){j=j+1;e=lg(\"t0\\n\",(1887^3));if((a%(2*3)))continue;b=(a%(2*3));}case 0:break;case 1:for(j=0;j<1;j=j+1){y=(-42656-(d%a));y=(3^b);}case 2:case 3:print(((-1^2.99)<lg(\"t0\\n\",-29987)));}}for(i=0;i<0;i=i+1){print((3^b));print(((a%2)-lg(\"t1\\n\",e)));}z=((x+z) in {-2,13,9,9,15});") \
+  X(c37, "i=0;while(i<3&&c){i=i+1;j=0;while(j<1&&(0.39||39973)){j=j+1;if(((0.30^-1) in {6,16,5,-3,4})){x=c;b=lg(\"t2\\n\",sq(2.40));}else{d=c;}switch(((0.30^-1) in {6,16,5,-3,4})){case -2000:x=((0.30^-1) in {6,16,5,-3,4});break;}}if((sq(25499)/(-20904<z)))continue;j=0;while(j<1&&-6976){j=j+1;if(((0.30^-1) in {6,16,5,-3,4})){d=(!z in {});x=(mx(2.99,0.88)<<lg(\"t1\\n\",-15327));}else{z=((1.93-b)||-4);}print(13934);}}if(((a&&-1)-(-45761+c))){y=x;a=mx(1.87,(c<<40312));}else{print(mx((y&&2.44),(48397 in {-171})));}print((mx(y,0.6)||!c));if(((0.30^-1) in {6,16,5,-3,4})){if(((0.30^-1) in {6,16,5,-3,4})){if(d){d=lg(\"t2\\n\",(-2/a));c=(b-1);}else{a=((2.27>=1.1)%lg(\"t2\\n\",y));}d=sq((1!=c));}else{print(lg(\"t0\\n\",(-28346&&z)));}i=0;while(i<2&&(e in {176,-272})){i=i+1;z=((0.30^-1) in {6,16,5,-3,4});b=((-20730<1.15)/(1.26>=-2));}}else{print(((d==y)<(d+d)));}") \
+  X(c38, "x=mx(1.13,(4!=-38282));i=0;while(i<0&&lg(\"t2\\n\",z)){i=i+1;z=mx((c!=2.88),(y/-47548));if((d^c))continue;break;}") \
+  X(c39, "e=lg(\"t2\\n\",(a/c));print(mx((-18019&&0.25),lg(\"t1\\n\",c)));if(lg(\"t0\\n\",(x%x))){for(i=0;i<2;i=i+1){print(0.40);for(j=0;j<3;j=j+1){y=(2.34 in {1883,490,688,1025});e=sq((d%e));}}d=4;}else{for(i=0;i<1;i=i+1){print(4);for(j=0;j<2;j=j+1){d=((x^b) in {});z=lg(\"t2\\n\",(a/c));}}}for(i=0;i<3;i=i+1){z=y;e=y;}") \
+  X(c40, "y=sq((35929+y));if((b*sq(y))){for(i=0;i<0;i=i+1){a=lg(\"t0\\n\",c);print(45739);}e=(b*sq(y));}else{z=(sq(4) in {});}d=e;x=46822;print(((0/47854)>=(-2-16134)));") \
+  X(c41, "if(-(d<b)){if(lg(\"t0\\n\",(y%x))){c=z;b=((-23785/0)&&-38929);}else{switch(c){case -2000:e=lg(\"t0\\n\",(b in {-82,1626,1655,1242}));break;case -1000:}}d=(-b^!-18703);}else{c=((a>=b)/lg(\"t2\\n\",z));}b=-(d<b);x=!(e+d);print((sq(1.0)*mx(-20197,0.23)));print(lg(\"t0\\n\",(b in {-82,1626,1655,1242})));") \
+  X(c42, "switch(e){case -2000:print(lg(\"t0\\n\",sq(x)));default:case -1000:print(lg(\"t2\\n\",e));case 0:break;case 1000:if(((16064!=c)&lg(\"t1\\n\",0.49))){i=0;while(i<0&&(19657%e)){i=i+1;b=-11783;if(-2)continue;c=z;}i=0;while(i<2&&mx(2.87,b)){i=i+1;b=(lg(\"t2\\n\",-2)&&(e in {555}));c=mx((0.54 in {-673,425,503,1311,95}),sq(x));}}else{c=x;}break;}for(i=0;i<1;i=i+1){for(j=0;j<1;j=j+1){switch(lg(\"t1\\n\",lg(\"t0\\n\",1))){case -2000:c=lg(\"t1\\n\",-2);}for(k=0;k<0;k=k+1){z=((4*b)!=(b||z));y=7883;}}if(c){print(46835);z=(lg(\"t1\\n\",y) in {-762,-687,-38,-708,1443});}else{print((c&x));}}b=((4*b)!=(b||z));i=0;while(i<0&&c){i=i+1;y=c;print(c);}i=0;while(i<0&&(3>=c)){i=i+1;j=0;while(j<3&&z){j=j+1;print(lg(\"t2\\n\",sq(z)));print(z);}j=0;while(j<2&&(0&5189)){j=j+1;y=(b||sq(-1));for(k=0;k<2;k=k+1){c=((0.7==z) in {});x=(mx(x,x)!=(x/-48064));}}}") \
+  X(c43, "x=sq((4/0));i=0;while(i<0&&((x||b)||(y^y))){i=i+1;continue;print(lg(\"t1\\n\",(a*8160)));}for(i=0;i<0;i=i+1){switch(e){default:case -1:y=(!4 in {0});case 0:break;case 1:switch(sq((4/0))){default:case -1:a=-2;break;case 0:e=(lg(\"t0\\n\",49265)!=(41551 in {-3,7,0,11,3}));case 1:x=0.45;}break;case 2:continue;case 3:if(((x||b)||(y^y))){c=!(1+4);b=1.6;}else{e=e;}}j=0;while(j<0&&0.45){j=j+1;for(k=0;k<2;k=k+1){b=((z||9615) in {15,14,15});d=lg(\"t2\\n\",sq(4));}k=0;while(k<3&&(x&e)){k=k+1;d=mx((1 in {706,152}),(1.93<-31543));d=((y<e)&&(1.70/c));}}}i=0;while(i<1&&((x||b)||(y^y))){i=i+1;j=0;while(j<2&&((x||b)||(y^y))){j=j+1;d=(0*(a==b));switch(e){case -1:break;}}for(j=0;j<3;j=j+1){switch(b){default:case -1:case 0:d=e;case 1:break;}if(0.45){e=sq((4/0));e=!!2.45;}else{x=(y*(-15483%e));}}}print(lg(\"t1\\n\",sq(e)));") \
+  X(c44, "print(lg(\"t0\\n\",(-31773 in {1,16,9})));print((4>=!d));y=a;i=0;while(i<3&&lg(\"t2\\n\",e)){i=i+1;c=c;if((z&&x))continue;switch(c){case -2000:}}switch(sq((y%2.29))){case -2000:}") \
+  X(c45, "print(11764);print(x);i=0;while(i<3&&mx(z,sq(y))){i=i+1;e=(lg(\"t0\\n\",a)&&lg(\"t1\\n\",z));if((0.72&&(0.26<<a))){switch(c){case -2000:case -1000:x=x;break;case 0:b=x;break;case 1000:c=(b||(a||e));break;default:case 2000:e=b;break;}print((b||(a||e)));}else{if(-(-44286 in {12})){b=(b||(a||e));a=(0.24&&(x-0.33));}else{y=(a<(d!=b));}}}") \
+  X(c46, "for(i=0;i<3;i=i+1){print(sq(mx(2.87,2.10)));c=mx(-28298,z);}for(i=0;i<2;i=i+1){print(x);for(j=0;j<3;j=j+1){switch((b||z)){case -1:y=!-1.5;break;case 0:case 1:x=2.27;case 2:break;}switch(lg(\"t1\\n\",-e)){case -1:b=z;case 0:c=mx((e/d),(-37507<<1.79));break;case 1:b=x;break;case 2:}}}") \
+  X(c47, "print((lg(\"t0\\n\",-6294)/1));print((0.19/(c in {1270,848,822})));i=0;while(i<2&&(2.71&&c)){i=i+1;switch((lg(\"t1\\n\",2.42)%(e!=13681))){case -2000:if((mx(a,35495)&&sq(-18018))){z=sq((z&&0.79));c=e;}else{b=3;}break;case -1000:}switch(a){case -1:print(((y-x) in {-1,6}));break;case 0:switch(lg(\"t1\\n\",(e in {8,13,11,3}))){case -2000:case -1000:y=(!4 in {1405,872,835,1984});case 0:d=(mx(b,-1)%(d!=1.53));break;}break;default:case 1:continue;case 2:print(lg(\"t1\\n\",(e in {8,13,11,3})));break;}}switch(b){case -1:case 0:case 1:case 2:case 3:print(d);}") \
+  X(c48, "switch(sq((0.53!=3))){case -1:if(((x in {16,16,6}) in {5})){print((0.86 in {}));for(i=0;i<0;i=i+1){x=41880;e=(mx(b,1) in {11,14});}}else{print(-1);}}c=mx(mx(2.74,-13093),(49484/y));if((d/0.77)){d=((-1 in {1807,1126,1923,927})<<sq(1));c=lg(\"t2\\n\",(y in {4,1,15,10,15}));}else{i=0;while(i<0&&sq((0.53!=3))){i=i+1;for(j=0;j<3;j=j+1){z=mx(sq(-38001),(1.88&&1));x=(d<<e);}for(j=0;j<3;j=j+1){z=sq((0.53!=3));x=a;}}}a=lg(\"t2\\n\",(a^23669));for(i=0;i<1;i=i+1){if(z){if((b<2)){c=(1 in {});y=((4/-1)==(a*x));}else{d=(!x in {4,-3,8,-1,1});}switch((y<lg(\"t2\\n\",11663))){case -1:z=-830;break;case 0:b=0.74;case 1:e=(!-43963+0.49);case 2:z=((a%6210)*sq(d));break;case 3:}}else{for(j=0;j<2;j=j+1){d=1.70;b=41880;}}print(-28376);}") \
+  X(c49, "print((1%(38076*0.21)));if(c){d=((1.75 in {0,2,9,1,9})/(d^b));i=0;while(i<1&&sq(b)){i=i+1;for(j=0;j<3;j=j+1){z=lg(\"t1\\n\",--1);d=(!-2/(0.42==-2));}print(mx(sq(2.7),(1.25 in {10,13,0})));}}else{i=0;while(i<3&&(0.57*-1)){i=i+1;j=0;while(j<3&&(x-a)){j=j+1;y=((z<30254)&0);y=4;}if(y)continue;switch(z){case -1:d=b;case 0:a=((b/2.67)||e);break;case 1:break;case 2:b=c;break;case 3:x=(8808&&(b!=c));break;}}}print(lg(\"t0\\n\",c));i=0;while(i<0&&(d&x)){i=i+1;c=c;if((2.66%3))continue;for(j=0;j<3;j=j+1){for(k=0;k<1;k=k+1){d=c;z=(-1*sq(b));}print(((b*5480)*1.20));}}print(mx((1&&z),0.35));print(sq((-35011!=x)));") \
+  X(c50, "for(i=0;i<2;i=i+1){for(j=0;j<1;j=j+1){x=((a/1)||lg(\"t0\\n\",d));k=0;while(k<2&&sq(--2)){k=k+1;c=sq(--2);if(sq(--2))continue;y=(lg(\"t2\\n\",4501)>=sq(1));}}print(((b!=3) in {-843,-612,1206,-339}));}switch((2.74/d)){case -1:switch(sq((0>=19832))){case -1:y=(lg(\"t2\\n\",4501)>=sq(1));break;case 0:print(sq(--2));break;case 1:z=sq(--2);break;case 2:print((mx(c,31628)&(b<<28926)));case 3:break;}case 0:print(sq((-17603 in {})));}b=sq(--2);") \
+  X(c51, "if(--19897){z=(0==(-10725 in {13,14}));switch(-(b||2)){case -1:switch((mx(z,2848) in {15,13,0})){case -1:e=-(2.26>=29573);case 0:case 1:z=--19897;break;}break;}}else{for(i=0;i<0;i=i+1){if(!21535){b=(0^(c in {13,6,0}));d=sq((e in {42,-956}));}else{y=(mx(1.60,b)^lg(\"t1\\n\",d));}print((mx(z,2848) in {15,13,0}));}}if((mx(z,2848) in {15,13,0})){x=--19897;switch((-1-(e&&a))){default:case -2000:y=(z&&(2.53 in {4,14,-1,13,-2}));break;case -1000:break;case 0:break;case 1000:case 2000:z=!(-2<e);}}else{for(i=0;i<1;i=i+1){e=mx((z%1530),(b in {-3,3,5}));for(j=0;j<2;j=j+1){b=-(2.26>=29573);c=(sq(4)%c);}}}print(z);") \
+  X(c52, "y=((1.15/46255)!=(-17233+-17235));i=0;while(i<0&&((z%c)*-a)){i=i+1;x=(!b&14679);switch(sq(mx(c,-45670))){case -1:j=0;while(j<3&&((a+y)<(y in {0,3,10,3,9}))){j=j+1;b=(lg(\"t0\\n\",1.91)&x);x=-19319;}break;case 0:print(((z%c)*-a));break;case 1:break;}}a=-(e!=-42314);") \
+  X(c53, "a=((a%x)&y);i=0;while(i<2&&((1.74%37017)&&c)){i=i+1;x=((2.22>=a)+lg(\"t1\\n\",e));x=2.80;}x=(!0.86&(1.10%b));b=mx((3<c),c);print(((2.99==c)==(-19225+-1)));z=d;") \
+  X(c54, "i=0;while(i<3&&mx(-18619,a)){i=i+1;j=0;while(j<2&&0){j=j+1;switch(lg(\"t1\\n\",(b%y))){default:case -2000:e=((-30071-b)*(c+z));case -1000:e=((44088 in {-1,11,16,15})-(c%1.85));case 0:y=((1==z)<(-2&&0));break;case 1000:e=(mx(e,d)&&sq(1.48));case 2000:break;}if((-6734||1.96))continue;for(k=0;k<1;k=k+1){c=!(-22665+e);b=(x<(b&2.91));}}if(((1.83-a) in {})){d=0;y=z;}else{for(j=0;j<3;j=j+1){z=!lg(\"t1\\n\",46458);a=!(-22665+e);}}}i=0;while(i<2&&(-43751 in {1042,584})){i=i+1;x=(mx(-1,e)%(b in {7,15}));if(lg(\"t2\\n\",33183))continue;a=lg(\"t1\\n\",(b%y));}") \
+  X(c55, "print(40774);for(i=0;i<0;i=i+1){x=(1 in {});x=sq((0.55||x));}i=0;while(i<3&&!sq(y)){i=i+1;for(j=0;j<2;j=j+1){print(40774);continue;}if(!4)continue;d=((2.60||z)<<!e);}") \
+  X(c56, "print(((b in {1,7,7,6,1})^(a in {13,10})));print(((x in {11,2,14})&&(e==2.87)));if((sq(x)&&-b)){y=((a&-13625)^lg(\"t0\\n\",e));print(a);}else{print(((-31118 in {})&(1.15||12616)));}print(sq(lg(\"t0\\n\",1325)));print(3);switch(sq(mx(-2,2.64))){case -2000:if((2.25&&mx(-2,y))){i=0;while(i<2&&y){i=i+1;c=(lg(\"t1\\n\",a) in {1118,456,-538,-9});b=((b in {1,7,7,6,1})^(a in {13,10}));}switch(((0.85>=-46620) in {})){case -2000:a=((x in {152,1554,-13,-880})*(-23712<<a));break;case -1000:e=(mx(c,1.50) in {1710});case 0:x=--1;case 1000:break;case 2000:c=(lg(\"t1\\n\",b)!=(d/c));}}else{y=((b>=3)>=sq(b));}case -1000:x=x;}") \
+  X(c57, "print((mx(39681,d) in {1}));switch(mx(sq(c),lg(\"t0\\n\",d))){case -2000:case -1000:i=0;while(i<3&&mx(sq(c),lg(\"t0\\n\",d))){i=i+1;break;j=0;while(j<1&&!(2+4)){j=j+1;a=lg(\"t1\\n\",mx(1,x));if((d&&x))continue;d=mx(sq(c),lg(\"t0\\n\",d));}}case 0:for(i=0;i<2;i=i+1){if(c){d=y;z=c;}else{b=z;}j=0;while(j<2&&(-45920/x)){j=j+1;x=((a<<y)+-26170);if(((a<<y)+-26170))continue;b=(a in {1,3,1});}}break;case 1000:a=((2.69&&c) in {595});break;}y=z;") \
+  X(c58, "i=0;while(i<1&&(34459||-2)){i=i+1;if(((47453/23380)&&mx(b,z))){z=((d||d)<<-1);print(-(4==z));}else{switch(((4 in {4,8}) in {625})){default:case -1:case 0:b=(-2.16&lg(\"t0\\n\",0.82));break;case 1:b=(1.84==(e%-2));}}c=(sq(a)<(e%x));}e=((d||d)<<-1);b=((x+x)+(a in {8,6}));y=((c in {12,6}) in {});") \
+  X(c59, "z=sq(lg(\"t1\\n\",c));print(mx(-25094,4));e=b;y=((z<3)+-2);print(sq(sq(4)));") \
+  X(c60, "if(s==0)x=0;else if(s==1)x=1;else if(s==2)x=2;else if(s==3)x=3;else if(s==4)x=4;else if(s==5)x=5;else x=-x;y=-(-(-(~!s)));z=s+s+s+s+s+s+s+s+s+s+s+s+s+s+s+s+s+s+s+s+s+s+s+s+(((((s+1)+2)+3)+4)+5);")
+
+#define STATIC(name, script)	STATIC_SCRIPT(name, script);
+CORPUS(STATIC)
+
+struct Compiled {
+  const char *src;
+  const uint8_t *image;
+  int len;
+};
+
+#define ENTRY(name, script)	{ script, name.image(), name.length() },
+static const struct Compiled corpus[] = {
+  CORPUS(ENTRY)
+};
+
+// A script over SCRIPT_MAX is refused as load() refuses it
+struct LongScript {
+  char src[SCRIPT_MAX + 2];
+};
+
+static constexpr struct LongScript longScript()
+{
+  struct LongScript s = {};
+
+  for (int i = 0; i < SCRIPT_MAX + 1; i ++)
+    s.src[i] = ' ';
+  return s;
+}
+
+static constexpr struct LongScript tooLong = longScript();
+static_assert(MyStaticCompiler<sizeof(tooLong.src)>(tooLong.src).error() == ERROR_TOO_BIG,
+	      "Scripts over SCRIPT_MAX must be refused");
+
+static void testSameImages()
+{
+  uint8_t *image;
+  int i, len;
+
+  for (i=0; i<(int)(sizeof(corpus) / sizeof(corpus[0])); i++) {
+    MyCompiler compiler;
+
+    compiler.noCaching();
+    CHECK_EQ(compiler.compile(corpus[i].src, strlen(corpus[i].src)), 0);
+    image = compiler.release(&len);
+    CHECK_EQ(len, corpus[i].len);
+    if (len == corpus[i].len && memcmp(image, corpus[i].image, len) != 0) {
+      printf("%s: images differ\n", corpus[i].src);
+      CHECK(false);
+    }
+    free(image);
+  }
+}
+
+int main()
+{
+  testSameImages();
+  return report("static");
+}
@@ -0,0 +1,129 @@
+// A SMING-compatible C interpreter
+//
+// String handlers get the literal as written, escapes decoded, with its
+// length and a terminating null, and the argument following it: plain and
+// empty literals, escapes, a null inside, and calls among other
+// arguments.  Literals too long are refused.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <string>
+#include <vector>
+#include "MyInterpreter.h"
+#include "test.h"
+
+struct Call {
+  const char *str;
+  std::string text;	// The len bytes at str
+  int arg;
+  bool terminated;
+};
+
+static std::vector<Call> calls;
+
+static int note(const char *str, int len, int arg)
+{
+  calls.push_back({ str, std::string(str, len), arg, str[len] == 0 });
+  return len + arg;
+}
+
+static int mx(int a, int b)
+{
+  return a > b ? a : b;
+}
+
+static const struct {
+  const char *src;
+  std::string text;
+  int arg;
+} literals[] = {
+  { "note(\"temperature\");", "temperature", 0 },
+  { "note(\"\");", "", 0 },
+  { "note(\"\",5);", "", 5 },
+  { "note(\"v\",v);", "v", 7 },
+  { "note(\"tab\\there\\n\");", "tab\there\n", 0 },
+  { "note(\"\\\"quoted\\\" \\\\ \\r\");", "\"quoted\" \\ \r", 0 },
+  { "note(\"a\\0b\",v*2);", std::string("a\0b", 3), 14 },
+  { "note(\"// not a comment /* */\");", "// not a comment /* */", 0 },
+};
+
+static void testLiterals()
+{
+  MyInterpreter interpreter;
+  int n;
+
+  interpreter.registerFuncS((char *)"note", note);
+  for (n = 0; n < (int)(sizeof(literals) / sizeof(literals[0])); n++) {
+    CHECK(interpreter.load((char *)literals[n].src, strlen(literals[n].src)));
+    interpreter.setVariable('v', 7);
+    calls.clear();
+    interpreter.run();
+    CHECK_EQ(calls.size(), 1u);
+    if (calls.size() != 1)
+      continue;
+    if (calls[0].text != literals[n].text) {
+      printf("strings: %s gives \"%s\"\n", literals[n].src, calls[0].text.c_str());
+      CHECK(false);
+    }
+    CHECK_EQ(calls[0].arg, literals[n].arg);
+    CHECK(calls[0].terminated);
+  }
+}
+
+// Among other arguments and calls, each in its place, the result used
+static void testArguments()
+{
+  const char src[] = "x=mx(note(\"ab\",v),3)+note(\"cde\");y=note(\"ab\",note(\"f\",1));";
+  MyInterpreter interpreter;
+
+  interpreter.registerFuncS((char *)"note", note);
+  interpreter.registerFunc2((char *)"mx", mx);
+  CHECK(interpreter.load((char *)src, strlen(src)));
+  interpreter.setVariable('v', 7);
+  calls.clear();
+  interpreter.run();
+  CHECK_EQ(calls.size(), 4u);
+  if (calls.size() != 4)
+    return;
+  CHECK(calls[0].text == "ab");
+  CHECK_EQ(calls[0].arg, 7);
+  CHECK(calls[1].text == "cde");
+  CHECK_EQ(calls[1].arg, 0);
+  CHECK(calls[2].text == "f");
+  CHECK_EQ(calls[2].arg, 1);
+  CHECK(calls[3].text == "ab");
+  CHECK_EQ(calls[3].arg, 2);
+  CHECK_EQ(interpreter.getVariable('x'), 9 + 3);
+  CHECK_EQ(interpreter.getVariable('y'), 4);
+  // The same literal is stored once
+  CHECK(calls[0].str == calls[3].str);
+}
+
+static void testRefused()
+{
+  MyInterpreter interpreter;
+  std::string src;
+
+  interpreter.registerFuncS((char *)"note", note);
+  src = "note(\"" + std::string(STRING_MAX, 'a') + "\");";
+  CHECK(interpreter.load((char *)src.c_str(), src.size()));
+  src = "note(\"" + std::string(STRING_MAX + 1, 'a') + "\");";
+  CHECK(!interpreter.load((char *)src.c_str(), src.size()));
+  CHECK_EQ(interpreter.getLoadError(), ERROR_TOO_BIG);
+  src = "note(\"unterminated);";
+  CHECK(!interpreter.load((char *)src.c_str(), src.size()));
+  CHECK_EQ(interpreter.getLoadError(), ERROR_SYNTAX);
+}
+
+int main()
+{
+  testLiterals();
+  testArguments();
+  testRefused();
+  return report("strings");
+}
@@ -0,0 +1,132 @@
+// A SMING-compatible C interpreter
+//
+// switch statements run as in C: dense and sparse cases, fall-through,
+// default anywhere, break and continue in loops, nested switches and the
+// extreme ints.  Malformed ones are refused.
+//
+// This is a free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+// See file LICENSE.txt for further informations on licensing terms.
+//
+
+#include <functional>
+#include "MyInterpreter.h"
+#include "test.h"
+
+static int print(int a)
+{
+  return a;
+}
+
+struct Switch {
+  const char *src;
+  std::function<int(int)> expect;	// x given v
+};
+
+#define SWITCH(body) { #body, [](int v) { int x = 0, i = 0; (void)v; (void)i; body; return x; } }
+
+static const struct Switch switches[] = {
+  // Fall-through from 2 into 3
+  SWITCH(x=0;switch(v){case 1:x=10;break;case 2:x=20;case 3:x=x+30;break;default:x=99;}),
+  // Sparse, with no default
+  SWITCH(x=0;switch(v){case 1000:x=1;break;case -5:x=2;break;case 77777:x=3;break;case 3:x=4;}),
+  // Default first, falling through into a case
+  SWITCH(x=5;switch(v){default:x=1;case 4:x=x+2;break;case 6:x=7;}),
+  SWITCH(x=0;for(i=0;i<10;i=i+1){switch(i%4){case 0:continue;case 1:x=x+1;break;case 2:x=x+10;}x=x+100;}),
+  SWITCH(x=0;i=0;while(1){switch(i){case 5:x=x+1000;break;default:x=x+1;}if(i==8)break;i=i+1;}),
+  SWITCH(x=0;switch(v){case 1:switch(v+1){case 2:x=1;break;default:x=2;}x=x+10;break;case 2:x=3;}),
+  SWITCH(x=0;switch(v){}),
+  SWITCH(x=3;switch(v){default:x=4;}),
+  SWITCH(x=0;switch(v%4*2){case -2:case 0:case 2:x=1;break;case 4:case 6:x=2;}),
+  SWITCH(x=0;switch(v){case 2147483647:x=1;break;case -2147483647-1:x=2;break;case 0:x=3;}),
+  SWITCH(x=0;for(i=0;i<4;i=i+1)switch(i){case 2:x=x+print(i);case 3:x=x+5;}),
+  SWITCH(x=0;switch(v){case 1+2:x=1;break;case 2*4:x=2;}),
+};
+
+static const char *refused[] = {
+  "switch(v){case v:x=1;}",
+  "switch(v){case 1:case 1:x=1;}",
+  "switch(v){default:default:x=1;}",
+  "case 1:x=1;",
+  "if(v){case 1:x=1;}",
+  "switch(v){case 1:{case 2:x=1;}}",
+  "switch(v){case 1:continue;}",
+  "break;",
+  "switch(v){case 1.5:x=1;}",
+  "switch(v)x=1;",
+  "switch(v){case 1 x=1;}",
+};
+
+static void testSwitch()
+{
+  const int values[] = { -5, -3, -2, -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 1000, 77777,
+			 2147483647, -2147483647 - 1 };
+  MyInterpreter interpreter;
+  int n, i;
+
+  interpreter.registerFunc1((char *)"print", print);
+  for (n = 0; n < (int)(sizeof(switches) / sizeof(switches[0])); n++) {
+    CHECK(interpreter.load((char *)switches[n].src, strlen(switches[n].src)));
+    for (i = 0; i < (int)(sizeof(values) / sizeof(values[0])); i++) {
+      interpreter.setVariable('v', values[i]);
+      interpreter.setVariable('x', 0);
+      interpreter.run();
+      if (interpreter.getVariable('x') != switches[n].expect(values[i])) {
+	printf("switch: %s for v=%d gives %d\n", switches[n].src, values[i], interpreter.getVariable('x'));
+	CHECK(false);
+      }
+    }
+  }
+  for (n = 0; n < (int)(sizeof(refused) / sizeof(refused[0])); n++)
+    CHECK(!interpreter.load((char *)refused[n], strlen(refused[n])));
+}
+
+// A real value is truncated like a real handler argument
+static void testReal()
+{
+  char src[] = "t=v*0.5;switch(t){case 1:x=1;break;case -1:x=-1;break;default:x=2;}";
+  MyInterpreter interpreter;
+  int v;
+
+  CHECK(interpreter.load(src, strlen(src)));
+  for (v = -4; v <= 4; v++) {
+    interpreter.setVariable('v', v);
+    interpreter.run();
+    CHECK_EQ(interpreter.getVariable('x'), v / 2 == 1 ? 1 : v / 2 == -1 ? -1 : 2);
+  }
+}
+
+// Long tables, dense and sparse, with jumps wider than a byte
+static void testLong()
+{
+  char src[2000];
+  MyInterpreter interpreter;
+  int step, i, n, v;
+
+  for (step = 1; step <= 97; step += 96) {
+    n = sprintf(src, "x=0;switch(v){");
+    for (i = 0; i < 32; i++)
+      n += sprintf(src + n, "case %d:x=%d;x=x*3;break;", i * step, i);
+    sprintf(src + n, "}");
+    CHECK(interpreter.load(src, strlen(src)));
+    for (v = -1; v <= 32 * step; v++) {
+      interpreter.setVariable('v', v);
+      interpreter.run();
+      if (interpreter.getVariable('x') != (v >= 0 && v % step == 0 && v / step < 32 ? v / step * 3 : 0)) {
+	printf("switch: %d cases %d apart, v=%d gives %d\n", 32, step, v, interpreter.getVariable('x'));
+	CHECK(false);
+	break;
+      }
+    }
+  }
+}
+
+int main()
+{
+  testSwitch();
+  testReal();
+  testLong();
+  return report("switch");
+}